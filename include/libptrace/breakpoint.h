@@ -49,6 +49,7 @@
 #define PT_BREAKPOINT_FLAG_ONESHOT	1
 #define PT_BREAKPOINT_FLAG_DISABLED	2
 #define PT_BREAKPOINT_FLAG_CONDITIONAL	4
+#define PT_BREAKPOINT_FLAG_RETIRED	8
 
 #define PT_BREAKPOINT_SCOPE_PROCESS	0
 #define PT_BREAKPOINT_SCOPE_THREAD	1
@@ -65,6 +66,15 @@ void pt_breakpoint_destroy(struct pt_breakpoint *);
 int  pt_breakpoint_handler(struct pt_thread *, struct pt_event_breakpoint *);
 int  pt_breakpoint_set(struct pt_process *, struct pt_breakpoint *);
 int  pt_breakpoint_remove(struct pt_process *, struct pt_breakpoint *);
+int  pt_breakpoint_condition_set(struct pt_breakpoint *, const char *);
+const char *pt_breakpoint_condition_get(struct pt_breakpoint *);
+void pt_breakpoint_ignore_count_set(struct pt_breakpoint *, uint64_t);
+void pt_breakpoint_every_nth_set(struct pt_breakpoint *, uint64_t);
+void pt_breakpoint_rate_limit_set(struct pt_breakpoint *, uint32_t);
+void pt_breakpoint_max_hits_set(struct pt_breakpoint *, uint64_t);
+uint64_t pt_breakpoint_hits_get(struct pt_breakpoint *);
+int  pt_breakpoint_set_many(struct pt_process *, struct pt_breakpoint **, size_t);
+int  pt_breakpoint_remove_many(struct pt_process *, struct pt_breakpoint **, size_t);
 
 #ifdef __cplusplus
 };
@@ -52,6 +52,8 @@
 #define PT_CORE_OPTION_EVENT_SECOND_CHANCE	1
 #define PT_CORE_OPTION_SYMBOL_MANAGER		2
 #define PT_CORE_OPTION_AUTO_TERMINATE_MAIN	4
+#define PT_CORE_OPTION_EVENT_RECORD		8
+#define PT_CORE_OPTION_STATS			16
 
 #define pt_core_for_each_process(c, p)					\
 	for (struct pt_iterator i = pt_iterator_process_begin(c);	\
@@ -70,6 +72,9 @@ void			pt_core_delete(struct pt_core *);
 int			pt_core_options_get(struct pt_core *);
 void			pt_core_options_set(struct pt_core *, int);
 
+int			pt_core_record_start(struct pt_core *, const utf8_t *, uint64_t, int);
+int			pt_core_record_stop(struct pt_core *);
+
 pt_handle_t		pt_core_process_attach(struct pt_core *, pt_pid_t, struct pt_event_handlers *, int);
 pt_handle_t		pt_core_process_attach_remote(struct pt_core *, pt_pid_t, struct pt_event_handlers *, int);
 int			pt_core_process_detach(struct pt_core *, struct pt_process *);
@@ -81,6 +86,11 @@ int			pt_core_process_break_remote(struct pt_core *, pt_handle_t);
 void			pt_core_quit(struct pt_core *);
 int			pt_core_main(struct pt_core *);
 int			pt_core_event_wait(struct pt_core *);
+int			pt_core_event_pending(struct pt_core *);
+int			pt_core_event_dispatch_pending(struct pt_core *, int);
+int			pt_core_event_notify_start(struct pt_core *, void (*)(void *), void *);
+int			pt_core_event_notify_stop(struct pt_core *);
+void			pt_core_idle_handler_set(struct pt_core *, void (*)(struct pt_core *, void *), void *);
 pt_handle_t		pt_core_execv(struct pt_core *, const utf8_t *, utf8_t *const [], struct pt_event_handlers *, int);
 pt_handle_t		pt_core_execv_remote(struct pt_core *, const utf8_t *, utf8_t *const[], struct pt_event_handlers *, int);
 
@@ -65,7 +65,8 @@
 #define PT_ERROR_WOULD_BLOCK	19	/* Block on non-blocking operation. */
 #define PT_ERROR_MSGSIZE        20      /* Invalid message size. */
 #define PT_ERROR_HANDLE		21	/* Invalid handle. */
-#define PT_ERROR_MAX		21	/* Mark the end of the error codes */
+#define PT_ERROR_SYNTAX		22	/* Syntax error. */
+#define PT_ERROR_MAX		22	/* Mark the end of the error codes */
 
 #define PT_ERR_SUCCESS		PT_ERR_NONE
 
@@ -46,6 +46,25 @@
 #define PT_EVENT_DROP		0
 #define PT_EVENT_FORWARD	1
 
+/* Event classes, used in the per-process event subscription mask. */
+#define PT_EVENT_CLASS_ATTACHED			0x0001
+#define PT_EVENT_CLASS_PROCESS_EXIT		0x0002
+#define PT_EVENT_CLASS_THREAD_CREATE		0x0004
+#define PT_EVENT_CLASS_THREAD_EXIT		0x0008
+#define PT_EVENT_CLASS_MODULE_LOAD		0x0010
+#define PT_EVENT_CLASS_MODULE_UNLOAD		0x0020
+#define PT_EVENT_CLASS_REMOTE_BREAK		0x0040
+#define PT_EVENT_CLASS_BREAKPOINT		0x0080
+#define PT_EVENT_CLASS_SINGLE_STEP		0x0100
+#define PT_EVENT_CLASS_SEGFAULT			0x0200
+#define PT_EVENT_CLASS_ILLEGAL_INSTRUCTION	0x0400
+#define PT_EVENT_CLASS_DIVIDE_BY_ZERO		0x0800
+#define PT_EVENT_CLASS_PRIV_INSTRUCTION		0x1000
+#define PT_EVENT_CLASS_UNKNOWN_EXCEPTION	0x2000
+#define PT_EVENT_CLASS_DEBUG_STRING		0x4000
+#define PT_EVENT_CLASS_X86_DR			0x8000
+#define PT_EVENT_CLASS_ALL			0xFFFF
+
 #define PT_EVENT_COMMON							\
 	void	*cookie;						\
 	int	error;
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * function_trace.h
+ *
+ * libptrace function entry and exit tracing.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_FUNCTION_TRACE_H
+#define PT_FUNCTION_TRACE_H
+
+#include <stdint.h>
+#include <libptrace/process.h>
+#include <libptrace/thread.h>
+#include <libptrace/types.h>
+
+struct pt_function_trace;
+
+/* Called on function entry, with the thread stopped on the first
+ * instruction of the function.
+ */
+typedef void (*pt_function_entry_handler_t)(struct pt_thread *, void *cookie);
+
+/* Called when a traced call returns, with the thread stopped on the
+ * return address.  'duration' is the time since entry in nanoseconds.
+ */
+typedef void (*pt_function_exit_handler_t)(struct pt_thread *,
+                                           pt_register_t retval,
+                                           uint64_t duration,
+                                           void *cookie);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pt_function_trace *
+pt_function_trace_set(struct pt_process *, pt_address_t,
+                      pt_function_entry_handler_t,
+                      pt_function_exit_handler_t, void *);
+int pt_function_trace_remove(struct pt_function_trace *);
+uint64_t pt_function_trace_calls_get(struct pt_function_trace *);
+size_t pt_function_trace_depth_get(struct pt_thread *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_FUNCTION_TRACE_H */
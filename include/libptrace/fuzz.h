@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * fuzz.h
+ *
+ * libptrace persistent-mode fuzzing loop.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_FUZZ_H
+#define PT_FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libptrace/process.h>
+#include <libptrace/types.h>
+
+#define PT_FUZZ_STATE_ARMED			0
+#define PT_FUZZ_STATE_RUNNING			1
+#define PT_FUZZ_STATE_DONE			2
+
+#define PT_FUZZ_CRASH_SEGFAULT			0
+#define PT_FUZZ_CRASH_ILLEGAL_INSTRUCTION	1
+#define PT_FUZZ_CRASH_DIVIDE_BY_ZERO		2
+#define PT_FUZZ_CRASH_PRIV_INSTRUCTION		3
+#define PT_FUZZ_CRASH_EXCEPTION			4
+
+struct pt_fuzz;
+
+/* The function to fuzz and where its input goes.  If 'input' is
+ * PT_ADDRESS_NULL a buffer of 'input_size' bytes is allocated in the
+ * process.  The input size and address are stored in the named registers
+ * before every iteration, if these are not NULL.
+ */
+struct pt_fuzz_target
+{
+	pt_address_t		function;
+	pt_address_t		input;
+	size_t			input_size;
+	const char		*size_register;
+	const char		*input_register;
+};
+
+/* A crash site.  Crashes are recorded once per type and address, with
+ * the first input that reached it.
+ */
+struct pt_fuzz_crash
+{
+	int			type;
+	int			number;
+	pt_address_t		address;
+	pt_address_t		fault_address;
+	uint64_t		iteration;
+	uint64_t		hits;
+	void			*input;
+	size_t			input_size;
+};
+
+struct pt_fuzz_stats
+{
+	uint64_t		iterations;
+	uint64_t		crashes;
+	uint64_t		pages_restored;
+	uint64_t		elapsed;
+	uint64_t		execs_per_sec;
+};
+
+/* Fill 'buf' with at most 'size' bytes of input for 'iteration', and
+ * return the number of bytes used.  Returning -1 ends the loop.
+ */
+typedef ssize_t (*pt_fuzz_input_handler_t)(struct pt_fuzz *, uint64_t iteration,
+                                           void *buf, size_t size, void *cookie);
+
+/* Called for every crash, with the thread stopped on the fault. */
+typedef void (*pt_fuzz_crash_handler_t)(struct pt_fuzz *, struct pt_thread *,
+                                        struct pt_fuzz_crash *, void *cookie);
+
+/* Called once the loop has ended and the process state is restored. */
+typedef void (*pt_fuzz_done_handler_t)(struct pt_fuzz *, void *cookie);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pt_fuzz *
+pt_fuzz_loop(struct pt_process *, struct pt_fuzz_target *,
+             pt_fuzz_input_handler_t, pt_fuzz_crash_handler_t,
+             pt_fuzz_done_handler_t, void *);
+void   pt_fuzz_stop(struct pt_fuzz *);
+int    pt_fuzz_delete(struct pt_fuzz *);
+int    pt_fuzz_state_get(struct pt_fuzz *);
+void   pt_fuzz_stats_get(struct pt_fuzz *, struct pt_fuzz_stats *);
+size_t pt_fuzz_crash_count_get(struct pt_fuzz *);
+struct pt_fuzz_crash *pt_fuzz_crash_get(struct pt_fuzz *, size_t);
+pt_address_t pt_fuzz_input_address_get(struct pt_fuzz *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_FUZZ_H */
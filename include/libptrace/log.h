@@ -43,18 +43,82 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <libptrace/list.h>
 #include <libptrace/charset.h>
 
 #define PT_LOG_HOOK_INIT	{ .handler = NULL, .cookie = NULL }
 
-extern struct list_head log_hooks__;
+/* Log levels, from most to least severe. */
+#define PT_LOG_LEVEL_ERROR		0
+#define PT_LOG_LEVEL_WARNING		1
+#define PT_LOG_LEVEL_INFO		2
+#define PT_LOG_LEVEL_DEBUG		3
+#define PT_LOG_LEVELS			4
+
+/* Log categories. */
+#define PT_LOG_CATEGORY_GENERIC		0
+#define PT_LOG_CATEGORY_CORE		1
+#define PT_LOG_CATEGORY_EVENT		2
+#define PT_LOG_CATEGORY_BREAKPOINT	3
+#define PT_LOG_CATEGORY_PROCESS		4
+#define PT_LOG_CATEGORY_THREAD		5
+#define PT_LOG_CATEGORY_MODULE		6
+#define PT_LOG_CATEGORY_SYMBOL		7
+#define PT_LOG_CATEGORY_FUZZ		8
+#define PT_LOG_CATEGORY_MEMORY		9
+#define PT_LOG_CATEGORIES		10
+
+#define PT_LOG_CATEGORY_MASK(c)		(1U << (c))
+#define PT_LOG_CATEGORY_MASK_ALL	((1U << PT_LOG_CATEGORIES) - 1)
+
+/* The log mask has one bit for every (category, level) pair. */
+#define PT_LOG_BIT(c, l)		(UINT64_C(1) << ((c) * PT_LOG_LEVELS + (l)))
+#define PT_LOG_MASK_ALL			UINT64_MAX
+
+/* Messages above this level are removed at compile time. */
+#ifndef PT_LOG_LEVEL_COMPILE
+#define PT_LOG_LEVEL_COMPILE		PT_LOG_LEVEL_DEBUG
+#endif
+
+/* Category of pt_log() messages.  Define before inclusion to override. */
+#ifndef PT_LOG_CATEGORY
+#define PT_LOG_CATEGORY			PT_LOG_CATEGORY_GENERIC
+#endif
+
+/* The effective log mask.  This is 0 when there is nobody to consume
+ * log messages, so that disabled logging costs a single test and does
+ * not evaluate any of the arguments.
+ */
+extern uint64_t pt_log_mask_;
 
 static inline int pt_log_active(void)
 {
-	return !list_empty(&log_hooks__);
+	return pt_log_mask_ != 0;
 };
 
+static inline int pt_log_enabled(int category, int level)
+{
+	return level <= PT_LOG_LEVEL_COMPILE &&
+	       (pt_log_mask_ & PT_LOG_BIT(category, level)) != 0;
+}
+
+#define pt_log_at(category, level, ...) do {				\
+	if ((level) <= PT_LOG_LEVEL_COMPILE &&				\
+	    (pt_log_mask_ & PT_LOG_BIT(category, level)))		\
+		pt_log_write(category, level, __VA_ARGS__);		\
+} while (0)
+
+#define pt_log(...)							\
+	pt_log_at(PT_LOG_CATEGORY, PT_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define pt_log_info(...)						\
+	pt_log_at(PT_LOG_CATEGORY, PT_LOG_LEVEL_INFO, __VA_ARGS__)
+#define pt_log_warning(...)						\
+	pt_log_at(PT_LOG_CATEGORY, PT_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define pt_log_error(...)						\
+	pt_log_at(PT_LOG_CATEGORY, PT_LOG_LEVEL_ERROR, __VA_ARGS__)
+
 typedef void (*pt_log_hook_t)(void *, const char *, va_list);
 
 struct pt_log_hook
@@ -65,14 +129,50 @@ struct pt_log_hook
 	struct list_head	list;
 };
 
+/* Binary log records.  The binary log hook stores the format string and
+ * the raw arguments in a ring buffer per thread, and formatting is done
+ * by the reader with pt_log_record_format().  String arguments are
+ * copied into the record, truncated if needed.
+ */
+#define PT_LOG_RECORD_ARGS		8
+#define PT_LOG_RECORD_STRINGS		40
+
+#define PT_LOG_RECORD_FLAG_TRUNCATED	1
+
+struct pt_log_record
+{
+	uint64_t		timestamp;
+	const char		*format;
+	uint32_t		tid;
+	uint8_t			category;
+	uint8_t			level;
+	uint8_t			nargs;
+	uint8_t			flags;
+	uint64_t		args[PT_LOG_RECORD_ARGS];
+	char			strings[PT_LOG_RECORD_STRINGS];
+};
+
+typedef void (*pt_log_record_handler_t)(void *, const struct pt_log_record *);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void pt_log(const char *format, ...);
+void (pt_log)(const char *format, ...);
+void pt_log_write(int, int, const char *format, ...);
 void pt_log_hook_register(struct pt_log_hook *);
 int  pt_log_hook_unregister(struct pt_log_hook *);
 
+uint64_t pt_log_mask_get(void);
+void     pt_log_mask_set(uint64_t);
+void     pt_log_level_set(uint32_t, int);
+
+int      pt_log_binary_enable(size_t);
+void     pt_log_binary_disable(void);
+size_t   pt_log_binary_drain(pt_log_record_handler_t, void *);
+uint64_t pt_log_binary_dropped(void);
+int      pt_log_record_format(const struct pt_log_record *, char *, size_t);
+
 #ifdef __cplusplus
 };
 #endif
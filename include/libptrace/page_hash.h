@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * page_hash.h
+ *
+ * libptrace page hashing and change detection.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_PAGE_HASH_H
+#define PT_PAGE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <libptrace/types.h>
+
+/* The hash of a page that could not be read.  No page hashes to this. */
+#define PT_PAGE_HASH_NONE	0
+
+struct pt_process;
+
+/* A run of pages whose hashes start at 'index' in the hash array. */
+struct pt_page_range
+{
+	pt_address_t	start;
+	size_t		pages;
+	size_t		index;
+};
+
+/* Ranges are sorted by address and do not overlap. */
+struct pt_page_hashes
+{
+	struct pt_page_range	*ranges;
+	size_t			range_count;
+	uint64_t		*hashes;
+	size_t			pages;
+};
+
+/* Called for every run of changed pages, in address order.  Returning
+ * non-zero ends the diff.
+ */
+typedef int (*pt_page_diff_handler_t)(pt_address_t start, size_t pages,
+                                      void *cookie);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t pt_page_hash(const void *page);
+struct pt_page_hashes *pt_mmap_page_hashes(struct pt_process *, int prot);
+void     pt_page_hashes_delete(struct pt_page_hashes *);
+ssize_t  pt_page_hashes_diff(const struct pt_page_hashes *,
+                             const struct pt_page_hashes *,
+                             pt_page_diff_handler_t, void *cookie);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_PAGE_HASH_H */
@@ -45,6 +45,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <libptrace/list.h>
 #include <libptrace/types.h>
 #include <libptrace/charset.h>
@@ -53,6 +54,7 @@
 #define PT_PROCESS_OPTION_NONE			0
 #define PT_PROCESS_OPTION_EVENT_SECOND_CHANCE	1
 #define PT_PROCESS_OPTION_SYMBOL_MANAGER	2
+#define PT_PROCESS_OPTION_DISPLACED_STEPPING	4
 
 #define PT_PROCESS_STATE_INIT			0
 #define PT_PROCESS_STATE_CREATED		1
@@ -93,6 +95,10 @@ struct pt_thread *pt_process_main_thread_get(struct pt_process *);
 int pt_process_option_set(struct pt_process *, int);
 int pt_process_exited(struct pt_process *);
 
+uint32_t pt_process_event_mask_get(struct pt_process *);
+void     pt_process_event_subscribe(struct pt_process *, uint32_t);
+void     pt_process_event_unsubscribe(struct pt_process *, uint32_t);
+
 int pt_process_strlen(struct pt_process *, const pt_address_t, size_t *);
 int pt_process_strlen16(struct pt_process *, const pt_address_t, size_t *);
 
@@ -103,8 +109,10 @@ int pt_process_execv(struct pt_process *process, const utf8_t *, utf8_t *const [
 
 int          pt_process_write(struct pt_process *, pt_address_t, const void *, size_t);
 ssize_t      pt_process_read(struct pt_process *, void *, const pt_address_t, size_t);
+ssize_t      pt_process_read_raw(struct pt_process *, void *, const pt_address_t, size_t);
 int          pt_process_thread_create(struct pt_process *, pt_address_t, pt_address_t);
 pt_address_t pt_process_malloc(struct pt_process *, size_t);
+pt_address_t pt_process_malloc_near(struct pt_process *, size_t, pt_address_t);
 int          pt_process_free(struct pt_process *, pt_address_t);
 
 utf8_t *pt_process_read_string(struct pt_process *, const pt_address_t);
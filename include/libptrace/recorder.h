@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * recorder.h
+ *
+ * libptrace binary event recorder.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_RECORDER_H
+#define PT_RECORDER_H
+
+#include <stdint.h>
+#include <libptrace/charset.h>
+#include <libptrace/types.h>
+
+#define PT_RECORDER_MAGIC		0x43525450	/* "PTRC" */
+#define PT_RECORDER_VERSION		1
+
+#define PT_RECORDER_FLAG_NONE		0
+#define PT_RECORDER_FLAG_RING		1	/* Overwrite the oldest records. */
+
+/* Record types. */
+#define PT_RECORD_PROCESS_CREATE	1
+#define PT_RECORD_PROCESS_EXIT		2
+#define PT_RECORD_THREAD_CREATE		3
+#define PT_RECORD_THREAD_EXIT		4
+#define PT_RECORD_MODULE_LOAD		5
+#define PT_RECORD_MODULE_UNLOAD		6
+#define PT_RECORD_BREAKPOINT		7
+#define PT_RECORD_SINGLE_STEP		8
+#define PT_RECORD_EXCEPTION		9
+
+/* On-disk file header.  All fields are little endian. */
+struct pt_record_header
+{
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	record_size;
+	uint32_t	flags;
+	uint32_t	reserved;
+	uint64_t	capacity;	/* Number of record slots.          */
+	uint64_t	count;		/* Records written since creation.  */
+	uint64_t	dropped;	/* Records lost to a full log.      */
+	uint64_t	padding[3];
+};
+
+/* Fixed size event record.
+ *
+ * 'pc' is the start address for process and thread creation, the
+ * exception address for exceptions, and the module base for module events.
+ * 'info' holds the image base for process creation, the exit code for exit
+ * events and the fault address for access violations.
+ */
+struct pt_record
+{
+	uint64_t	timestamp;	/* Monotonic, in nanoseconds. */
+	uint32_t	pid;
+	uint32_t	tid;
+	uint16_t	type;
+	uint8_t		chance;
+	uint8_t		reserved;
+	uint32_t	code;		/* Exception code.            */
+	uint64_t	pc;
+	uint64_t	info;
+};
+
+struct pt_recorder;
+struct pt_record_reader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pt_recorder *pt_recorder_open(const utf8_t *, uint64_t, int);
+int  pt_recorder_close(struct pt_recorder *);
+void pt_recorder_append(struct pt_recorder *, const struct pt_record *);
+int  pt_recorder_sync(struct pt_recorder *);
+
+struct pt_record_reader *pt_record_reader_open(const utf8_t *);
+int  pt_record_reader_next(struct pt_record_reader *, struct pt_record *);
+uint64_t pt_record_reader_dropped_get(struct pt_record_reader *);
+int  pt_record_reader_close(struct pt_record_reader *);
+
+const char *pt_record_type_to_string(int);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_RECORDER_H */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * scan.h
+ *
+ * libptrace memory pattern scanning.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_SCAN_H
+#define PT_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libptrace/process.h>
+#include <libptrace/types.h>
+
+/* Protection an area needs to have to be scanned.  Only readable areas
+ * are ever scanned.
+ */
+#define PT_SCAN_PROT_READ	1
+#define PT_SCAN_PROT_WRITE	2
+#define PT_SCAN_PROT_EXEC	4
+
+/* Called for every match, in address order.  Returning non-zero ends the
+ * scan.
+ */
+typedef int (*pt_scan_handler_t)(struct pt_process *, pt_address_t, void *cookie);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t pt_memscan(const void *, size_t, const void *, const void *, size_t, size_t);
+ssize_t pt_scan_pattern_parse(const char *, uint8_t *, uint8_t *, size_t);
+ssize_t pt_process_scan(struct pt_process *, const void *, const void *,
+                        size_t, int, pt_scan_handler_t, void *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_SCAN_H */
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * stats.h
+ *
+ * libptrace event loop latency statistics.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_STATS_H
+#define PT_STATS_H
+
+#include <stdint.h>
+#include <libptrace/types.h>
+
+/* Log-linear histograms: every power of two is split into
+ * PT_HISTOGRAM_SUB linear buckets.  Values are in nanoseconds, and all
+ * values of 2^(PT_HISTOGRAM_EXP_MAX + 1) and up share the last bucket.
+ */
+#define PT_HISTOGRAM_SUB_BITS		2
+#define PT_HISTOGRAM_SUB		(1 << PT_HISTOGRAM_SUB_BITS)
+#define PT_HISTOGRAM_EXP_MAX		40
+#define PT_HISTOGRAM_BUCKETS		\
+	((PT_HISTOGRAM_EXP_MAX - PT_HISTOGRAM_SUB_BITS + 2) * PT_HISTOGRAM_SUB + 1)
+
+/* Phases of handling a single debug event. */
+#define PT_STATS_WAIT			0	/* Continue to next event.  */
+#define PT_STATS_DISPATCH		1	/* Event handling.          */
+#define PT_STATS_HANDLER		2	/* User event handlers.     */
+#define PT_STATS_CONTINUE		3	/* Resuming the debuggee.   */
+#define PT_STATS_PHASES			4
+
+/* Event types are the PT_RECORD_* types, with 0 for unknown events. */
+#define PT_STATS_EVENT_TYPES		10
+
+struct pt_histogram
+{
+	uint64_t	count;
+	uint64_t	sum;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	buckets[PT_HISTOGRAM_BUCKETS];
+};
+
+struct pt_stats
+{
+	struct pt_histogram	histograms[PT_STATS_PHASES][PT_STATS_EVENT_TYPES];
+};
+
+struct pt_core;
+struct pt_process;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void     pt_histogram_record(struct pt_histogram *, uint64_t);
+int      pt_histogram_bucket(uint64_t);
+uint64_t pt_histogram_bucket_lower(int);
+uint64_t pt_histogram_percentile(const struct pt_histogram *, double);
+
+int  pt_core_stats_get(struct pt_core *, struct pt_stats *);
+void pt_core_stats_reset(struct pt_core *);
+int  pt_process_stats_get(struct pt_process *, struct pt_stats *);
+
+const char *pt_stats_phase_to_string(int);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_STATS_H */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * struct.h
+ *
+ * libptrace remote structure layouts.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_STRUCT_H
+#define PT_STRUCT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PT_STRUCT_FIELD_INT		0
+#define PT_STRUCT_FIELD_UINT		1
+#define PT_STRUCT_FIELD_POINTER		2
+#define PT_STRUCT_FIELD_BYTES		3
+
+#define PT_STRUCT_FIELDS_MAX		32
+
+/* Fields are laid out for both 4 and 8 byte pointers, so that a single
+ * layout serves threads of either width.  Index with the result of
+ * PT_STRUCT_WIDTH().
+ */
+#define PT_STRUCT_WIDTH(pointer_size)	((pointer_size) == 8)
+
+struct pt_struct_field
+{
+	uint8_t		type;
+	/* element size in bytes, or 0 for the pointer size. */
+	uint8_t		size;
+	/* the field is padding, and no argument is stored. */
+	uint8_t		skip;
+	uint32_t	count;
+	uint32_t	offset[2];
+};
+
+struct pt_struct_layout
+{
+	size_t			field_count;
+	struct pt_struct_field	fields[PT_STRUCT_FIELDS_MAX];
+	/* bytes up to the end of the last field, and the size including
+	 * trailing padding.
+	 */
+	size_t			extent[2];
+	size_t			size[2];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int pt_struct_layout_init(struct pt_struct_layout *, const char *fmt);
+int pt_struct_decode(const struct pt_struct_layout *, int pointer_size,
+                     const void *buf, ...);
+int pt_struct_vdecode(const struct pt_struct_layout *, int pointer_size,
+                      const void *buf, va_list);
+uint64_t pt_struct_element_get(const struct pt_struct_layout *, int pointer_size,
+                               const void *buf, size_t field, size_t index);
+
+static inline size_t
+pt_struct_field_size(const struct pt_struct_field *field, int pointer_size)
+{
+	return field->size != 0 ? field->size : (size_t)pointer_size;
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_STRUCT_H */
@@ -45,6 +45,7 @@
 
 #include <libptrace/breakpoint.h>
 #include <libptrace/breakpoint_x86.h>
+#include <libptrace/struct.h>
 #include <libptrace/types.h>
 
 /* Thread states */
@@ -85,6 +86,8 @@ int  pt_thread_single_step_remove(struct pt_thread *thread);
 int  pt_thread_single_step_internal_set(struct pt_thread *thread);
 int  pt_thread_single_step_internal_remove(struct pt_thread *thread);
 int  pt_thread_sscanf(struct pt_thread *thread, const pt_address_t src, const char *fmt, ...);
+int  pt_thread_read_struct(struct pt_thread *, const pt_address_t,
+                           const struct pt_struct_layout *, ...);
 
 
 struct pt_registers *pt_thread_registers_get(struct pt_thread *);
@@ -102,6 +105,7 @@ pt_thread_breakpoint_find(struct pt_thread *thread, pt_address_t address);
 /* Abstract register access. */
 int          pt_thread_register_pc_set(struct pt_thread *, pt_address_t);
 pt_address_t pt_thread_register_pc_get(struct pt_thread *);
+pt_address_t pt_thread_register_sp_get(struct pt_thread *);
 
 #ifdef __cplusplus
 };
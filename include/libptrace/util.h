@@ -43,6 +43,7 @@
 #ifndef PT_UTIL_H
 #define PT_UTIL_H
 
+#include <stdint.h>
 #include <libptrace/types.h>
 
 #ifdef __cplusplus
@@ -50,6 +51,8 @@ extern "C" {
 #endif
 
 pt_tid_t pt_util_tid_get(void);
+uint64_t pt_util_time_ns(void);
+unsigned int pt_util_cpu_count(void);
 
 #ifdef __cplusplus
 };
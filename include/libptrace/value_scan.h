@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * value_scan.h
+ *
+ * libptrace iterative value scanning.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_VALUE_SCAN_H
+#define PT_VALUE_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libptrace/process.h>
+#include <libptrace/types.h>
+
+#define PT_VALUE_INT8			0
+#define PT_VALUE_INT16			1
+#define PT_VALUE_INT32			2
+#define PT_VALUE_INT64			3
+#define PT_VALUE_UINT8			4
+#define PT_VALUE_UINT16			5
+#define PT_VALUE_UINT32			6
+#define PT_VALUE_UINT64			7
+#define PT_VALUE_FLOAT			8
+#define PT_VALUE_DOUBLE			9
+#define PT_VALUE_MAX			10
+
+/* Comparisons against the given value. */
+#define PT_VALUE_CMP_ANY		0
+#define PT_VALUE_CMP_EQUAL		1
+#define PT_VALUE_CMP_NOT_EQUAL		2
+#define PT_VALUE_CMP_GREATER		3
+#define PT_VALUE_CMP_LESS		4
+/* Comparisons against the value seen by the previous pass. */
+#define PT_VALUE_CMP_UNCHANGED		5
+#define PT_VALUE_CMP_CHANGED		6
+#define PT_VALUE_CMP_INCREASED		7
+#define PT_VALUE_CMP_DECREASED		8
+#define PT_VALUE_CMP_MAX		9
+
+/* Signed values are in 'i', unsigned values in 'u', and floating point
+ * values in 'f'.
+ */
+union pt_value
+{
+	int64_t		i;
+	uint64_t	u;
+	double		f;
+};
+
+struct pt_value_scan;
+
+/* Called for every candidate, in address order, with the value seen by
+ * the last pass.  Returning non-zero ends the iteration.
+ */
+typedef int (*pt_value_scan_handler_t)(struct pt_process *, pt_address_t,
+                                       const union pt_value *, void *cookie);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pt_value_scan *pt_value_scan_new(struct pt_process *, int, size_t, int);
+void     pt_value_scan_delete(struct pt_value_scan *);
+void     pt_value_scan_tolerance_set(struct pt_value_scan *, double);
+ssize_t  pt_value_scan_update(struct pt_value_scan *, int, const union pt_value *);
+uint64_t pt_value_scan_count_get(struct pt_value_scan *);
+size_t   pt_value_scan_pages_get(struct pt_value_scan *);
+int      pt_value_scan_for_each(struct pt_value_scan *,
+                                pt_value_scan_handler_t, void *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_VALUE_SCAN_H */
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * batch.c
+ *
+ * Batched delivery of high frequency events to python.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <python/Python.h>
+#include <python/pythread.h>
+#include <libptrace/process.h>
+#include "../src/process.h"
+#include "../src/thread.h"
+#include "batch.h"
+#include "compat.h"
+#include "core.h"
+#include "thread.h"
+
+static const char *pypt_batch_event_names_[PYPT_BATCH_EVENT_MAX] = {
+	[PYPT_BATCH_EVENT_BREAKPOINT]		= "breakpoint",
+	[PYPT_BATCH_EVENT_BREAKPOINT_SW]	= "breakpoint_sw",
+	[PYPT_BATCH_EVENT_REMOTE_BREAK]		= "remote_break",
+	[PYPT_BATCH_EVENT_SINGLE_STEP]		= "single_step",
+	[PYPT_BATCH_EVENT_SEGFAULT]		= "segfault",
+	[PYPT_BATCH_EVENT_ILLEGAL_INSTRUCTION]	= "illegal_instruction",
+	[PYPT_BATCH_EVENT_DIVIDE_BY_ZERO]	= "divide_by_zero",
+	[PYPT_BATCH_EVENT_PRIV_INSTRUCTION]	= "priv_instruction",
+	[PYPT_BATCH_EVENT_UNKNOWN_EXCEPTION]	= "unknown_exception"
+};
+
+static inline struct pypt_core *pypt_batch_core_(struct pt_core *core)
+{
+	return core->super_;
+}
+
+static void pypt_batch_idle_handler_(struct pt_core *core, void *cookie)
+{
+	pypt_batch_flush(core);
+}
+
+int pypt_batch_start(struct pt_core *core, PyObject *callback,
+                     size_t capacity, int policy)
+{
+	struct pypt_core *pycore = pypt_batch_core_(core);
+	struct pypt_batch *batch;
+
+	if (pycore == NULL || pycore->batch != NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "batching already active");
+		return -1;
+	}
+
+	if (capacity == 0)
+		capacity = PYPT_BATCH_CAPACITY_DEFAULT;
+
+	if ( (batch = malloc(sizeof *batch)) == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	if ( (batch->records = malloc(capacity * sizeof *batch->records)) == NULL) {
+		free(batch);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	Py_INCREF(callback);
+	batch->callback = callback;
+	batch->policy   = policy;
+	batch->count    = 0;
+	batch->capacity = capacity;
+
+	PyThread_acquire_lock(pycore->batch_lock, WAIT_LOCK);
+	pycore->batch = batch;
+	PyThread_release_lock(pycore->batch_lock);
+
+	pt_core_idle_handler_set(core, pypt_batch_idle_handler_, NULL);
+
+	return 0;
+}
+
+static void
+pypt_batch_deliver_(PyObject *, struct pypt_batch_record *, size_t);
+
+/* Must be called with the GIL held.  Events still queued are delivered
+ * before the batch is released.
+ */
+void pypt_batch_stop(struct pt_core *core)
+{
+	struct pypt_core *pycore = pypt_batch_core_(core);
+	struct pypt_batch *batch;
+
+	if (pycore == NULL)
+		return;
+
+	/* Detach the batch first, so that the event loop thread delivers
+	 * new events directly from now on.
+	 */
+	PyThread_acquire_lock(pycore->batch_lock, WAIT_LOCK);
+	batch = pycore->batch;
+	pycore->batch = NULL;
+	PyThread_release_lock(pycore->batch_lock);
+
+	if (batch == NULL)
+		return;
+
+	pt_core_idle_handler_set(core, NULL, NULL);
+
+	pypt_batch_deliver_(batch->callback, batch->records, batch->count);
+
+	Py_DECREF(batch->callback);
+	free(batch->records);
+	free(batch);
+}
+
+/* Queue an event for batched delivery.  Returns 0 if the event was
+ * queued, and -1 if batching is not active and the caller should deliver
+ * the event itself.  If 'object' is not NULL, a reference to it is taken
+ * and passed to the callback as the extra event argument.  Does not need
+ * the GIL unless an object is passed or the batch is flushed.
+ */
+int pypt_batch_push(struct pt_thread *thread, int type, pt_address_t address,
+                    uint64_t extra, int chance, PyObject *object)
+{
+	struct pt_core *core = thread->process->core;
+	struct pypt_core *pycore = pypt_batch_core_(core);
+	struct pypt_batch_record *record;
+	struct pypt_batch *batch;
+	PyGILState_STATE gstate;
+	int flush;
+
+	if (pycore == NULL || pycore->batch == NULL)
+		return -1;
+
+	/* The object may go away before the batch is delivered, so we hold
+	 * on to it.  This is done before the batch lock is taken, as the
+	 * lock is never held while waiting for the GIL.
+	 */
+	if (object != NULL) {
+		gstate = PyGILState_Ensure();
+		Py_INCREF(object);
+		PyGILState_Release(gstate);
+	}
+
+	/* If the batch was stopped in the meantime, or could not be
+	 * delivered when it filled up, the caller delivers the event.
+	 */
+	PyThread_acquire_lock(pycore->batch_lock, WAIT_LOCK);
+
+	if ( (batch = pycore->batch) == NULL || batch->count == batch->capacity) {
+		PyThread_release_lock(pycore->batch_lock);
+
+		if (object != NULL) {
+			gstate = PyGILState_Ensure();
+			Py_DECREF(object);
+			PyGILState_Release(gstate);
+		}
+
+		return -1;
+	}
+
+	record          = &batch->records[batch->count++];
+	record->type    = type;
+	record->chance  = chance;
+	record->thread  = thread->super_;
+	record->address = address;
+	record->extra   = extra;
+	record->object  = object;
+
+	/* A full batch is delivered right away.  Under PYPT_BATCH_STOP we
+	 * also deliver once this is the last event pending, so the thread
+	 * that reported it is still stopped when the callback runs.
+	 */
+	flush = batch->count == batch->capacity ||
+	        (batch->policy == PYPT_BATCH_STOP &&
+	         pt_core_event_pending(core) != 1);
+
+	PyThread_release_lock(pycore->batch_lock);
+
+	if (flush)
+		pypt_batch_flush(core);
+
+	return 0;
+}
+
+static PyObject *
+pypt_batch_record_extra_(struct pypt_batch_record *record)
+{
+	switch (record->type) {
+	case PYPT_BATCH_EVENT_SEGFAULT:
+		return PyLong_FromUnsignedLongLong(record->extra);
+
+	case PYPT_BATCH_EVENT_UNKNOWN_EXCEPTION:
+		return PyInt_FromLong((long)record->extra);
+	}
+
+	Py_RETURN_NONE;
+}
+
+/* Build the tuple for 'record'.  This consumes the reference to the
+ * record object, whether or not it succeeds.
+ */
+static PyObject *
+pypt_batch_record_to_tuple_(struct pypt_batch_record *record)
+{
+	PyObject *extra;
+
+	if ( (extra = record->object) == NULL &&
+	     (extra = pypt_batch_record_extra_(record)) == NULL)
+		return NULL;
+
+	return Py_BuildValue("(sOOKiN)",
+		pypt_batch_event_names_[record->type],
+		record->thread->process,
+		record->thread,
+		(unsigned long long)record->address,
+		record->chance,
+		extra);
+}
+
+/* Deliver 'count' records to 'callback' as a single list.  Must be called
+ * with the GIL held, and releases the references held by the records.
+ */
+static void
+pypt_batch_deliver_(PyObject *callback, struct pypt_batch_record *records,
+                    size_t count)
+{
+	PyObject *list, *ret;
+	size_t i;
+
+	if (count == 0)
+		return;
+
+	list = PyList_New(count);
+
+	for (i = 0; i < count; i++) {
+		PyObject *tuple;
+
+		if (list == NULL) {
+			Py_XDECREF(records[i].object);
+			continue;
+		}
+
+		if ( (tuple = pypt_batch_record_to_tuple_(&records[i])) == NULL) {
+			Py_CLEAR(list);
+			continue;
+		}
+
+		PyList_SET_ITEM(list, i, tuple);
+	}
+
+	if (list == NULL) {
+		PyErr_Print();
+		return;
+	}
+
+	ret = PyObject_CallFunctionObjArgs(callback, list, NULL);
+	if (ret == NULL)
+		PyErr_Print();
+	else
+		Py_DECREF(ret);
+
+	Py_DECREF(list);
+}
+
+/* Deliver all queued events as a single list, acquiring the GIL once. */
+void pypt_batch_flush(struct pt_core *core)
+{
+	struct pypt_core *pycore = pypt_batch_core_(core);
+	struct pypt_batch_record *records;
+	struct pypt_batch *batch;
+	PyGILState_STATE gstate;
+	PyObject *callback;
+	size_t count;
+
+	if (pycore == NULL)
+		return;
+
+	/* Avoid taking the GIL from the idle handler if there is nothing
+	 * to deliver.
+	 */
+	PyThread_acquire_lock(pycore->batch_lock, WAIT_LOCK);
+	count = pycore->batch != NULL ? pycore->batch->count : 0;
+	PyThread_release_lock(pycore->batch_lock);
+
+	if (count == 0)
+		return;
+
+	gstate = PyGILState_Ensure();
+
+	/* Take the queued records out of the batch, as the callback may
+	 * cause a new flush, and other threads may queue new events while
+	 * it runs.
+	 */
+	PyThread_acquire_lock(pycore->batch_lock, WAIT_LOCK);
+
+	if ( (batch = pycore->batch) == NULL || (count = batch->count) == 0) {
+		PyThread_release_lock(pycore->batch_lock);
+		PyGILState_Release(gstate);
+		return;
+	}
+
+	if ( (records = malloc(count * sizeof *records)) == NULL) {
+		PyThread_release_lock(pycore->batch_lock);
+		PyErr_NoMemory();
+		PyErr_Print();
+		PyGILState_Release(gstate);
+		return;
+	}
+
+	memcpy(records, batch->records, count * sizeof *records);
+	batch->count = 0;
+
+	callback = batch->callback;
+	Py_INCREF(callback);
+
+	PyThread_release_lock(pycore->batch_lock);
+
+	pypt_batch_deliver_(callback, records, count);
+
+	Py_DECREF(callback);
+	free(records);
+	PyGILState_Release(gstate);
+}
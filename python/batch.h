@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * batch.h
+ *
+ * Batched delivery of high frequency events to python.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PYPT_BATCH_INTERNAL_H
+#define PYPT_BATCH_INTERNAL_H
+
+#include <python/Python.h>
+#include <libptrace/types.h>
+#include "../src/core.h"
+
+/* Delivery policies.  With PYPT_BATCH_RESUME every event is continued as
+ * soon as it has been queued, and the batch is delivered once the core has
+ * no further events pending.  With PYPT_BATCH_STOP the batch is delivered
+ * while the last queued event has not been continued yet.
+ */
+#define PYPT_BATCH_RESUME		0
+#define PYPT_BATCH_STOP			1
+
+#define PYPT_BATCH_CAPACITY_DEFAULT	4096
+
+#define PYPT_BATCH_EVENT_BREAKPOINT		0
+#define PYPT_BATCH_EVENT_BREAKPOINT_SW		1
+#define PYPT_BATCH_EVENT_REMOTE_BREAK		2
+#define PYPT_BATCH_EVENT_SINGLE_STEP		3
+#define PYPT_BATCH_EVENT_SEGFAULT		4
+#define PYPT_BATCH_EVENT_ILLEGAL_INSTRUCTION	5
+#define PYPT_BATCH_EVENT_DIVIDE_BY_ZERO		6
+#define PYPT_BATCH_EVENT_PRIV_INSTRUCTION	7
+#define PYPT_BATCH_EVENT_UNKNOWN_EXCEPTION	8
+#define PYPT_BATCH_EVENT_MAX			9
+
+struct pypt_thread;
+
+/* Queued events are kept as plain C records, so that they can be queued
+ * without holding the GIL.  The thread is a borrowed reference; the batch
+ * is flushed before any thread exit is handled.  The object, if any, is a
+ * reference taken when the event was queued, and is handed to the callback.
+ */
+struct pypt_batch_record
+{
+	uint8_t			type;
+	uint8_t			chance;
+	struct pypt_thread	*thread;
+	pt_address_t		address;
+	uint64_t		extra;
+	PyObject		*object;
+};
+
+/* The batch is shared between the thread running the event loop and any
+ * python thread calling batch_flush() or batch_stop(), so it is only
+ * accessed with the batch lock of its core held.  The lock is never held
+ * while waiting for the GIL.
+ */
+struct pypt_batch
+{
+	PyObject			*callback;
+	int				policy;
+	size_t				count;
+	size_t				capacity;
+	struct pypt_batch_record	*records;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  pypt_batch_start(struct pt_core *, PyObject *, size_t, int);
+void pypt_batch_stop(struct pt_core *);
+int  pypt_batch_push(struct pt_thread *, int, pt_address_t, uint64_t, int,
+                     PyObject *);
+void pypt_batch_flush(struct pt_core *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PYPT_BATCH_INTERNAL_H */
@@ -42,11 +42,14 @@
  */
 #include <python/Python.h>
 #include <python/structmember.h>
+#include <libptrace/error.h>
 #include "../src/thread.h"
 
+#include "batch.h"
 #include "compat.h"
 #include "breakpoint.h"
 #include "breakpoint_sw.h"
+#include "ptrace.h"
 #include "thread.h"
 #include "utils.h"
 
@@ -54,13 +57,148 @@ static PyMethodDef pypt_breakpoint_sw_methods[] = {
 	{ NULL }
 };
 
+#define BP_MEMBER(f) offsetof(struct pypt_breakpoint_sw, breakpoint.f)
+
 static PyMemberDef pypt_breakpoint_sw_members[] = {
+	{ "fired", T_ULONGLONG, BP_MEMBER(fired), READONLY, "Number of times the handler was called." },
+	{ "ignore_count", T_ULONGLONG, BP_MEMBER(ignore_count), 0, "Number of initial hits to ignore." },
+	{ "max_hits", T_ULONGLONG, BP_MEMBER(max_hits), 0, "Retire the breakpoint after this many handler calls." },
 	{ NULL }
 };
 
+#undef BP_MEMBER
+
+static PyObject *
+pypt_breakpoint_sw_condition_get(struct pypt_breakpoint_sw *self, void *closure)
+{
+	const char *condition;
+
+	if ( (condition = pt_breakpoint_condition_get(&self->breakpoint)) == NULL)
+		Py_RETURN_NONE;
+
+	return PyString_FromString(condition);
+}
+
+static int
+pypt_breakpoint_sw_condition_set(struct pypt_breakpoint_sw *self,
+                                 PyObject *value, void *closure)
+{
+	char *condition = NULL;
+	int ret;
+
+	if (value != NULL && value != Py_None) {
+		if (!py_string_check(value)) {
+			PyErr_SetString(PyExc_TypeError, "'condition' must be a string");
+			return -1;
+		}
+
+		if ( (condition = py_string_to_utf8(value)) == NULL)
+			return -1;
+	}
+
+	ret = pt_breakpoint_condition_set(&self->breakpoint, condition);
+	free(condition);
+
+	if (ret == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return -1;
+	}
+
+	return 0;
+}
+
+static PyObject *
+pypt_breakpoint_sw_hits_get(struct pypt_breakpoint_sw *self, void *closure)
+{
+	return PyLong_FromUnsignedLongLong(self->breakpoint.hits);
+}
+
+/* Convert 'value' for the setter of attribute 'name', failing on values
+ * that do not fit in 'max'.
+ */
+static int
+pypt_breakpoint_sw_num_(PyObject *value, const char *name,
+                        unsigned long long max, unsigned long long *result)
+{
+	unsigned long long v;
+
+	if (value == NULL) {
+		PyErr_Format(PyExc_TypeError, "Cannot delete the '%s' attribute.", name);
+		return -1;
+	}
+
+	if (!py_num_check(value)) {
+		PyErr_Format(PyExc_TypeError, "'%s' must be an integer type.", name);
+		return -1;
+	}
+
+	v = py_num_to_ulonglong(value);
+	if (v == (unsigned long long)-1 && PyErr_Occurred())
+		return -1;
+
+	if (v > max) {
+		PyErr_Format(PyExc_OverflowError, "value too large for '%s'", name);
+		return -1;
+	}
+
+	*result = v;
+	return 0;
+}
+
+static PyObject *
+pypt_breakpoint_sw_every_nth_get(struct pypt_breakpoint_sw *self, void *closure)
+{
+	return PyLong_FromUnsignedLongLong(self->breakpoint.every_nth);
+}
+
+static int
+pypt_breakpoint_sw_every_nth_set(struct pypt_breakpoint_sw *self,
+                                 PyObject *value, void *closure)
+{
+	unsigned long long n;
+
+	if (pypt_breakpoint_sw_num_(value, "every_nth", UINT64_MAX, &n) == -1)
+		return -1;
+
+	pt_breakpoint_every_nth_set(&self->breakpoint, n);
+
+	return 0;
+}
+
+static PyObject *
+pypt_breakpoint_sw_rate_limit_get(struct pypt_breakpoint_sw *self, void *closure)
+{
+	return PyLong_FromUnsignedLong(self->breakpoint.rate_limit);
+}
+
+static int
+pypt_breakpoint_sw_rate_limit_set(struct pypt_breakpoint_sw *self,
+                                  PyObject *value, void *closure)
+{
+	unsigned long long per_second;
+
+	if (pypt_breakpoint_sw_num_(value, "rate_limit", UINT32_MAX, &per_second) == -1)
+		return -1;
+
+	pt_breakpoint_rate_limit_set(&self->breakpoint, per_second);
+
+	return 0;
+}
+
 static PyGetSetDef pypt_breakpoint_sw_getset[] = {
 	{"__dict__", (getter)pypt_dict_get, (setter)pypt_dict_set,
 	"The __dict__ for this breakpoint.", &pypt_breakpoint_sw_type},
+	{"condition", (getter)pypt_breakpoint_sw_condition_get,
+	(setter)pypt_breakpoint_sw_condition_set,
+	"Condition expression evaluated before the handler is called.", NULL},
+	{"hits", (getter)pypt_breakpoint_sw_hits_get, NULL,
+	"Number of times this breakpoint was hit.", NULL},
+	{"every_nth", (getter)pypt_breakpoint_sw_every_nth_get,
+	(setter)pypt_breakpoint_sw_every_nth_set,
+	"Only call the handler on every Nth matching hit.", NULL},
+	{"rate_limit", (getter)pypt_breakpoint_sw_rate_limit_get,
+	(setter)pypt_breakpoint_sw_rate_limit_set,
+	"Maximum number of handler calls per second.", NULL},
 	{NULL}
 };
 
@@ -72,6 +210,11 @@ pypt_breakpoint_sw_handler_(struct pt_thread *pt_thread, void *cookie)
 	struct pypt_thread *thread;
 	PyObject *ret;
 
+	if (pypt_batch_push(pt_thread, PYPT_BATCH_EVENT_BREAKPOINT_SW,
+	                    bp->breakpoint.address, 0, 0,
+	                    (PyObject *)bp) == 0)
+		return;
+
 	thread = (struct pypt_thread *)pt_thread->super_;
 
 	gstate = PyGILState_Ensure();
@@ -159,6 +302,7 @@ pypt_breakpoint_sw_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static void
 pypt_breakpoint_sw_dealloc(struct pypt_breakpoint_sw *self)
 {
+	pt_breakpoint_condition_set(&self->breakpoint, NULL);
 	Py_XDECREF(self->handler);
 	Py_XDECREF(self->dict);
 	Py_TYPE(self)->tp_free((PyObject *)self);
@@ -64,6 +64,12 @@
 #else
   #define PyBytes_FromStringAndSize PyString_FromStringAndSize
   #define PyBytes_AsStringAndSize   PyString_AsStringAndSize
+  #define _PyBytes_Resize           _PyString_Resize
+#endif
+
+/* Python 3 types always support the new buffer protocol. */
+#ifndef Py_TPFLAGS_HAVE_NEWBUFFER
+  #define Py_TPFLAGS_HAVE_NEWBUFFER 0
 #endif
 
 #ifdef __cplusplus
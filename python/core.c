@@ -41,10 +41,19 @@
  *
  */
 #include <stdint.h>
+#include <stdlib.h>
+#ifdef WIN32
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif
 #include <python/Python.h>
 #include <python/structmember.h>
 #include <libptrace/error.h>
 #include <libptrace/factory.h>
+#include <libptrace/recorder.h>
+#include <libptrace/stats.h>
+#include "batch.h"
 #include "compat.h"
 #include "core.h"
 #include "ptrace.h"
@@ -65,6 +74,8 @@ pypt_core_init(struct pypt_core *self, PyObject *args, PyObject *kwds)
 		return -1;
 	}
 
+	self->core->super_ = self;
+
 	return 0;
 }
 
@@ -81,7 +92,15 @@ pypt_core_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 		return NULL;
 	}
 
-	self->core = NULL;
+	if ( (self->batch_lock = PyThread_allocate_lock()) == NULL) {
+		Py_DECREF(self->dict);
+		Py_TYPE(self)->tp_free((PyObject*)self);
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	self->core  = NULL;
+	self->batch = NULL;
 
 	return (PyObject *)self;
 }
@@ -89,6 +108,14 @@ pypt_core_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static void
 pypt_core_dealloc(struct pypt_core *self)
 {
+	if (self->core != NULL) {
+		pypt_batch_stop(self->core);
+		self->core->super_ = NULL;
+	}
+
+	if (self->batch_lock != NULL)
+		PyThread_free_lock(self->batch_lock);
+
 	Py_XDECREF(self->dict);
 	Py_TYPE(self)->tp_free((PyObject *)self);
 }
@@ -316,6 +343,7 @@ PyObject *pypt_core_process_detach_remote(struct pypt_core *self, PyObject *args
 {
 	pt_handle_t handle;
 	PyObject *object;
+	int ret;
 
 	if (!PyArg_ParseTuple(args, "O:process_detach_remote", &object))
 		return NULL;
@@ -327,7 +355,14 @@ PyObject *pypt_core_process_detach_remote(struct pypt_core *self, PyObject *args
 
 	handle = pyhandle_to_handle(object);
 
-	if (pt_core_process_detach_remote(self->core, handle) == -1) {
+	/* Blocks until the core thread has handled the request, and that
+	 * thread may need the GIL to run event handlers in the meantime.
+	 */
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_core_process_detach_remote(self->core, handle);
+	Py_END_ALLOW_THREADS
+
+	if (ret == -1) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
 	}
@@ -362,6 +397,7 @@ PyObject *pypt_core_process_break_remote(struct pypt_core *self, PyObject *args)
 {
 	pt_handle_t handle;
 	PyObject *object;
+	int ret;
 
 	if (!PyArg_ParseTuple(args, "O:process_break_remote", &object))
 		return NULL;
@@ -373,7 +409,11 @@ PyObject *pypt_core_process_break_remote(struct pypt_core *self, PyObject *args)
 
 	handle = pyhandle_to_handle(object);
 
-	if (pt_core_process_break_remote(self->core, handle) == -1) {
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_core_process_break_remote(self->core, handle);
+	Py_END_ALLOW_THREADS
+
+	if (ret == -1) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
 	}
@@ -512,6 +552,190 @@ PyObject *pypt_core_quit(struct pypt_core *self, PyObject *args)
 	Py_RETURN_NONE;
 }
 
+PyObject *pypt_core_record_start(struct pypt_core *self, PyObject *args)
+{
+	unsigned long long capacity;
+	const char *filename;
+	int ring = 0;
+
+	if (!PyArg_ParseTuple(args, "sK|i", &filename, &capacity, &ring))
+		return NULL;
+
+	if (pt_core_record_start(self->core, filename, capacity,
+	                         ring ? PT_RECORDER_FLAG_RING : PT_RECORDER_FLAG_NONE) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_record_stop(struct pypt_core *self, PyObject *args)
+{
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	if (pt_core_record_stop(self->core) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_stats(struct pypt_core *self, PyObject *args)
+{
+	struct pt_stats *stats;
+	PyObject *result;
+
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	if ( (stats = malloc(sizeof *stats)) == NULL)
+		return PyErr_NoMemory();
+
+	if (pt_core_stats_get(self->core, stats) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		free(stats);
+		return NULL;
+	}
+
+	result = pypt_stats_to_dict(stats);
+	free(stats);
+
+	return result;
+}
+
+PyObject *pypt_core_stats_reset(struct pypt_core *self, PyObject *args)
+{
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	pt_core_stats_reset(self->core);
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_batch_start(struct pypt_core *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "callback", "capacity", "policy", NULL };
+	Py_ssize_t capacity = 0;
+	int policy = PYPT_BATCH_RESUME;
+	PyObject *callback;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ni:batch_start", kwlist,
+	                                 &callback, &capacity, &policy))
+		return NULL;
+
+	if (!PyCallable_Check(callback)) {
+		PyErr_SetString(PyExc_TypeError, "'callback' must be callable");
+		return NULL;
+	}
+
+	if (capacity < 0) {
+		PyErr_SetString(PyExc_ValueError, "'capacity' must not be negative");
+		return NULL;
+	}
+
+	if (policy != PYPT_BATCH_RESUME && policy != PYPT_BATCH_STOP) {
+		PyErr_SetString(PyExc_ValueError, "unknown batch policy");
+		return NULL;
+	}
+
+	if (pypt_batch_start(self->core, callback, capacity, policy) == -1)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_batch_stop(struct pypt_core *self, PyObject *args)
+{
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	pypt_batch_stop(self->core);
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_batch_flush(struct pypt_core *self, PyObject *args)
+{
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	pypt_batch_flush(self->core);
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_dispatch_pending(struct pypt_core *self, PyObject *args)
+{
+	int max = 0, ret;
+
+	if (!PyArg_ParseTuple(args, "|i:dispatch_pending", &max))
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_core_event_dispatch_pending(self->core, max);
+	Py_END_ALLOW_THREADS
+
+	if (ret == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	return PyInt_FromLong(ret);
+}
+
+/* Called from the core notification thread, without the GIL.  Writing a
+ * byte to the socket wakes up whoever polls the other end.
+ */
+static void pypt_core_event_notify_(void *cookie)
+{
+#ifdef WIN32
+	send((SOCKET)(uintptr_t)cookie, "", 1, 0);
+#else
+	ssize_t ret = write((int)(intptr_t)cookie, "", 1);
+	(void)ret;
+#endif
+}
+
+PyObject *pypt_core_event_notify_start(struct pypt_core *self, PyObject *args)
+{
+	unsigned long long fd;
+
+	if (!PyArg_ParseTuple(args, "K:event_notify_start", &fd))
+		return NULL;
+
+	if (pt_core_event_notify_start(self->core, pypt_core_event_notify_,
+	                               (void *)(uintptr_t)fd) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
+PyObject *pypt_core_event_notify_stop(struct pypt_core *self, PyObject *args)
+{
+	int ret;
+
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	/* The notification thread may be blocked writing the socket. */
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_core_event_notify_stop(self->core);
+	Py_END_ALLOW_THREADS
+
+	if (ret == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
 static PyObject *pypt_core__repr__(struct pypt_core *self)
 {
 	return PyString_FromFormat("<%s(%p)>", Py_TYPE(self)->tp_name, self);
@@ -536,6 +760,16 @@ static PyMethodDef pypt_core_methods[] = {
 	{ "execv",                 (PyCFunction)pypt_core_execv, METH_VARARGS, "Execute a process." },
 	{ "execv_remote",          (PyCFunction)pypt_core_execv_remote, METH_VARARGS, "Execute a process from a different thread." },
 	{ "quit",                  (PyCFunction)pypt_core_quit, METH_VARARGS, "Quit the main loop of this core." },
+	{ "record_start",          (PyCFunction)pypt_core_record_start, METH_VARARGS, "Record all debug events to a file." },
+	{ "record_stop",           (PyCFunction)pypt_core_record_stop, METH_VARARGS, "Stop recording debug events." },
+	{ "stats",                 (PyCFunction)pypt_core_stats, METH_VARARGS, "Get event latency histograms." },
+	{ "stats_reset",           (PyCFunction)pypt_core_stats_reset, METH_VARARGS, "Reset event latency histograms." },
+	{ "batch_start",           (PyCFunction)pypt_core_batch_start, METH_VARARGS | METH_KEYWORDS, "Deliver breakpoint and exception events in batches." },
+	{ "batch_stop",            (PyCFunction)pypt_core_batch_stop, METH_VARARGS, "Stop batched event delivery." },
+	{ "batch_flush",           (PyCFunction)pypt_core_batch_flush, METH_VARARGS, "Deliver all queued events now." },
+	{ "dispatch_pending",      (PyCFunction)pypt_core_dispatch_pending, METH_VARARGS, "Handle pending events without blocking." },
+	{ "event_notify_start",    (PyCFunction)pypt_core_event_notify_start, METH_VARARGS, "Write a byte to a socket when events are pending." },
+	{ "event_notify_stop",     (PyCFunction)pypt_core_event_notify_stop, METH_VARARGS, "Stop event notification." },
 	{ NULL }
 };
 
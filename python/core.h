@@ -43,12 +43,21 @@
 #ifndef PYPT_CORE_INTERNAL_H
 #define PYPT_CORE_INTERNAL_H
 
+#include <python/Python.h>
+#include <python/pythread.h>
+
+struct pypt_batch;
+
 struct pypt_core
 {
 	PyObject_HEAD;
 	PyObject *dict;
 
 	struct pt_core *core;
+
+	/* Batched event delivery, or NULL if not enabled. */
+	struct pypt_batch *batch;
+	PyThread_type_lock batch_lock;
 };
 
 extern PyTypeObject pypt_core_type;
@@ -68,6 +77,16 @@ PyObject *pypt_core_main(struct pypt_core *, PyObject *);
 PyObject *pypt_core_execv(struct pypt_core *, PyObject *);
 PyObject *pypt_core_execv_remote(struct pypt_core *, PyObject *);
 PyObject *pypt_core_quit(struct pypt_core *, PyObject *);
+PyObject *pypt_core_record_start(struct pypt_core *, PyObject *);
+PyObject *pypt_core_record_stop(struct pypt_core *, PyObject *);
+PyObject *pypt_core_stats(struct pypt_core *, PyObject *);
+PyObject *pypt_core_stats_reset(struct pypt_core *, PyObject *);
+PyObject *pypt_core_batch_start(struct pypt_core *, PyObject *, PyObject *);
+PyObject *pypt_core_batch_stop(struct pypt_core *, PyObject *);
+PyObject *pypt_core_batch_flush(struct pypt_core *, PyObject *);
+PyObject *pypt_core_dispatch_pending(struct pypt_core *, PyObject *);
+PyObject *pypt_core_event_notify_start(struct pypt_core *, PyObject *);
+PyObject *pypt_core_event_notify_stop(struct pypt_core *, PyObject *);
 
 #ifdef __cplusplus
 };
@@ -44,6 +44,7 @@
 #include <python/structmember.h>
 
 #include <libptrace/event.h>
+#include "batch.h"
 #include "compat.h"
 #include "event.h"
 #include "module.h"
@@ -92,6 +93,9 @@ int pypt_handle_attached(struct pt_event_attached *event)
 	PyGILState_STATE gstate;
 	PyObject *ret;
 
+	/* Deliver batched events first, to keep events ordered. */
+	pypt_batch_flush(event->process->core);
+
 	/* We have attached.  At this point, we need to represent the
 	 * main thread, as it doesn't get a separate event.  We use the
 	 * callback handler for this.
@@ -144,6 +148,8 @@ int pypt_handle_process_exit(struct pt_event_process_exit *event)
 	PyGILState_STATE gstate;
 	PyObject *ret;
 
+	pypt_batch_flush(event->process->core);
+
 	/* If we have no process_exit handler, we're done. */
 	if (self->handlers->process_exit == NULL)
 		goto out;
@@ -168,6 +174,8 @@ int pypt_handle_module_load(struct pt_event_module_load *event)
 	PyGILState_STATE gstate;
 	PyObject *ret;
 
+	pypt_batch_flush(event->module->process->core);
+
         /* Does its own GIL management */
 	module = pypt_handle_module_load_internal_(event);
 	if (module == NULL)
@@ -239,6 +247,8 @@ int pypt_handle_module_unload(struct pt_event_module_unload *event)
 	PyObject *ret;
 	Py_ssize_t i;
 
+	pypt_batch_flush(event->module->process->core);
+
 	/* No super?  Strange, this is a module we don't track... */
 	if (!module)
 		goto out;
@@ -286,6 +296,8 @@ int pypt_handle_thread_create(struct pt_event_thread_create *event)
 	PyGILState_STATE gstate;
 	PyObject *ret;
 
+	pypt_batch_flush(event->thread->process->core);
+
 	/* Create a new thread and add it internally. */
 	/* Does its own GIL management */
 	thread = pypt_handle_thread_create_internal_(event);
@@ -353,6 +365,11 @@ int pypt_handle_thread_exit(struct pt_event_thread_exit *event)
 	PyObject *ret;
 	Py_ssize_t i;
 
+	/* Batched events hold borrowed thread references, so they must
+	 * be delivered before the thread goes away.
+	 */
+	pypt_batch_flush(event->thread->process->core);
+
 	/* No super?  Strange, this is a thread we don't track... */
 	if (!thread)
 		goto out;
@@ -404,6 +421,12 @@ int pypt_handle_breakpoint(struct pt_event_breakpoint *ev)
 	if (self->handlers->breakpoint == NULL)
 		goto out;
 
+	/* In batched mode the event is queued for the batch callback. */
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_BREAKPOINT,
+	                    ev->address, 0, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	if ( (chance = PyInt_FromLong(ev->chance)) == NULL) {
@@ -436,6 +459,11 @@ int pypt_handle_remote_break(struct pt_event_breakpoint *ev)
 	if (self->handlers->remote_break == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_REMOTE_BREAK,
+	                    ev->address, 0, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	if ( (chance = PyInt_FromLong(ev->chance)) == NULL) {
@@ -468,6 +496,11 @@ int pypt_handle_single_step(struct pt_event_single_step *ev)
 	if (self->handlers->single_step == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_SINGLE_STEP,
+	                    (pt_address_t)ev->address, 0, 0,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	ret = PyObject_CallFunctionObjArgs(
@@ -494,6 +527,11 @@ int pypt_handle_segfault(struct pt_event_segfault *ev)
 	if (self->handlers->segfault == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_SEGFAULT,
+	                    (pt_address_t)ev->address, (uint64_t)(uintptr_t)ev->fault_address, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	/* If integer conversion fails, forward the event and be done.
@@ -547,6 +585,11 @@ int pypt_handle_illegal_instruction(struct pt_event_illegal_instruction *ev)
 	if (self->handlers->illegal_instruction == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_ILLEGAL_INSTRUCTION,
+	                    (pt_address_t)ev->address, 0, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	if ( (chance = PyInt_FromLong(ev->chance)) == NULL) {
@@ -579,6 +622,11 @@ int pypt_handle_divide_by_zero(struct pt_event_divide_by_zero *ev)
 	if (self->handlers->divide_by_zero == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_DIVIDE_BY_ZERO,
+	                    (pt_address_t)ev->address, 0, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	if ( (chance = PyInt_FromLong(ev->chance)) == NULL) {
@@ -611,6 +659,11 @@ int pypt_handle_priv_instruction(struct pt_event_priv_instruction *ev)
 	if (self->handlers->priv_instruction == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_PRIV_INSTRUCTION,
+	                    (pt_address_t)ev->address, 0, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	if ( (chance = PyInt_FromLong(ev->chance)) == NULL) {
@@ -644,6 +697,11 @@ int pypt_handle_unknown_exception(struct pt_event_unknown_exception *ev)
 	if (self->handlers->unknown_exception == NULL)
 		goto out;
 
+	if (pypt_batch_push(ev->thread, PYPT_BATCH_EVENT_UNKNOWN_EXCEPTION,
+	                    (pt_address_t)ev->address, ev->number, ev->chance,
+	                    NULL) == 0)
+		goto out;
+
 	gstate = PyGILState_Ensure();
 
 	if ( (number = PyInt_FromLong(ev->number)) == NULL) {
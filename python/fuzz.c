@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * fuzz.c
+ *
+ * Python persistent-mode fuzzing loop objects.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <string.h>
+#include <python/Python.h>
+#include <libptrace/error.h>
+#include <libptrace/fuzz.h>
+#include "compat.h"
+#include "fuzz.h"
+#include "ptrace.h"
+#include "thread.h"
+
+static const char *pypt_fuzz_crash_names_[] = {
+	[PT_FUZZ_CRASH_SEGFAULT]		= "segfault",
+	[PT_FUZZ_CRASH_ILLEGAL_INSTRUCTION]	= "illegal_instruction",
+	[PT_FUZZ_CRASH_DIVIDE_BY_ZERO]		= "divide_by_zero",
+	[PT_FUZZ_CRASH_PRIV_INSTRUCTION]	= "priv_instruction",
+	[PT_FUZZ_CRASH_EXCEPTION]		= "exception"
+};
+
+static PyObject *pypt_fuzz_crash_to_dict_(struct pt_fuzz_crash *crash)
+{
+	return Py_BuildValue("{s:s,s:i,s:K,s:K,s:K,s:K,s:N}",
+		"type", pypt_fuzz_crash_names_[crash->type],
+		"number", crash->number,
+		"address", (unsigned long long)crash->address,
+		"fault_address", (unsigned long long)crash->fault_address,
+		"iteration", (unsigned long long)crash->iteration,
+		"hits", (unsigned long long)crash->hits,
+		"input", PyBytes_FromStringAndSize(crash->input, crash->input_size));
+}
+
+/* Ask python for the input of an iteration.  Returning None, or raising
+ * an exception, ends the loop.
+ */
+static ssize_t
+pypt_fuzz_input_handler_(struct pt_fuzz *fuzz, uint64_t iteration,
+                         void *buf, size_t size, void *cookie)
+{
+	struct pypt_fuzz *self = cookie;
+	PyGILState_STATE gstate;
+	ssize_t len = -1;
+	Py_buffer view;
+	PyObject *ret;
+
+	gstate = PyGILState_Ensure();
+
+	ret = PyObject_CallFunction(self->input, "Kn",
+	                            (unsigned long long)iteration,
+	                            (Py_ssize_t)size);
+	if (ret == NULL)
+		goto out_error;
+
+	if (ret == Py_None)
+		goto out;
+
+	if (PyObject_GetBuffer(ret, &view, PyBUF_SIMPLE) == -1)
+		goto out_error;
+
+	len = view.len < (Py_ssize_t)size ? view.len : (Py_ssize_t)size;
+	memcpy(buf, view.buf, len);
+	PyBuffer_Release(&view);
+
+out:
+	Py_DECREF(ret);
+	PyGILState_Release(gstate);
+	return len;
+
+out_error:
+	PyErr_Print();
+	Py_XDECREF(ret);
+	PyGILState_Release(gstate);
+	return -1;
+}
+
+static void
+pypt_fuzz_crash_handler_(struct pt_fuzz *fuzz, struct pt_thread *thread,
+                         struct pt_fuzz_crash *crash, void *cookie)
+{
+	struct pypt_fuzz *self = cookie;
+	PyGILState_STATE gstate;
+	PyObject *pythread, *ret;
+
+	if (self->crash == NULL)
+		return;
+
+	gstate = PyGILState_Ensure();
+
+	pythread = thread->super_ != NULL ? thread->super_ : Py_None;
+	ret = PyObject_CallFunction(self->crash, "OON", self, pythread,
+	                            pypt_fuzz_crash_to_dict_(crash));
+	if (ret == NULL)
+		PyErr_Print();
+	else
+		Py_DECREF(ret);
+
+	PyGILState_Release(gstate);
+}
+
+/* The loop is over, so we drop the reference it held on us.  This may
+ * delete the loop.
+ */
+static void pypt_fuzz_done_handler_(struct pt_fuzz *fuzz, void *cookie)
+{
+	struct pypt_fuzz *self = cookie;
+	PyGILState_STATE gstate;
+	PyObject *ret;
+
+	gstate = PyGILState_Ensure();
+
+	if (self->done != NULL) {
+		ret = PyObject_CallFunctionObjArgs(self->done, self, NULL);
+		if (ret == NULL)
+			PyErr_Print();
+		else
+			Py_DECREF(ret);
+	}
+
+	Py_DECREF(self);
+	PyGILState_Release(gstate);
+}
+
+PyObject *
+pypt_fuzz_loop(struct pypt_process *process, struct pt_fuzz_target *target,
+               PyObject *input, PyObject *crash, PyObject *done)
+{
+	struct pypt_fuzz *self;
+
+	self = PyObject_New(struct pypt_fuzz, &pypt_fuzz_type);
+	if (self == NULL)
+		return NULL;
+
+	Py_INCREF(process);
+	Py_INCREF(input);
+	Py_XINCREF(crash);
+	Py_XINCREF(done);
+	self->process = process;
+	self->input   = input;
+	self->crash   = crash;
+	self->done    = done;
+
+	self->fuzz = pt_fuzz_loop(process->process, target,
+	                          pypt_fuzz_input_handler_,
+	                          pypt_fuzz_crash_handler_,
+	                          pypt_fuzz_done_handler_, self);
+	if (self->fuzz == NULL) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		Py_DECREF(self);
+		return NULL;
+	}
+
+	/* The reference held by the loop. */
+	Py_INCREF(self);
+
+	return (PyObject *)self;
+}
+
+static void pypt_fuzz_dealloc(struct pypt_fuzz *self)
+{
+	if (self->fuzz != NULL)
+		pt_fuzz_delete(self->fuzz);
+
+	Py_DECREF(self->process);
+	Py_DECREF(self->input);
+	Py_XDECREF(self->crash);
+	Py_XDECREF(self->done);
+	PyObject_Del(self);
+}
+
+static PyObject *pypt_fuzz_stop(struct pypt_fuzz *self, PyObject *args)
+{
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	pt_fuzz_stop(self->fuzz);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *pypt_fuzz_stats(struct pypt_fuzz *self, PyObject *args)
+{
+	struct pt_fuzz_stats stats;
+
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	pt_fuzz_stats_get(self->fuzz, &stats);
+
+	return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K}",
+		"iterations", (unsigned long long)stats.iterations,
+		"crashes", (unsigned long long)stats.crashes,
+		"pages_restored", (unsigned long long)stats.pages_restored,
+		"elapsed", (unsigned long long)stats.elapsed,
+		"execs_per_sec", (unsigned long long)stats.execs_per_sec);
+}
+
+static PyObject *pypt_fuzz_crashes(struct pypt_fuzz *self, PyObject *args)
+{
+	PyObject *list, *dict;
+	size_t i, count;
+
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	count = pt_fuzz_crash_count_get(self->fuzz);
+	if ( (list = PyList_New(count)) == NULL)
+		return NULL;
+
+	for (i = 0; i < count; i++) {
+		dict = pypt_fuzz_crash_to_dict_(pt_fuzz_crash_get(self->fuzz, i));
+		if (dict == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+
+		PyList_SET_ITEM(list, i, dict);
+	}
+
+	return list;
+}
+
+static PyObject *pypt_fuzz_state_get(struct pypt_fuzz *self, void *closure)
+{
+	return PyInt_FromLong(pt_fuzz_state_get(self->fuzz));
+}
+
+static PyObject *
+pypt_fuzz_input_address_get(struct pypt_fuzz *self, void *closure)
+{
+	return PyLong_FromUnsignedLongLong(pt_fuzz_input_address_get(self->fuzz));
+}
+
+static PyObject *pypt_fuzz__repr__(struct pypt_fuzz *self)
+{
+	struct pt_fuzz_stats stats;
+
+	pt_fuzz_stats_get(self->fuzz, &stats);
+
+	return PyString_FromFormat("<%s(%p) iterations:%llu crashes:%llu>",
+	                           Py_TYPE(self)->tp_name, self,
+	                           (unsigned long long)stats.iterations,
+	                           (unsigned long long)stats.crashes);
+}
+
+static PyMethodDef pypt_fuzz_methods[] = {
+	{ "stop", (PyCFunction)pypt_fuzz_stop, METH_VARARGS, "End the loop after the current iteration." },
+	{ "stats", (PyCFunction)pypt_fuzz_stats, METH_VARARGS, "Get iteration and crash counts, and executions per second." },
+	{ "crashes", (PyCFunction)pypt_fuzz_crashes, METH_VARARGS, "Get the crash sites found so far." },
+	{ NULL }
+};
+
+static PyGetSetDef pypt_fuzz_getset[] = {
+	{ "state", (getter)pypt_fuzz_state_get, NULL, "Loop state", NULL },
+	{ "input_address", (getter)pypt_fuzz_input_address_get, NULL, "Address of the input buffer", NULL },
+	{ NULL }
+};
+
+PyTypeObject pypt_fuzz_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"_ptrace.fuzz",				/* tp_name */
+	sizeof(struct pypt_fuzz),		/* tp_basicsize */
+	0,					/* tp_itemsize */
+	(destructor)pypt_fuzz_dealloc,		/* tp_dealloc */
+	0,					/* tp_print */
+	0,					/* tp_getattr */
+	0,					/* tp_setattr */
+	0,					/* tp_compare */
+	(reprfunc)pypt_fuzz__repr__,		/* tp_repr */
+	0,					/* tp_as_number */
+	0,					/* tp_as_sequence */
+	0,					/* tp_as_mapping */
+	0,					/* tp_hash */
+	0,					/* tp_call */
+	0,					/* tp_str */
+	0,					/* tp_getattro */
+	0,					/* tp_setattro */
+	0,					/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,			/* tp_flags */
+	"Fuzzing loop object",			/* tp_doc */
+	0,					/* tp_traverse */
+	0,					/* tp_clear */
+	0,					/* tp_richcompare */
+	0,					/* tp_weaklistoffset */
+	0,					/* tp_iter */
+	0,					/* tp_iternext */
+	pypt_fuzz_methods,			/* tp_methods */
+	0,					/* tp_members */
+	pypt_fuzz_getset,			/* tp_getset */
+};
@@ -240,7 +240,11 @@ pypt_inject_inject(struct pypt_inject *self, PyObject *args)
 	/* Do not disappear until the callback is called. */
 	Py_INCREF(self);
 
-	if (pt_inject(&inject, process) == -1) {
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_inject(&inject, process);
+	Py_END_ALLOW_THREADS
+
+	if (ret == -1) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
 	}
@@ -78,7 +78,9 @@ pypt_mmap_init(struct pypt_mmap *self, PyObject *args, PyObject *kwds)
                 Py_INCREF(pyprocess);
                 self->pyprocess = pyprocess;
                 // TODO: raise an exception if virtual_query_ex fails.
+                Py_BEGIN_ALLOW_THREADS
                 pt_mmap_load(pyprocess->process);
+                Py_END_ALLOW_THREADS
                 self->mmap = &pyprocess->process->mmap;
         } else {
                 self->mmap = pt_mmap_new();
@@ -91,17 +93,38 @@ pypt_mmap_init(struct pypt_mmap *self, PyObject *args, PyObject *kwds)
 static void
 pypt_mmap_dealloc(struct pypt_mmap *self)
 {
-        if(self->pyprocess && self->mmap) {
-                self->pyprocess->mmap = NULL;
-                Py_XDECREF(self->pyprocess);
-        }
+	/* The map of a process belongs to the process. */
+	if (self->pyprocess) {
+		if (self->pyprocess->mmap == (PyObject *)self)
+			self->pyprocess->mmap = NULL;
+		Py_XDECREF(self->pyprocess);
+	} else {
+		pt_mmap_delete(self->mmap);
+	}
 
 	Py_XDECREF(self->dict);
 	self->pyprocess = NULL;
-	pt_mmap_delete(self->mmap);
 	Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
+/* The map of a process is rebuilt by threads scanning the process, so we
+ * only touch it under the process lock.  The lock is never held while
+ * waiting for the GIL, so we can take it with the GIL held.
+ */
+static void
+pypt_mmap_lock_(struct pypt_mmap *self)
+{
+	if (self->pyprocess)
+		pt_process_lock(self->pyprocess->process);
+}
+
+static void
+pypt_mmap_unlock_(struct pypt_mmap *self)
+{
+	if (self->pyprocess)
+		pt_process_unlock(self->pyprocess->process);
+}
+
 // TODO: Add a real userland range depending on:
 //              - architecture x86/amd64 (bounds + possible uncanonical addresses)
 //              - OS (linux/windows)
@@ -125,8 +148,10 @@ pypt_mmap_add(struct pypt_mmap *self, PyObject *args)
 		goto err;
 
         if (is_valid_range_(start,end)) {
+                pypt_mmap_lock_(self);
                 area = pt_mmap_find_exact_area(self->mmap, start, end);
                 if(area) {
+                        pypt_mmap_unlock_(self);
                         PyOS_snprintf( buffer, sizeof(buffer), "Range [0x%.8lx,0x%.8lx] already in AVL tree.", start,end);
                         PyErr_SetString(PyExc_KeyError, buffer);
                         goto err;
@@ -138,8 +163,10 @@ pypt_mmap_add(struct pypt_mmap *self, PyObject *args)
                         area->end_   = end;
                         area->flags  = flags;
                         pt_mmap_add_area(self->mmap, area);
+                        pypt_mmap_unlock_(self);
                         Py_RETURN_NONE;
                 } else {
+                        pypt_mmap_unlock_(self);
                         PyErr_SetString(PyExc_MemoryError, "Not enough memory to append an item into the tree.");
                         goto err;
                 }
@@ -163,13 +190,16 @@ pypt_mmap_remove(struct pypt_mmap *self, PyObject *args)
 		goto err;
 
         if (is_valid_range_(start, end)) {
+                pypt_mmap_lock_(self);
                 area = pt_mmap_find_exact_area(self->mmap, start, end);
                 if(!area) {
+                        pypt_mmap_unlock_(self);
                         PyOS_snprintf( buffer, sizeof(buffer), "Range [0x%.8lx,0x%.8lx] not found.", start,end);
                         PyErr_SetString(PyExc_KeyError, buffer);
                         goto err;
                 } else {
                         pt_mmap_area_delete(self->mmap, area);
+                        pypt_mmap_unlock_(self);
                         Py_RETURN_NONE;
                 }
         } else {
@@ -181,95 +211,110 @@ err:
         return NULL;
 }
 
-#define PYPT_MAP_INT32(n, x)						\
-	do {								\
-		integer = PyInt_FromLong(x);				\
-		if (integer == NULL)					\
-			goto err_dict;					\
-									\
-		if (PyDict_SetItemString(dict, #n, integer) == -1)	\
-			goto err_integer;				\
-									\
-		Py_DECREF(integer);					\
-	} while (0)
+/* Copy of an area found, so that we build the result list after we
+ * drop the process lock.
+ */
+struct pypt_mmap_found_
+{
+	unsigned long	start;
+	unsigned long	end;
+	int		flags;
+};
+
+/* Copy the areas holding 'start', or those in [start, end] if 'end' is
+ * set.  Returns the number of areas, or -1 on allocation failure.
+ */
+static Py_ssize_t
+pypt_mmap_find_areas_(struct pypt_mmap *self, unsigned long start,
+                      unsigned long end, struct pypt_mmap_found_ **found)
+{
+	struct pypt_mmap_found_ *p;
+	struct pt_mmap_area *area;
+	Py_ssize_t count = 0, size = 0;
+
+	*found = NULL;
+
+	pypt_mmap_lock_(self);
+
+	if (!end)
+		area = pt_mmap_find_all_area_from_address_start(self->mmap, start);
+	else
+		area = pt_mmap_find_all_area_from_range_start(self->mmap, start, end);
+
+	while (area) {
+		if (count == size) {
+			size = size ? size * 2 : 16;
+			if ( (p = realloc(*found, size * sizeof *p)) == NULL) {
+				pypt_mmap_unlock_(self);
+				free(*found);
+				*found = NULL;
+				return -1;
+			}
+			*found = p;
+		}
+
+		(*found)[count].start = area->start_;
+		(*found)[count].end   = area->end_;
+		(*found)[count].flags = area->flags;
+		count++;
+
+		if (!end)
+			area = pt_mmap_find_all_area_from_address_next();
+		else
+			area = pt_mmap_find_all_area_from_range_next();
+	}
+
+	pypt_mmap_unlock_(self);
+	return count;
+}
 
 static PyObject *
 pypt_mmap_find(struct pypt_mmap *self, PyObject *args)
 {
-        struct pt_mmap_area *area = NULL;
-        unsigned long start=0, end=0;
-        PyObject *integer;
-        PyObject *dict;
-        char buffer[1024];
-	PyObject* pyList = PyList_New(1);
-
-	if(!(dict = PyDict_New()))
-		goto err;
+	struct pypt_mmap_found_ *found;
+	unsigned long start = 0, end = 0;
+	Py_ssize_t i, count = 0;
+	PyObject *list, *dict;
+	char buffer[1024];
 
 	if (!PyArg_ParseTuple(args, "i|i", &start, &end))
-		goto err;
+		return NULL;
 
-        if(start && !end){
-                area = pt_mmap_find_all_area_from_address_start(self->mmap, start);
-                if(area) {
-                        dict = PyDict_New();
-                        PYPT_MAP_INT32(start, area->start_);
-	                PYPT_MAP_INT32(end, area->end_);
-	                PYPT_MAP_INT32(flags, area->flags);
-	                PyList_SetItem(pyList, 0, dict);
-	                while(area) {
-	                        area = pt_mmap_find_all_area_from_address_next();
-                                if(area) {
-                                        dict = PyDict_New();
-                                        PYPT_MAP_INT32(start, area->start_);
-	                                PYPT_MAP_INT32(end, area->end_);
-	                                PYPT_MAP_INT32(flags, area->flags);
-	                                PyList_Append(pyList, dict);
-	                        }
-	                }
-	                return pyList;
-	        }
+	if (start && !end)
+		count = pypt_mmap_find_areas_(self, start, 0, &found);
+	else if (is_valid_range_(start, end))
+		count = pypt_mmap_find_areas_(self, start, end, &found);
 
-        } else {
-                if (is_valid_range_(start, end)) {
-                        area = pt_mmap_find_all_area_from_range_start(self->mmap, start, end);
-                        if(area) {
-                                dict = PyDict_New();
-                                PYPT_MAP_INT32(start, area->start_);
-	                        PYPT_MAP_INT32(end, area->end_);
-	                        PYPT_MAP_INT32(flags, area->flags);
-	                        PyList_SetItem(pyList, 0, dict);
-
-	                        while(area) {
-	                                area = pt_mmap_find_all_area_from_range_next();
-                                        if(area) {
-                                                dict = PyDict_New();
-                                                PYPT_MAP_INT32(start, area->start_);
-	                                        PYPT_MAP_INT32(end, area->end_);
-	                                        PYPT_MAP_INT32(flags, area->flags);
-	                                        PyList_Append(pyList, dict);
-	                                }
-	                        }
-	                        return pyList;
-	                }
-                }
-        }
+	if (count == -1)
+		return PyErr_NoMemory();
 
-        if(!area) {
-                if(end)
-                        PyOS_snprintf( buffer, sizeof(buffer), "Range [0x%.8lx,0x%.8lx] not found.", start, end);
-                else
-                        PyOS_snprintf( buffer, sizeof(buffer), "Address 0x%.8lx was not found in any range.", start);
-                PyErr_SetString(PyExc_KeyError, buffer);
-                goto err;
-        }
+	if (count == 0) {
+		if (end)
+			PyOS_snprintf(buffer, sizeof(buffer), "Range [0x%.8lx,0x%.8lx] not found.", start, end);
+		else
+			PyOS_snprintf(buffer, sizeof(buffer), "Address 0x%.8lx was not found in any range.", start);
+		PyErr_SetString(PyExc_KeyError, buffer);
+		return NULL;
+	}
 
-err_integer:
-	Py_DECREF(integer);
-err_dict:
-	Py_DECREF(dict);
-err:
-        return NULL;
+	if ( (list = PyList_New(count)) == NULL)
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		dict = Py_BuildValue("{s:l,s:l,s:i}",
+		                     "start", (long)found[i].start,
+		                     "end", (long)found[i].end,
+		                     "flags", found[i].flags);
+		if (dict == NULL) {
+			Py_CLEAR(list);
+			break;
+		}
+		PyList_SET_ITEM(list, i, dict);
+	}
+
+out:
+	free(found);
+	return list;
 }
 
 static PyGetSetDef pypt_mmap_getset[] = {
@@ -43,15 +43,19 @@
 #include <python/Python.h>
 #include <python/structmember.h>
 #include <libptrace/error.h>
+#include <libptrace/scan.h>
+#include <libptrace/stats.h>
 #include "../src/windows/process.h"
 
 #include "compat.h"
 #include "breakpoint.h"
 #include "event.h"
+#include "fuzz.h"
 #include "module.h"
 #include "ptrace.h"
 #include "thread.h"
 #include "utils.h"
+#include "value_scan.h"
 
 _Static_assert(sizeof(unsigned long long) == sizeof(uint64_t), "T_ULONGLONG is not 64-bit");
 
@@ -216,6 +220,114 @@ pypt_process_breakpoint_unset(struct pypt_process *self, PyObject *args)
 	Py_RETURN_NONE;
 }
 
+/* Convert a sequence of breakpoint objects to an array of libptrace
+ * breakpoints.  Returns a new reference to the fast sequence, so that the
+ * caller can adjust the reference counts of the items.
+ */
+static PyObject *
+pypt_process_breakpoint_seq_(PyObject *object, struct pt_breakpoint ***bps_,
+                             Py_ssize_t *count_)
+{
+	struct pt_breakpoint **bps;
+	Py_ssize_t count, i;
+	PyObject *seq;
+
+	if ( (seq = PySequence_Fast(object, "arg must be a sequence")) == NULL)
+		return NULL;
+
+	count = PySequence_Fast_GET_SIZE(seq);
+
+	if ( (bps = PyMem_Malloc((count + 1) * sizeof *bps)) == NULL) {
+		Py_DECREF(seq);
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+
+		if (!PyObject_TypeCheck(item, &pypt_breakpoint_type)) {
+			PyErr_SetString(PyExc_TypeError,
+			                "sequence items must be _ptrace.breakpoint objects");
+			PyMem_Free(bps);
+			Py_DECREF(seq);
+			return NULL;
+		}
+
+		bps[i] = &((struct pypt_breakpoint *)item)->breakpoint;
+	}
+
+	*bps_   = bps;
+	*count_ = count;
+	return seq;
+}
+
+static PyObject *
+pypt_process_breakpoint_set_many(struct pypt_process *self, PyObject *args)
+{
+	struct pt_breakpoint **bps;
+	PyObject *object, *seq;
+	Py_ssize_t count, i;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "O:process.breakpoint_set_many", &object))
+		return NULL;
+
+	if ( (seq = pypt_process_breakpoint_seq_(object, &bps, &count)) == NULL)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_breakpoint_set_many(self->process, bps, count);
+	Py_END_ALLOW_THREADS
+
+	PyMem_Free(bps);
+
+	if (ret == -1) {
+		Py_DECREF(seq);
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++)
+		Py_INCREF(PySequence_Fast_GET_ITEM(seq, i));
+
+	Py_DECREF(seq);
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+pypt_process_breakpoint_unset_many(struct pypt_process *self, PyObject *args)
+{
+	struct pt_breakpoint **bps;
+	PyObject *object, *seq;
+	Py_ssize_t count, i;
+	int ret;
+
+	if (!PyArg_ParseTuple(args, "O:process.breakpoint_unset_many", &object))
+		return NULL;
+
+	if ( (seq = pypt_process_breakpoint_seq_(object, &bps, &count)) == NULL)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_breakpoint_remove_many(self->process, bps, count);
+	Py_END_ALLOW_THREADS
+
+	PyMem_Free(bps);
+
+	if (ret == -1) {
+		Py_DECREF(seq);
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++)
+		Py_DECREF(PySequence_Fast_GET_ITEM(seq, i));
+
+	Py_DECREF(seq);
+	Py_RETURN_NONE;
+}
+
 static PyObject *
 pypt_process_export_find(struct pypt_process *self, PyObject *args)
 {
@@ -234,33 +346,159 @@ pypt_process_export_find(struct pypt_process *self, PyObject *args)
 	return (void *)PyInt_FromSize_t((size_t)result);
 }
 
+/* Read process memory, hiding breakpoints unless 'raw' is set. */
+static ssize_t
+pypt_process_read_(struct pt_process *process, void *dst,
+                   pt_address_t src, size_t size, int raw)
+{
+	ssize_t ret;
+
+	Py_BEGIN_ALLOW_THREADS
+	if (raw)
+		ret = pt_process_read_raw(process, dst, src, size);
+	else
+		ret = pt_process_read(process, dst, src, size);
+	Py_END_ALLOW_THREADS
+
+	return ret;
+}
+
 static PyObject *
 pypt_process_read(struct pypt_process *self, PyObject *args)
 {
 	unsigned long long address;
 	PyObject *object;
 	Py_ssize_t size;
-	char *p;
+	ssize_t ret;
+	int raw = 0;
 
-	if (!PyArg_ParseTuple(args, "Kn:process_read", &address, &size))
+	if (!PyArg_ParseTuple(args, "Kn|i:process_read", &address, &size, &raw))
 		return NULL;
 
-	if ( (p = malloc(size)) == NULL) {
-		pt_error_errno_set(errno);
+	/* Read straight into the storage of the new bytes object. */
+	if ( (object = PyBytes_FromStringAndSize(NULL, size)) == NULL)
+		return NULL;
+
+	ret = pypt_process_read_(self->process, PyBytes_AS_STRING(object),
+	                         (pt_address_t)address, size, raw);
+	if (ret == -1) {
+		Py_DECREF(object);
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
 	}
 
-	if (pt_process_read(self->process, p, (pt_address_t)address, size) == -1) {
-		free(p);
+	return object;
+}
+
+static PyObject *
+pypt_process_read_into(struct pypt_process *self, PyObject *args)
+{
+	unsigned long long address;
+	PyObject *object;
+	Py_buffer view;
+	ssize_t ret;
+	int raw = 0;
+
+	if (!PyArg_ParseTuple(args, "KO|i:process_read_into", &address, &object, &raw))
+		return NULL;
+
+	if (PyObject_GetBuffer(object, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) == -1)
+		return NULL;
+
+	ret = pypt_process_read_(self->process, view.buf,
+	                         (pt_address_t)address, view.len, raw);
+	PyBuffer_Release(&view);
+
+	if (ret == -1) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
 	}
 
-	object = PyBytes_FromStringAndSize(p, size);
-	free(p);
+	return PyInt_FromSsize_t(ret);
+}
 
-	return object;
+/* Read a sequence of (address, size) ranges into a single bytearray, and
+ * return a list of memoryviews over it.  Ranges that cannot be read are
+ * returned as None.
+ */
+static PyObject *
+pypt_process_readv(struct pypt_process *self, PyObject *args)
+{
+	PyObject *object, *seq, *buffer, *view, *list = NULL;
+	unsigned long long *addresses;
+	Py_ssize_t *sizes;
+	Py_ssize_t count, i, total = 0, offset;
+	char *p;
+	int raw = 0;
+
+	if (!PyArg_ParseTuple(args, "O|i:process_readv", &object, &raw))
+		return NULL;
+
+	if ( (seq = PySequence_Fast(object, "expected a sequence of (address, size)")) == NULL)
+		return NULL;
+
+	count     = PySequence_Fast_GET_SIZE(seq);
+	addresses = PyMem_New(unsigned long long, count);
+	sizes     = PyMem_New(Py_ssize_t, count);
+	if (addresses == NULL || sizes == NULL) {
+		PyErr_NoMemory();
+		goto out_seq;
+	}
+
+	for (i = 0; i < count; i++) {
+		PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+
+		if (!PyArg_ParseTuple(item, "Kn:process_readv", &addresses[i], &sizes[i]))
+			goto out_seq;
+
+		if (sizes[i] < 0 || sizes[i] > PY_SSIZE_T_MAX - total) {
+			PyErr_SetString(PyExc_ValueError, "invalid range size");
+			goto out_seq;
+		}
+
+		total += sizes[i];
+	}
+
+	if ( (buffer = PyByteArray_FromStringAndSize(NULL, total)) == NULL)
+		goto out_seq;
+
+	if ( (view = PyMemoryView_FromObject(buffer)) == NULL)
+		goto out_buffer;
+
+	if ( (list = PyList_New(count)) == NULL)
+		goto out_view;
+
+	p = PyByteArray_AS_STRING(buffer);
+	for (i = 0, offset = 0; i < count; offset += sizes[i++]) {
+		PyObject *slice;
+		ssize_t ret;
+
+		ret = pypt_process_read_(self->process, p + offset,
+		                         (pt_address_t)addresses[i], sizes[i], raw);
+		if (ret == -1) {
+			Py_INCREF(Py_None);
+			PyList_SET_ITEM(list, i, Py_None);
+			continue;
+		}
+
+		slice = PySequence_GetSlice(view, offset, offset + sizes[i]);
+		if (slice == NULL) {
+			Py_CLEAR(list);
+			goto out_view;
+		}
+
+		PyList_SET_ITEM(list, i, slice);
+	}
+
+out_view:
+	Py_DECREF(view);
+out_buffer:
+	Py_DECREF(buffer);
+out_seq:
+	PyMem_Free(addresses);
+	PyMem_Free(sizes);
+	Py_DECREF(seq);
+	return list;
 }
 
 static PyObject *
@@ -273,7 +511,9 @@ pypt_process_read_utf8(struct pypt_process *self, PyObject *args)
 	if (!PyArg_ParseTuple(args, "K:process_read_utf8", &address))
 		return NULL;
 
+	Py_BEGIN_ALLOW_THREADS
 	p = pt_process_read_string(self->process, (pt_address_t)address);
+	Py_END_ALLOW_THREADS
 	if (p == NULL) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
@@ -295,7 +535,9 @@ pypt_process_read_utf16(struct pypt_process *self, PyObject *args)
 	if (!PyArg_ParseTuple(args, "K:process_read_utf16", &address))
 		return NULL;
 
+	Py_BEGIN_ALLOW_THREADS
 	p = pt_process_read_string_utf16(self->process, (pt_address_t)address);
+	Py_END_ALLOW_THREADS
 	if (p == NULL) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
@@ -350,7 +592,9 @@ pypt_process_mmap(struct pypt_process *self, PyObject *args)
 	if(!mmap)
 		goto err;
 
+	Py_BEGIN_ALLOW_THREADS
 	pt_mmap_load(self->process);
+	Py_END_ALLOW_THREADS
 
 	Py_INCREF(self);
 	mmap->mmap = &self->process->mmap;
@@ -364,6 +608,30 @@ err:
 	return NULL;
 }
 
+static PyObject *
+pypt_process_stats(struct pypt_process *self, PyObject *args)
+{
+	struct pt_stats *stats;
+	PyObject *result;
+
+	if (!PyArg_ParseTuple(args, ""))
+		return NULL;
+
+	if ( (stats = malloc(sizeof *stats)) == NULL)
+		return PyErr_NoMemory();
+
+	if (pt_process_stats_get(self->process, stats) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		free(stats);
+		return NULL;
+	}
+
+	result = pypt_stats_to_dict(stats);
+	free(stats);
+
+	return result;
+}
+
 static PyObject *
 pypt_process_option_set(struct pypt_process *self, PyObject *args)
 {
@@ -405,8 +673,10 @@ pypt_process_thread_create(struct pypt_process *self, PyObject *args)
 	if (ret == 0)
 		return NULL;
 
+	Py_BEGIN_ALLOW_THREADS
 	ret = pt_process_thread_create(self->process, (pt_address_t)handler,
 	                               (pt_address_t)cookie);
+	Py_END_ALLOW_THREADS
 	if (ret == -1) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
@@ -424,7 +694,9 @@ pypt_process_malloc(struct pypt_process *self, PyObject *args)
 	if (PyArg_ParseTuple(args, "n:process_malloc", &size) == 0)
 		return NULL;
 
+	Py_BEGIN_ALLOW_THREADS
 	ret = pt_process_malloc(self->process, (size_t)size);
+	Py_END_ALLOW_THREADS
 	if (ret == PT_ADDRESS_NULL) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
@@ -443,7 +715,9 @@ pypt_process_free(struct pypt_process *self, PyObject *args)
 	if (ret == 0)
 		return NULL;
 
+	Py_BEGIN_ALLOW_THREADS
 	ret = pt_process_free(self->process, (pt_address_t)address);
+	Py_END_ALLOW_THREADS
 	if (ret == -1) {
 		PyErr_SetString(pypt_exception, pt_error_strerror());
 		return NULL;
@@ -452,6 +726,217 @@ pypt_process_free(struct pypt_process *self, PyObject *args)
 	Py_RETURN_NONE;
 }
 
+/* Matches collected while the GIL is released. */
+struct pypt_process_scan_
+{
+	unsigned long long	*matches;
+	size_t			count;
+	size_t			capacity;
+	size_t			limit;
+	int			nomem;
+};
+
+static int
+pypt_process_scan_handler_(struct pt_process *process, pt_address_t address,
+                           void *cookie)
+{
+	struct pypt_process_scan_ *scan = cookie;
+	unsigned long long *matches;
+	size_t capacity;
+
+	if (scan->count == scan->capacity) {
+		capacity = scan->capacity == 0 ? 64 : scan->capacity * 2;
+		matches  = realloc(scan->matches, capacity * sizeof *matches);
+		if (matches == NULL) {
+			scan->nomem = 1;
+			return 1;
+		}
+
+		scan->matches  = matches;
+		scan->capacity = capacity;
+	}
+
+	scan->matches[scan->count++] = address;
+
+	return scan->limit != 0 && scan->count == scan->limit;
+}
+
+/* Scan for a bytes pattern with an optional mask of the same size, or
+ * for a signature string such as "48 8b ?? 05".
+ */
+static PyObject *
+pypt_process_scan(struct pypt_process *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "pattern", "mask", "prot", "limit", NULL };
+	struct pypt_process_scan_ scan = { NULL, 0, 0, 0, 0 };
+	PyObject *pattern, *mask = NULL, *list = NULL;
+	Py_buffer pattern_view, mask_view;
+	uint8_t *p = NULL, *m = NULL;
+	Py_ssize_t limit = 0, i;
+	ssize_t size, ret;
+	char *signature;
+	int prot = 0;
+
+	pattern_view.obj = NULL;
+	mask_view.obj    = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Oin:scan", kwlist,
+	                                 &pattern, &mask, &prot, &limit))
+		return NULL;
+
+	if (limit < 0) {
+		PyErr_SetString(PyExc_ValueError, "'limit' must not be negative");
+		return NULL;
+	}
+	scan.limit = limit;
+
+	if (PyUnicode_Check(pattern)) {
+		if ( (signature = py_string_to_utf8(pattern)) == NULL)
+			return NULL;
+
+		size = strlen(signature);
+		p = malloc(size + 1);
+		m = malloc(size + 1);
+		if (p == NULL || m == NULL) {
+			free(signature);
+			PyErr_NoMemory();
+			goto out;
+		}
+
+		size = pt_scan_pattern_parse(signature, p, m, size + 1);
+		free(signature);
+		if (size == -1) {
+			PyErr_SetString(PyExc_ValueError, "invalid signature");
+			goto out;
+		}
+	} else {
+		if (PyObject_GetBuffer(pattern, &pattern_view, PyBUF_SIMPLE) == -1)
+			return NULL;
+		p    = pattern_view.buf;
+		size = pattern_view.len;
+
+		if (mask != NULL && mask != Py_None) {
+			if (PyObject_GetBuffer(mask, &mask_view, PyBUF_SIMPLE) == -1)
+				goto out;
+
+			if (mask_view.len != size) {
+				PyErr_SetString(PyExc_ValueError, "mask and pattern sizes differ");
+				goto out;
+			}
+			m = mask_view.buf;
+		}
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_process_scan(self->process, p, m, size, prot,
+	                      pypt_process_scan_handler_, &scan);
+	Py_END_ALLOW_THREADS
+
+	if (scan.nomem) {
+		PyErr_NoMemory();
+		goto out;
+	}
+
+	if (ret == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		goto out;
+	}
+
+	if ( (list = PyList_New(scan.count)) == NULL)
+		goto out;
+
+	for (i = 0; i < (Py_ssize_t)scan.count; i++) {
+		PyObject *address;
+
+		if ( (address = PyLong_FromUnsignedLongLong(scan.matches[i])) == NULL) {
+			Py_CLEAR(list);
+			goto out;
+		}
+
+		PyList_SET_ITEM(list, i, address);
+	}
+
+out:
+	if (pattern_view.obj != NULL)
+		PyBuffer_Release(&pattern_view);
+	else
+		free(p);
+
+	if (mask_view.obj != NULL)
+		PyBuffer_Release(&mask_view);
+	else if (pattern_view.obj == NULL)
+		free(m);
+
+	free(scan.matches);
+	return list;
+}
+
+static PyObject *
+pypt_process_fuzz_loop(struct pypt_process *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "function", "input", "input_address",
+	                          "input_size", "size_register",
+	                          "input_register", "crash", "done", NULL };
+	unsigned long long function, input_address = 0;
+	struct pt_fuzz_target target;
+	PyObject *input, *crash = NULL, *done = NULL;
+	Py_ssize_t input_size = 4096;
+
+	target.size_register  = NULL;
+	target.input_register = NULL;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "KO|KnzzOO:fuzz_loop", kwlist,
+	                                 &function, &input, &input_address,
+	                                 &input_size, &target.size_register,
+	                                 &target.input_register, &crash, &done))
+		return NULL;
+
+	if (crash == Py_None)
+		crash = NULL;
+	if (done == Py_None)
+		done = NULL;
+
+	if (!PyCallable_Check(input) ||
+	    (crash != NULL && !PyCallable_Check(crash)) ||
+	    (done != NULL && !PyCallable_Check(done))) {
+		PyErr_SetString(PyExc_TypeError, "callbacks must be callable");
+		return NULL;
+	}
+
+	if (input_size <= 0) {
+		PyErr_SetString(PyExc_ValueError, "'input_size' must be positive");
+		return NULL;
+	}
+
+	target.function   = (pt_address_t)function;
+	target.input      = (pt_address_t)input_address;
+	target.input_size = (size_t)input_size;
+
+	return pypt_fuzz_loop(self, &target, input, crash, done);
+}
+
+/* Start an iterative value scan.  By default only writable memory is
+ * scanned, as that is where state we are looking for lives.
+ */
+static PyObject *
+pypt_process_value_scan(struct pypt_process *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "type", "align", "prot", NULL };
+	int type, prot = PT_SCAN_PROT_WRITE;
+	Py_ssize_t align = 0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|ni:value_scan", kwlist,
+	                                 &type, &align, &prot))
+		return NULL;
+
+	if (align < 0) {
+		PyErr_SetString(PyExc_ValueError, "'align' must not be negative");
+		return NULL;
+	}
+
+	return pypt_value_scan_new(self, type, (size_t)align, prot);
+}
+
 static PyObject *
 pypt_process_name_get(struct pypt_process *self, void *closure)
 {
@@ -471,14 +956,22 @@ static PyMethodDef pypt_process_methods[] = {
 	{ "breakpoint_find", (PyCFunction)pypt_process_breakpoint_find, METH_VARARGS, "Find a breakpoint." },
 	{ "breakpoint_set", (PyCFunction)pypt_process_breakpoint_set, METH_VARARGS, "Set a breakpoint." },
 	{ "breakpoint_unset", (PyCFunction)pypt_process_breakpoint_unset, METH_VARARGS, "Unset a breakpoint." },
+	{ "breakpoint_set_many", (PyCFunction)pypt_process_breakpoint_set_many, METH_VARARGS, "Set a list of breakpoints." },
+	{ "breakpoint_unset_many", (PyCFunction)pypt_process_breakpoint_unset_many, METH_VARARGS, "Unset a list of breakpoints." },
 	{ "export_find", (PyCFunction)pypt_process_export_find, METH_VARARGS, "Find an exported symbol." },
-	{ "read", (PyCFunction)pypt_process_read, METH_VARARGS, "Read process memory." },
+	{ "fuzz_loop", (PyCFunction)pypt_process_fuzz_loop, METH_VARARGS | METH_KEYWORDS, "Run a persistent-mode fuzzing loop on a function." },
+	{ "read", (PyCFunction)pypt_process_read, METH_VARARGS, "Read process memory, optionally including breakpoint opcodes." },
+	{ "read_into", (PyCFunction)pypt_process_read_into, METH_VARARGS, "Read process memory into a writable buffer." },
+	{ "readv", (PyCFunction)pypt_process_readv, METH_VARARGS, "Read a list of ranges into memoryviews over one buffer." },
+	{ "scan", (PyCFunction)pypt_process_scan, METH_VARARGS | METH_KEYWORDS, "Scan memory for a byte pattern or signature." },
 	{ "read_utf8", (PyCFunction)pypt_process_read_utf8, METH_VARARGS, "Read a UTF-8 string from process memory." },
 	{ "read_utf16", (PyCFunction)pypt_process_read_utf16, METH_VARARGS, "Read a UTF-16 string from process memory." },
+	{ "value_scan", (PyCFunction)pypt_process_value_scan, METH_VARARGS | METH_KEYWORDS, "Start an iterative scan for a value." },
 	{ "resume", (PyCFunction)pypt_process_resume, METH_VARARGS, "Resume all threads in the process." },
 	{ "suspend", (PyCFunction)pypt_process_suspend, METH_VARARGS, "Suspend all threads in the process." },
 	{ "mmap", (PyCFunction)pypt_process_mmap, METH_VARARGS, "Get the area list of the process." },
 	{ "option_set", (PyCFunction)pypt_process_option_set, METH_VARARGS, "Set process options." },
+	{ "stats", (PyCFunction)pypt_process_stats, METH_VARARGS, "Get event latency histograms." },
 	{ "thread_create", (PyCFunction)pypt_process_thread_create, METH_VARARGS, "Create a remote thread." },
 	{ "malloc", (PyCFunction)pypt_process_malloc, METH_VARARGS, "Allocate memory in process." },
 	{ "free", (PyCFunction)pypt_process_free, METH_VARARGS, "Free memory in process." },
@@ -45,18 +45,24 @@
 #include <libptrace/core.h>
 #include <libptrace/error.h>
 #include <libptrace/factory.h>
+#include <libptrace/scan.h>
 #include <libptrace/util.h>
+#include <libptrace/value_scan.h>
+#include "batch.h"
 #include "compat.h"
 #include "core.h"
 #include "event.h"
+#include "fuzz.h"
 #include "breakpoint.h"
 #include "breakpoint_sw.h"
 #include "cconv.h"
 #include "log.h"
 #include "module.h"
 #include "process.h"
+#include "registers.h"
 #include "thread.h"
 #include "inject.h"
+#include "value_scan.h"
 #include "../src/core.h"
 
 #define MODULE      _ptrace
@@ -72,6 +78,11 @@ static PyObject *pypt_process_detach_remote(PyObject *, PyObject *);
 static PyObject *pypt_process_break(PyObject *self, PyObject *args);
 static PyObject *pypt_process_break_remote(PyObject *self, PyObject *args);
 
+static PyObject *pypt_module_batch_start(PyObject *, PyObject *, PyObject *);
+static PyObject *pypt_module_batch_stop(PyObject *, PyObject *);
+static PyObject *pypt_dispatch_pending(PyObject *, PyObject *);
+static PyObject *pypt_event_notify_start(PyObject *, PyObject *);
+static PyObject *pypt_event_notify_stop(PyObject *, PyObject *);
 static PyObject *pypt_execv(PyObject *, PyObject *);
 static PyObject *pypt_log_hook_add(PyObject *, PyObject *);
 static PyObject *pypt_log_hook_del(PyObject *, PyObject *);
@@ -87,6 +98,11 @@ static PyMethodDef pypt_ptrace_module_methods[] = {
 	{ "process_break",         (PyCFunction)pypt_process_break, METH_VARARGS, "Break a running process." },
 	{ "process_break_remote",  (PyCFunction)pypt_process_break_remote, METH_VARARGS, "Break a running process from a different thread." },
 
+	{ "batch_start", (PyCFunction)pypt_module_batch_start, METH_VARARGS | METH_KEYWORDS, "Deliver breakpoint and exception events in batches." },
+	{ "batch_stop", pypt_module_batch_stop, METH_VARARGS, "Stop batched event delivery." },
+	{ "dispatch_pending", pypt_dispatch_pending, METH_VARARGS, "Handle pending events without blocking." },
+	{ "event_notify_start", pypt_event_notify_start, METH_VARARGS, "Write a byte to a socket when events are pending." },
+	{ "event_notify_stop", pypt_event_notify_stop, METH_VARARGS, "Stop event notification." },
 	{ "execv", pypt_execv, METH_VARARGS, "Execute a process." },
 	{ "log_hook_add", pypt_log_hook_add, METH_VARARGS, "Adds a logger hook." },
 	{ "log_hook_del", pypt_log_hook_del, METH_VARARGS, "Deletes a logger hook." },
@@ -120,6 +136,93 @@ static void add_constants(PyObject *m)
 	if ( (i = PyInt_FromLong(PT_CORE_OPTION_EVENT_SECOND_CHANCE)) != NULL)
 		PyModule_AddObject(m, "PROCESS_OPTION_EVENT_SECOND_CHANCE", i);
 
+	if ( (i = PyInt_FromLong(PT_CORE_OPTION_EVENT_RECORD)) != NULL)
+		PyModule_AddObject(m, "CORE_OPTION_EVENT_RECORD", i);
+
+	if ( (i = PyInt_FromLong(PT_CORE_OPTION_STATS)) != NULL)
+		PyModule_AddObject(m, "CORE_OPTION_STATS", i);
+
+	if ( (i = PyInt_FromLong(PYPT_BATCH_RESUME)) != NULL)
+		PyModule_AddObject(m, "BATCH_RESUME", i);
+
+	if ( (i = PyInt_FromLong(PYPT_BATCH_STOP)) != NULL)
+		PyModule_AddObject(m, "BATCH_STOP", i);
+
+	if ( (i = PyInt_FromLong(PT_SCAN_PROT_READ)) != NULL)
+		PyModule_AddObject(m, "SCAN_PROT_READ", i);
+
+	if ( (i = PyInt_FromLong(PT_SCAN_PROT_WRITE)) != NULL)
+		PyModule_AddObject(m, "SCAN_PROT_WRITE", i);
+
+	if ( (i = PyInt_FromLong(PT_SCAN_PROT_EXEC)) != NULL)
+		PyModule_AddObject(m, "SCAN_PROT_EXEC", i);
+
+	if ( (i = PyInt_FromLong(PT_FUZZ_STATE_ARMED)) != NULL)
+		PyModule_AddObject(m, "FUZZ_STATE_ARMED", i);
+
+	if ( (i = PyInt_FromLong(PT_FUZZ_STATE_RUNNING)) != NULL)
+		PyModule_AddObject(m, "FUZZ_STATE_RUNNING", i);
+
+	if ( (i = PyInt_FromLong(PT_FUZZ_STATE_DONE)) != NULL)
+		PyModule_AddObject(m, "FUZZ_STATE_DONE", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_INT8)) != NULL)
+		PyModule_AddObject(m, "VALUE_INT8", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_INT16)) != NULL)
+		PyModule_AddObject(m, "VALUE_INT16", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_INT32)) != NULL)
+		PyModule_AddObject(m, "VALUE_INT32", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_INT64)) != NULL)
+		PyModule_AddObject(m, "VALUE_INT64", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_UINT8)) != NULL)
+		PyModule_AddObject(m, "VALUE_UINT8", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_UINT16)) != NULL)
+		PyModule_AddObject(m, "VALUE_UINT16", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_UINT32)) != NULL)
+		PyModule_AddObject(m, "VALUE_UINT32", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_UINT64)) != NULL)
+		PyModule_AddObject(m, "VALUE_UINT64", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_FLOAT)) != NULL)
+		PyModule_AddObject(m, "VALUE_FLOAT", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_DOUBLE)) != NULL)
+		PyModule_AddObject(m, "VALUE_DOUBLE", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_ANY)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_ANY", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_EQUAL)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_EQUAL", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_NOT_EQUAL)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_NOT_EQUAL", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_GREATER)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_GREATER", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_LESS)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_LESS", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_UNCHANGED)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_UNCHANGED", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_CHANGED)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_CHANGED", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_INCREASED)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_INCREASED", i);
+
+	if ( (i = PyInt_FromLong(PT_VALUE_CMP_DECREASED)) != NULL)
+		PyModule_AddObject(m, "VALUE_CMP_DECREASED", i);
+
 	if ( (i = PyInt_FromLong(PT_FACTORY_CORE_WINDOWS)) != NULL)
 		PyModule_AddObject(m, "CORE_WINDOWS", i);
 }
@@ -155,6 +258,15 @@ PyMODINIT_FUNC MODULE_INIT_FUNC_NAME(MODULE)(void)
 	if (PyType_Ready(&pypt_thread_type) < 0)
 		MODULE_INIT_FUNC_RETURN(NULL);
 
+	if (PyType_Ready(&pypt_registers_type) < 0)
+		MODULE_INIT_FUNC_RETURN(NULL);
+
+	if (PyType_Ready(&pypt_fuzz_type) < 0)
+		MODULE_INIT_FUNC_RETURN(NULL);
+
+	if (PyType_Ready(&pypt_value_scan_type) < 0)
+		MODULE_INIT_FUNC_RETURN(NULL);
+
 	if (PyType_Ready(&pypt_cconv_type) < 0)
 		MODULE_INIT_FUNC_RETURN(NULL);
 
@@ -193,6 +305,12 @@ PyMODINIT_FUNC MODULE_INIT_FUNC_NAME(MODULE)(void)
 	PyModule_AddObject(m, "process", (PyObject *)&pypt_process_type);
 	Py_INCREF(&pypt_thread_type);
 	PyModule_AddObject(m, "thread", (PyObject *)&pypt_thread_type);
+	Py_INCREF(&pypt_registers_type);
+	PyModule_AddObject(m, "registers", (PyObject *)&pypt_registers_type);
+	Py_INCREF(&pypt_fuzz_type);
+	PyModule_AddObject(m, "fuzz", (PyObject *)&pypt_fuzz_type);
+	Py_INCREF(&pypt_value_scan_type);
+	PyModule_AddObject(m, "value_scan", (PyObject *)&pypt_value_scan_type);
 	Py_INCREF(&pypt_mmap_type);
 	PyModule_AddObject(m, "mmap", (PyObject *)&pypt_mmap_type);
 	Py_INCREF(&pypt_inject_type);
@@ -204,6 +322,7 @@ PyMODINIT_FUNC MODULE_INIT_FUNC_NAME(MODULE)(void)
 		MODULE_INIT_FUNC_RETURN(NULL);
 
 	pypt_core_main_->core = &pt_core_main_;
+	pt_core_main_.super_  = pypt_core_main_;
 	MODULE_INIT_FUNC_RETURN(m);
 }
 
@@ -257,6 +376,31 @@ static PyObject *pypt_main(PyObject *self, PyObject *args)
 	return pypt_core_main(pypt_core_main_, args);
 }
 
+static PyObject *pypt_module_batch_start(PyObject *self, PyObject *args, PyObject *kwds)
+{
+	return pypt_core_batch_start(pypt_core_main_, args, kwds);
+}
+
+static PyObject *pypt_module_batch_stop(PyObject *self, PyObject *args)
+{
+	return pypt_core_batch_stop(pypt_core_main_, args);
+}
+
+static PyObject *pypt_dispatch_pending(PyObject *self, PyObject *args)
+{
+	return pypt_core_dispatch_pending(pypt_core_main_, args);
+}
+
+static PyObject *pypt_event_notify_start(PyObject *self, PyObject *args)
+{
+	return pypt_core_event_notify_start(pypt_core_main_, args);
+}
+
+static PyObject *pypt_event_notify_stop(PyObject *self, PyObject *args)
+{
+	return pypt_core_event_notify_stop(pypt_core_main_, args);
+}
+
 static PyObject *pypt_quit(PyObject *self, PyObject *args)
 {
 	return pypt_core_quit(pypt_core_main_, args);
@@ -0,0 +1,636 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * registers.c
+ *
+ * Python register snapshot objects.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <python/Python.h>
+#include <libptrace/error.h>
+#include "compat.h"
+#include "ptrace.h"
+#include "registers.h"
+#include "thread.h"
+
+#define PYPT_REG(t, r) \
+	{ #r, offsetof(struct t, r), sizeof(((struct t *)0)->r) }
+
+static const struct pypt_register_desc pypt_registers_i386_[] = {
+	PYPT_REG(pt_registers_i386, eax),
+	PYPT_REG(pt_registers_i386, ebx),
+	PYPT_REG(pt_registers_i386, ecx),
+	PYPT_REG(pt_registers_i386, edx),
+	PYPT_REG(pt_registers_i386, esi),
+	PYPT_REG(pt_registers_i386, edi),
+	PYPT_REG(pt_registers_i386, esp),
+	PYPT_REG(pt_registers_i386, ebp),
+	PYPT_REG(pt_registers_i386, eip),
+	PYPT_REG(pt_registers_i386, cs),
+	PYPT_REG(pt_registers_i386, ds),
+	PYPT_REG(pt_registers_i386, es),
+	PYPT_REG(pt_registers_i386, fs),
+	PYPT_REG(pt_registers_i386, gs),
+	PYPT_REG(pt_registers_i386, ss),
+	PYPT_REG(pt_registers_i386, eflags),
+	PYPT_REG(pt_registers_i386, dr0),
+	PYPT_REG(pt_registers_i386, dr1),
+	PYPT_REG(pt_registers_i386, dr2),
+	PYPT_REG(pt_registers_i386, dr3),
+	PYPT_REG(pt_registers_i386, dr6),
+	PYPT_REG(pt_registers_i386, dr7),
+	{ NULL }
+};
+
+static const struct pypt_register_desc pypt_registers_x86_64_[] = {
+	PYPT_REG(pt_registers_x86_64, rax),
+	PYPT_REG(pt_registers_x86_64, rbx),
+	PYPT_REG(pt_registers_x86_64, rcx),
+	PYPT_REG(pt_registers_x86_64, rdx),
+	PYPT_REG(pt_registers_x86_64, r8),
+	PYPT_REG(pt_registers_x86_64, r9),
+	PYPT_REG(pt_registers_x86_64, r10),
+	PYPT_REG(pt_registers_x86_64, r11),
+	PYPT_REG(pt_registers_x86_64, r12),
+	PYPT_REG(pt_registers_x86_64, r13),
+	PYPT_REG(pt_registers_x86_64, r14),
+	PYPT_REG(pt_registers_x86_64, r15),
+	PYPT_REG(pt_registers_x86_64, rsi),
+	PYPT_REG(pt_registers_x86_64, rdi),
+	PYPT_REG(pt_registers_x86_64, rsp),
+	PYPT_REG(pt_registers_x86_64, rbp),
+	PYPT_REG(pt_registers_x86_64, rip),
+	PYPT_REG(pt_registers_x86_64, cs),
+	PYPT_REG(pt_registers_x86_64, ds),
+	PYPT_REG(pt_registers_x86_64, es),
+	PYPT_REG(pt_registers_x86_64, fs),
+	PYPT_REG(pt_registers_x86_64, gs),
+	PYPT_REG(pt_registers_x86_64, ss),
+	PYPT_REG(pt_registers_x86_64, rflags),
+	PYPT_REG(pt_registers_x86_64, dr0),
+	PYPT_REG(pt_registers_x86_64, dr1),
+	PYPT_REG(pt_registers_x86_64, dr2),
+	PYPT_REG(pt_registers_x86_64, dr3),
+	PYPT_REG(pt_registers_x86_64, dr6),
+	PYPT_REG(pt_registers_x86_64, dr7),
+	{ NULL }
+};
+
+/* Get the register description for layout 'type', along with the size of
+ * its struct and the offset of the first register in it.
+ */
+static const struct pypt_register_desc *
+pypt_registers_layout_(int type, size_t *size, size_t *offset)
+{
+	switch (type) {
+	case PT_REGISTERS_I386:
+		*size   = sizeof(struct pt_registers_i386);
+		*offset = offsetof(struct pt_registers_i386, eax);
+		return pypt_registers_i386_;
+	case PT_REGISTERS_X86_64:
+		*size   = sizeof(struct pt_registers_x86_64);
+		*offset = offsetof(struct pt_registers_x86_64, rax);
+		return pypt_registers_x86_64_;
+	}
+
+	return NULL;
+}
+
+/* Get the register description for 'name', or NULL if 'name' is not a
+ * register.  Does not raise an exception.
+ */
+static const struct pypt_register_desc *
+pypt_registers_find_(struct pypt_registers *self, PyObject *name)
+{
+	const struct pypt_register_desc *d;
+	const char *s = NULL;
+
+#if PY_MAJOR_VERSION >= 3
+	if (PyUnicode_Check(name))
+		s = PyUnicode_AsUTF8(name);
+#else
+	if (PyString_Check(name))
+		s = PyString_AS_STRING(name);
+#endif
+	if (s == NULL) {
+		PyErr_Clear();
+		return NULL;
+	}
+
+	for (d = self->desc; d->name != NULL; d++)
+		if (strcmp(d->name, s) == 0)
+			return d;
+
+	return NULL;
+}
+
+static PyObject *
+pypt_registers_value_get_(struct pypt_registers *self,
+                          const struct pypt_register_desc *d)
+{
+	const unsigned char *p = (const unsigned char *)self->regs + d->offset;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	switch (d->size) {
+	case 2:
+		memcpy(&v16, p, 2);
+		return PyLong_FromUnsignedLong(v16);
+	case 4:
+		memcpy(&v32, p, 4);
+		return PyLong_FromUnsignedLong(v32);
+	default:
+		memcpy(&v64, p, 8);
+		return PyLong_FromUnsignedLongLong(v64);
+	}
+}
+
+static int
+pypt_registers_value_set_(struct pypt_registers *self,
+                          const struct pypt_register_desc *d,
+                          PyObject *value)
+{
+	unsigned char *p = (unsigned char *)self->regs + d->offset;
+	unsigned long long v;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	if (value == NULL) {
+		PyErr_SetString(PyExc_TypeError, "registers cannot be deleted");
+		return -1;
+	}
+
+	if (!py_num_check(value)) {
+		PyErr_SetString(PyExc_TypeError, "register value must be an integer");
+		return -1;
+	}
+
+	v = py_num_to_ulonglong(value);
+	if (v == (unsigned long long)-1 && PyErr_Occurred())
+		return -1;
+
+	if (d->size < 8 && (v >> (d->size * 8)) != 0) {
+		PyErr_Format(PyExc_OverflowError, "value too large for %s", d->name);
+		return -1;
+	}
+
+	switch (d->size) {
+	case 2:
+		v16 = (uint16_t)v;
+		memcpy(p, &v16, 2);
+		break;
+	case 4:
+		v32 = (uint32_t)v;
+		memcpy(p, &v32, 4);
+		break;
+	default:
+		v64 = (uint64_t)v;
+		memcpy(p, &v64, 8);
+		break;
+	}
+
+	return 0;
+}
+
+/* Wrap 'regs' in a python registers object, which takes ownership of the
+ * allocation.  'regs' is released on failure.
+ */
+PyObject *
+pypt_registers_new_from(struct pypt_thread *thread, struct pt_registers *regs)
+{
+	const struct pypt_register_desc *desc;
+	struct pypt_registers *self;
+	size_t size, offset;
+
+	if ( (desc = pypt_registers_layout_(regs->type, &size, &offset)) == NULL) {
+		PyErr_SetString(pypt_exception, "unsupported register layout");
+		free(regs);
+		return NULL;
+	}
+
+	self = PyObject_New(struct pypt_registers, &pypt_registers_type);
+	if (self == NULL) {
+		free(regs);
+		return NULL;
+	}
+
+	Py_XINCREF(thread);
+	self->thread = thread;
+	self->desc   = desc;
+	self->size   = size;
+	self->offset = offset;
+	self->regs   = regs;
+
+	return (PyObject *)self;
+}
+
+/* Build a detached register set from the raw bytes of a previous one.
+ * The layouts differ in size, so the size tells us which one it is.
+ */
+static PyObject *
+pypt_registers_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+	static const int layouts[] = { PT_REGISTERS_I386, PT_REGISTERS_X86_64 };
+	struct pt_registers *regs;
+	size_t size, offset;
+	Py_buffer view;
+	size_t i;
+
+#if PY_MAJOR_VERSION >= 3
+	if (!PyArg_ParseTuple(args, "y*:registers", &view))
+#else
+	if (!PyArg_ParseTuple(args, "s*:registers", &view))
+#endif
+		return NULL;
+
+	for (i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+		pypt_registers_layout_(layouts[i], &size, &offset);
+		if ((size_t)view.len == size - offset)
+			break;
+	}
+
+	if (i == sizeof(layouts) / sizeof(layouts[0])) {
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError, "invalid register data");
+		return NULL;
+	}
+
+	if ( (regs = calloc(1, size)) == NULL) {
+		PyBuffer_Release(&view);
+		return PyErr_NoMemory();
+	}
+
+	regs->type = layouts[i];
+	memcpy((uint8_t *)regs + offset, view.buf, size - offset);
+	PyBuffer_Release(&view);
+
+	return pypt_registers_new_from(NULL, regs);
+}
+
+static void
+pypt_registers_dealloc(struct pypt_registers *self)
+{
+	Py_XDECREF(self->thread);
+	free(self->regs);
+	PyObject_Del(self);
+}
+
+static PyObject *
+pypt_registers_getattro(struct pypt_registers *self, PyObject *name)
+{
+	const struct pypt_register_desc *d;
+
+	if ( (d = pypt_registers_find_(self, name)) != NULL)
+		return pypt_registers_value_get_(self, d);
+
+	return PyObject_GenericGetAttr((PyObject *)self, name);
+}
+
+static int
+pypt_registers_setattro(struct pypt_registers *self, PyObject *name,
+                        PyObject *value)
+{
+	const struct pypt_register_desc *d;
+
+	if ( (d = pypt_registers_find_(self, name)) != NULL)
+		return pypt_registers_value_set_(self, d, value);
+
+	return PyObject_GenericSetAttr((PyObject *)self, name, value);
+}
+
+static Py_ssize_t
+pypt_registers_length(struct pypt_registers *self)
+{
+	const struct pypt_register_desc *d;
+
+	for (d = self->desc; d->name != NULL; d++)
+		;
+
+	return d - self->desc;
+}
+
+static PyObject *
+pypt_registers_subscript(struct pypt_registers *self, PyObject *key)
+{
+	const struct pypt_register_desc *d;
+
+	if ( (d = pypt_registers_find_(self, key)) == NULL) {
+		PyErr_SetObject(PyExc_KeyError, key);
+		return NULL;
+	}
+
+	return pypt_registers_value_get_(self, d);
+}
+
+static int
+pypt_registers_ass_subscript(struct pypt_registers *self, PyObject *key,
+                             PyObject *value)
+{
+	const struct pypt_register_desc *d;
+
+	if ( (d = pypt_registers_find_(self, key)) == NULL) {
+		PyErr_SetObject(PyExc_KeyError, key);
+		return -1;
+	}
+
+	return pypt_registers_value_set_(self, d, value);
+}
+
+static PyObject *
+pypt_registers_keys(struct pypt_registers *self, PyObject *unused)
+{
+	const struct pypt_register_desc *d;
+	PyObject *list, *name;
+
+	if ( (list = PyList_New(0)) == NULL)
+		return NULL;
+
+	for (d = self->desc; d->name != NULL; d++) {
+		if ( (name = PyString_FromString(d->name)) == NULL)
+			goto err_list;
+
+		if (PyList_Append(list, name) == -1)
+			goto err_name;
+
+		Py_DECREF(name);
+	}
+
+	return list;
+
+err_name:
+	Py_DECREF(name);
+err_list:
+	Py_DECREF(list);
+	return NULL;
+}
+
+static PyObject *
+pypt_registers_items(struct pypt_registers *self, PyObject *unused)
+{
+	const struct pypt_register_desc *d;
+	PyObject *list, *item;
+
+	if ( (list = PyList_New(0)) == NULL)
+		return NULL;
+
+	for (d = self->desc; d->name != NULL; d++) {
+		item = Py_BuildValue("(sN)", d->name,
+		                     pypt_registers_value_get_(self, d));
+		if (item == NULL)
+			goto err_list;
+
+		if (PyList_Append(list, item) == -1)
+			goto err_item;
+
+		Py_DECREF(item);
+	}
+
+	return list;
+
+err_item:
+	Py_DECREF(item);
+err_list:
+	Py_DECREF(list);
+	return NULL;
+}
+
+static PyObject *
+pypt_registers_iteritems(struct pypt_registers *self, PyObject *unused)
+{
+	PyObject *items, *iter;
+
+	if ( (items = pypt_registers_items(self, NULL)) == NULL)
+		return NULL;
+
+	iter = PyObject_GetIter(items);
+	Py_DECREF(items);
+
+	return iter;
+}
+
+static PyObject *
+pypt_registers_iter(struct pypt_registers *self)
+{
+	PyObject *keys, *iter;
+
+	if ( (keys = pypt_registers_keys(self, NULL)) == NULL)
+		return NULL;
+
+	iter = PyObject_GetIter(keys);
+	Py_DECREF(keys);
+
+	return iter;
+}
+
+static PyObject *
+pypt_registers_to_dict(struct pypt_registers *self, PyObject *unused)
+{
+	const struct pypt_register_desc *d;
+	PyObject *dict, *value;
+
+	if ( (dict = PyDict_New()) == NULL)
+		return NULL;
+
+	for (d = self->desc; d->name != NULL; d++) {
+		if ( (value = pypt_registers_value_get_(self, d)) == NULL)
+			goto err_dict;
+
+		if (PyDict_SetItemString(dict, d->name, value) == -1)
+			goto err_value;
+
+		Py_DECREF(value);
+	}
+
+	return dict;
+
+err_value:
+	Py_DECREF(value);
+err_dict:
+	Py_DECREF(dict);
+	return NULL;
+}
+
+/* Write all registers to the thread they were taken from, or to the
+ * given thread, in a single context write.
+ */
+static PyObject *
+pypt_registers_apply_(struct pypt_registers *self, struct pypt_thread *thread)
+{
+	int ret;
+
+	if (thread == NULL) {
+		PyErr_SetString(pypt_exception, "registers are not bound to a thread");
+		return NULL;
+	}
+
+	ret = pt_thread_registers_set(thread->thread, self->regs);
+	if (ret == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+pypt_registers_apply(struct pypt_registers *self, PyObject *args)
+{
+	struct pypt_thread *thread = self->thread;
+
+	if (!PyArg_ParseTuple(args, "|O!:apply", &pypt_thread_type, &thread))
+		return NULL;
+
+	return pypt_registers_apply_(self, thread);
+}
+
+/* Set several registers from a mapping and apply them at once. */
+static PyObject *
+pypt_registers_update(struct pypt_registers *self, PyObject *args)
+{
+	PyObject *mapping, *items, *item;
+	Py_ssize_t i, n;
+
+	if (!PyArg_ParseTuple(args, "O:update", &mapping))
+		return NULL;
+
+	if ( (items = PyMapping_Items(mapping)) == NULL)
+		return NULL;
+
+	n = PyList_GET_SIZE(items);
+	for (i = 0; i < n; i++) {
+		item = PyList_GET_ITEM(items, i);
+
+		if (pypt_registers_ass_subscript(self, PyTuple_GET_ITEM(item, 0),
+		                                 PyTuple_GET_ITEM(item, 1)) == -1) {
+			Py_DECREF(items);
+			return NULL;
+		}
+	}
+
+	Py_DECREF(items);
+
+	if (self->thread == NULL)
+		Py_RETURN_NONE;
+
+	return pypt_registers_apply_(self, self->thread);
+}
+
+/* Export the registers, but not the layout type in front of them, which
+ * must not be changed through the buffer.
+ */
+static int
+pypt_registers_getbuffer(struct pypt_registers *self, Py_buffer *view, int flags)
+{
+	return PyBuffer_FillInfo(view, (PyObject *)self,
+	                         (uint8_t *)self->regs + self->offset,
+	                         self->size - self->offset, 0, flags);
+}
+
+static PyObject *pypt_registers__repr__(struct pypt_registers *self)
+{
+	return PyString_FromFormat("<%s(%p) %s pc:0x%llx>",
+	                           Py_TYPE(self)->tp_name, self,
+	                           self->regs->type == PT_REGISTERS_I386 ?
+	                           "i386" : "x86_64",
+	                           (unsigned long long)pt_registers_pc_get(self->regs));
+}
+
+static PyMappingMethods pypt_registers_as_mapping = {
+	(lenfunc)pypt_registers_length,			/* mp_length */
+	(binaryfunc)pypt_registers_subscript,		/* mp_subscript */
+	(objobjargproc)pypt_registers_ass_subscript,	/* mp_ass_subscript */
+};
+
+static PyBufferProcs pypt_registers_as_buffer = {
+	.bf_getbuffer = (getbufferproc)pypt_registers_getbuffer,
+};
+
+static PyMethodDef pypt_registers_methods[] = {
+	{ "keys", (PyCFunction)pypt_registers_keys, METH_NOARGS, "Get the register names." },
+	{ "items", (PyCFunction)pypt_registers_items, METH_NOARGS, "Get (name, value) pairs." },
+	{ "iteritems", (PyCFunction)pypt_registers_iteritems, METH_NOARGS, "Iterate over (name, value) pairs." },
+	{ "to_dict", (PyCFunction)pypt_registers_to_dict, METH_NOARGS, "Get the registers as a dictionary." },
+	{ "apply", (PyCFunction)pypt_registers_apply, METH_VARARGS, "Write the registers to a thread." },
+	{ "update", (PyCFunction)pypt_registers_update, METH_VARARGS, "Set several registers and apply them." },
+	{ NULL }
+};
+
+PyTypeObject pypt_registers_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"_ptrace.registers",			/* tp_name */
+	sizeof(struct pypt_registers),		/* tp_basicsize */
+	0,					/* tp_itemsize */
+	(destructor)pypt_registers_dealloc,	/* tp_dealloc */
+	0,					/* tp_print */
+	0,					/* tp_getattr */
+	0,					/* tp_setattr */
+	0,					/* tp_compare */
+	(reprfunc)pypt_registers__repr__,	/* tp_repr */
+	0,					/* tp_as_number */
+	0,					/* tp_as_sequence */
+	&pypt_registers_as_mapping,		/* tp_as_mapping */
+	0,					/* tp_hash */
+	0,					/* tp_call */
+	0,					/* tp_str */
+	(getattrofunc)pypt_registers_getattro,	/* tp_getattro */
+	(setattrofunc)pypt_registers_setattro,	/* tp_setattro */
+	&pypt_registers_as_buffer,		/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT	|		/* tp_flags */
+	Py_TPFLAGS_HAVE_NEWBUFFER,
+	"Register set object",			/* tp_doc */
+	0,					/* tp_traverse */
+	0,					/* tp_clear */
+	0,					/* tp_richcompare */
+	0,					/* tp_weaklistoffset */
+	(getiterfunc)pypt_registers_iter,	/* tp_iter */
+	0,					/* tp_iternext */
+	pypt_registers_methods,			/* tp_methods */
+	0,					/* tp_members */
+	0,					/* tp_getset */
+	0,					/* tp_base */
+	0,					/* tp_dict */
+	0,					/* tp_descr_get */
+	0,					/* tp_descr_set */
+	0,					/* tp_dictoffset */
+	0,					/* tp_init */
+	0,					/* tp_alloc */
+	pypt_registers_new,			/* tp_new */
+};
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * registers.h
+ *
+ * Python register snapshot objects.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PYPT_REGISTERS_INTERNAL_H
+#define PYPT_REGISTERS_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <python/Python.h>
+#include "../src/registers.h"
+#include "thread.h"
+
+struct pypt_register_desc
+{
+	const char	*name;
+	uint16_t	offset;
+	uint8_t		size;
+};
+
+/* A register set backed by a raw struct pt_registers.  Attribute access
+ * reads and writes the raw struct directly.  Writes are only made visible
+ * to the thread by apply(), so several registers can be changed at the
+ * cost of a single context write.
+ */
+struct pypt_registers
+{
+	PyObject_HEAD;
+
+	/* thread the registers were taken from, or NULL. */
+	struct pypt_thread		*thread;
+	/* register layout for regs->type. */
+	const struct pypt_register_desc	*desc;
+	size_t				size;
+	/* start of the registers in 'regs', past the layout type. */
+	size_t				offset;
+	struct pt_registers		*regs;
+};
+
+extern PyTypeObject pypt_registers_type;
+
+PyObject *pypt_registers_new_from(struct pypt_thread *, struct pt_registers *);
+
+#endif	/* !PYPT_REGISTERS_INTERNAL_H */
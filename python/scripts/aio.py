@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+# version 2.1 for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# version 2.1 along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+# USA.
+#
+# THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+# AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+# DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+# OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+# WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+# EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+# THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+# CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+# EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+# OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+# PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+# REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+# UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+# BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+#
+# aio.py
+#
+# Service libptrace events from an asyncio event loop.
+#
+# Dedicated to Yuzuyu Arielle Huizer.
+#
+# Author: Ronald Huizer <ronald@immunityinc.com>
+#
+import sys
+import socket
+import asyncio
+import argparse
+import _ptrace
+
+class EventReader(object):
+    """Dispatch events of a libptrace core from an asyncio loop.
+
+    Windows debug objects cannot be polled by a selector, so the core
+    writes a byte to a socket pair whenever events are pending, and the
+    reading end is registered with loop.add_reader().  The loop needs to
+    support add_reader(); on Windows this is the SelectorEventLoop.
+    """
+    def __init__(self, core=_ptrace, loop=None, max_events=256):
+        self.core       = core
+        self.loop       = loop or asyncio.get_event_loop()
+        self.max_events = max_events
+
+        self.rsock, self.wsock = socket.socketpair()
+        self.rsock.setblocking(False)
+
+        self.core.event_notify_start(self.wsock.fileno())
+        self.loop.add_reader(self.rsock.fileno(), self._ready)
+
+    def _ready(self):
+        try:
+            self.rsock.recv(4096)
+        except (BlockingIOError, InterruptedError):
+            pass
+
+        self.core.dispatch_pending(self.max_events)
+
+    def close(self):
+        self.loop.remove_reader(self.rsock.fileno())
+        self.core.event_notify_stop()
+        self.rsock.close()
+        self.wsock.close()
+
+def main():
+    parser = argparse.ArgumentParser(description='asyncio event loop demonstration script.')
+    parser.add_argument('file', nargs='?', metavar='filename', help='executable.')
+    parser.add_argument('args', nargs='*', metavar='args', help='arguments.')
+    parser.add_argument('--pid', '-p', type=int)
+    args = parser.parse_args(sys.argv[1:])
+
+    if (not args.file and not args.pid) or (args.file and args.pid):
+        parser.print_help()
+        sys.exit(1)
+
+    loop = asyncio.SelectorEventLoop()
+    asyncio.set_event_loop(loop)
+
+    def module_load(process, module):
+        print("[{}] Module {} loaded at 0x{:08x}".format(process.id, module.name, module.base))
+
+    def process_exit(process):
+        print("[{}] exited".format(process.id))
+        loop.stop()
+
+    async def heartbeat():
+        while True:
+            print("loop is alive")
+            await asyncio.sleep(1.0)
+
+    handlers              = _ptrace.event_handlers()
+    handlers.module_load  = module_load
+    handlers.process_exit = process_exit
+
+    reader = EventReader(loop=loop)
+
+    if args.pid:
+        _ptrace.process_attach(args.pid, handlers, 0)
+
+    if args.file:
+        _ptrace.execv(args.file, args.args, handlers, 0)
+
+    task = loop.create_task(heartbeat())
+    loop.run_forever()
+    task.cancel()
+    reader.close()
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+# version 2.1 for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# version 2.1 along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+# USA.
+#
+# THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+# AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+# DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+# OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+# WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+# EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+# THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+# CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+# EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+# OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+# PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+# REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+# UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+# BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+#
+# batch.py
+#
+# Count breakpoint hits using batched event delivery.
+#
+# Dedicated to Yuzuyu Arielle Huizer.
+#
+# Author: Ronald Huizer <ronald@immunityinc.com>
+#
+from __future__ import print_function
+import sys
+import _ptrace
+import argparse
+import collections
+
+hits = collections.Counter()
+
+def batch(events):
+    for event, process, thread, address, chance, extra in events:
+        hits[(event, address)] += 1
+
+def hit(breakpoint, thread):
+    # Hits are delivered through batch() while batching is active.
+    pass
+
+def attached(process):
+    for symbol in args.symbols:
+        process.breakpoint_set(_ptrace.breakpoint_sw(symbol, hit))
+
+def process_exit(process):
+    for (event, address), count in hits.most_common():
+        print("{:<16} 0x{:08x} {}".format(event, address, count))
+
+parser = argparse.ArgumentParser(description='Batched breakpoint counter.')
+parser.add_argument('file', nargs='?', metavar='filename', help='executable.')
+parser.add_argument('args', nargs='*', metavar='args', help='arguments.')
+parser.add_argument('--pid', '-p', type=int)
+parser.add_argument('--symbol', '-b', dest='symbols', action='append', default=[])
+parser.add_argument('--capacity', '-c', type=int, default=0)
+parser.add_argument('--stop', '-s', action='store_true',
+                    help='deliver batches while the last thread is stopped.')
+args = parser.parse_args(sys.argv[1:])
+
+if (not args.file and not args.pid) or (args.file and args.pid):
+    parser.print_help()
+    sys.exit(1)
+
+policy = _ptrace.BATCH_STOP if args.stop else _ptrace.BATCH_RESUME
+_ptrace.batch_start(batch, args.capacity, policy)
+
+handlers              = _ptrace.event_handlers()
+handlers.attached     = attached
+handlers.process_exit = process_exit
+
+if args.pid:
+    _ptrace.process_attach(args.pid, handlers, 0)
+
+if args.file:
+    _ptrace.execv(args.file, args.args, handlers, 0)
+
+_ptrace.main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+# version 2.1 for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# version 2.1 along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+# USA.
+#
+# THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+# AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+# DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+# OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+# WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+# EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+# THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+# CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+# EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+# OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+# PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+# REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+# UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+# BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+#
+# crash_snapshot.py
+#
+# Dedicated to Yuzuyu Arielle Huizer.
+#
+# Author: Ronald Huizer <ronald@immunityinc.com>
+#
+from __future__ import print_function
+import binascii
+import sys
+import _ptrace
+import argparse
+
+def logger(cookie, string):
+    print(string, end='')
+
+def capture(process, thread, what):
+    regs, stack = thread.snapshot(args.stack)
+
+    print("[{}/{}] {} at 0x{:x}".format(process.id, thread.id, what,
+                                        regs.rip if 'rip' in regs.keys() else regs.eip))
+    for name, value in regs.items():
+        print("  {:>6}: 0x{:x}".format(name, value))
+
+    print("  stack ({} bytes):".format(len(stack)))
+    for i in range(0, len(stack), 16):
+        print("    {}".format(binascii.hexlify(stack[i:i + 16]).decode()))
+
+    if args.output:
+        with open(args.output, "ab") as f:
+            f.write(bytes(bytearray(regs)))
+            f.write(stack)
+
+def segfault(process, thread, address, fault_address):
+    capture(process, thread, "segmentation fault")
+
+def illegal_instruction(process, thread, chance=None):
+    capture(process, thread, "illegal instruction")
+
+def divide_by_zero(process, thread, chance=None):
+    capture(process, thread, "divide by zero")
+
+parser = argparse.ArgumentParser(description='Capture registers and stack on crashes.')
+parser.add_argument('file', nargs='?', metavar='filename', help='executable.')
+parser.add_argument('args', nargs='*', metavar='args', help='arguments.')
+parser.add_argument('--debug', '-d', action='store_true')
+parser.add_argument('--pid', '-p', type=int)
+parser.add_argument('--stack', '-s', type=int, default=256, help='stack bytes to capture.')
+parser.add_argument('--output', '-o', help='append raw snapshots to this file.')
+args = parser.parse_args(sys.argv[1:])
+
+if (not args.file and not args.pid) or (args.file and args.pid):
+    parser.print_help()
+    sys.exit(1)
+
+if args.debug:
+    _ptrace.log_hook_add(_ptrace.log_hook(logger))
+
+handlers                     = _ptrace.event_handlers()
+handlers.segfault            = segfault
+handlers.illegal_instruction = illegal_instruction
+handlers.divide_by_zero      = divide_by_zero
+
+if args.pid:
+    _ptrace.process_attach(args.pid, handlers)
+
+if args.file:
+    _ptrace.execv(args.file, args.args, handlers)
+
+_ptrace.main()
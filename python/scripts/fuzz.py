@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+# version 2.1 for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# version 2.1 along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+# USA.
+#
+# THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+# AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+# DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+# OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+# WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+# EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+# THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+# CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+# EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+# OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+# PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+# REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+# UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+# BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+#
+# fuzz.py
+#
+# Dedicated to Yuzuyu Arielle Huizer.
+#
+# Author: Ronald Huizer <ronald@immunityinc.com>
+#
+from __future__ import print_function
+import os
+import random
+import sys
+import _ptrace
+import argparse
+
+def mutate(data):
+    data = bytearray(data)
+    for _ in range(random.randint(1, 8)):
+        if data and random.random() < 0.8:
+            data[random.randrange(len(data))] = random.randrange(256)
+        else:
+            data.insert(random.randint(0, len(data)), random.randrange(256))
+    return bytes(data[:args.size])
+
+def report(fuzz):
+    stats = fuzz.stats()
+    print("{iterations} iterations, {crashes} crashes, {execs_per_sec} exec/s, "
+          "{pages_restored} pages restored".format(**stats))
+
+def fuzz_input(iteration, size):
+    if args.iterations and iteration >= args.iterations:
+        return None
+    if iteration and iteration % 10000 == 0:
+        report(loop)
+    return mutate(random.choice(corpus))
+
+def crash(fuzz, thread, crash):
+    if crash['hits'] != 1:
+        return
+
+    print("{type} at 0x{address:x}, iteration {iteration}".format(**crash))
+
+    if args.output:
+        name = "{}-{:x}".format(crash['type'], crash['address'])
+        with open(os.path.join(args.output, name), "wb") as f:
+            f.write(crash['input'])
+
+def done(fuzz):
+    report(fuzz)
+
+def attached(process):
+    global loop
+
+    try:
+        function = int(args.function, 0)
+    except ValueError:
+        function = process.export_find(args.function)
+
+    loop = process.fuzz_loop(function, fuzz_input, args.address, args.size,
+                             args.size_register, args.input_register,
+                             crash, done)
+
+parser = argparse.ArgumentParser(description='Persistent-mode function fuzzer.')
+parser.add_argument('file', nargs='?', metavar='filename', help='executable.')
+parser.add_argument('args', nargs='*', metavar='args', help='arguments.')
+parser.add_argument('--pid', '-p', type=int)
+parser.add_argument('--function', '-f', required=True,
+                    help='address or exported symbol of the function to fuzz.')
+parser.add_argument('--address', '-a', type=lambda x: int(x, 0), default=0,
+                    help='input buffer address; allocated if not given.')
+parser.add_argument('--size', '-s', type=int, default=4096, help='maximum input size.')
+parser.add_argument('--size-register', help='register receiving the input size.')
+parser.add_argument('--input-register', help='register receiving the input address.')
+parser.add_argument('--corpus', '-c', action='append', default=[],
+                    help='seed input file.')
+parser.add_argument('--iterations', '-n', type=int, default=0)
+parser.add_argument('--output', '-o', help='directory to store crashing inputs in.')
+args = parser.parse_args(sys.argv[1:])
+
+if (not args.file and not args.pid) or (args.file and args.pid):
+    parser.print_help()
+    sys.exit(1)
+
+corpus = []
+for name in args.corpus:
+    with open(name, "rb") as f:
+        corpus.append(f.read())
+if not corpus:
+    corpus.append(b"")
+
+loop = None
+
+handlers          = _ptrace.event_handlers()
+handlers.attached = attached
+
+if args.pid:
+    _ptrace.process_attach(args.pid, handlers)
+
+if args.file:
+    _ptrace.execv(args.file, args.args, handlers)
+
+_ptrace.main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+# version 2.1 for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# version 2.1 along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+# USA.
+#
+# THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+# AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+# DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+# OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+# WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+# EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+# THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+# CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+# EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+# OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+# PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+# REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+# UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+# BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+#
+# gil_stress.py
+#
+# Run a busy python thread next to the tracer, and check that it keeps
+# making progress while the event loop waits for debug events.
+#
+# Dedicated to Yuzuyu Arielle Huizer.
+#
+# Author: Ronald Huizer <ronald@immunityinc.com>
+#
+from __future__ import print_function
+import sys
+import time
+import _ptrace
+import argparse
+import threading
+
+class Busy(threading.Thread):
+    def __init__(self):
+        threading.Thread.__init__(self)
+        self.daemon     = True
+        self.iterations = 0
+
+    def run(self):
+        while True:
+            self.iterations += 1
+
+    def rate(self, function):
+        start_iterations, start_time = self.iterations, time.time()
+        function()
+        elapsed = time.time() - start_time
+        return (self.iterations - start_iterations) / max(elapsed, 1e-6), elapsed
+
+events = [0]
+
+def module_load(process, module):
+    # Bulk reads release the GIL as well.
+    events[0] += 1
+    for i in range(args.reads):
+        process.read(module.base, 4096)
+
+def single_step(process, thread):
+    events[0] += 1
+    thread.single_step_set(True)
+
+def attached(process):
+    events[0] += 1
+    if args.step:
+        for thread in process.threads:
+            thread.single_step_set(True)
+
+def trace():
+    if args.pid:
+        _ptrace.process_attach(args.pid, handlers, 0)
+    else:
+        _ptrace.execv(args.file, args.args, handlers, 0)
+    _ptrace.main()
+
+parser = argparse.ArgumentParser(description='GIL stress test.')
+parser.add_argument('file', nargs='?', metavar='filename', help='executable.')
+parser.add_argument('args', nargs='*', metavar='args', help='arguments.')
+parser.add_argument('--pid', '-p', type=int)
+parser.add_argument('--reads', '-r', type=int, default=100,
+                    help='pages to read for every loaded module.')
+parser.add_argument('--step', '-s', action='store_true',
+                    help='single step the main thread.')
+args = parser.parse_args(sys.argv[1:])
+
+if (not args.file and not args.pid) or (args.file and args.pid):
+    parser.print_help()
+    sys.exit(1)
+
+handlers             = _ptrace.event_handlers()
+handlers.attached    = attached
+handlers.module_load = module_load
+handlers.single_step = single_step
+
+busy = Busy()
+busy.start()
+
+# Calibrate against a blocking call that is known to release the GIL.
+baseline, _ = busy.rate(lambda: time.sleep(1.0))
+traced, elapsed = busy.rate(trace)
+
+print("busy thread: {:.0f} iterations/s idle, {:.0f} iterations/s "
+      "while tracing for {:.2f}s ({} events)"
+      .format(baseline, traced, elapsed, events[0]))
+
+# If the event loop holds the GIL while waiting, the busy thread starves.
+if traced < baseline / 10:
+    print("FAIL: busy thread starved while tracing")
+    sys.exit(1)
+
+print("OK")
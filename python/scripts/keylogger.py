@@ -67,7 +67,7 @@ def dispatch_message_hook(breakpoint, thread):
 
 def get_message(thread, lpmsg):
     # Read the MSG structure from process memory.
-    (hwnd, message, wparam, lparam) = thread.sscanf(lpmsg, "%p%p%p%p")
+    (hwnd, message, wparam, lparam) = thread.sscanf(lpmsg, "%p%u%p%p")
 
     mtype = message & 0xFFFF
     if mtype in (WM_CHAR, WM_DEADCHAR, WM_SYSCHAR, WM_SYSDEADCHAR, WM_IME_CHAR):
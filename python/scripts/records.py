@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License version 2.1 as
+# published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+# version 2.1 for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# version 2.1 along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+# USA.
+#
+# THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+# AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+# DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+# OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+# WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+# EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+# THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+# CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+# EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+# OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+# PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+# REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+# UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+# BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+# records.py
+#
+# Convert a libptrace binary event log to text or CSV.
+#
+# Dedicated to Yuzuyu Arielle Huizer.
+#
+# Author: Ronald Huizer <ronald@immunityinc.com>
+#
+from __future__ import print_function
+import sys
+import struct
+import argparse
+
+HEADER = struct.Struct('<IHHIIQQQ24x')
+RECORD = struct.Struct('<QIIHBBIQQ')
+MAGIC  = 0x43525450
+RING   = 1
+
+TYPES = {
+    1: 'process_create',
+    2: 'process_exit',
+    3: 'thread_create',
+    4: 'thread_exit',
+    5: 'module_load',
+    6: 'module_unload',
+    7: 'breakpoint',
+    8: 'single_step',
+    9: 'exception',
+}
+
+def records(data):
+    (magic, version, record_size, flags, _,
+     capacity, count, dropped) = HEADER.unpack_from(data, 0)
+
+    if magic != MAGIC or version != 1 or record_size != RECORD.size:
+        raise ValueError('not a libptrace record file')
+
+    if capacity == 0 or HEADER.size + capacity * RECORD.size > len(data):
+        raise ValueError('truncated record file')
+
+    start = count - capacity if count > capacity else 0
+    for i in range(start, count):
+        yield RECORD.unpack_from(data, HEADER.size + (i % capacity) * RECORD.size)
+
+    if dropped:
+        print('%d records dropped' % dropped, file=sys.stderr)
+
+parser = argparse.ArgumentParser(description='Convert a libptrace event log.')
+parser.add_argument('file', metavar='filename', help='event log to convert.')
+parser.add_argument('--csv', '-c', action='store_true', help='output CSV.')
+args = parser.parse_args(sys.argv[1:])
+
+with open(args.file, 'rb') as f:
+    data = f.read()
+
+if args.csv:
+    print('timestamp,pid,tid,type,chance,code,pc,info')
+
+base = None
+for (ts, pid, tid, type, chance, _, code, pc, info) in records(data):
+    if args.csv:
+        print('%d,%d,%d,%s,%d,%#x,%#x,%#x' %
+              (ts, pid, tid, TYPES.get(type, type), chance, code, pc, info))
+        continue
+
+    if base is None:
+        base = ts
+
+    print('%14.6f %6d %6d %-14s %#010x %#018x %#x%s' %
+          ((ts - base) / 1e9, pid, tid, TYPES.get(type, 'unknown'), code,
+           pc, info, ' (2nd chance)' if chance else ''))
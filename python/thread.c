@@ -41,14 +41,18 @@
  *
  */
 #include <stdint.h>
+#include <stdlib.h>
 #include <python/Python.h>
 #include <python/structmember.h>
 #include <libptrace/error.h>
+#include <libptrace/struct.h>
+#include "../src/mmap.h"
 #include "../src/registers.h"
 #include "../src/thread_x86.h"
 
 #include "compat.h"
 #include "ptrace.h"
+#include "registers.h"
 #include "thread.h"
 #include "utils.h"
 
@@ -96,112 +100,98 @@ pypt_thread_id_get(struct pypt_thread *self, void *closure)
 	return PyInt_FromLong(self->thread->tid);
 }
 
-#define PYPT_MAP_REG32(t, x)						\
-	do {								\
-		integer = PyLong_FromUnsignedLong(((t)pt_regs)->x);	\
-		if (integer == NULL)					\
-			goto err_regs;					\
-									\
-		if (PyDict_SetItemString(regs, #x, integer) == -1)	\
-			goto err_integer;				\
-									\
-		Py_DECREF(integer);					\
-	} while (0)
+static PyObject *
+pypt_thread_registers_get(struct pypt_thread *self, void *closure)
+{
+	struct pt_registers *pt_regs;
 
-#define PYPT_MAP_REG64(t, x)						\
-	do {								\
-		integer = PyLong_FromUnsignedLongLong(((t)pt_regs)->x);	\
-		if (integer == NULL)					\
-			goto err_regs;					\
-									\
-		if (PyDict_SetItemString(regs, #x, integer) == -1)	\
-			goto err_integer;				\
-									\
-		Py_DECREF(integer);					\
-	} while (0)
+	if ( (pt_regs = pt_thread_registers_get(self->thread)) == NULL) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	return pypt_registers_new_from(self, pt_regs);
+}
 
+static int
+pypt_thread_registers_set(struct pypt_thread *self, PyObject *value,
+                          void *closure)
+{
+	struct pypt_registers *regs = (struct pypt_registers *)value;
+
+	if (value == NULL || !PyObject_TypeCheck(value, &pypt_registers_type)) {
+		PyErr_SetString(PyExc_TypeError, "value must be a registers object");
+		return -1;
+	}
+
+	if (pt_thread_registers_set(self->thread, regs->regs) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Capture the registers and up to 'stack_size' bytes of stack in one
+ * call.  The stack is cut short at the first unreadable page.
+ */
 static PyObject *
-pypt_thread_registers_get(struct pypt_thread *self, void *closure)
+pypt_thread_snapshot(struct pypt_thread *self, PyObject *args)
 {
+	struct pt_process *process = self->thread->process;
+	Py_ssize_t stack_size = 0, done = 0, chunk;
 	struct pt_registers *pt_regs;
-	PyObject *integer;
-	PyObject *regs;
+	PyObject *regs, *stack;
+	pt_address_t sp;
+	char *buf;
 
-	if ( (pt_regs = pt_thread_registers_get(self->thread)) == NULL)
-		goto err;
+	if (!PyArg_ParseTuple(args, "|n:snapshot", &stack_size))
+		return NULL;
 
-	if ( (regs = PyDict_New()) == NULL)
-		goto err_pt_regs;
-
-	switch (pt_regs->type) {
-	case PT_REGISTERS_I386:
-		PYPT_MAP_REG32(struct pt_registers_i386 *, eax);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, ebx);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, ecx);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, edx);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, esi);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, edi);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, esp);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, ebp);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, eip);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, cs);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, ds);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, es);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, fs);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, gs);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, ss);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, eflags);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, dr0);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, dr1);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, dr2);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, dr3);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, dr6);
-		PYPT_MAP_REG32(struct pt_registers_i386 *, dr7);
-		break;
-	case PT_REGISTERS_X86_64:
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rax);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rbx);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rcx);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rdx);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r8);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r9);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r10);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r11);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r12);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r13);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r14);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, r15);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rsi);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rdi);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rsp);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rbp);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rip);
-		PYPT_MAP_REG32(struct pt_registers_x86_64 *, cs);
-		PYPT_MAP_REG32(struct pt_registers_x86_64 *, ds);
-		PYPT_MAP_REG32(struct pt_registers_x86_64 *, es);
-		PYPT_MAP_REG32(struct pt_registers_x86_64 *, fs);
-		PYPT_MAP_REG32(struct pt_registers_x86_64 *, gs);
-		PYPT_MAP_REG32(struct pt_registers_x86_64 *, ss);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, rflags);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, dr0);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, dr1);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, dr2);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, dr3);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, dr6);
-		PYPT_MAP_REG64(struct pt_registers_x86_64 *, dr7);
-		break;
+	if (stack_size < 0) {
+		PyErr_SetString(PyExc_ValueError, "stack_size must not be negative");
+		return NULL;
 	}
 
-	free(pt_regs);
-	return regs;
+	if ( (pt_regs = pt_thread_registers_get(self->thread)) == NULL) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	sp = pt_registers_sp_get(pt_regs);
+
+	if ( (regs = pypt_registers_new_from(self, pt_regs)) == NULL)
+		return NULL;
+
+	if ( (stack = PyBytes_FromStringAndSize(NULL, stack_size)) == NULL)
+		goto err_regs;
+
+	buf = PyBytes_AS_STRING(stack);
+
+	Py_BEGIN_ALLOW_THREADS
+	if (pt_process_read(process, buf, sp, stack_size) == stack_size) {
+		done = stack_size;
+	} else {
+		while (done < stack_size) {
+			chunk = PT_MMAP_PAGE_SIZE - ((sp + done) & ~PT_MMAP_PAGE_MASK);
+			if (chunk > stack_size - done)
+				chunk = stack_size - done;
+
+			if (pt_process_read(process, buf + done, sp + done, chunk) != chunk)
+				break;
+
+			done += chunk;
+		}
+	}
+	Py_END_ALLOW_THREADS
+
+	if (done != stack_size && _PyBytes_Resize(&stack, done) == -1)
+		goto err_regs;
+
+	return Py_BuildValue("(NN)", regs, stack);
 
-err_integer:
-	Py_DECREF(integer);
 err_regs:
 	Py_DECREF(regs);
-err_pt_regs:
-	free(pt_regs);
-err:
 	return NULL;
 }
 
@@ -392,109 +382,104 @@ pypt_thread_suspend(struct pypt_thread *self, PyObject *args)
 	Py_RETURN_NONE;
 }
 
-#define pypt_read_type_signed_(p, t, src_, type)				\
-	do {									\
-		pt_address_t src = (pt_address_t)(src_);			\
-		Py_ssize_t size = PyTuple_GET_SIZE((t));			\
-		PyObject *pyarg;						\
-		type arg;							\
-										\
-		if (pt_process_read((p), &arg, src, sizeof arg) == -1) {	\
-			PyErr_SetString(pypt_exception, pt_error_strerror());	\
-			Py_DECREF((t));						\
-			return NULL;						\
-		}								\
-										\
-		if (_PyTuple_Resize(&(t), size + 1) == -1)			\
-			return NULL;						\
-										\
-		if ( (pyarg = PyInt_FromSsize_t(arg)) == NULL) {		\
-			Py_DECREF((t));						\
-			return NULL;						\
-		}								\
-										\
-		if (PyTuple_SetItem((t), size, pyarg) == -1) {			\
-			Py_DECREF((t));						\
-			return NULL;						\
-		}								\
-										\
-		src_ += sizeof(arg);						\
-	} while (0)
+static PyObject *
+pypt_struct_element_(const struct pt_struct_layout *layout, int pointer_size,
+                     const uint8_t *buf, size_t field, size_t index)
+{
+	uint64_t value;
 
-#define pypt_read_type_unsigned_(p, t, src_, type)				\
-	do {									\
-		pt_address_t src = (pt_address_t)(src_);			\
-		Py_ssize_t size = PyTuple_GET_SIZE((t));			\
-		PyObject *pyarg;						\
-		type arg;							\
-										\
-		if (pt_process_read((p), &arg, src, sizeof arg) == -1) {	\
-			PyErr_SetString(pypt_exception, pt_error_strerror());	\
-			Py_DECREF((t));						\
-			return NULL;						\
-		}								\
-										\
-		if (_PyTuple_Resize(&(t), size + 1) == -1)			\
-			return NULL;						\
-										\
-		if ( (pyarg = PyInt_FromSize_t((size_t)arg)) == NULL) {		\
-			Py_DECREF((t));						\
-			return NULL;						\
-		}								\
-										\
-		if (PyTuple_SetItem((t), size, pyarg) == -1) {			\
-			Py_DECREF((t));						\
-			return NULL;						\
-		}								\
-										\
-		src_ += sizeof(arg);						\
-	} while (0)
+	value = pt_struct_element_get(layout, pointer_size, buf, field, index);
+
+	if (layout->fields[field].type == PT_STRUCT_FIELD_INT)
+		return PyLong_FromLongLong((long long)value);
+
+	return PyLong_FromUnsignedLongLong(value);
+}
 
+static PyObject *
+pypt_struct_field_(const struct pt_struct_layout *layout, int pointer_size,
+                   const uint8_t *buf, size_t field)
+{
+	const struct pt_struct_field *f = &layout->fields[field];
+	PyObject *tuple, *item;
+	size_t i;
+
+	if (f->type == PT_STRUCT_FIELD_BYTES)
+		return PyBytes_FromStringAndSize(
+			(const char *)buf + f->offset[PT_STRUCT_WIDTH(pointer_size)],
+			f->count);
+
+	if (f->count == 1)
+		return pypt_struct_element_(layout, pointer_size, buf, field, 0);
+
+	if ( (tuple = PyTuple_New(f->count)) == NULL)
+		return NULL;
+
+	for (i = 0; i < f->count; i++) {
+		item = pypt_struct_element_(layout, pointer_size, buf, field, i);
+		if (item == NULL) {
+			Py_DECREF(tuple);
+			return NULL;
+		}
+
+		PyTuple_SET_ITEM(tuple, i, item);
+	}
+
+	return tuple;
+}
+
+/* Read a structure in a single read, and return a tuple with a value per
+ * field.  Arrays are returned as tuples, and raw bytes as bytes.
+ */
 static PyObject *
 pypt_thread_sscanf(struct pypt_thread *self, PyObject *args)
 {
 	struct pt_process *process = self->process->process;
+	int pointer_size = self->thread->arch_data->pointer_size;
+	struct pt_struct_layout layout;
+	PyObject *ret = NULL, *item;
 	unsigned long long address;
-	PyObject *ret;
-	char *fmt, *p;
+	uint8_t *buf = NULL;
+	size_t i, n, size;
+	char *fmt;
 
 	if (!PyArg_ParseTuple(args, "Ks:thread_sscanf", &address, &fmt))
 		return NULL;
 
-        /* New tuple to return the arguments in. */
-        if ( (ret = PyTuple_New(0)) == NULL)
+	if (pt_struct_layout_init(&layout, fmt) == -1) {
+		PyErr_SetString(PyExc_ValueError, "invalid structure format");
 		return NULL;
+	}
+
+	size = layout.extent[PT_STRUCT_WIDTH(pointer_size)];
+	if ( (buf = malloc(size + 1)) == NULL)
+		return PyErr_NoMemory();
 
-	for (p = fmt; *p != '\0'; p++) {
-		/* XXX: support literals that have to match later. */
-		if (*p != '%')
+	if (pt_process_read(process, buf, (pt_address_t)address, size) == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		goto out;
+	}
+
+	for (i = n = 0; i < layout.field_count; i++)
+		n += !layout.fields[i].skip;
+
+	if ( (ret = PyTuple_New(n)) == NULL)
+		goto out;
+
+	for (i = n = 0; i < layout.field_count; i++) {
+		if (layout.fields[i].skip)
 			continue;
 
-		/* Ensure we do not overindex. */
-		if (*++p == '\0')
-			break;
-
-		switch (*p) {
-		case 'i':
-			pypt_read_type_signed_(process, ret, address, int);
-			break;
-		case 'u':
-			pypt_read_type_unsigned_(process, ret, address, unsigned int);
-			break;
-		case 'p':
-			/* XXX: kludge. */
-			if (self->thread->arch_data->pointer_size == 4)
-				pypt_read_type_unsigned_(process, ret, address, uint32_t);
-			else if (self->thread->arch_data->pointer_size == 8)
-				pypt_read_type_unsigned_(process, ret, address, uint64_t);
-			else
-				return NULL;
-			break;
-		default:
-			break;
+		if ( (item = pypt_struct_field_(&layout, pointer_size, buf, i)) == NULL) {
+			Py_CLEAR(ret);
+			goto out;
 		}
+
+		PyTuple_SET_ITEM(ret, n++, item);
 	}
 
+out:
+	free(buf);
 	return ret;
 }
 
@@ -514,7 +499,7 @@ static PyGetSetDef pypt_thread_getset[] = {
 	{"__dict__", (getter)pypt_dict_get, (setter)pypt_dict_set,
 	 "The __dict__ for this thread.", &pypt_thread_type},
 	{ "id", (getter)pypt_thread_id_get, NULL, "thread identifier", NULL},
-	{ "registers", (getter)pypt_thread_registers_get, NULL, "thread registers", NULL },
+	{ "registers", (getter)pypt_thread_registers_get, (setter)pypt_thread_registers_set, "thread registers", NULL },
 	{ NULL }
 };
 
@@ -526,6 +511,7 @@ static PyMethodDef pypt_thread_methods[] = {
         { "ldt_entry_set", (PyCFunction)pypt_thread_x86_ldt_entry_set, METH_VARARGS, "Set a LDT entry." },
 	{ "resume", (PyCFunction)pypt_thread_resume, METH_VARARGS, "Resume the thread." },
 	{ "suspend", (PyCFunction)pypt_thread_suspend, METH_VARARGS, "Suspend the thread." },
+	{ "snapshot", (PyCFunction)pypt_thread_snapshot, METH_VARARGS, "Capture registers and stack memory." },
 	{ NULL }
 };
 
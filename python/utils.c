@@ -40,6 +40,8 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#include <libptrace/recorder.h>
+#include <libptrace/stats.h>
 #include "utils.h"
 
 PyObject*
@@ -78,3 +80,79 @@ pypt_dict_set(PyObject *self, PyObject *value, void *closure)
 
 	return 0;
 }
+
+static PyObject *
+pypt_histogram_to_dict(const struct pt_histogram *h)
+{
+	PyObject *buckets, *bucket, *result;
+	int i;
+
+	if ( (buckets = PyList_New(0)) == NULL)
+		return NULL;
+
+	/* Only report non-empty buckets as (lower bound, count) pairs. */
+	for (i = 0; i < PT_HISTOGRAM_BUCKETS; i++) {
+		if (h->buckets[i] == 0)
+			continue;
+
+		bucket = Py_BuildValue("(KK)",
+		                       (unsigned long long)pt_histogram_bucket_lower(i),
+		                       (unsigned long long)h->buckets[i]);
+		if (bucket == NULL || PyList_Append(buckets, bucket) == -1) {
+			Py_XDECREF(bucket);
+			Py_DECREF(buckets);
+			return NULL;
+		}
+		Py_DECREF(bucket);
+	}
+
+	result = Py_BuildValue("{sKsKsKsKsKsKsKsN}",
+		"count", (unsigned long long)h->count,
+		"sum",   (unsigned long long)h->sum,
+		"min",   (unsigned long long)h->min,
+		"max",   (unsigned long long)h->max,
+		"p50",   (unsigned long long)pt_histogram_percentile(h, 50.0),
+		"p90",   (unsigned long long)pt_histogram_percentile(h, 90.0),
+		"p99",   (unsigned long long)pt_histogram_percentile(h, 99.0),
+		"buckets", buckets);
+
+	return result;
+}
+
+/* Convert latency statistics to a dict keyed by (phase, event type). */
+PyObject*
+pypt_stats_to_dict(const struct pt_stats *stats)
+{
+	const struct pt_histogram *h;
+	PyObject *result, *key, *value;
+	int phase, type;
+
+	if ( (result = PyDict_New()) == NULL)
+		return NULL;
+
+	for (phase = 0; phase < PT_STATS_PHASES; phase++) {
+		for (type = 0; type < PT_STATS_EVENT_TYPES; type++) {
+			h = &stats->histograms[phase][type];
+			if (h->count == 0)
+				continue;
+
+			key = Py_BuildValue("(ss)",
+			                    pt_stats_phase_to_string(phase),
+			                    pt_record_type_to_string(type));
+			value = pypt_histogram_to_dict(h);
+
+			if (key == NULL || value == NULL ||
+			    PyDict_SetItem(result, key, value) == -1) {
+				Py_XDECREF(key);
+				Py_XDECREF(value);
+				Py_DECREF(result);
+				return NULL;
+			}
+
+			Py_DECREF(key);
+			Py_DECREF(value);
+		}
+	}
+
+	return result;
+}
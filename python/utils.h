@@ -44,8 +44,10 @@
 #define PYPT_UTILS_INTERNAL_H
 
 #include <python/Python.h>
+#include <libptrace/stats.h>
 
 PyObject* pypt_dict_get(PyObject *self, void *closure);
 PyObject* pypt_dict_set(PyObject *self, PyObject *value, void *closure);
+PyObject* pypt_stats_to_dict(const struct pt_stats *stats);
 
 #endif	/* !PYPT_UTILS_INTERNAL_H */
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * value_scan.c
+ *
+ * Python iterative value scan objects.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <stdlib.h>
+#include <python/Python.h>
+#include <libptrace/error.h>
+#include <libptrace/value_scan.h>
+#include "compat.h"
+#include "ptrace.h"
+#include "value_scan.h"
+
+static int pypt_value_is_float_(int type)
+{
+	return type == PT_VALUE_FLOAT || type == PT_VALUE_DOUBLE;
+}
+
+static int pypt_value_is_signed_(int type)
+{
+	return type >= PT_VALUE_INT8 && type <= PT_VALUE_INT64;
+}
+
+static PyObject *pypt_value_to_object_(int type, const union pt_value *value)
+{
+	if (pypt_value_is_float_(type))
+		return PyFloat_FromDouble(value->f);
+
+	if (pypt_value_is_signed_(type))
+		return PyLong_FromLongLong(value->i);
+
+	return PyLong_FromUnsignedLongLong(value->u);
+}
+
+/* Integers are converted as signed or unsigned depending on the type.
+ * Values that do not fit the type are rejected by the scan itself.
+ */
+static int
+pypt_value_from_object_(int type, PyObject *object, union pt_value *value)
+{
+	if (pypt_value_is_float_(type)) {
+		value->f = PyFloat_AsDouble(object);
+		return value->f == -1.0 && PyErr_Occurred() ? -1 : 0;
+	}
+
+	if (!py_num_check(object)) {
+		PyErr_SetString(PyExc_TypeError, "value must be an integer");
+		return -1;
+	}
+
+	if (pypt_value_is_signed_(type)) {
+		value->i = PyLong_AsLongLong(object);
+		return value->i == -1 && PyErr_Occurred() ? -1 : 0;
+	}
+
+	value->u = py_num_to_ulonglong(object);
+	return value->u == (uint64_t)-1 && PyErr_Occurred() ? -1 : 0;
+}
+
+/* update() releases the GIL while it changes the candidate pages, so no
+ * other python thread may use the scan until it is done.
+ */
+static int pypt_value_scan_busy_(struct pypt_value_scan *self)
+{
+	if (!self->busy)
+		return 0;
+
+	PyErr_SetString(PyExc_RuntimeError, "value scan is being updated");
+	return -1;
+}
+
+PyObject *
+pypt_value_scan_new(struct pypt_process *process, int type, size_t align,
+                    int prot)
+{
+	struct pypt_value_scan *self;
+
+	self = PyObject_New(struct pypt_value_scan, &pypt_value_scan_type);
+	if (self == NULL)
+		return NULL;
+
+	Py_INCREF(process);
+	self->process   = process;
+	self->type      = type;
+	self->tolerance = 0.0;
+	self->busy      = 0;
+
+	self->scan = pt_value_scan_new(process->process, type, align, prot);
+	if (self->scan == NULL) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		Py_DECREF(self);
+		return NULL;
+	}
+
+	return (PyObject *)self;
+}
+
+static void pypt_value_scan_dealloc(struct pypt_value_scan *self)
+{
+	if (self->scan != NULL)
+		pt_value_scan_delete(self->scan);
+
+	Py_DECREF(self->process);
+	PyObject_Del(self);
+}
+
+static PyObject *
+pypt_value_scan_update(struct pypt_value_scan *self, PyObject *args)
+{
+	union pt_value value, *v = NULL;
+	PyObject *object = Py_None;
+	ssize_t ret;
+	int cmp;
+
+	if (!PyArg_ParseTuple(args, "i|O", &cmp, &object))
+		return NULL;
+
+	if (pypt_value_scan_busy_(self) == -1)
+		return NULL;
+
+	if (object != Py_None) {
+		if (pypt_value_from_object_(self->type, object, &value) == -1)
+			return NULL;
+		v = &value;
+	}
+
+	self->busy = 1;
+	Py_BEGIN_ALLOW_THREADS
+	ret = pt_value_scan_update(self->scan, cmp, v);
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+
+	if (ret == -1) {
+		PyErr_SetString(pypt_exception, pt_error_strerror());
+		return NULL;
+	}
+
+	return PyLong_FromSsize_t(ret);
+}
+
+struct pypt_value_scan_results_
+{
+	PyObject	*list;
+	int		type;
+	Py_ssize_t	limit;
+	int		error;
+};
+
+static int
+pypt_value_scan_results_handler_(struct pt_process *process,
+                                 pt_address_t address,
+                                 const union pt_value *value, void *cookie)
+{
+	struct pypt_value_scan_results_ *results = cookie;
+	PyObject *item;
+	int ret;
+
+	item = Py_BuildValue("(KN)", (unsigned long long)address,
+	                     pypt_value_to_object_(results->type, value));
+	if (item == NULL) {
+		results->error = 1;
+		return 1;
+	}
+
+	ret = PyList_Append(results->list, item);
+	Py_DECREF(item);
+
+	if (ret == -1) {
+		results->error = 1;
+		return 1;
+	}
+
+	return results->limit != 0 &&
+	       PyList_GET_SIZE(results->list) == results->limit;
+}
+
+static PyObject *
+pypt_value_scan_results(struct pypt_value_scan *self, PyObject *args)
+{
+	struct pypt_value_scan_results_ results;
+
+	results.limit = 0;
+	results.error = 0;
+	results.type  = self->type;
+
+	if (!PyArg_ParseTuple(args, "|n", &results.limit))
+		return NULL;
+
+	if (pypt_value_scan_busy_(self) == -1)
+		return NULL;
+
+	if (results.limit < 0) {
+		PyErr_SetString(PyExc_ValueError, "'limit' must not be negative");
+		return NULL;
+	}
+
+	if ( (results.list = PyList_New(0)) == NULL)
+		return NULL;
+
+	pt_value_scan_for_each(self->scan, pypt_value_scan_results_handler_,
+	                       &results);
+
+	if (results.error) {
+		Py_DECREF(results.list);
+		return NULL;
+	}
+
+	return results.list;
+}
+
+static PyObject *
+pypt_value_scan_count_get(struct pypt_value_scan *self, void *closure)
+{
+	return PyLong_FromUnsignedLongLong(pt_value_scan_count_get(self->scan));
+}
+
+static PyObject *
+pypt_value_scan_pages_get(struct pypt_value_scan *self, void *closure)
+{
+	return PyLong_FromSize_t(pt_value_scan_pages_get(self->scan));
+}
+
+static PyObject *
+pypt_value_scan_tolerance_get(struct pypt_value_scan *self, void *closure)
+{
+	return PyFloat_FromDouble(self->tolerance);
+}
+
+static int
+pypt_value_scan_tolerance_set(struct pypt_value_scan *self, PyObject *value,
+                              void *closure)
+{
+	double tolerance;
+
+	if (value == NULL) {
+		PyErr_SetString(PyExc_TypeError, "Cannot delete the tolerance attribute");
+		return -1;
+	}
+
+	if (pypt_value_scan_busy_(self) == -1)
+		return -1;
+
+	tolerance = PyFloat_AsDouble(value);
+	if (tolerance == -1.0 && PyErr_Occurred())
+		return -1;
+
+	self->tolerance = tolerance < 0 ? -tolerance : tolerance;
+	pt_value_scan_tolerance_set(self->scan, self->tolerance);
+
+	return 0;
+}
+
+static PyObject *pypt_value_scan__repr__(struct pypt_value_scan *self)
+{
+	return PyString_FromFormat("<%s(%p) candidates:%llu>",
+	                           Py_TYPE(self)->tp_name, self,
+	                           (unsigned long long)pt_value_scan_count_get(self->scan));
+}
+
+static PyMethodDef pypt_value_scan_methods[] = {
+	{ "update", (PyCFunction)pypt_value_scan_update, METH_VARARGS, "Run a scan pass and return the number of candidates left." },
+	{ "results", (PyCFunction)pypt_value_scan_results, METH_VARARGS, "Get (address, value) tuples for the candidates." },
+	{ NULL }
+};
+
+static PyGetSetDef pypt_value_scan_getset[] = {
+	{ "count", (getter)pypt_value_scan_count_get, NULL, "Number of candidates", NULL },
+	{ "pages", (getter)pypt_value_scan_pages_get, NULL, "Number of pages holding candidates", NULL },
+	{ "tolerance", (getter)pypt_value_scan_tolerance_get, (setter)pypt_value_scan_tolerance_set, "Floating point comparison tolerance", NULL },
+	{ NULL }
+};
+
+PyTypeObject pypt_value_scan_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"_ptrace.value_scan",			/* tp_name */
+	sizeof(struct pypt_value_scan),		/* tp_basicsize */
+	0,					/* tp_itemsize */
+	(destructor)pypt_value_scan_dealloc,	/* tp_dealloc */
+	0,					/* tp_print */
+	0,					/* tp_getattr */
+	0,					/* tp_setattr */
+	0,					/* tp_compare */
+	(reprfunc)pypt_value_scan__repr__,	/* tp_repr */
+	0,					/* tp_as_number */
+	0,					/* tp_as_sequence */
+	0,					/* tp_as_mapping */
+	0,					/* tp_hash */
+	0,					/* tp_call */
+	0,					/* tp_str */
+	0,					/* tp_getattro */
+	0,					/* tp_setattro */
+	0,					/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,			/* tp_flags */
+	"Value scan object",			/* tp_doc */
+	0,					/* tp_traverse */
+	0,					/* tp_clear */
+	0,					/* tp_richcompare */
+	0,					/* tp_weaklistoffset */
+	0,					/* tp_iter */
+	0,					/* tp_iternext */
+	pypt_value_scan_methods,		/* tp_methods */
+	0,					/* tp_members */
+	pypt_value_scan_getset,			/* tp_getset */
+};
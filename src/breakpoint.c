@@ -57,13 +57,21 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
+#include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <libptrace/error.h>
 #include <libptrace/event.h>
 #include <libptrace/list.h>
 #include <libptrace/log.h>
+#include <libptrace/util.h>
 #include "breakpoint.h"
+#include "breakpoint_cond.h"
 #include "process.h"
+#include "stats.h"
 #include "thread.h"
 
 void pt_breakpoint_init(struct pt_breakpoint *breakpoint)
@@ -73,12 +81,183 @@ void pt_breakpoint_init(struct pt_breakpoint *breakpoint)
 	breakpoint->handler = NULL;
 	breakpoint->cookie  = NULL;
 	breakpoint->flag    = PT_BREAKPOINT_FLAG_NONE;
+	breakpoint->hits    = 0;
+	breakpoint->fired   = 0;
+	breakpoint->condition    = NULL;
+	breakpoint->ignore_count = 0;
+	breakpoint->every_nth    = 0;
+	breakpoint->matched      = 0;
+	breakpoint->max_hits     = 0;
+	breakpoint->rate_limit   = 0;
+	breakpoint->rate_hits    = 0;
+	breakpoint->rate_start   = 0;
+}
+
+/* Compile 'condition' and attach it to the breakpoint.  Passing NULL
+ * removes the current condition.  On error the breakpoint is left as is.
+ */
+int pt_breakpoint_condition_set(struct pt_breakpoint *breakpoint,
+                                const char *condition)
+{
+	struct pt_breakpoint_cond *cond = NULL;
+
+	if (condition != NULL &&
+	    (cond = pt_breakpoint_cond_compile(condition)) == NULL)
+		return -1;
+
+	pt_breakpoint_cond_delete(breakpoint->condition);
+	breakpoint->condition = cond;
+
+	if (cond != NULL)
+		breakpoint->flag |= PT_BREAKPOINT_FLAG_CONDITIONAL;
+	else
+		breakpoint->flag &= ~PT_BREAKPOINT_FLAG_CONDITIONAL;
+
+	return 0;
+}
+
+const char *pt_breakpoint_condition_get(struct pt_breakpoint *breakpoint)
+{
+	if (breakpoint->condition == NULL)
+		return NULL;
+
+	return breakpoint->condition->source;
 }
 
 void pt_breakpoint_destroy(struct pt_breakpoint *breakpoint)
 {
 }
 
+void pt_breakpoint_ignore_count_set(struct pt_breakpoint *bp, uint64_t count)
+{
+	bp->ignore_count = count;
+}
+
+void pt_breakpoint_every_nth_set(struct pt_breakpoint *bp, uint64_t n)
+{
+	bp->every_nth = n;
+	bp->matched   = 0;
+}
+
+void pt_breakpoint_rate_limit_set(struct pt_breakpoint *bp, uint32_t per_second)
+{
+	bp->rate_limit = per_second;
+	bp->rate_hits  = 0;
+	bp->rate_start = 0;
+}
+
+void pt_breakpoint_max_hits_set(struct pt_breakpoint *bp, uint64_t max_hits)
+{
+	bp->max_hits = max_hits;
+}
+
+uint64_t pt_breakpoint_hits_get(struct pt_breakpoint *bp)
+{
+	return bp->hits;
+}
+
+/* Decide whether a hit on 'bp' should reach its handler.  The checks are
+ * ordered from cheapest to most expensive, and each stage only counts the
+ * hits that passed the previous ones.
+ */
+static int
+pt_breakpoint_filter_(struct pt_thread *thread, struct pt_breakpoint *bp)
+{
+	uint64_t now;
+
+	if (bp->hits <= bp->ignore_count)
+		return 0;
+
+	/* Conditions we fail to evaluate are treated as satisfied, so that
+	 * errors are not silently swallowed.
+	 */
+	if ((bp->flag & PT_BREAKPOINT_FLAG_CONDITIONAL) && bp->condition != NULL) {
+		if (pt_breakpoint_cond_eval(bp->condition, thread, bp) == 0)
+			return 0;
+	}
+
+	if (bp->every_nth > 1 && ++bp->matched % bp->every_nth != 0)
+		return 0;
+
+	if (bp->rate_limit != 0) {
+		now = pt_util_time_ns();
+
+		if (bp->rate_hits == 0 || now - bp->rate_start >= 1000000000ULL) {
+			bp->rate_start = now;
+			bp->rate_hits  = 0;
+		}
+
+		if (bp->rate_hits >= bp->rate_limit)
+			return 0;
+
+		bp->rate_hits++;
+	}
+
+	return 1;
+}
+
+/* Whether a hit on 'bpi' can be stepped over out of line.  Thread scope
+ * breakpoints are not, as they are disarmed for the other threads anyway,
+ * and neither are threads the user is single stepping, as they would
+ * report the scratch page addresses.
+ */
+static int
+breakpoint_displaceable_(struct pt_thread *thread,
+                         struct pt_breakpoint_internal *bpi, int thread_scope)
+{
+	struct pt_breakpoint *bp = bpi->breakpoint;
+
+	return (thread->process->options & PT_PROCESS_OPTION_DISPLACED_STEPPING) &&
+	       bp->b_op->displace != NULL && !thread_scope &&
+	       !(bp->flag & PT_BREAKPOINT_FLAG_ONESHOT) &&
+	       !(thread->flags & THREAD_FLAG_SINGLE_STEP);
+}
+
+/* Resume 'thread' past the displaceable breakpoint at 'address' once its
+ * handler has run.  The handler may have removed the breakpoint or moved
+ * the thread elsewhere, so we look at the state it left behind.  If the
+ * instruction cannot be displaced, we fall back to disarming the
+ * breakpoint and restoring it after a single step.
+ */
+static void
+breakpoint_step_over_locked_(struct pt_thread *thread, pt_address_t address)
+{
+	struct pt_breakpoint_internal *bpi;
+	struct pt_breakpoint *bp;
+
+	bpi = pt_process_breakpoint_find_internal(thread->process, address);
+	if (bpi == NULL)
+		return;
+
+	bp = bpi->breakpoint;
+	if (bp->flag & PT_BREAKPOINT_FLAG_RETIRED)
+		return;
+
+	if (pt_thread_register_pc_get(thread) != address)
+		return;
+
+	if (bp->b_op->displace(thread, bpi) == 0)
+		return;
+
+	pt_log("%s(): cannot displace 0x%p: %s\n",
+	       __FUNCTION__, address, pt_error_strerror());
+
+	if (bp->b_op->suppress(thread, bpi) == -1)
+		return;
+
+	pt_thread_breakpoint_restore_set(thread, bpi);
+}
+
+static void
+breakpoint_step_over_(struct pt_thread *thread, pt_address_t address)
+{
+	struct pt_process *process = thread->process;
+
+	pt_process_lock(process);
+	breakpoint_step_over_locked_(thread, address);
+	pt_process_unlock(process);
+}
+
 /* Breakpoint handler invocation management. */
 int pt_breakpoint_handler(struct pt_thread *thread,
                           struct pt_event_breakpoint *ev)
@@ -86,56 +265,121 @@ int pt_breakpoint_handler(struct pt_thread *thread,
 	struct pt_process *process = thread->process;
 	struct pt_breakpoint_internal *bpi;
 	struct pt_breakpoint *bp;
+	pt_address_t address;
+	int thread_scope = 0;
+	int displaced;
+	int ret;
 
 	pt_log("%s(): address: 0x%x\n", __FUNCTION__, ev->address);
 
+	/* Other threads can set and remove breakpoints, so we hold the
+	 * process lock up to the point where we call out to a handler.
+	 */
+	pt_process_lock(process);
+
 	/* Try to find a registered breakpoint handler for this event.
 	 * If we do not have one, we proceed calling the ptrace breakpoint
 	 * event hook directly.
 	 */
 	bpi = pt_thread_breakpoint_internal_find(thread, ev->address);
-	if (bpi == NULL)
+	if (bpi != NULL)
+		thread_scope = 1;
+	else
 		bpi = pt_process_breakpoint_find_internal(process, ev->address);
 
 	/* We do not have any high level handler for this breakpoint. */
 	if (bpi == NULL) {
+		pt_process_unlock(process);
 		pt_log("%s(): Unknown breakpoint, calling bottom handler.\n", __FUNCTION__);
-		if (process->handlers.breakpoint != NULL)
-			return process->handlers.breakpoint(ev);
-		else
+		if (process->handlers.breakpoint == NULL)
 			return PT_EVENT_FORWARD;
+
+		PT_STATS_HANDLER_CALL(process->core,
+			ret = process->handlers.breakpoint(ev));
+		return ret;
 	}
 
 	pt_log("%s(): High level breakpoint at 0x%.8x\n", __FUNCTION__, ev->address);
-	bp = bpi->breakpoint;
+	bp      = bpi->breakpoint;
+	address = bpi->address;
 
 	/* If the breakpoint is disabled we're done.  We even do this for
 	 * ONESHOT breakpoints, as these can be disabled before they are
 	 * handled.
 	 */
-	if (bp->flag & PT_BREAKPOINT_FLAG_DISABLED)
+	if (bp->flag & PT_BREAKPOINT_FLAG_DISABLED) {
+		pt_process_unlock(process);
 		return PT_EVENT_DROP;
+	}
 
-	/* If we have a suppress operation defined for this breakpoint,
-	 * invoke it.
+	/* Breakpoints we step over out of line stay armed, so we only move
+	 * the pc back to the breakpoint address for the handler.
+	 * Otherwise, if we have a suppress operation defined for this
+	 * breakpoint, invoke it.
 	 *
 	 * XXX: handle suppression error.
 	 */
-	if (bp->b_op->suppress != NULL)
+	displaced = breakpoint_displaceable_(ev->thread, bpi, thread_scope);
+	if (displaced)
+		pt_thread_register_pc_set(ev->thread, address);
+	else if (bp->b_op->suppress != NULL)
 		bp->b_op->suppress(ev->thread, bpi);
 
-	/* If this was a one shot breakpoint, remove it. */
+	/* Retired breakpoints are no longer armed once suppressed, but other
+	 * threads can still report hits that raced with the retirement.  A
+	 * displaced retired breakpoint is disarmed before we resume.
+	 */
+	if (bp->flag & PT_BREAKPOINT_FLAG_RETIRED) {
+		pt_process_unlock(process);
+		return PT_EVENT_DROP;
+	}
+
+	bp->hits++;
+
+	/* Hits that are filtered out resume the thread right away, without
+	 * any handler being called.  The breakpoint stays armed, even if it
+	 * is a ONESHOT breakpoint.
+	 */
+	if (!pt_breakpoint_filter_(thread, bp)) {
+		if (displaced)
+			breakpoint_step_over_(ev->thread, address);
+		else
+			pt_thread_breakpoint_restore_set(ev->thread, bpi);
+		pt_process_unlock(process);
+		return PT_EVENT_DROP;
+	}
+
+	bp->fired++;
+
+	/* If this was a one shot breakpoint, remove it.  This releases
+	 * 'bpi', so it must not be used after this point.
+	 */
 	if (bp->flag & PT_BREAKPOINT_FLAG_ONESHOT) {
 		bp->b_op->process_remove(process, bpi);
-	} else {
+	} else if (bp->max_hits != 0 && bp->fired >= bp->max_hits) {
+		/* The breakpoint has used up its budget.  Suppression left
+		 * it disarmed, so we leave it that way and release it in
+		 * bulk with the others retired during this event.  Thread
+		 * scope instances only hold a debug register, so they are
+		 * released right away.  Either way 'bpi' must not be used
+		 * after this point.
+		 */
+		bp->flag |= PT_BREAKPOINT_FLAG_RETIRED;
+		if (thread_scope)
+			thread_breakpoint_remove_internal(thread, bpi);
+		else
+			list_add_tail(&bpi->retired, &process->breakpoints_retired);
+	} else if (!displaced) {
 		/* For persistent breakpoints, we need to reenable them
 		 * at the right moment.  Which is on process resumption
 		 * after single stepping the proper once.  There are
 		 * some delicate races here, which I will detail later.
 		 */
-		ev->thread->breakpoint_restore = bpi;
+		pt_thread_breakpoint_restore_set(ev->thread, bpi);
 	}
 
+	pt_process_unlock(process);
+
 	/* We had a registered breakpoint, so we call its handler instead of
 	 * the generic breakpoint handler as above.  We do this last, as the
 	 * handler may well remove the breakpoint, which means we can't set
@@ -144,12 +388,367 @@ int pt_breakpoint_handler(struct pt_thread *thread,
 	 * XXX: warning, PT_BREAKPOINT_FLAG_ONESHOT breakpoints should never
 	 * be removed in the breakpoint handler.
 	 */
-	bp->handler(thread, bp->cookie);
+	PT_STATS_HANDLER_CALL(process->core, bp->handler(thread, bp->cookie));
+
+	if (displaced)
+		breakpoint_step_over_(ev->thread, address);
 
 	/* Registered breakpoints are never relayed to the debuggee. */
 	return PT_EVENT_DROP;
 }
 
+static int breakpoint_address_compare_(const void *a_, const void *b_)
+{
+	const struct pt_breakpoint_internal *a =
+		*(struct pt_breakpoint_internal * const *)a_;
+	const struct pt_breakpoint_internal *b =
+		*(struct pt_breakpoint_internal * const *)b_;
+
+	if (a->address < b->address)
+		return -1;
+
+	if (a->address > b->address)
+		return 1;
+
+	return 0;
+}
+
+static pt_address_t
+breakpoint_resolve_(struct pt_process *process, struct pt_breakpoint *bp)
+{
+	pt_address_t address;
+
+	if (bp->symbol == NULL)
+		return bp->address;
+
+	address = pt_process_export_find(process, bp->symbol);
+	if (address == PT_ADDRESS_NULL)
+		pt_log("%s(): failed to resolve symbol %s: %s\n",
+		       __FUNCTION__, bp->symbol, pt_error_strerror());
+
+	return address;
+}
+
+/* Remove 'count' installed breakpoints sorted by address.  Runs of
+ * breakpoints sharing the same operations are handed to the batched
+ * operation when it exists.
+ */
+static int
+breakpoint_internal_remove_many_(struct pt_process *process,
+                                 struct pt_breakpoint_internal **bpis,
+                                 size_t count)
+{
+	struct pt_breakpoint_operations *b_op;
+	size_t i, j;
+
+	for (i = 0; i < count; i = j) {
+		b_op = bpis[i]->breakpoint->b_op;
+
+		for (j = i + 1; j < count; j++)
+			if (bpis[j]->breakpoint->b_op != b_op)
+				break;
+
+		if (b_op->process_remove_many != NULL) {
+			if (b_op->process_remove_many(process, &bpis[i], j - i) == -1)
+				return -1;
+			continue;
+		}
+
+		for (; i < j; i++)
+			if (b_op->process_remove(process, bpis[i]) == -1)
+				return -1;
+	}
+
+	return 0;
+}
+
+static void breakpoint_retired_flush_locked_(struct pt_process *process)
+{
+	struct pt_breakpoint_internal **bpis, *bpi;
+	struct list_head *lh, *lh2;
+	size_t count = 0, i = 0;
+
+	if (list_empty(&process->breakpoints_retired))
+		return;
+
+	list_for_each (lh, &process->breakpoints_retired)
+		count++;
+
+	/* Without memory for the batch we release them one by one. */
+	if ( (bpis = malloc(count * sizeof *bpis)) == NULL) {
+		list_for_each_safe (lh, lh2, &process->breakpoints_retired) {
+			bpi = list_entry(lh, struct pt_breakpoint_internal, retired);
+			list_del_init(&bpi->retired);
+			bpi->breakpoint->b_op->process_remove(process, bpi);
+		}
+		return;
+	}
+
+	list_for_each_safe (lh, lh2, &process->breakpoints_retired) {
+		bpis[i] = list_entry(lh, struct pt_breakpoint_internal, retired);
+		list_del_init(&bpis[i++]->retired);
+	}
+
+	qsort(bpis, count, sizeof *bpis, breakpoint_address_compare_);
+
+	if (breakpoint_internal_remove_many_(process, bpis, count) == -1)
+		pt_log("%s(): failed to release retired breakpoints: %s\n",
+		       __FUNCTION__, pt_error_strerror());
+
+	free(bpis);
+}
+
+/* Release the breakpoints that were retired while handling the last
+ * debug event.  This is called before the process is continued, so that
+ * all of them are unpatched in a single batch.
+ */
+void pt_breakpoint_retired_flush(struct pt_process *process)
+{
+	pt_process_lock(process);
+	breakpoint_retired_flush_locked_(process);
+	pt_process_unlock(process);
+}
+
+static int
+breakpoint_set_many_locked_(struct pt_process *process,
+                            struct pt_breakpoint **bps, size_t count)
+{
+	struct pt_breakpoint_operations *b_op;
+	struct pt_breakpoint_internal **bpis;
+	size_t i, j, k, done = 0;
+
+	assert(process != NULL);
+	assert(bps != NULL || count == 0);
+
+	pt_log("%s(0x%p, 0x%p, %zu)\n", __FUNCTION__, process, bps, count);
+
+	if (count == 0)
+		return 0;
+
+	if ( (bpis = calloc(count, sizeof *bpis)) == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	/* Resolve all addresses and allocate the internal breakpoints. */
+	for (i = 0; i < count; i++) {
+		assert(bps[i] != NULL && bps[i]->b_op != NULL);
+
+		if ( (bpis[i] = malloc(sizeof **bpis)) == NULL) {
+			pt_error_errno_set(errno);
+			goto err_bpis;
+		}
+
+		bpis[i]->breakpoint = bps[i];
+		bpis[i]->patched    = 0;
+		list_init(&bpis[i]->retired);
+		bpis[i]->address    = breakpoint_resolve_(process, bps[i]);
+		if (bpis[i]->address == PT_ADDRESS_NULL) {
+			i++;
+			goto err_bpis;
+		}
+
+		if (pt_process_breakpoint_find(process, bpis[i]->address) != NULL) {
+			pt_error_internal_set(PT_ERROR_EXISTS);
+			i++;
+			goto err_bpis;
+		}
+	}
+
+	qsort(bpis, count, sizeof *bpis, breakpoint_address_compare_);
+
+	/* Do not allow multiple breakpoints on the same address. */
+	for (i = 1; i < count; i++) {
+		if (bpis[i - 1]->address == bpis[i]->address) {
+			pt_error_internal_set(PT_ERROR_EXISTS);
+			i = count;
+			goto err_bpis;
+		}
+	}
+
+	for (i = 0; i < count; i = j) {
+		b_op = bpis[i]->breakpoint->b_op;
+
+		for (j = i + 1; j < count; j++)
+			if (bpis[j]->breakpoint->b_op != b_op)
+				break;
+
+		if (b_op->process_set_many != NULL) {
+			if (b_op->process_set_many(process, &bpis[i], j - i) == -1)
+				goto err_set;
+		} else {
+			for (k = i; k < j; k++) {
+				if (b_op->process_set(process, bpis[k]) == -1)
+					break;
+				avl_tree_insert(&process->breakpoints, &bpis[k]->avl_node);
+				done++;
+			}
+
+			if (k != j)
+				goto err_set;
+			continue;
+		}
+
+		for (k = i; k < j; k++)
+			avl_tree_insert(&process->breakpoints, &bpis[k]->avl_node);
+		done = j;
+	}
+
+	free(bpis);
+
+	pt_log("%s(): returning 0\n", __FUNCTION__);
+	return 0;
+
+err_set:
+	/* Roll back what we already installed, which also releases the
+	 * internal breakpoints of those, and free the remainder.
+	 */
+	breakpoint_internal_remove_many_(process, bpis, done);
+	for (i = done; i < count; i++)
+		free(bpis[i]);
+	free(bpis);
+	pt_log("%s(): returning -1\n", __FUNCTION__);
+	return -1;
+
+err_bpis:
+	while (i-- > 0)
+		free(bpis[i]);
+	free(bpis);
+	pt_log("%s(): returning -1\n", __FUNCTION__);
+	return -1;
+}
+
+/* Set a batch of process breakpoints.  The breakpoints are sorted by
+ * address so that backends can patch all breakpoints on a page using a
+ * single read-modify-write cycle.  Either all breakpoints are set, or
+ * none are.
+ */
+int pt_breakpoint_set_many(struct pt_process *process,
+                           struct pt_breakpoint **bps, size_t count)
+{
+	int ret;
+
+	pt_process_lock(process);
+	ret = breakpoint_set_many_locked_(process, bps, count);
+	pt_process_unlock(process);
+
+	return ret;
+}
+
+/* Reinstall the breakpoints of a batch whose removal failed halfway.
+ * Those still found at their address were never removed.  This is a best
+ * effort attempt; the error of the failed removal is kept.
+ */
+static void
+breakpoint_remove_undo_(struct pt_process *process, struct pt_breakpoint **bps,
+                        const pt_address_t *addresses, size_t count)
+{
+	struct pt_breakpoint **removed;
+	size_t i, n = 0;
+
+	pt_error_save();
+
+	if ( (removed = malloc(count * sizeof *removed)) == NULL)
+		goto out;
+
+	for (i = 0; i < count; i++)
+		if (pt_process_breakpoint_find_internal(process, addresses[i]) == NULL)
+			removed[n++] = bps[i];
+
+	if (pt_breakpoint_set_many(process, removed, n) == -1)
+		pt_log("%s(): failed to reinstall %zu breakpoints: %s\n",
+		       __FUNCTION__, n, pt_error_strerror());
+
+	free(removed);
+out:
+	pt_error_restore();
+}
+
+static int
+breakpoint_remove_many_locked_(struct pt_process *process,
+                               struct pt_breakpoint **bps, size_t count)
+{
+	struct pt_breakpoint_internal **bpis;
+	pt_address_t *addresses;
+	size_t i;
+	int ret;
+
+	assert(process != NULL);
+	assert(bps != NULL || count == 0);
+
+	pt_log("%s(0x%p, 0x%p, %zu)\n", __FUNCTION__, process, bps, count);
+
+	if (count == 0)
+		return 0;
+
+	if ( (bpis = malloc(count * sizeof *bpis)) == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	if ( (addresses = malloc(count * sizeof *addresses)) == NULL) {
+		pt_error_errno_set(errno);
+		free(bpis);
+		return -1;
+	}
+
+	/* Look up all breakpoints first, so that we do not remove anything
+	 * when one of them is not set.
+	 */
+	for (i = 0; i < count; i++) {
+		addresses[i] = breakpoint_resolve_(process, bps[i]);
+		if (addresses[i] == PT_ADDRESS_NULL)
+			goto err_bpis;
+
+		bpis[i] = pt_process_breakpoint_find_internal(process, addresses[i]);
+		if (bpis[i] == NULL || bpis[i]->breakpoint != bps[i]) {
+			pt_error_internal_set(PT_ERROR_NOT_FOUND);
+			goto err_bpis;
+		}
+	}
+
+	qsort(bpis, count, sizeof *bpis, breakpoint_address_compare_);
+
+	/* Removing the same breakpoint twice would release it twice. */
+	for (i = 1; i < count; i++) {
+		if (bpis[i - 1] == bpis[i]) {
+			pt_error_internal_set(PT_ERROR_INVALID_ARG);
+			goto err_bpis;
+		}
+	}
+
+	ret = breakpoint_internal_remove_many_(process, bpis, count);
+	if (ret == -1)
+		breakpoint_remove_undo_(process, bps, addresses, count);
+
+	free(addresses);
+	free(bpis);
+
+	pt_log("%s(): returning %d\n", __FUNCTION__, ret);
+	return ret;
+
+err_bpis:
+	free(addresses);
+	free(bpis);
+	return -1;
+}
+
+/* Remove a batch of process breakpoints.  Either all breakpoints are
+ * removed, or none are; if removal fails halfway, the breakpoints that
+ * were already removed are set again.
+ */
+int pt_breakpoint_remove_many(struct pt_process *process,
+                              struct pt_breakpoint **bps, size_t count)
+{
+	int ret;
+
+	pt_process_lock(process);
+	ret = breakpoint_remove_many_locked_(process, bps, count);
+	pt_process_unlock(process);
+
+	return ret;
+}
+
 int breakpoint_avl_compare_(struct avl_node *a_, struct avl_node *b_)
 {
         struct pt_breakpoint_internal *a =
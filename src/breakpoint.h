@@ -55,6 +55,7 @@
 #define PT_BREAKPOINT_FLAG_ONESHOT	1
 #define PT_BREAKPOINT_FLAG_DISABLED	2
 #define PT_BREAKPOINT_FLAG_CONDITIONAL	4
+#define PT_BREAKPOINT_FLAG_RETIRED	8
 
 #define PT_BREAKPOINT_SCOPE_PROCESS	0
 #define PT_BREAKPOINT_SCOPE_THREAD	1
@@ -64,6 +65,7 @@ extern "C" {
 #endif
 
 struct pt_breakpoint;
+struct pt_breakpoint_cond;
 typedef void (*pt_breakpoint_handler_t)(struct pt_thread *, void *cookie);
 
 /* Structure used to track process level breakpoints. */
@@ -81,6 +83,11 @@ struct pt_breakpoint_internal
 	struct avl_node		avl_node;
 	/* The original byte we patched out. */
 	uint8_t			original;
+	/* Set when 'original' has been replaced in process memory. */
+	uint8_t			patched;
+
+	/* Entry on the process list of breakpoints pending release. */
+	struct list_head	retired;
 };
 
 struct pt_breakpoint_operations
@@ -91,6 +98,19 @@ struct pt_breakpoint_operations
 	int	(*process_remove)(struct pt_process *, struct pt_breakpoint_internal *);
 	int	(*suppress)(struct pt_thread *, struct pt_breakpoint_internal *);
 	int	(*restore)(struct pt_thread *, struct pt_breakpoint_internal *);
+
+	/* Optional batched variants.  The breakpoint array is sorted by
+	 * address and all entries share these operations.
+	 */
+	int	(*process_set_many)(struct pt_process *,
+		                    struct pt_breakpoint_internal **, size_t);
+	int	(*process_remove_many)(struct pt_process *,
+		                       struct pt_breakpoint_internal **, size_t);
+
+	/* Optional.  Resume the thread past the breakpoint without ever
+	 * disarming it.
+	 */
+	int	(*displace)(struct pt_thread *, struct pt_breakpoint_internal *);
 };
 
 struct pt_breakpoint
@@ -103,6 +123,24 @@ struct pt_breakpoint
 	pt_breakpoint_handler_t		handler;
 	void				*cookie;
 
+	/* Number of times this breakpoint was hit, and the number of times
+	 * its handler was called.
+	 */
+	uint64_t			hits;
+	uint64_t			fired;
+
+	/* Compiled condition for PT_BREAKPOINT_FLAG_CONDITIONAL. */
+	struct pt_breakpoint_cond	*condition;
+
+	/* Hit filters.  A value of 0 disables the filter. */
+	uint64_t			ignore_count;	/* skip first N hits  */
+	uint64_t			every_nth;	/* fire on every Nth  */
+	uint64_t			matched;
+	uint64_t			max_hits;	/* retire after N     */
+	uint32_t			rate_limit;	/* max hits / second  */
+	uint32_t			rate_hits;
+	uint64_t			rate_start;
+
 	struct pt_breakpoint_operations	*b_op;
 };
 
@@ -115,6 +153,20 @@ int pt_breakpoint_handler(struct pt_thread *thread,
 int pt_breakpoint_set(struct pt_process *process,
                       struct pt_breakpoint *breakpoint);
 int pt_breakpoint_remove(struct pt_process *process, struct pt_breakpoint *breakpoint);
+int pt_breakpoint_condition_set(struct pt_breakpoint *breakpoint,
+                                const char *condition);
+const char *pt_breakpoint_condition_get(struct pt_breakpoint *breakpoint);
+void pt_breakpoint_ignore_count_set(struct pt_breakpoint *, uint64_t);
+void pt_breakpoint_every_nth_set(struct pt_breakpoint *, uint64_t);
+void pt_breakpoint_rate_limit_set(struct pt_breakpoint *, uint32_t);
+void pt_breakpoint_max_hits_set(struct pt_breakpoint *, uint64_t);
+uint64_t pt_breakpoint_hits_get(struct pt_breakpoint *);
+void pt_breakpoint_retired_flush(struct pt_process *);
+
+int pt_breakpoint_set_many(struct pt_process *process,
+                           struct pt_breakpoint **breakpoints, size_t count);
+int pt_breakpoint_remove_many(struct pt_process *process,
+                              struct pt_breakpoint **breakpoints, size_t count);
 
 int breakpoint_avl_compare_(struct avl_node *, struct avl_node *);
 
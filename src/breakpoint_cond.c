@@ -0,0 +1,665 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * breakpoint_cond.c
+ *
+ * Compiled breakpoint conditions.
+ *
+ * Conditions are small expressions over registers, process memory and the
+ * breakpoint hit count, such as:
+ *
+ *   rcx == 0x10 && dword[rsp + 8] != 0 && hits > 100
+ *
+ * They are compiled once into bytecode for a small stack machine, and
+ * evaluated by the breakpoint handler before any handler is dispatched,
+ * so that hits which do not match never leave the library.
+ *
+ * The grammar, from lowest to highest precedence:
+ *
+ *   expr    := land ('||' land)*
+ *   land    := binary ('&&' binary)*
+ *   binary  := unary (binop unary)*      with C precedence for binop in
+ *                                        '|' '^' '&' '==' '!=' '<' '<='
+ *                                        '>' '>=' '<<' '>>' '+' '-' '*'
+ *                                        '/' '%'
+ *   unary   := ('-' | '~' | '!') unary | primary
+ *   primary := number | register | 'hits' | 'tid' | '(' expr ')'
+ *            | [size] '[' expr ']'
+ *   size    := 'byte' | 'word' | 'dword' | 'qword'
+ *
+ * A memory dereference without a size reads a pointer sized value.  All
+ * arithmetic is done on unsigned 64-bit values.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include "arch.h"
+#include "breakpoint.h"
+#include "breakpoint_cond.h"
+#include "process.h"
+#include "registers.h"
+#include "thread.h"
+
+#define REG_NONE	-1
+#define REG_X64(r)	offsetof(struct pt_registers_x86_64, r)
+#define REG_I386(r)	offsetof(struct pt_registers_i386, r)
+
+struct cond_register
+{
+	const char	*name;
+	int		x86_64_offset;
+	uint8_t		x86_64_size;
+	int		i386_offset;
+	uint8_t		i386_size;
+};
+
+static const struct cond_register cond_registers_[] = {
+	{ "rax",    REG_X64(rax),    8, REG_NONE,         0 },
+	{ "rbx",    REG_X64(rbx),    8, REG_NONE,         0 },
+	{ "rcx",    REG_X64(rcx),    8, REG_NONE,         0 },
+	{ "rdx",    REG_X64(rdx),    8, REG_NONE,         0 },
+	{ "rsi",    REG_X64(rsi),    8, REG_NONE,         0 },
+	{ "rdi",    REG_X64(rdi),    8, REG_NONE,         0 },
+	{ "rsp",    REG_X64(rsp),    8, REG_NONE,         0 },
+	{ "rbp",    REG_X64(rbp),    8, REG_NONE,         0 },
+	{ "rip",    REG_X64(rip),    8, REG_NONE,         0 },
+	{ "r8",     REG_X64(r8),     8, REG_NONE,         0 },
+	{ "r9",     REG_X64(r9),     8, REG_NONE,         0 },
+	{ "r10",    REG_X64(r10),    8, REG_NONE,         0 },
+	{ "r11",    REG_X64(r11),    8, REG_NONE,         0 },
+	{ "r12",    REG_X64(r12),    8, REG_NONE,         0 },
+	{ "r13",    REG_X64(r13),    8, REG_NONE,         0 },
+	{ "r14",    REG_X64(r14),    8, REG_NONE,         0 },
+	{ "r15",    REG_X64(r15),    8, REG_NONE,         0 },
+	{ "rflags", REG_X64(rflags), 8, REG_NONE,         0 },
+
+	/* x86 is little endian, so the 32-bit registers overlap the low
+	 * half of their 64-bit counterparts.
+	 */
+	{ "eax",    REG_X64(rax),    4, REG_I386(eax),    4 },
+	{ "ebx",    REG_X64(rbx),    4, REG_I386(ebx),    4 },
+	{ "ecx",    REG_X64(rcx),    4, REG_I386(ecx),    4 },
+	{ "edx",    REG_X64(rdx),    4, REG_I386(edx),    4 },
+	{ "esi",    REG_X64(rsi),    4, REG_I386(esi),    4 },
+	{ "edi",    REG_X64(rdi),    4, REG_I386(edi),    4 },
+	{ "esp",    REG_X64(rsp),    4, REG_I386(esp),    4 },
+	{ "ebp",    REG_X64(rbp),    4, REG_I386(ebp),    4 },
+	{ "eip",    REG_X64(rip),    4, REG_I386(eip),    4 },
+	{ "eflags", REG_X64(rflags), 4, REG_I386(eflags), 4 },
+
+	/* Architecture neutral names. */
+	{ "pc",     REG_X64(rip),    8, REG_I386(eip),    4 },
+	{ "sp",     REG_X64(rsp),    8, REG_I386(esp),    4 },
+	{ "fp",     REG_X64(rbp),    8, REG_I386(ebp),    4 },
+};
+
+#define COND_REGISTER_COUNT \
+	(sizeof(cond_registers_) / sizeof(cond_registers_[0]))
+
+/* Binary operators handled by precedence climbing. */
+struct cond_binop
+{
+	const char	*token;
+	uint8_t		opcode;
+	int		precedence;
+};
+
+/* Longer tokens first, so that '<<' is not matched as '<'. */
+static const struct cond_binop cond_binops_[] = {
+	{ "<<", PT_COND_OP_SHL, 6 },
+	{ ">>", PT_COND_OP_SHR, 6 },
+	{ "==", PT_COND_OP_EQ,  4 },
+	{ "!=", PT_COND_OP_NE,  4 },
+	{ "<=", PT_COND_OP_LE,  5 },
+	{ ">=", PT_COND_OP_GE,  5 },
+	{ "<",  PT_COND_OP_LT,  5 },
+	{ ">",  PT_COND_OP_GT,  5 },
+	{ "|",  PT_COND_OP_OR,  1 },
+	{ "^",  PT_COND_OP_XOR, 2 },
+	{ "&",  PT_COND_OP_AND, 3 },
+	{ "+",  PT_COND_OP_ADD, 7 },
+	{ "-",  PT_COND_OP_SUB, 7 },
+	{ "*",  PT_COND_OP_MUL, 8 },
+	{ "/",  PT_COND_OP_DIV, 8 },
+	{ "%",  PT_COND_OP_MOD, 8 },
+};
+
+#define COND_BINOP_COUNT (sizeof(cond_binops_) / sizeof(cond_binops_[0]))
+
+struct cond_parser
+{
+	const char			*source;
+	const char			*p;
+	struct pt_breakpoint_cond_insn	*insns;
+	size_t				count;
+	size_t				capacity;
+	int				depth;
+	int				error;
+};
+
+static int cond_parse_expr_(struct cond_parser *);
+
+static void cond_error_(struct cond_parser *parser, const char *what)
+{
+	if (parser->error)
+		return;
+
+	pt_log("%s(): %s at offset %zu in '%s'\n", __FUNCTION__, what,
+	       (size_t)(parser->p - parser->source), parser->source);
+
+	pt_error_internal_set(PT_ERROR_SYNTAX);
+	parser->error = 1;
+}
+
+static void cond_skip_space_(struct cond_parser *parser)
+{
+	while (isspace((unsigned char)*parser->p))
+		parser->p++;
+}
+
+/* Consume 'token' if it is next in the input. */
+static int cond_accept_(struct cond_parser *parser, const char *token)
+{
+	size_t len = strlen(token);
+
+	cond_skip_space_(parser);
+
+	if (strncmp(parser->p, token, len) != 0)
+		return 0;
+
+	/* Do not split '&&' and '||' into two bitwise operators. */
+	if (len == 1 && (token[0] == '&' || token[0] == '|') &&
+	    parser->p[1] == token[0])
+		return 0;
+
+	parser->p += len;
+	return 1;
+}
+
+static size_t
+cond_emit_(struct cond_parser *parser, uint8_t opcode, uint64_t operand)
+{
+	struct pt_breakpoint_cond_insn *insns;
+	size_t capacity;
+
+	if (parser->error)
+		return 0;
+
+	if (parser->count == parser->capacity) {
+		capacity = parser->capacity ? parser->capacity * 2 : 16;
+		insns = realloc(parser->insns, capacity * sizeof *insns);
+		if (insns == NULL) {
+			pt_error_errno_set(errno);
+			parser->error = 1;
+			return 0;
+		}
+
+		parser->insns    = insns;
+		parser->capacity = capacity;
+	}
+
+	parser->insns[parser->count].opcode  = opcode;
+	parser->insns[parser->count].operand = operand;
+
+	/* Track the stack depth the program needs. */
+	switch (opcode) {
+	case PT_COND_OP_CONST:
+	case PT_COND_OP_REG:
+	case PT_COND_OP_HITS:
+	case PT_COND_OP_TID:
+		if (++parser->depth > PT_BREAKPOINT_COND_STACK_MAX)
+			cond_error_(parser, "expression too complex");
+		break;
+	case PT_COND_OP_LOAD:
+	case PT_COND_OP_NEG:
+	case PT_COND_OP_NOT:
+	case PT_COND_OP_LNOT:
+	case PT_COND_OP_BOOL:
+		break;
+	default:
+		/* Binary operators, and the fall through path of jumps. */
+		parser->depth--;
+		break;
+	}
+
+	return parser->count++;
+}
+
+static int cond_parse_primary_(struct cond_parser *parser)
+{
+	static const struct {
+		const char	*name;
+		uint8_t		size;
+	} sizes[] = {
+		{ "byte", 1 }, { "word", 2 }, { "dword", 4 }, { "qword", 8 }
+	};
+	const char *ident;
+	size_t i, len;
+	uint64_t size = 0;
+
+	cond_skip_space_(parser);
+
+	if (cond_accept_(parser, "(")) {
+		cond_parse_expr_(parser);
+		if (!cond_accept_(parser, ")"))
+			cond_error_(parser, "expected ')'");
+		return -parser->error;
+	}
+
+	if (isdigit((unsigned char)*parser->p)) {
+		char *end;
+		uint64_t value;
+
+		errno = 0;
+		value = strtoull(parser->p, &end, 0);
+		if (errno != 0) {
+			cond_error_(parser, "invalid number");
+			return -1;
+		}
+
+		parser->p = end;
+		cond_emit_(parser, PT_COND_OP_CONST, value);
+		return -parser->error;
+	}
+
+	if (*parser->p == '[')
+		goto deref;
+
+	if (!isalpha((unsigned char)*parser->p) && *parser->p != '_') {
+		cond_error_(parser, "expected an operand");
+		return -1;
+	}
+
+	ident = parser->p;
+	while (isalnum((unsigned char)*parser->p) || *parser->p == '_')
+		parser->p++;
+	len = parser->p - ident;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (strlen(sizes[i].name) == len &&
+		    strncmp(sizes[i].name, ident, len) == 0) {
+			size = sizes[i].size;
+			goto deref;
+		}
+	}
+
+	if (len == 4 && strncmp(ident, "hits", 4) == 0) {
+		cond_emit_(parser, PT_COND_OP_HITS, 0);
+		return -parser->error;
+	}
+
+	if (len == 3 && strncmp(ident, "tid", 3) == 0) {
+		cond_emit_(parser, PT_COND_OP_TID, 0);
+		return -parser->error;
+	}
+
+	for (i = 0; i < COND_REGISTER_COUNT; i++) {
+		if (strlen(cond_registers_[i].name) == len &&
+		    strncmp(cond_registers_[i].name, ident, len) == 0) {
+			cond_emit_(parser, PT_COND_OP_REG, i);
+			return -parser->error;
+		}
+	}
+
+	parser->p = ident;
+	cond_error_(parser, "unknown identifier");
+	return -1;
+
+deref:
+	if (!cond_accept_(parser, "[")) {
+		cond_error_(parser, "expected '['");
+		return -1;
+	}
+
+	cond_parse_expr_(parser);
+
+	if (!cond_accept_(parser, "]"))
+		cond_error_(parser, "expected ']'");
+
+	/* A size of 0 is resolved to the pointer size at evaluation. */
+	cond_emit_(parser, PT_COND_OP_LOAD, size);
+	return -parser->error;
+}
+
+static int cond_parse_unary_(struct cond_parser *parser)
+{
+	uint8_t opcode;
+
+	if (cond_accept_(parser, "-"))
+		opcode = PT_COND_OP_NEG;
+	else if (cond_accept_(parser, "~"))
+		opcode = PT_COND_OP_NOT;
+	else if (cond_accept_(parser, "!") )
+		opcode = PT_COND_OP_LNOT;
+	else
+		return cond_parse_primary_(parser);
+
+	cond_parse_unary_(parser);
+	cond_emit_(parser, opcode, 0);
+	return -parser->error;
+}
+
+static const struct cond_binop *cond_peek_binop_(struct cond_parser *parser)
+{
+	const char *p = parser->p;
+	size_t i;
+
+	for (i = 0; i < COND_BINOP_COUNT; i++) {
+		if (cond_accept_(parser, cond_binops_[i].token)) {
+			parser->p = p;
+			return &cond_binops_[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int cond_parse_binary_(struct cond_parser *parser, int min_precedence)
+{
+	const struct cond_binop *op;
+
+	cond_parse_unary_(parser);
+
+	while (!parser->error) {
+		op = cond_peek_binop_(parser);
+		if (op == NULL || op->precedence < min_precedence)
+			break;
+
+		cond_accept_(parser, op->token);
+		cond_parse_binary_(parser, op->precedence + 1);
+		cond_emit_(parser, op->opcode, 0);
+	}
+
+	return -parser->error;
+}
+
+/* Short circuit evaluation for '&&' and '||'.  The left operand is left
+ * on the stack as the result when the jump is taken.
+ */
+static int
+cond_parse_logical_(struct cond_parser *parser, const char *token,
+                    uint8_t jump, int (*operand)(struct cond_parser *))
+{
+	size_t insn;
+
+	operand(parser);
+
+	while (!parser->error && cond_accept_(parser, token)) {
+		cond_emit_(parser, PT_COND_OP_BOOL, 0);
+		insn = cond_emit_(parser, jump, 0);
+		operand(parser);
+		cond_emit_(parser, PT_COND_OP_BOOL, 0);
+
+		if (!parser->error)
+			parser->insns[insn].operand = parser->count;
+	}
+
+	return -parser->error;
+}
+
+static int cond_parse_land_operand_(struct cond_parser *parser)
+{
+	return cond_parse_binary_(parser, 0);
+}
+
+static int cond_parse_land_(struct cond_parser *parser)
+{
+	return cond_parse_logical_(parser, "&&", PT_COND_OP_JZ,
+	                           cond_parse_land_operand_);
+}
+
+static int cond_parse_expr_(struct cond_parser *parser)
+{
+	return cond_parse_logical_(parser, "||", PT_COND_OP_JNZ,
+	                           cond_parse_land_);
+}
+
+struct pt_breakpoint_cond *pt_breakpoint_cond_compile(const char *source)
+{
+	struct pt_breakpoint_cond *cond;
+	struct cond_parser parser;
+
+	memset(&parser, 0, sizeof parser);
+	parser.source = source;
+	parser.p      = source;
+
+	cond_parse_expr_(&parser);
+
+	cond_skip_space_(&parser);
+	if (*parser.p != '\0')
+		cond_error_(&parser, "trailing characters");
+
+	if (parser.error)
+		goto err_insns;
+
+	if ( (cond = malloc(sizeof *cond)) == NULL) {
+		pt_error_errno_set(errno);
+		goto err_insns;
+	}
+
+	if ( (cond->source = strdup(source)) == NULL) {
+		pt_error_errno_set(errno);
+		goto err_cond;
+	}
+
+	cond->insns      = parser.insns;
+	cond->insn_count = parser.count;
+
+	return cond;
+
+err_cond:
+	free(cond);
+err_insns:
+	free(parser.insns);
+	return NULL;
+}
+
+void pt_breakpoint_cond_delete(struct pt_breakpoint_cond *cond)
+{
+	if (cond == NULL)
+		return;
+
+	free(cond->source);
+	free(cond->insns);
+	free(cond);
+}
+
+static int
+cond_register_get_(struct pt_registers *regs, size_t index, uint64_t *value)
+{
+	const struct cond_register *reg = &cond_registers_[index];
+	uint8_t *base = (uint8_t *)regs;
+	uint32_t value32;
+	uint8_t size = 0;
+	int offset;
+
+	switch (regs->type) {
+	case PT_REGISTERS_X86_64:
+		offset = reg->x86_64_offset;
+		size   = reg->x86_64_size;
+		break;
+	case PT_REGISTERS_I386:
+		offset = reg->i386_offset;
+		size   = reg->i386_size;
+		break;
+	default:
+		offset = REG_NONE;
+		break;
+	}
+
+	if (offset == REG_NONE) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	if (size == 4) {
+		memcpy(&value32, base + offset, sizeof value32);
+		*value = value32;
+	} else {
+		memcpy(value, base + offset, sizeof *value);
+	}
+
+	return 0;
+}
+
+/* Returns 1 if the condition holds, 0 if it does not, and -1 if it could
+ * not be evaluated.
+ */
+int pt_breakpoint_cond_eval(struct pt_breakpoint_cond *cond,
+                            struct pt_thread *thread, struct pt_breakpoint *bp)
+{
+	uint64_t stack[PT_BREAKPOINT_COND_STACK_MAX];
+	struct pt_registers *regs = NULL;
+	struct pt_breakpoint_cond_insn *insn;
+	uint64_t a, b;
+	size_t pc = 0;
+	int sp = 0;
+	int ret = -1;
+
+#define PUSH(v)	(stack[sp++] = (v))
+#define POP()	(stack[--sp])
+#define TOP()	(stack[sp - 1])
+
+	while (pc < cond->insn_count) {
+		insn = &cond->insns[pc++];
+
+		switch (insn->opcode) {
+		case PT_COND_OP_CONST:
+			PUSH(insn->operand);
+			break;
+		case PT_COND_OP_REG:
+			/* Fetch the register context only once. */
+			if (regs == NULL && (regs = pt_thread_registers_get(thread)) == NULL)
+				goto out;
+
+			if (cond_register_get_(regs, insn->operand, &a) == -1)
+				goto out;
+
+			PUSH(a);
+			break;
+		case PT_COND_OP_HITS:
+			PUSH(bp->hits);
+			break;
+		case PT_COND_OP_TID:
+			PUSH((uint64_t)thread->tid);
+			break;
+		case PT_COND_OP_LOAD:
+			a = POP();
+			b = insn->operand ? insn->operand : thread->arch_data->pointer_size;
+
+			/* x86 is little endian, so a short read into a zeroed
+			 * 64-bit value zero extends it.
+			 */
+			stack[sp] = 0;
+			if (pt_process_read(thread->process, &stack[sp], a, b) == -1)
+				goto out;
+			sp++;
+			break;
+		case PT_COND_OP_NEG:
+			TOP() = -TOP();
+			break;
+		case PT_COND_OP_NOT:
+			TOP() = ~TOP();
+			break;
+		case PT_COND_OP_LNOT:
+			TOP() = !TOP();
+			break;
+		case PT_COND_OP_BOOL:
+			TOP() = !!TOP();
+			break;
+		case PT_COND_OP_JZ:
+			if (TOP() == 0)
+				pc = insn->operand;
+			else
+				sp--;
+			break;
+		case PT_COND_OP_JNZ:
+			if (TOP() != 0)
+				pc = insn->operand;
+			else
+				sp--;
+			break;
+		default:
+			b = POP();
+			a = POP();
+
+			switch (insn->opcode) {
+			case PT_COND_OP_ADD: a = a + b;  break;
+			case PT_COND_OP_SUB: a = a - b;  break;
+			case PT_COND_OP_MUL: a = a * b;  break;
+			case PT_COND_OP_AND: a = a & b;  break;
+			case PT_COND_OP_OR:  a = a | b;  break;
+			case PT_COND_OP_XOR: a = a ^ b;  break;
+			case PT_COND_OP_SHL: a = b < 64 ? a << b : 0; break;
+			case PT_COND_OP_SHR: a = b < 64 ? a >> b : 0; break;
+			case PT_COND_OP_EQ:  a = a == b; break;
+			case PT_COND_OP_NE:  a = a != b; break;
+			case PT_COND_OP_LT:  a = a < b;  break;
+			case PT_COND_OP_LE:  a = a <= b; break;
+			case PT_COND_OP_GT:  a = a > b;  break;
+			case PT_COND_OP_GE:  a = a >= b; break;
+			case PT_COND_OP_DIV:
+			case PT_COND_OP_MOD:
+				if (b == 0) {
+					pt_error_internal_set(PT_ERROR_ARITH_OVERFLOW);
+					goto out;
+				}
+				a = insn->opcode == PT_COND_OP_DIV ? a / b : a % b;
+				break;
+			}
+
+			PUSH(a);
+			break;
+		}
+	}
+
+	ret = sp > 0 && TOP() != 0;
+out:
+	free(regs);
+	return ret;
+
+#undef TOP
+#undef POP
+#undef PUSH
+}
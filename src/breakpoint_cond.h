@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * breakpoint_cond.h
+ *
+ * Compiled breakpoint conditions.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_BREAKPOINT_COND_INTERNAL_H
+#define PT_BREAKPOINT_COND_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum depth of the evaluation stack of a condition. */
+#define PT_BREAKPOINT_COND_STACK_MAX	32
+
+struct pt_breakpoint;
+struct pt_thread;
+
+enum pt_breakpoint_cond_opcode
+{
+	PT_COND_OP_CONST,	/* push operand                          */
+	PT_COND_OP_REG,		/* push register operand                 */
+	PT_COND_OP_HITS,	/* push breakpoint hit count             */
+	PT_COND_OP_TID,		/* push thread id                        */
+	PT_COND_OP_LOAD,	/* pop address, push operand sized value */
+	PT_COND_OP_NEG,
+	PT_COND_OP_NOT,
+	PT_COND_OP_LNOT,
+	PT_COND_OP_ADD,
+	PT_COND_OP_SUB,
+	PT_COND_OP_MUL,
+	PT_COND_OP_DIV,
+	PT_COND_OP_MOD,
+	PT_COND_OP_AND,
+	PT_COND_OP_OR,
+	PT_COND_OP_XOR,
+	PT_COND_OP_SHL,
+	PT_COND_OP_SHR,
+	PT_COND_OP_EQ,
+	PT_COND_OP_NE,
+	PT_COND_OP_LT,
+	PT_COND_OP_LE,
+	PT_COND_OP_GT,
+	PT_COND_OP_GE,
+	PT_COND_OP_JZ,		/* if top is 0 jump to operand, else pop  */
+	PT_COND_OP_JNZ,		/* if top is !0 jump to operand, else pop */
+	PT_COND_OP_BOOL		/* normalize top to 0 or 1               */
+};
+
+struct pt_breakpoint_cond_insn
+{
+	uint8_t		opcode;
+	uint64_t	operand;
+};
+
+struct pt_breakpoint_cond
+{
+	/* Source text, kept for introspection. */
+	char				*source;
+
+	size_t				insn_count;
+	struct pt_breakpoint_cond_insn	*insns;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pt_breakpoint_cond *pt_breakpoint_cond_compile(const char *source);
+void pt_breakpoint_cond_delete(struct pt_breakpoint_cond *);
+int  pt_breakpoint_cond_eval(struct pt_breakpoint_cond *,
+                             struct pt_thread *, struct pt_breakpoint *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_BREAKPOINT_COND_INTERNAL_H */
@@ -46,6 +46,8 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <libptrace/error.h>
@@ -40,6 +40,8 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -47,6 +49,8 @@
 #include <libptrace/list.h>
 #include <libptrace/log.h>
 #include "breakpoint.h"
+#include "displaced.h"
+#include "mmap.h"
 #include "process.h"
 #include "thread.h"
 
@@ -84,40 +88,50 @@ pt_breakpoint_sw_process_set(struct pt_process *process,
 
 	/* Store the byte we replaced. */
 	breakpoint->original = buf[0];
+	breakpoint->patched  = 1;
 
 	pt_log("%s(): returning 0\n", __FUNCTION__);
 	return 0;
 }
 
-static int
-pt_breakpoint_sw_process_remove(struct pt_process *process,
-                                struct pt_breakpoint_internal *bpi)
+static void
+pt_breakpoint_sw_release_(struct pt_process *process,
+                          struct pt_breakpoint_internal *bpi)
 {
-	struct pt_thread *thread;
-	int ret;
-
-	pt_log("%s(): patching back original byte 0x%.2x at 0x%p\n",
-	       __FUNCTION__, bpi->original, bpi->address);
-	/* Restore the original opcode we replaced. */
-	ret = pt_process_write(process, bpi->address, &bpi->original, 1);
-	if (ret == -1)
-		return -1;
+	struct list_head *lh, *lh2;
 
 	/* Make sure to remove this breakpoint from all threads that happen
 	 * to have it set as their breakpoint_restore.
 	 */
-	pt_process_for_each_thread (process, thread) {
-		if (thread->breakpoint_restore == NULL)
-			continue;
+	list_for_each_safe (lh, lh2, &process->threads_restore) {
+		struct pt_thread *thread;
 
+		thread = list_entry(lh, struct pt_thread, restore_list);
 		if (thread->breakpoint_restore->breakpoint == bpi->breakpoint)
-			thread->breakpoint_restore = NULL;
+			pt_thread_breakpoint_restore_set(thread, NULL);
 	}
 
 	/* Clean up the breakpoint itself. */
+	list_del_init(&bpi->retired);
 	avl_tree_delete(&process->breakpoints, &bpi->avl_node);
 	pt_breakpoint_destroy(bpi->breakpoint);
 	free(bpi);
+}
+
+static int
+pt_breakpoint_sw_process_remove(struct pt_process *process,
+                                struct pt_breakpoint_internal *bpi)
+{
+	int ret;
+
+	pt_log("%s(): patching back original byte 0x%.2x at 0x%p\n",
+	       __FUNCTION__, bpi->original, bpi->address);
+	/* Restore the original opcode we replaced. */
+	ret = pt_process_write(process, bpi->address, &bpi->original, 1);
+	if (ret == -1)
+		return -1;
+
+	pt_breakpoint_sw_release_(process, bpi);
 
 	return 0;
 }
@@ -148,11 +162,120 @@ pt_breakpoint_sw_restore(struct pt_thread *thread,
 	return pt_process_write(thread->process, breakpoint->address, "\xCC", 1);
 }
 
+static int
+pt_breakpoint_sw_displace(struct pt_thread *thread,
+                          struct pt_breakpoint_internal *breakpoint)
+{
+	return pt_displaced_step(thread, breakpoint->address);
+}
+
+/* Returns the number of breakpoints starting at bpis[0] that live on the
+ * same page as bpis[0].  The array is sorted by address.
+ */
+static size_t
+pt_breakpoint_sw_page_run_(struct pt_breakpoint_internal **bpis, size_t count)
+{
+	pt_address_t page = bpis[0]->address & PT_MMAP_PAGE_MASK;
+	size_t i;
+
+	for (i = 1; i < count; i++)
+		if ( (bpis[i]->address & PT_MMAP_PAGE_MASK) != page)
+			break;
+
+	return i;
+}
+
+static int
+pt_breakpoint_sw_process_set_many(struct pt_process *process,
+                                  struct pt_breakpoint_internal **bpis,
+                                  size_t count)
+{
+	uint8_t buf[PT_MMAP_PAGE_SIZE];
+	pt_address_t start;
+	size_t i, j, run, len;
+
+	pt_log("%s(0x%p, 0x%p, %zu)\n", __FUNCTION__, process, bpis, count);
+
+	/* Patch every page touched by this batch with a single read and a
+	 * single write covering the span from its first to its last
+	 * breakpoint.  The span can hold breakpoints set earlier, so it
+	 * is read raw to write those back unchanged.
+	 */
+	for (i = 0; i < count; i += run) {
+		run   = pt_breakpoint_sw_page_run_(&bpis[i], count - i);
+		start = bpis[i]->address;
+		len   = bpis[i + run - 1]->address - start + 1;
+
+		if (pt_process_read_raw(process, buf, start, len) == -1)
+			goto err_undo;
+
+		for (j = i; j < i + run; j++) {
+			bpis[j]->original = buf[bpis[j]->address - start];
+			buf[bpis[j]->address - start] = 0xCC;
+		}
+
+		if (pt_process_write(process, start, buf, len) == -1)
+			goto err_undo;
+
+		for (j = i; j < i + run; j++)
+			bpis[j]->patched = 1;
+	}
+
+	pt_log("%s(): returning 0\n", __FUNCTION__);
+	return 0;
+
+err_undo:
+	/* Patch back the original bytes of the pages we already wrote.  This
+	 * is a best effort attempt; the error of the failed access is kept.
+	 */
+	for (j = 0; j < i; j++)
+		pt_process_write(process, bpis[j]->address, &bpis[j]->original, 1);
+
+	pt_log("%s(): returning -1\n", __FUNCTION__);
+	return -1;
+}
+
+static int
+pt_breakpoint_sw_process_remove_many(struct pt_process *process,
+                                     struct pt_breakpoint_internal **bpis,
+                                     size_t count)
+{
+	uint8_t buf[PT_MMAP_PAGE_SIZE];
+	pt_address_t start;
+	size_t i, j, run, len;
+
+	pt_log("%s(0x%p, 0x%p, %zu)\n", __FUNCTION__, process, bpis, count);
+
+	for (i = 0; i < count; i += run) {
+		run   = pt_breakpoint_sw_page_run_(&bpis[i], count - i);
+		start = bpis[i]->address;
+		len   = bpis[i + run - 1]->address - start + 1;
+
+		if (pt_process_read_raw(process, buf, start, len) == -1)
+			return -1;
+
+		for (j = i; j < i + run; j++)
+			buf[bpis[j]->address - start] = bpis[j]->original;
+
+		if (pt_process_write(process, start, buf, len) == -1)
+			return -1;
+
+		/* The page is clean, so release the breakpoints on it. */
+		for (j = i; j < i + run; j++)
+			pt_breakpoint_sw_release_(process, bpis[j]);
+	}
+
+	return 0;
+}
+
 static struct pt_breakpoint_operations breakpoint_sw_operations = {
 	.suppress	= pt_breakpoint_sw_suppress,
 	.restore	= pt_breakpoint_sw_restore,
 	.process_set	= pt_breakpoint_sw_process_set,
 	.process_remove	= pt_breakpoint_sw_process_remove,
 	.thread_set	= NULL,
-	.thread_remove	= NULL
+	.thread_remove	= NULL,
+	.process_set_many	= pt_breakpoint_sw_process_set_many,
+	.process_remove_many	= pt_breakpoint_sw_process_remove_many,
+	.displace		= pt_breakpoint_sw_displace
 };
@@ -37,6 +37,8 @@
  *
  * Author: Ronald Huizer <ronald@immunityinc.com>
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
 #include <libptrace/log.h>
 #include <libptrace/error.h>
 #include <libptrace/breakpoint_x86.h>
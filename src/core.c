@@ -43,6 +43,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <libptrace/error.h>
 #include <libptrace/util.h>
 #include "avl.h"
@@ -51,6 +52,7 @@
 #include "handle.h"
 #include "message.h"
 #include "process.h"
+#include "recorder.h"
 
 static int process_compare_(struct avl_node *a_, struct avl_node *b_);
 struct pt_core pt_core_main_;
@@ -89,6 +91,12 @@ int pt_core_init(struct pt_core *core)
 	core->options      = PT_CORE_OPTION_AUTO_TERMINATE_MAIN;
 	core->quit         = 0;
 	core->private_data = NULL;
+	core->recorder     = NULL;
+	core->stats        = NULL;
+	core->stats_handler_ns = 0;
+	core->idle_handler = NULL;
+	core->idle_cookie  = NULL;
+	core->super_       = NULL;
 	INIT_AVL_TREE(&core->process_tree, process_compare_);
 
 	return 0;
@@ -102,6 +110,12 @@ int pt_core_destroy(struct pt_core *core)
 	if (pt_queue_destroy(&core->msg_queue) == -1)
 		return -1;
 
+	if (core->recorder != NULL)
+		pt_core_record_stop(core);
+
+	free(core->stats);
+	core->stats = NULL;
+
 	return 0;
 }
 
@@ -121,14 +135,133 @@ void pt_core_options_set(struct pt_core *core, int options)
 	core->options = options;
 }
 
+/* Start recording every debug event handled by this core to 'filename'.
+ * Recording can be paused and resumed by toggling
+ * PT_CORE_OPTION_EVENT_RECORD.
+ */
+int pt_core_record_start(struct pt_core *core, const utf8_t *filename,
+                         uint64_t capacity, int flags)
+{
+	struct pt_recorder *recorder;
+
+	if (core->recorder != NULL) {
+		pt_error_internal_set(PT_ERROR_EXISTS);
+		return -1;
+	}
+
+	if ( (recorder = pt_recorder_open(filename, capacity, flags)) == NULL)
+		return -1;
+
+	core->recorder  = recorder;
+	core->options  |= PT_CORE_OPTION_EVENT_RECORD;
+
+	return 0;
+}
+
+int pt_core_record_stop(struct pt_core *core)
+{
+	struct pt_recorder *recorder = core->recorder;
+
+	if (recorder == NULL) {
+		pt_error_internal_set(PT_ERROR_NOT_FOUND);
+		return -1;
+	}
+
+	core->options  &= ~PT_CORE_OPTION_EVENT_RECORD;
+	core->recorder  = NULL;
+
+	return pt_recorder_close(recorder);
+}
+
 int pt_core_event_wait(struct pt_core *core)
 {
+	int ret;
+
 	if (core->c_op->event_wait == NULL) {
 		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
 		return -1;
 	}
 
-	return core->c_op->event_wait(core);
+	ret = core->c_op->event_wait(core);
+
+	/* Once the backend has drained all pending debug events, give the
+	 * idle handler a chance to run.  Backends that cannot tell whether
+	 * events are pending call it after every event.
+	 */
+	if (ret == 0 && core->idle_handler != NULL &&
+	    pt_core_event_pending(core) != 1)
+		core->idle_handler(core, core->idle_cookie);
+
+	return ret;
+}
+
+/* Returns 1 if a debug event can be retrieved without blocking, 0 if not,
+ * and -1 on error or if the backend cannot tell.
+ */
+int pt_core_event_pending(struct pt_core *core)
+{
+	if (core->c_op->event_pending == NULL) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	return core->c_op->event_pending(core);
+}
+
+/* Handle at most 'max' pending debug events without blocking, or all of
+ * them if 'max' is 0.  Returns the number of debug events handled, or -1
+ * on error.  Together with pt_core_event_notify_start() this allows the
+ * core to be driven from a foreign event loop instead of pt_core_main().
+ */
+int pt_core_event_dispatch_pending(struct pt_core *core, int max)
+{
+	int ret;
+
+	if (core->c_op->event_dispatch_pending == NULL) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	ret = core->c_op->event_dispatch_pending(core, max);
+
+	if (ret > 0 && core->idle_handler != NULL &&
+	    pt_core_event_pending(core) != 1)
+		core->idle_handler(core, core->idle_cookie);
+
+	return ret;
+}
+
+/* Call 'handler' from a separate thread whenever debug events or messages
+ * become pending.  The handler is called once, and not again until the
+ * pending events have been handled by pt_core_event_dispatch_pending().
+ */
+int pt_core_event_notify_start(struct pt_core *core,
+                               void (*handler)(void *), void *cookie)
+{
+	if (core->c_op->event_notify_start == NULL) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	return core->c_op->event_notify_start(core, handler, cookie);
+}
+
+int pt_core_event_notify_stop(struct pt_core *core)
+{
+	if (core->c_op->event_notify_stop == NULL) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	return core->c_op->event_notify_stop(core);
+}
+
+void pt_core_idle_handler_set(struct pt_core *core,
+                              void (*handler)(struct pt_core *, void *),
+                              void *cookie)
+{
+	core->idle_handler = handler;
+	core->idle_cookie  = cookie;
 }
 
 struct pt_process *pt_core_process_find(struct pt_core *core, pt_pid_t pid)
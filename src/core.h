@@ -49,6 +49,8 @@
 #include "queue.h"
 
 struct pt_core;
+struct pt_recorder;
+struct pt_stats;
 
 extern struct pt_core pt_core_main_;
 
@@ -61,6 +63,10 @@ struct pt_core_operations
 	struct pt_process *(*exec)(struct pt_core *, const utf8_t *, const utf8_t *, struct pt_event_handlers *, int);
 	struct pt_process *(*execv)(struct pt_core *, const utf8_t *, utf8_t *const [], struct pt_event_handlers *, int);
 	int                (*event_wait)(struct pt_core *core);
+	int                (*event_pending)(struct pt_core *core);
+	int                (*event_dispatch_pending)(struct pt_core *core, int max);
+	int                (*event_notify_start)(struct pt_core *core, void (*)(void *), void *);
+	int                (*event_notify_stop)(struct pt_core *core);
 };
 
 struct pt_core
@@ -71,6 +77,21 @@ struct pt_core
 	void				*private_data;
 	struct pt_core_operations	*c_op;
 	struct pt_queue			msg_queue;
+
+	/* Event recorder, used with PT_CORE_OPTION_EVENT_RECORD. */
+	struct pt_recorder		*recorder;
+
+	/* Latency histograms, used with PT_CORE_OPTION_STATS. */
+	struct pt_stats			*stats;
+	/* Time spent in user handlers for the current event. */
+	uint64_t			stats_handler_ns;
+
+	/* Called once no further debug events are pending. */
+	void				(*idle_handler)(struct pt_core *, void *);
+	void				*idle_cookie;
+
+	/* Language binding object wrapping this core. */
+	void				*super_;
 };
 
 int pt_core_init(struct pt_core *);
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * displaced.c
+ *
+ * Displaced stepping over software breakpoints.
+ *
+ * Stepping over a software breakpoint traditionally means patching back the
+ * original byte, single stepping the thread, and patching the breakpoint in
+ * again.  While the original byte is in place, every other thread in the
+ * process can run past the breakpoint unnoticed, so they would need to be
+ * stopped.
+ *
+ * Instead, we copy the original instruction to a per-thread slot on a
+ * scratch page in the debuggee, followed by a jump back to the instruction
+ * after it, and resume the thread in that slot.  The breakpoint itself is
+ * never removed.  Instructions whose behaviour depends on where they are
+ * executed are either relocated (RIP relative operands) or refused, in
+ * which case the caller falls back to the old scheme.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include "arch.h"
+#include "displaced.h"
+#include "getput.h"
+#include "insn_x86.h"
+#include "process.h"
+#include "thread.h"
+
+#define REL32_MIN	((int64_t)INT32_MIN)
+#define REL32_MAX	((int64_t)INT32_MAX)
+
+static pt_address_t
+pt_displaced_slot_get_(struct pt_thread *thread, pt_address_t near)
+{
+	struct pt_process *process = thread->process;
+	struct pt_displaced *displaced = process->displaced;
+	int i;
+
+	if (displaced != NULL && thread->displaced_slot != -1)
+		return displaced->base +
+		       thread->displaced_slot * PT_DISPLACED_SLOT_SIZE;
+
+	/* The scratch page is allocated on first use, as close as we can
+	 * get to the first breakpoint we step over.  This keeps most RIP
+	 * relative operands and the jump back within a rel32.
+	 */
+	if (displaced == NULL) {
+		if ( (displaced = calloc(1, sizeof *displaced)) == NULL) {
+			pt_error_errno_set(errno);
+			return PT_ADDRESS_NULL;
+		}
+
+		displaced->base = pt_process_malloc_near(process,
+		                                         PT_MMAP_PAGE_SIZE, near);
+		if (displaced->base == PT_ADDRESS_NULL) {
+			free(displaced);
+			return PT_ADDRESS_NULL;
+		}
+
+		process->displaced = displaced;
+	}
+
+	for (i = 0; i < PT_DISPLACED_SLOTS; i++) {
+		if (displaced->used[i / 8] & (1 << (i % 8)))
+			continue;
+
+		displaced->used[i / 8] |= 1 << (i % 8);
+		thread->displaced_slot = i;
+
+		return displaced->base + i * PT_DISPLACED_SLOT_SIZE;
+	}
+
+	pt_error_internal_set(PT_ERROR_RESOURCE_LIMIT);
+	return PT_ADDRESS_NULL;
+}
+
+void pt_displaced_slot_release(struct pt_thread *thread)
+{
+	struct pt_displaced *displaced = thread->process->displaced;
+	int slot = thread->displaced_slot;
+
+	if (displaced == NULL || slot == -1)
+		return;
+
+	displaced->used[slot / 8] &= ~(1 << (slot % 8));
+	thread->displaced_slot = -1;
+}
+
+void pt_displaced_destroy(struct pt_process *process)
+{
+	struct pt_displaced *displaced = process->displaced;
+
+	if (displaced == NULL)
+		return;
+
+	/* The page itself is left mapped in the debuggee, as a thread that
+	 * was resumed in its slot may not have left it yet when we detach.
+	 */
+	free(displaced);
+	process->displaced = NULL;
+}
+
+/* Read the instruction at 'address' without the breakpoints in it.  The
+ * instruction may end at the last byte of a mapping, so we only insist on
+ * the part up to the page boundary.
+ */
+static ssize_t
+pt_displaced_insn_read_(struct pt_process *process, uint8_t *buf,
+                        pt_address_t address)
+{
+	size_t len;
+
+	len = PT_MMAP_PAGE_SIZE - (address & ~PT_MMAP_PAGE_MASK);
+	if (len >= X86_INSN_LENGTH_MAX)
+		return pt_process_read(process, buf, address, X86_INSN_LENGTH_MAX);
+
+	if (pt_process_read(process, buf, address, len) == -1)
+		return -1;
+
+	if (pt_process_read(process, buf + len, address + len,
+	                    X86_INSN_LENGTH_MAX - len) == -1)
+		return len;
+
+	return X86_INSN_LENGTH_MAX;
+}
+
+/* Execute the instruction at 'address' out of line for 'thread'.  On
+ * success the thread pc is moved to its slot; on failure nothing in the
+ * thread or process has been changed.
+ */
+int pt_displaced_step(struct pt_thread *thread, pt_address_t address)
+{
+	struct pt_process *process = thread->process;
+	uint8_t buf[PT_DISPLACED_SLOT_SIZE];
+	struct x86_insn insn;
+	pt_address_t slot;
+	int64_t disp, rel;
+	ssize_t size;
+	int mode, len;
+
+	mode = thread->arch_data->pointer_size == 8 ? X86_INSN_MODE_64
+	                                            : X86_INSN_MODE_32;
+
+	if ( (size = pt_displaced_insn_read_(process, buf, address)) == -1)
+		return -1;
+
+	if ( (len = x86_insn_decode(&insn, buf, size, mode)) == -1)
+		return -1;
+
+	/* Relative branches and calls would need to be emulated rather than
+	 * relocated, and traps report the wrong address.
+	 */
+	if (insn.flags & (X86_INSN_FLAG_BRANCH_RELATIVE |
+	                  X86_INSN_FLAG_CALL | X86_INSN_FLAG_TRAP)) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	if ( (slot = pt_displaced_slot_get_(thread, address)) == PT_ADDRESS_NULL)
+		return -1;
+
+	/* Retarget RIP relative operands to the memory they referred to. */
+	if (insn.flags & X86_INSN_FLAG_RIP_RELATIVE) {
+		disp  = (int32_t)GET_32BIT_LSB(&buf[insn.disp_offset]);
+		disp += (int64_t)(address - slot);
+
+		if (disp < REL32_MIN || disp > REL32_MAX) {
+			pt_error_internal_set(PT_ERROR_ARITH_OVERFLOW);
+			return -1;
+		}
+
+		PUT_32BIT_LSB(&buf[insn.disp_offset], (uint32_t)disp);
+	}
+
+	/* Jump back to the instruction following the original one.  In
+	 * 32-bit mode a rel32 always reaches, as it wraps around.
+	 */
+	rel = (int64_t)((address + len) - (slot + len + 5));
+	if (mode == X86_INSN_MODE_32 || (rel >= REL32_MIN && rel <= REL32_MAX)) {
+		buf[len] = 0xE9;
+		PUT_32BIT_LSB(&buf[len + 1], (uint32_t)rel);
+		size = len + 5;
+	} else {
+		/* jmp qword [rip + 0], followed by the target. */
+		memcpy(&buf[len], "\xFF\x25\x00\x00\x00\x00", 6);
+		PUT_64BIT_LSB(&buf[len + 6], (uint64_t)(address + len));
+		size = len + 14;
+	}
+
+	if (pt_process_write(process, slot, buf, size) == -1)
+		return -1;
+
+	if (pt_thread_register_pc_set(thread, slot) == -1)
+		return -1;
+
+	pt_log("%s(): stepping %d byte instruction at 0x%p from 0x%p\n",
+	       __FUNCTION__, len, address, slot);
+
+	return 0;
+}
@@ -113,7 +113,8 @@ static const char *pt_error_internal_str_[] = {
 	"Invalid ptrace core",
 	"Non-blocking operation would block",
 	"Invalid message size",
-	"Invalid handle"
+	"Invalid handle",
+	"Syntax error"
 };
 
 void pt_error_internal_set(int err)
@@ -41,18 +41,13 @@
  *
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <libptrace/error.h>
 #include <libptrace/list.h>
 #include "event.h"
 
-void pt_event_handler_destroy(struct pt_event_handler *handler)
-{
-	list_del(&handler->list);
-	free(handler);
-}
-
 void pt_event_handlers_init(struct pt_event_handlers *handlers)
 {
 	assert(handlers != NULL);
@@ -107,27 +102,121 @@ void pt_event_handlers_internal_delete(struct pt_event_handlers_internal *handle
 	free(handlers);
 }
 
+/* Returns the PT_EVENT_CLASS_* mask of events that have handlers. */
+uint32_t pt_event_handlers_internal_mask(struct pt_event_handlers_internal *handlers)
+{
+	uint32_t mask = 0;
+
+	assert(handlers != NULL);
+
+	if (!pt_event_handler_stack_empty(&handlers->attached))
+		mask |= PT_EVENT_CLASS_ATTACHED;
+	if (!pt_event_handler_stack_empty(&handlers->process_exit))
+		mask |= PT_EVENT_CLASS_PROCESS_EXIT;
+	if (!pt_event_handler_stack_empty(&handlers->thread_create))
+		mask |= PT_EVENT_CLASS_THREAD_CREATE;
+	if (!pt_event_handler_stack_empty(&handlers->thread_exit))
+		mask |= PT_EVENT_CLASS_THREAD_EXIT;
+	if (!pt_event_handler_stack_empty(&handlers->module_load))
+		mask |= PT_EVENT_CLASS_MODULE_LOAD;
+	if (!pt_event_handler_stack_empty(&handlers->module_unload))
+		mask |= PT_EVENT_CLASS_MODULE_UNLOAD;
+
+	if (handlers->remote_break != NULL)
+		mask |= PT_EVENT_CLASS_REMOTE_BREAK;
+	if (handlers->breakpoint != NULL)
+		mask |= PT_EVENT_CLASS_BREAKPOINT;
+	if (handlers->single_step != NULL)
+		mask |= PT_EVENT_CLASS_SINGLE_STEP;
+	if (handlers->segfault != NULL)
+		mask |= PT_EVENT_CLASS_SEGFAULT;
+	if (handlers->illegal_instruction != NULL)
+		mask |= PT_EVENT_CLASS_ILLEGAL_INSTRUCTION;
+	if (handlers->divide_by_zero != NULL)
+		mask |= PT_EVENT_CLASS_DIVIDE_BY_ZERO;
+	if (handlers->priv_instruction != NULL)
+		mask |= PT_EVENT_CLASS_PRIV_INSTRUCTION;
+	if (handlers->unknown_exception != NULL)
+		mask |= PT_EVENT_CLASS_UNKNOWN_EXCEPTION;
+	if (handlers->x86_dr != NULL)
+		mask |= PT_EVENT_CLASS_X86_DR;
+
+	return mask;
+}
+
+static inline struct pt_event_handler *
+handler_stack_array_(struct pt_event_handler_stack *stack)
+{
+	return stack->heap != NULL ? stack->heap : stack->inline_;
+}
+
+/* Squeeze out the tombstones, keeping the order of the handlers. */
+static void handler_stack_compact_(struct pt_event_handler_stack *stack)
+{
+	struct pt_event_handler *handlers = handler_stack_array_(stack);
+	uint16_t i, j;
+
+	for (i = j = 0; i < stack->count; i++)
+		if (handlers[i].handler != NULL)
+			handlers[j++] = handlers[i];
+
+	stack->count      = j;
+	stack->tombstones = 0;
+}
+
+static int handler_stack_grow_(struct pt_event_handler_stack *stack)
+{
+	struct pt_event_handler *handlers;
+	size_t capacity = (size_t)stack->capacity * 2;
+
+	if (capacity > UINT16_MAX) {
+		pt_error_internal_set(PT_ERROR_RESOURCE_LIMIT);
+		return -1;
+	}
+
+	if (stack->heap == NULL) {
+		handlers = malloc(capacity * sizeof *handlers);
+		if (handlers != NULL)
+			memcpy(handlers, stack->inline_, sizeof stack->inline_);
+	} else {
+		handlers = realloc(stack->heap, capacity * sizeof *handlers);
+	}
+
+	if (handlers == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	stack->heap     = handlers;
+	stack->capacity = capacity;
+
+	return 0;
+}
+
 void pt_event_handler_stack_init(struct pt_event_handler_stack *stack)
 {
 	assert(stack != NULL);
-	list_init(&stack->list);
+
+	stack->heap        = NULL;
+	stack->count       = 0;
+	stack->capacity    = PT_EVENT_HANDLER_STACK_INLINE;
+	stack->tombstones  = 0;
+	stack->dispatching = 0;
+	stack->generation  = 0;
 }
 
 void pt_event_handler_stack_destroy(struct pt_event_handler_stack *stack)
 {
-	struct pt_event_handler *handler;
-	struct list_head *lh, *lh2;
-
 	assert(stack != NULL);
 
-	list_for_each_safe (lh, lh2, &stack->list) {
-		handler = list_entry(lh, struct pt_event_handler, list);
-		list_del(&handler->list);
-		free(handler);
-	}
+	free(stack->heap);
+	pt_event_handler_stack_init(stack);
 }
 
-struct pt_event_handler *
+/* Push a handler on the stack.  Returns an id for the handler to remove
+ * it with, or 0 on failure.
+ */
+uint32_t
 pt_event_handler_stack_push(struct pt_event_handler_stack *stack,
                             int (*handler)(struct pt_event *), void *cookie)
 {
@@ -136,30 +225,82 @@ pt_event_handler_stack_push(struct pt_event_handler_stack *stack,
 	assert(stack != NULL);
 	assert(handler != NULL);
 
-	if ( (ev_handler = malloc(sizeof *ev_handler)) == NULL) {
-		pt_error_errno_set(errno);
-		return NULL;
+	if (stack->count == stack->capacity) {
+		if (stack->tombstones != 0 && stack->dispatching == 0)
+			handler_stack_compact_(stack);
+		else if (handler_stack_grow_(stack) == -1)
+			return 0;
 	}
 
+	/* Skip id 0 when the generation wraps. */
+	if (++stack->generation == 0)
+		stack->generation = 1;
+
+	ev_handler = &handler_stack_array_(stack)[stack->count++];
 	ev_handler->handler = handler;
 	ev_handler->cookie  = cookie;
-	list_add(&ev_handler->list, &stack->list);
+	ev_handler->id      = stack->generation;
+
+	return ev_handler->id;
+}
+
+int pt_event_handler_stack_remove(struct pt_event_handler_stack *stack,
+                                  uint32_t id)
+{
+	struct pt_event_handler *handlers;
+	uint16_t i;
+
+	assert(stack != NULL);
+
+	handlers = handler_stack_array_(stack);
+	for (i = 0; i < stack->count; i++) {
+		if (handlers[i].id == id && handlers[i].handler != NULL)
+			break;
+	}
+
+	if (i == stack->count) {
+		pt_error_internal_set(PT_ERROR_NOT_FOUND);
+		return -1;
+	}
+
+	handlers[i].handler = NULL;
+	stack->tombstones++;
+
+	if (stack->dispatching == 0)
+		handler_stack_compact_(stack);
 
-	return ev_handler;
+	return 0;
+}
+
+int pt_event_handler_stack_empty(struct pt_event_handler_stack *stack)
+{
+	assert(stack != NULL);
+	return stack->count == stack->tombstones;
 }
 
 int pt_event_handler_stack_call(struct pt_event_handler_stack *stack,
                                 struct pt_event *ev)
 {
 	struct pt_event_handler *handler;
-	struct list_head *lh, *lh2;
+	uint32_t generation;
 	int ret = PT_EVENT_DROP;
+	uint16_t i;
 
 	assert(stack != NULL);
 	assert(ev != NULL);
 
-	list_for_each_safe (lh, lh2, &stack->list) {
-		handler = list_entry(lh, struct pt_event_handler, list);
+	generation = stack->generation;
+	stack->dispatching++;
+
+	/* Handlers may push or remove handlers, which can move the array,
+	 * so we index it again for every handler.
+	 */
+	for (i = stack->count; i-- > 0; ) {
+		handler = &handler_stack_array_(stack)[i];
+
+		/* Skip removed handlers, and those pushed during dispatch. */
+		if (handler->handler == NULL || handler->id > generation)
+			continue;
 
 		ev->cookie = handler->cookie;
 		ret = handler->handler(ev);
@@ -167,5 +308,8 @@ int pt_event_handler_stack_call(struct pt_event_handler_stack *stack,
 			break;
 	}
 
+	if (--stack->dispatching == 0 && stack->tombstones != 0)
+		handler_stack_compact_(stack);
+
 	return ret;
 }
@@ -43,22 +43,38 @@
 #ifndef PT_EVENT_INTERNAL_H
 #define PT_EVENT_INTERNAL_H
 
+#include <stdint.h>
 #include <libptrace/event.h>
 #include <libptrace/list.h>
 #include <libptrace/types.h>
 
 typedef int (*pt_event_handler_t)(struct pt_event *);
 
+/* Handlers per stack that are stored without any allocation. */
+#define PT_EVENT_HANDLER_STACK_INLINE	4
+
 struct pt_event_handler
 {
-	pt_event_handler_t	handler;
+	pt_event_handler_t	handler;	/* NULL when removed. */
 	void			*cookie;
-	struct list_head	list;
+	uint32_t		id;
 };
 
+/* Event handler stacks are arrays, with the top of the stack at the end.
+ * Handlers removed during dispatch are left as tombstones, and the array
+ * is compacted once the outermost dispatch returns.  Every push gets a
+ * new generation as its id, so that a dispatch can skip the handlers
+ * pushed while it is running.
+ */
 struct pt_event_handler_stack
 {
-	struct list_head	list;
+	struct pt_event_handler	*heap;		/* NULL when inline.       */
+	uint16_t		count;		/* Including tombstones.   */
+	uint16_t		capacity;
+	uint16_t		tombstones;
+	uint16_t		dispatching;	/* Dispatch nesting depth. */
+	uint32_t		generation;
+	struct pt_event_handler	inline_[PT_EVENT_HANDLER_STACK_INLINE];
 };
 
 struct pt_event_handlers_internal
@@ -90,14 +106,16 @@ void pt_event_handler_stack_init(struct pt_event_handler_stack *stack);
 void pt_event_handler_stack_destroy(struct pt_event_handler_stack *stack);
 int  pt_event_handler_stack_call(struct pt_event_handler_stack *stack,
                                  struct pt_event *ev);
+int  pt_event_handler_stack_empty(struct pt_event_handler_stack *stack);
 
-struct pt_event_handler *pt_event_handler_stack_push(struct pt_event_handler_stack *,
-                                                     int (*)(struct pt_event *), void *);
+uint32_t pt_event_handler_stack_push(struct pt_event_handler_stack *,
+                                     int (*)(struct pt_event *), void *);
+int      pt_event_handler_stack_remove(struct pt_event_handler_stack *, uint32_t);
 
 void pt_event_handlers_internal_init(struct pt_event_handlers_internal *);
 struct pt_event_handlers_internal *pt_event_handlers_internal_new(void);
 void pt_event_handlers_internal_destroy(struct pt_event_handlers_internal *handlers);
-void pt_event_handler_destroy(struct pt_event_handler *handler);
+uint32_t pt_event_handlers_internal_mask(struct pt_event_handlers_internal *handlers);
 
 #ifdef __cplusplus
 };
@@ -142,9 +142,22 @@ struct pt_file_buffer
 	off_t	pos;
 };
 
+/* A file mapped into our own address space. */
+struct pt_file_mapping
+{
+	uint8_t	*base;
+	size_t	size;
+	void	*file;
+	void	*mapping;
+};
+
 extern const struct pt_file_operations pt_file_c_operations;
 extern const struct pt_file_operations pt_file_native_operations;
 extern const struct pt_file_operations pt_file_buffer_operations;
 extern const struct pt_file_operations pt_file_process_operations;
 
+int pt_file_mapping_open(struct pt_file_mapping *, const utf8_t *, size_t, int);
+int pt_file_mapping_sync(struct pt_file_mapping *);
+int pt_file_mapping_close(struct pt_file_mapping *);
+
 #endif	/* !PT_FILE_INTERNAL_H */
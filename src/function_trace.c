@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * function_trace.c
+ *
+ * libptrace function entry and exit tracing.
+ *
+ * Function entry is traced with a breakpoint on the function.  On entry we
+ * push the call on a per-thread shadow stack and make sure there is a
+ * breakpoint on its return address.  Return breakpoints are shared by all
+ * pending calls returning to the same address and reference counted, so
+ * recursion and multiple threads work out.
+ *
+ * Calls do not always return: longjmp() and exceptions unwind the stack
+ * past them.  We identify each pending call by the stack pointer on entry,
+ * and drop every call whose return address slot the stack pointer has
+ * moved past when we next see the thread enter or leave a traced function.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_BREAKPOINT
+
+#include <errno.h>
+#include <stdlib.h>
+#include <libptrace/error.h>
+#include <libptrace/function_trace.h>
+#include <libptrace/list.h>
+#include <libptrace/log.h>
+#include <libptrace/util.h>
+#include "breakpoint.h"
+#include "breakpoint_sw.h"
+#include "function_trace.h"
+#include "process.h"
+#include "thread.h"
+#include "windows/cconv.h"
+
+static void function_return_handler_(struct pt_thread *, void *);
+
+void pt_function_stack_init(struct pt_function_stack *fs)
+{
+	fs->frames = NULL;
+	fs->count  = 0;
+	fs->size   = 0;
+}
+
+/* Take a reference to the return breakpoint at 'address', creating it if
+ * needed.
+ */
+static struct pt_function_return *
+function_return_get_(struct pt_process *process, pt_address_t address)
+{
+	struct pt_function_return *ret;
+	struct pt_breakpoint *bp;
+
+	if ( (bp = pt_process_breakpoint_find(process, address)) != NULL) {
+		/* Someone else owns a breakpoint here. */
+		if (bp->handler != function_return_handler_) {
+			pt_error_internal_set(PT_ERROR_EXISTS);
+			return NULL;
+		}
+
+		ret = bp->cookie;
+		ret->refcount++;
+		return ret;
+	}
+
+	if ( (ret = malloc(sizeof *ret)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	pt_breakpoint_sw_init(&ret->breakpoint);
+	ret->breakpoint.address = address;
+	ret->breakpoint.handler = function_return_handler_;
+	ret->breakpoint.cookie  = ret;
+	ret->refcount           = 1;
+
+	if (pt_process_breakpoint_set(process, &ret->breakpoint) == -1) {
+		free(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+static void
+function_return_put_(struct pt_process *process, struct pt_function_return *ret)
+{
+	if (--ret->refcount != 0)
+		return;
+
+	/* If we cannot remove the breakpoint it stays registered with a
+	 * reference count of 0, and is picked up again by the next call
+	 * returning there.
+	 */
+	if (pt_process_breakpoint_remove(process, &ret->breakpoint) == -1) {
+		pt_log("%s(): cannot remove return breakpoint at 0x%p: %s\n",
+		       __FUNCTION__, ret->breakpoint.address, pt_error_strerror());
+		return;
+	}
+
+	free(ret);
+}
+
+static int
+function_stack_push_(struct pt_function_stack *fs,
+                     struct pt_function_frame *frame)
+{
+	struct pt_function_frame *frames;
+	size_t size;
+
+	if (fs->count == fs->size) {
+		size = fs->size == 0 ? 16 : fs->size * 2;
+
+		if ( (frames = realloc(fs->frames, size * sizeof *frames)) == NULL) {
+			pt_error_errno_set(errno);
+			return -1;
+		}
+
+		fs->frames = frames;
+		fs->size   = size;
+	}
+
+	fs->frames[fs->count++] = *frame;
+	return 0;
+}
+
+/* Drop the pending calls of 'thread' whose return address slot is at or
+ * below 'sp'.  These can no longer return normally.
+ */
+static void
+function_stack_unwind_(struct pt_thread *thread, pt_address_t sp)
+{
+	struct pt_function_stack *fs = &thread->function_stack;
+	struct pt_function_frame *frame;
+
+	while (fs->count > 0 && fs->frames[fs->count - 1].sp <= sp) {
+		frame = &fs->frames[--fs->count];
+
+		pt_log("%s(): unwinding stale frame 0x%p returning to 0x%p\n",
+		       __FUNCTION__, frame->sp, frame->ret->breakpoint.address);
+
+		function_return_put_(thread->process, frame->ret);
+	}
+}
+
+/* Drop all pending calls of 'trace' on 'thread'. */
+static void
+function_stack_drop_(struct pt_thread *thread, struct pt_function_trace *trace)
+{
+	struct pt_function_stack *fs = &thread->function_stack;
+	size_t i, j;
+
+	for (i = j = 0; i < fs->count; i++) {
+		if (fs->frames[i].trace == trace)
+			function_return_put_(thread->process, fs->frames[i].ret);
+		else
+			fs->frames[j++] = fs->frames[i];
+	}
+
+	fs->count = j;
+}
+
+static void function_entry_handler_(struct pt_thread *thread, void *cookie)
+{
+	struct pt_function_trace *trace = cookie;
+	struct pt_function_frame frame;
+	pt_register_t retaddr;
+
+	trace->calls++;
+
+	/* Without a return address we still report the entry, but will not
+	 * see the call return.
+	 */
+	pt_error_clear();
+	frame.sp = pt_cconv_function_stack_get(thread);
+	retaddr  = pt_cconv_function_retaddr_get(thread);
+	if (pt_error_is_set()) {
+		pt_log("%s(): cannot get return address: %s\n",
+		       __FUNCTION__, pt_error_strerror());
+		goto out;
+	}
+
+	/* The call just stored its return address at the stack pointer, so
+	 * anything pending at or below it is stale.
+	 */
+	function_stack_unwind_(thread, frame.sp);
+
+	if ( (frame.ret = function_return_get_(thread->process, retaddr)) == NULL) {
+		pt_log("%s(): cannot trace return to 0x%p: %s\n",
+		       __FUNCTION__, retaddr, pt_error_strerror());
+		goto out;
+	}
+
+	frame.trace = trace;
+	frame.start = pt_util_time_ns();
+
+	if (function_stack_push_(&thread->function_stack, &frame) == -1)
+		function_return_put_(thread->process, frame.ret);
+
+out:
+	if (trace->entry != NULL)
+		trace->entry(thread, trace->cookie);
+}
+
+static void function_return_handler_(struct pt_thread *thread, void *cookie)
+{
+	struct pt_function_stack *fs = &thread->function_stack;
+	struct pt_function_return *ret = cookie;
+	struct pt_function_frame frame;
+	pt_register_t retval;
+	uint64_t duration;
+	pt_address_t sp;
+	int found = 0;
+
+	pt_error_clear();
+	sp = pt_cconv_function_stack_get(thread);
+	if (pt_error_is_set())
+		return;
+
+	/* The return popped the return address, so every pending call below
+	 * the stack pointer has finished.  The outermost of them returned
+	 * here; the others were unwound without returning.
+	 */
+	while (fs->count > 0 && fs->frames[fs->count - 1].sp < sp) {
+		frame = fs->frames[--fs->count];
+
+		if (frame.ret == ret &&
+		    (fs->count == 0 || fs->frames[fs->count - 1].sp >= sp)) {
+			found = 1;
+			break;
+		}
+
+		pt_log("%s(): unwinding stale frame 0x%p returning to 0x%p\n",
+		       __FUNCTION__, frame.sp, frame.ret->breakpoint.address);
+		function_return_put_(thread->process, frame.ret);
+	}
+
+	/* Another thread, or a call we did not see enter. */
+	if (!found)
+		return;
+
+	duration = pt_util_time_ns() - frame.start;
+	retval   = pt_cconv_function_retval_get(thread);
+
+	/* The handler may remove the trace, but we keep our reference to
+	 * the return breakpoint until it is done.
+	 */
+	if (frame.trace->exit != NULL)
+		frame.trace->exit(thread, retval, duration, frame.trace->cookie);
+
+	function_return_put_(thread->process, ret);
+}
+
+/** Trace calls to the function at 'address'.
+ *
+ * 'entry' is called on every call to the function, and 'exit' when such
+ * a call returns.  Either can be NULL.
+ */
+struct pt_function_trace *
+pt_function_trace_set(struct pt_process *process, pt_address_t address,
+                      pt_function_entry_handler_t entry,
+                      pt_function_exit_handler_t exit, void *cookie)
+{
+	struct pt_function_trace *trace;
+
+	if ( (trace = malloc(sizeof *trace)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	pt_breakpoint_sw_init(&trace->breakpoint);
+	trace->breakpoint.address = address;
+	trace->breakpoint.handler = function_entry_handler_;
+	trace->breakpoint.cookie  = trace;
+	trace->process            = process;
+	trace->entry              = entry;
+	trace->exit               = exit;
+	trace->cookie             = cookie;
+	trace->calls              = 0;
+
+	if (pt_process_breakpoint_set(process, &trace->breakpoint) == -1) {
+		free(trace);
+		return NULL;
+	}
+
+	list_add_tail(&trace->list, &process->function_traces);
+
+	return trace;
+}
+
+/* Stop tracing and release the pending calls of this trace.  Calls in
+ * progress will not report their exit.
+ */
+int pt_function_trace_remove(struct pt_function_trace *trace)
+{
+	struct pt_process *process = trace->process;
+	struct pt_thread *thread;
+
+	if (pt_process_breakpoint_remove(process, &trace->breakpoint) == -1)
+		return -1;
+
+	pt_process_for_each_thread (process, thread)
+		function_stack_drop_(thread, trace);
+
+	list_del(&trace->list);
+	free(trace);
+
+	return 0;
+}
+
+uint64_t pt_function_trace_calls_get(struct pt_function_trace *trace)
+{
+	return trace->calls;
+}
+
+size_t pt_function_trace_depth_get(struct pt_thread *thread)
+{
+	return thread->function_stack.count;
+}
+
+void pt_function_trace_thread_destroy(struct pt_thread *thread)
+{
+	struct pt_function_stack *fs = &thread->function_stack;
+
+	while (fs->count > 0)
+		function_return_put_(thread->process, fs->frames[--fs->count].ret);
+
+	free(fs->frames);
+	pt_function_stack_init(fs);
+}
+
+void pt_function_trace_process_destroy(struct pt_process *process)
+{
+	struct pt_function_trace *trace;
+	struct list_head *lh, *lh2;
+
+	list_for_each_safe (lh, lh2, &process->function_traces) {
+		trace = list_entry(lh, struct pt_function_trace, list);
+		pt_function_trace_remove(trace);
+	}
+}
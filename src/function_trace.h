@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * function_trace.h
+ *
+ * libptrace function entry and exit tracing.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_FUNCTION_TRACE_INTERNAL_H
+#define PT_FUNCTION_TRACE_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libptrace/function_trace.h>
+#include <libptrace/list.h>
+#include <libptrace/types.h>
+#include "breakpoint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Breakpoint on a return address, shared by all pending calls that will
+ * return there.
+ */
+struct pt_function_return
+{
+	struct pt_breakpoint		breakpoint;
+	unsigned long			refcount;
+};
+
+struct pt_function_trace
+{
+	struct pt_breakpoint		breakpoint;
+	struct pt_process		*process;
+	pt_function_entry_handler_t	entry;
+	pt_function_exit_handler_t	exit;
+	void				*cookie;
+	uint64_t			calls;
+
+	/* Entry on the process list of function traces. */
+	struct list_head		list;
+};
+
+/* A call that has not returned yet.  'sp' is the stack pointer on entry,
+ * which points to the return address.
+ */
+struct pt_function_frame
+{
+	struct pt_function_trace	*trace;
+	struct pt_function_return	*ret;
+	pt_address_t			sp;
+	uint64_t			start;
+};
+
+/* Per-thread shadow return stack. */
+struct pt_function_stack
+{
+	struct pt_function_frame	*frames;
+	size_t				count;
+	size_t				size;
+};
+
+void pt_function_stack_init(struct pt_function_stack *);
+void pt_function_trace_thread_destroy(struct pt_thread *);
+void pt_function_trace_process_destroy(struct pt_process *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_FUNCTION_TRACE_INTERNAL_H */
@@ -0,0 +1,674 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * fuzz.c
+ *
+ * libptrace persistent-mode fuzzing loop.
+ *
+ * We wait for the target function to be called once, and then use that
+ * call to run the function over and over again inside the same process.
+ * On entry we record the register context of the thread and take a
+ * snapshot of the writable memory of the process.  Every iteration
+ * writes a new input, resets the registers to the entry context, and
+ * lets the function run until it returns to its caller or faults.  Both
+ * are caught on the fuzzing thread, after which only the pages that the
+ * iteration dirtied are restored before the next iteration starts.
+ *
+ * When the loop ends the process is put back in the state of the
+ * original call, which then runs as if nothing happened.
+ *
+ * Memory is restored process-wide, so other threads should be idle
+ * while the loop runs.  There is no hang detection: an iteration that
+ * never returns stalls the loop.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_FUZZ
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/fuzz.h>
+#include <libptrace/log.h>
+#include <libptrace/snapshot.h>
+#include <libptrace/util.h>
+#include "breakpoint.h"
+#include "breakpoint_sw.h"
+#include "fuzz.h"
+#include "process.h"
+#include "registers.h"
+#include "thread.h"
+#include "windows/cconv.h"
+
+static int fuzz_segfault_(struct pt_event_segfault *);
+static int fuzz_illegal_instruction_(struct pt_event_illegal_instruction *);
+static int fuzz_divide_by_zero_(struct pt_event_divide_by_zero *);
+static int fuzz_priv_instruction_(struct pt_event_priv_instruction *);
+static int fuzz_unknown_exception_(struct pt_event_unknown_exception *);
+
+/* Hook the exception handlers of 'process'.  Our handlers may still be
+ * installed by an earlier loop, in which case they are left alone, as
+ * chaining to them again would loop forever.
+ */
+static void fuzz_handlers_install_(struct pt_process *process)
+{
+	struct pt_event_handlers_internal *h = &process->handlers;
+	struct pt_fuzz_hooks *hooks = &process->fuzz_hooks;
+
+	if (hooks->installed)
+		return;
+
+	hooks->segfault            = h->segfault;
+	hooks->illegal_instruction = h->illegal_instruction;
+	hooks->divide_by_zero      = h->divide_by_zero;
+	hooks->priv_instruction    = h->priv_instruction;
+	hooks->unknown_exception   = h->unknown_exception;
+	hooks->installed           = 1;
+
+	h->segfault                = fuzz_segfault_;
+	h->illegal_instruction     = fuzz_illegal_instruction_;
+	h->divide_by_zero          = fuzz_divide_by_zero_;
+	h->priv_instruction        = fuzz_priv_instruction_;
+	h->unknown_exception       = fuzz_unknown_exception_;
+}
+
+/* Put back the handlers we chained to, unless someone installed theirs
+ * on top of ours in the meantime.  Ours then stay installed, and pass
+ * every event on until the process goes away.
+ */
+static void fuzz_handlers_remove_(struct pt_process *process)
+{
+	struct pt_event_handlers_internal *h = &process->handlers;
+	struct pt_fuzz_hooks *hooks = &process->fuzz_hooks;
+
+	if (!hooks->installed ||
+	    h->segfault != fuzz_segfault_ ||
+	    h->illegal_instruction != fuzz_illegal_instruction_ ||
+	    h->divide_by_zero != fuzz_divide_by_zero_ ||
+	    h->priv_instruction != fuzz_priv_instruction_ ||
+	    h->unknown_exception != fuzz_unknown_exception_)
+		return;
+
+	h->segfault            = hooks->segfault;
+	h->illegal_instruction = hooks->illegal_instruction;
+	h->divide_by_zero      = hooks->divide_by_zero;
+	h->priv_instruction    = hooks->priv_instruction;
+	h->unknown_exception   = hooks->unknown_exception;
+	hooks->installed       = 0;
+}
+
+/* End the loop.  With 'restore' set the process is put back in the state
+ * of the original call first.  The done handler may delete the loop, so
+ * it is the last thing we do.
+ */
+static void fuzz_finish_(struct pt_fuzz *fuzz, int restore)
+{
+	struct pt_process *process = fuzz->process;
+
+	if (fuzz->state == PT_FUZZ_STATE_DONE)
+		return;
+
+	if (fuzz->state == PT_FUZZ_STATE_RUNNING) {
+		fuzz->end = pt_util_time_ns();
+
+		if (restore &&
+		    (pt_process_restore_memory(process, fuzz->snapshot) == -1 ||
+		     pt_thread_registers_set(fuzz->thread, fuzz->regs) == -1))
+			pt_log("%s(): cannot restore original state: %s\n",
+			       __FUNCTION__, pt_error_strerror());
+	}
+
+	if (fuzz->entry_set) {
+		pt_process_breakpoint_remove(process, &fuzz->entry);
+		fuzz->entry_set = 0;
+	}
+
+	if (fuzz->ret_set) {
+		pt_process_breakpoint_remove(process, &fuzz->ret);
+		fuzz->ret_set = 0;
+	}
+
+	fuzz_handlers_remove_(process);
+	process->fuzz = NULL;
+	fuzz->state   = PT_FUZZ_STATE_DONE;
+	fuzz->thread  = NULL;
+
+	pt_log("%s(): %llu iterations, %llu crashes\n", __FUNCTION__,
+	       (unsigned long long)fuzz->iterations,
+	       (unsigned long long)fuzz->crash_total);
+
+	if (fuzz->done != NULL)
+		fuzz->done(fuzz, fuzz->cookie);
+}
+
+/* Start an iteration.  The fuzzing thread is stopped, and memory is in
+ * the state of the snapshot.
+ */
+static void fuzz_iteration_(struct pt_fuzz *fuzz)
+{
+	struct pt_fuzz_target *target = &fuzz->target;
+	ssize_t len;
+
+	if (fuzz->stop) {
+		fuzz_finish_(fuzz, 1);
+		return;
+	}
+
+	len = fuzz->input(fuzz, fuzz->iterations, fuzz->buf,
+	                  target->input_size, fuzz->cookie);
+	if (len < 0) {
+		fuzz_finish_(fuzz, 1);
+		return;
+	}
+
+	if ((size_t)len > target->input_size)
+		len = target->input_size;
+
+	fuzz->buf_len = len;
+
+	if (len != 0 &&
+	    pt_process_write(fuzz->process, target->input, fuzz->buf, len) == -1)
+		goto err;
+
+	memcpy(fuzz->iter_regs, fuzz->regs, pt_registers_get_size(fuzz->regs));
+
+	if (target->size_register != NULL &&
+	    pt_registers_set_by_name(fuzz->iter_regs, target->size_register, len) == -1)
+		goto err;
+
+	if (target->input_register != NULL &&
+	    pt_registers_set_by_name(fuzz->iter_regs, target->input_register,
+	                             target->input) == -1)
+		goto err;
+
+	if (pt_thread_registers_set(fuzz->thread, fuzz->iter_regs) == -1)
+		goto err;
+
+	return;
+
+err:
+	pt_log("%s(): cannot start iteration %llu: %s\n", __FUNCTION__,
+	       (unsigned long long)fuzz->iterations, pt_error_strerror());
+	fuzz_finish_(fuzz, 1);
+}
+
+/* Reset the process after an iteration and start the next one. */
+static void fuzz_next_(struct pt_fuzz *fuzz)
+{
+	ssize_t pages;
+
+	fuzz->iterations++;
+
+	if ( (pages = pt_process_restore_memory(fuzz->process, fuzz->snapshot)) == -1) {
+		pt_log("%s(): cannot restore memory: %s\n",
+		       __FUNCTION__, pt_error_strerror());
+		fuzz_finish_(fuzz, 0);
+		return;
+	}
+
+	fuzz->pages_restored += pages;
+	fuzz_iteration_(fuzz);
+}
+
+static void fuzz_return_handler_(struct pt_thread *thread, void *cookie)
+{
+	struct pt_fuzz *fuzz = cookie;
+	pt_address_t sp;
+
+	/* Hits racing with the end of the loop are not ours anymore. */
+	if (thread->process->fuzz != fuzz ||
+	    fuzz->state != PT_FUZZ_STATE_RUNNING || thread != fuzz->thread)
+		return;
+
+	/* A recursive call returning to the same caller. */
+	pt_error_clear();
+	sp = pt_cconv_function_stack_get(thread);
+	if (pt_error_is_set() || sp <= fuzz->sp)
+		return;
+
+	fuzz_next_(fuzz);
+}
+
+static void fuzz_entry_handler_(struct pt_thread *thread, void *cookie)
+{
+	struct pt_fuzz *fuzz = cookie;
+	pt_register_t retaddr;
+
+	/* The entry breakpoint was a ONESHOT and is gone now. */
+	fuzz->entry_set = 0;
+
+	if (fuzz->state != PT_FUZZ_STATE_ARMED)
+		return;
+
+	pt_error_clear();
+	fuzz->sp = pt_cconv_function_stack_get(thread);
+	retaddr  = pt_cconv_function_retaddr_get(thread);
+	if (pt_error_is_set())
+		goto err;
+
+	if ( (fuzz->regs = pt_thread_registers_get(thread)) == NULL)
+		goto err;
+
+	if ( (fuzz->iter_regs = malloc(pt_registers_get_size(fuzz->regs))) == NULL) {
+		pt_error_errno_set(errno);
+		goto err;
+	}
+
+	if ( (fuzz->snapshot = pt_process_snapshot(fuzz->process)) == NULL)
+		goto err;
+
+	pt_breakpoint_sw_init(&fuzz->ret);
+	fuzz->ret.address = retaddr;
+	fuzz->ret.handler = fuzz_return_handler_;
+	fuzz->ret.cookie  = fuzz;
+
+	if (pt_process_breakpoint_set(fuzz->process, &fuzz->ret) == -1)
+		goto err;
+
+	pt_log("%s(): fuzzing tid %d, %zu snapshot pages, returning to 0x%p\n",
+	       __FUNCTION__, thread->tid,
+	       pt_snapshot_pages_get(fuzz->snapshot), retaddr);
+
+	fuzz->ret_set = 1;
+	fuzz->thread  = thread;
+	fuzz->state   = PT_FUZZ_STATE_RUNNING;
+	fuzz->start   = pt_util_time_ns();
+
+	fuzz_iteration_(fuzz);
+	return;
+
+err:
+	pt_log("%s(): cannot start fuzzing: %s\n",
+	       __FUNCTION__, pt_error_strerror());
+	fuzz_finish_(fuzz, 0);
+}
+
+/* Record a crash of the current iteration.  Crashes are kept once per
+ * type and address.
+ */
+static void
+fuzz_crash_record_(struct pt_fuzz *fuzz, int type, int number,
+                   pt_address_t address, pt_address_t fault_address)
+{
+	struct pt_fuzz_crash *crash, *crashes;
+	size_t i, size;
+
+	fuzz->crash_total++;
+
+	for (i = 0; i < fuzz->crash_count; i++) {
+		crash = &fuzz->crashes[i];
+
+		if (crash->type == type && crash->address == address) {
+			crash->hits++;
+			goto out;
+		}
+	}
+
+	if (fuzz->crash_count == fuzz->crash_size) {
+		size = fuzz->crash_size == 0 ? 16 : fuzz->crash_size * 2;
+
+		if ( (crashes = realloc(fuzz->crashes, size * sizeof *crashes)) == NULL)
+			return;
+
+		fuzz->crashes    = crashes;
+		fuzz->crash_size = size;
+	}
+
+	crash = &fuzz->crashes[fuzz->crash_count];
+	if ( (crash->input = malloc(fuzz->buf_len + 1)) == NULL)
+		return;
+
+	memcpy(crash->input, fuzz->buf, fuzz->buf_len);
+	crash->input_size    = fuzz->buf_len;
+	crash->type          = type;
+	crash->number        = number;
+	crash->address       = address;
+	crash->fault_address = fault_address;
+	crash->iteration     = fuzz->iterations;
+	crash->hits          = 1;
+	fuzz->crash_count++;
+
+	pt_log("%s(): new crash type %d at 0x%p, iteration %llu\n",
+	       __FUNCTION__, type, address, (unsigned long long)fuzz->iterations);
+
+out:
+	if (fuzz->crash != NULL)
+		fuzz->crash(fuzz, fuzz->thread, crash, fuzz->cookie);
+}
+
+/* Handle a fault.  Returns 0 if it ended an iteration, and -1 if it is
+ * not ours.
+ */
+static int
+fuzz_fault_(struct pt_thread *thread, int type, int number,
+            void *address, void *fault_address)
+{
+	struct pt_fuzz *fuzz = thread->process->fuzz;
+
+	if (fuzz == NULL || fuzz->state != PT_FUZZ_STATE_RUNNING ||
+	    thread != fuzz->thread)
+		return -1;
+
+	fuzz_crash_record_(fuzz, type, number, (pt_address_t)address,
+	                   (pt_address_t)fault_address);
+	fuzz_next_(fuzz);
+
+	return 0;
+}
+
+/* Faults are taken as crashes on first chance, so exception handlers in
+ * the target never see them.
+ */
+static int fuzz_segfault_(struct pt_event_segfault *ev)
+{
+	struct pt_fuzz_hooks *hooks = &ev->thread->process->fuzz_hooks;
+
+	if (fuzz_fault_(ev->thread, PT_FUZZ_CRASH_SEGFAULT, 0,
+	                ev->address, ev->fault_address) == 0)
+		return PT_EVENT_DROP;
+
+	if (hooks->segfault != NULL)
+		return hooks->segfault(ev);
+
+	return PT_EVENT_FORWARD;
+}
+
+static int fuzz_illegal_instruction_(struct pt_event_illegal_instruction *ev)
+{
+	struct pt_fuzz_hooks *hooks = &ev->thread->process->fuzz_hooks;
+
+	if (fuzz_fault_(ev->thread, PT_FUZZ_CRASH_ILLEGAL_INSTRUCTION, 0,
+	                ev->address, NULL) == 0)
+		return PT_EVENT_DROP;
+
+	if (hooks->illegal_instruction != NULL)
+		return hooks->illegal_instruction(ev);
+
+	return PT_EVENT_FORWARD;
+}
+
+static int fuzz_divide_by_zero_(struct pt_event_divide_by_zero *ev)
+{
+	struct pt_fuzz_hooks *hooks = &ev->thread->process->fuzz_hooks;
+
+	if (fuzz_fault_(ev->thread, PT_FUZZ_CRASH_DIVIDE_BY_ZERO, 0,
+	                ev->address, NULL) == 0)
+		return PT_EVENT_DROP;
+
+	if (hooks->divide_by_zero != NULL)
+		return hooks->divide_by_zero(ev);
+
+	return PT_EVENT_FORWARD;
+}
+
+static int fuzz_priv_instruction_(struct pt_event_priv_instruction *ev)
+{
+	struct pt_fuzz_hooks *hooks = &ev->thread->process->fuzz_hooks;
+
+	if (fuzz_fault_(ev->thread, PT_FUZZ_CRASH_PRIV_INSTRUCTION, 0,
+	                ev->address, NULL) == 0)
+		return PT_EVENT_DROP;
+
+	if (hooks->priv_instruction != NULL)
+		return hooks->priv_instruction(ev);
+
+	return PT_EVENT_FORWARD;
+}
+
+/* Other exceptions are raised and handled by programs routinely, so
+ * these only count as a crash once they went unhandled.
+ */
+static int fuzz_unknown_exception_(struct pt_event_unknown_exception *ev)
+{
+	struct pt_fuzz_hooks *hooks = &ev->thread->process->fuzz_hooks;
+
+	if (ev->chance != 0 &&
+	    fuzz_fault_(ev->thread, PT_FUZZ_CRASH_EXCEPTION, ev->number,
+	                ev->address, NULL) == 0)
+		return PT_EVENT_DROP;
+
+	if (hooks->unknown_exception != NULL)
+		return hooks->unknown_exception(ev);
+
+	return PT_EVENT_FORWARD;
+}
+
+/** Run a persistent-mode fuzzing loop on the function 'target->function'.
+ *
+ * The loop starts on the next call to the function.  'input' provides
+ * the input of every iteration, and 'crash' and 'done' can be NULL.
+ * Only one loop can run per process.  The loop ends when the process
+ * goes away, but must still be deleted.
+ */
+struct pt_fuzz *
+pt_fuzz_loop(struct pt_process *process, struct pt_fuzz_target *target,
+             pt_fuzz_input_handler_t input, pt_fuzz_crash_handler_t crash,
+             pt_fuzz_done_handler_t done, void *cookie)
+{
+	struct pt_fuzz *fuzz;
+
+	if (process->fuzz != NULL) {
+		pt_error_internal_set(PT_ERROR_EXISTS);
+		return NULL;
+	}
+
+	if (input == NULL || target->input_size == 0) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return NULL;
+	}
+
+	if ( (fuzz = calloc(1, sizeof *fuzz)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	fuzz->process = process;
+	fuzz->target  = *target;
+	fuzz->input   = input;
+	fuzz->crash   = crash;
+	fuzz->done    = done;
+	fuzz->cookie  = cookie;
+	fuzz->state   = PT_FUZZ_STATE_ARMED;
+
+	fuzz->target.size_register  = NULL;
+	fuzz->target.input_register = NULL;
+
+	if (target->size_register != NULL &&
+	    (fuzz->target.size_register = strdup(target->size_register)) == NULL)
+		goto err_errno;
+
+	if (target->input_register != NULL &&
+	    (fuzz->target.input_register = strdup(target->input_register)) == NULL)
+		goto err_errno;
+
+	if ( (fuzz->buf = malloc(target->input_size)) == NULL)
+		goto err_errno;
+
+	if (target->input == PT_ADDRESS_NULL) {
+		fuzz->target.input = pt_process_malloc(process, target->input_size);
+		if (fuzz->target.input == PT_ADDRESS_NULL)
+			goto err;
+		fuzz->input_allocated = 1;
+	}
+
+	pt_breakpoint_sw_init(&fuzz->entry);
+	fuzz->entry.flag   |= PT_BREAKPOINT_FLAG_ONESHOT;
+	fuzz->entry.address = target->function;
+	fuzz->entry.handler = fuzz_entry_handler_;
+	fuzz->entry.cookie  = fuzz;
+
+	if (pt_process_breakpoint_set(process, &fuzz->entry) == -1)
+		goto err_free;
+
+	fuzz->entry_set = 1;
+	fuzz_handlers_install_(process);
+	process->fuzz = fuzz;
+
+	return fuzz;
+
+err_errno:
+	pt_error_errno_set(errno);
+	goto err;
+err_free:
+	if (fuzz->input_allocated)
+		pt_process_free(process, fuzz->target.input);
+err:
+	free((char *)fuzz->target.size_register);
+	free((char *)fuzz->target.input_register);
+	free(fuzz->buf);
+	free(fuzz);
+	return NULL;
+}
+
+/** End the loop at the next iteration boundary.
+ *
+ * A loop that has not started yet ends right away.
+ */
+void pt_fuzz_stop(struct pt_fuzz *fuzz)
+{
+	fuzz->stop = 1;
+
+	if (fuzz->state == PT_FUZZ_STATE_ARMED)
+		fuzz_finish_(fuzz, 0);
+}
+
+static void fuzz_free_(struct pt_fuzz *fuzz)
+{
+	size_t i;
+
+	for (i = 0; i < fuzz->crash_count; i++)
+		free(fuzz->crashes[i].input);
+
+	pt_snapshot_delete(fuzz->snapshot);
+	free((char *)fuzz->target.size_register);
+	free((char *)fuzz->target.input_register);
+	free(fuzz->crashes);
+	free(fuzz->regs);
+	free(fuzz->iter_regs);
+	free(fuzz->buf);
+	free(fuzz);
+}
+
+/** Delete a fuzzing loop, ending it first if needed.
+ *
+ * A loop that is still running is ended in the state of the original
+ * call, so the process must be stopped.  Must not be called from the
+ * input and crash handlers, but the done handler may delete the loop.
+ */
+int pt_fuzz_delete(struct pt_fuzz *fuzz)
+{
+	int ret = 0;
+
+	fuzz->done = NULL;
+	fuzz_finish_(fuzz, 1);
+
+	if (fuzz->input_allocated &&
+	    pt_process_free(fuzz->process, fuzz->target.input) == -1)
+		ret = -1;
+
+	fuzz_free_(fuzz);
+	return ret;
+}
+
+int pt_fuzz_state_get(struct pt_fuzz *fuzz)
+{
+	return fuzz->state;
+}
+
+void pt_fuzz_stats_get(struct pt_fuzz *fuzz, struct pt_fuzz_stats *stats)
+{
+	uint64_t end;
+
+	stats->iterations     = fuzz->iterations;
+	stats->crashes        = fuzz->crash_total;
+	stats->pages_restored = fuzz->pages_restored;
+	stats->elapsed        = 0;
+	stats->execs_per_sec  = 0;
+
+	if (fuzz->start == 0)
+		return;
+
+	end = fuzz->state == PT_FUZZ_STATE_DONE ? fuzz->end : pt_util_time_ns();
+	stats->elapsed = end - fuzz->start;
+
+	if (stats->elapsed != 0)
+		stats->execs_per_sec = fuzz->iterations * 1000000000ULL /
+		                       stats->elapsed;
+}
+
+size_t pt_fuzz_crash_count_get(struct pt_fuzz *fuzz)
+{
+	return fuzz->crash_count;
+}
+
+struct pt_fuzz_crash *pt_fuzz_crash_get(struct pt_fuzz *fuzz, size_t index)
+{
+	if (index >= fuzz->crash_count) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return NULL;
+	}
+
+	return &fuzz->crashes[index];
+}
+
+pt_address_t pt_fuzz_input_address_get(struct pt_fuzz *fuzz)
+{
+	return fuzz->target.input;
+}
+
+/* The fuzzing thread went away, so the loop cannot go on. */
+void pt_fuzz_thread_destroy(struct pt_thread *thread)
+{
+	struct pt_fuzz *fuzz = thread->process->fuzz;
+
+	if (fuzz != NULL && fuzz->thread == thread)
+		fuzz_finish_(fuzz, 0);
+}
+
+/* The process is going away, so the loop ends without restoring the
+ * original call, and the input buffer goes with the process.
+ */
+void pt_fuzz_process_destroy(struct pt_process *process)
+{
+	struct pt_fuzz *fuzz = process->fuzz;
+
+	if (fuzz == NULL)
+		return;
+
+	fuzz->input_allocated = 0;
+	fuzz_finish_(fuzz, 0);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * fuzz.h
+ *
+ * libptrace persistent-mode fuzzing loop.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_FUZZ_INTERNAL_H
+#define PT_FUZZ_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libptrace/event.h>
+#include <libptrace/fuzz.h>
+#include <libptrace/snapshot.h>
+#include <libptrace/types.h>
+#include "breakpoint.h"
+#include "registers.h"
+
+struct pt_fuzz
+{
+	struct pt_process		*process;
+	struct pt_fuzz_target		target;
+	pt_fuzz_input_handler_t		input;
+	pt_fuzz_crash_handler_t		crash;
+	pt_fuzz_done_handler_t		done;
+	void				*cookie;
+	int				state;
+	int				stop;
+	int				input_allocated;
+
+	struct pt_breakpoint		entry;
+	int				entry_set;
+	struct pt_breakpoint		ret;
+	int				ret_set;
+
+	/* The thread we fuzz on, its stack pointer and registers on entry,
+	 * and the process state to go back to after every iteration.
+	 */
+	struct pt_thread		*thread;
+	pt_address_t			sp;
+	struct pt_registers		*regs;
+	struct pt_registers		*iter_regs;
+	struct pt_snapshot		*snapshot;
+
+	/* The input of the current iteration. */
+	uint8_t				*buf;
+	size_t				buf_len;
+
+	uint64_t			iterations;
+	uint64_t			crash_total;
+	uint64_t			pages_restored;
+	uint64_t			start;
+	uint64_t			end;
+
+	struct pt_fuzz_crash		*crashes;
+	size_t				crash_count;
+	size_t				crash_size;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void pt_fuzz_thread_destroy(struct pt_thread *);
+void pt_fuzz_process_destroy(struct pt_process *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_FUZZ_INTERNAL_H */
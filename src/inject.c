@@ -40,6 +40,8 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_PROCESS
+
 #include <libptrace/error.h>
 #include <libptrace/process.h>
 #include <libptrace/inject.h>
@@ -53,8 +55,8 @@ struct pt_inject_context_
 	struct pt_process *process;
 
 	/* Stacked event handlers. */
-	struct pt_event_handler *thread_create;
-	struct pt_event_handler *thread_exit;
+	uint32_t thread_create;
+	uint32_t thread_exit;
 
 	/* Pointer to allocated memory region in the remote. */
 	pt_address_t data;
@@ -111,8 +113,10 @@ pt_inject_thread_exit_(struct pt_event *event)
 			ret = ctx->handler_post(p, ctx->cookie_post);
 
 		/* We're done with the injection, so we clean up. */
-		pt_event_handler_destroy(ctx->thread_create);
-		pt_event_handler_destroy(ctx->thread_exit);
+		pt_event_handler_stack_remove(&p->handlers.thread_create,
+		                              ctx->thread_create);
+		pt_event_handler_stack_remove(&p->handlers.thread_exit,
+		                              ctx->thread_exit);
 		pt_process_free(p, ctx->data); /* Ignore errors. */
 		free(ctx);
 
@@ -174,13 +178,13 @@ int pt_inject(struct pt_inject *inject, struct pt_process *p)
 	ctx->thread_create = pt_event_handler_stack_push(
 		&p->handlers.thread_create,
 	        pt_inject_thread_create_, ctx);
-	if (ctx->thread_create == NULL)
+	if (ctx->thread_create == 0)
 		goto err_free;
 
 	ctx->thread_exit   = pt_event_handler_stack_push(
 		&p->handlers.thread_exit,
 	        pt_inject_thread_exit_, ctx);
-	if (ctx->thread_exit == NULL)
+	if (ctx->thread_exit == 0)
 		goto err_thread_create_handler;
 
 	/* Create a new thread to execute the code. */
@@ -202,9 +206,9 @@ int pt_inject(struct pt_inject *inject, struct pt_process *p)
 	return 0;
 
 err_thread_exit_handler:
-	pt_event_handler_destroy(ctx->thread_exit);
+	pt_event_handler_stack_remove(&p->handlers.thread_exit, ctx->thread_exit);
 err_thread_create_handler:
-	pt_event_handler_destroy(ctx->thread_create);
+	pt_event_handler_stack_remove(&p->handlers.thread_create, ctx->thread_create);
 err_free:
 	pt_process_free(p, data);	/* Try once; ignore errors. */
 err_ctx:
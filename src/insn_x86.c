@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * insn_x86.c
+ *
+ * Minimal x86 instruction length decoder.
+ *
+ * This decodes just enough of an instruction to know its length, where
+ * its displacement and immediate are, and whether it depends on the
+ * address it executes at.  That is what is needed to relocate a single
+ * instruction, for instance when stepping over a breakpoint out of line.
+ *
+ * Instructions we cannot classify with confidence are rejected, so that
+ * callers can fall back to a slower but safe strategy.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <string.h>
+#include <libptrace/error.h>
+#include "insn_x86.h"
+
+#define O_NONE	0x00
+#define O_M	0x01	/* ModRM follows.                           */
+#define O_I8	0x02	/* 8-bit immediate.                         */
+#define O_IZ	0x04	/* 16-bit or 32-bit immediate.              */
+#define O_IW	0x08	/* 16-bit immediate.                        */
+#define O_REL	0x10	/* Immediate is a relative branch target.   */
+#define O_X	0x20	/* Needs special handling.                  */
+#define O_BAD	0x40	/* Invalid or not supported.                */
+
+#define M_I8	(O_M | O_I8)
+#define M_IZ	(O_M | O_IZ)
+#define R_I8	(O_REL | O_I8)
+#define R_IZ	(O_REL | O_IZ)
+
+static const uint8_t one_byte_map_[256] = {
+	/* 0x00 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, 0,    0,
+	/* 0x08 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, 0,    O_X,
+	/* 0x10 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, 0,    0,
+	/* 0x18 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, 0,    0,
+	/* 0x20 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, O_X,  0,
+	/* 0x28 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, O_X,  0,
+	/* 0x30 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, O_X,  0,
+	/* 0x38 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_IZ, O_X,  0,
+	/* 0x40 */ 0,    0,    0,    0,    0,    0,    0,    0,
+	/* 0x48 */ 0,    0,    0,    0,    0,    0,    0,    0,
+	/* 0x50 */ 0,    0,    0,    0,    0,    0,    0,    0,
+	/* 0x58 */ 0,    0,    0,    0,    0,    0,    0,    0,
+	/* 0x60 */ 0,    0,    O_X,  O_M,  O_X,  O_X,  O_X,  O_X,
+	/* 0x68 */ O_IZ, M_IZ, O_I8, M_I8, 0,    0,    0,    0,
+	/* 0x70 */ R_I8, R_I8, R_I8, R_I8, R_I8, R_I8, R_I8, R_I8,
+	/* 0x78 */ R_I8, R_I8, R_I8, R_I8, R_I8, R_I8, R_I8, R_I8,
+	/* 0x80 */ M_I8, M_IZ, M_I8, M_I8, O_M,  O_M,  O_M,  O_M,
+	/* 0x88 */ O_M,  O_M,  O_M,  O_M,  O_M,  O_M,  O_M,  O_X,
+	/* 0x90 */ 0,    0,    0,    0,    0,    0,    0,    0,
+	/* 0x98 */ 0,    0,    O_BAD,0,    0,    0,    0,    0,
+	/* 0xa0 */ O_X,  O_X,  O_X,  O_X,  0,    0,    0,    0,
+	/* 0xa8 */ O_I8, O_IZ, 0,    0,    0,    0,    0,    0,
+	/* 0xb0 */ O_I8, O_I8, O_I8, O_I8, O_I8, O_I8, O_I8, O_I8,
+	/* 0xb8 */ O_X,  O_X,  O_X,  O_X,  O_X,  O_X,  O_X,  O_X,
+	/* 0xc0 */ M_I8, M_I8, O_IW, 0,    O_X,  O_X,  M_I8, O_X,
+	/* 0xc8 */ O_IW | O_I8, 0, O_IW, 0, O_X, O_X,  O_X,  0,
+	/* 0xd0 */ O_M,  O_M,  O_M,  O_M,  O_I8, O_I8, 0,    0,
+	/* 0xd8 */ O_M,  O_M,  O_M,  O_M,  O_M,  O_M,  O_M,  O_M,
+	/* 0xe0 */ R_I8, R_I8, R_I8, R_I8, O_I8, O_I8, O_I8, O_I8,
+	/* 0xe8 */ O_X,  R_IZ, O_BAD,R_I8, 0,    0,    0,    0,
+	/* 0xf0 */ O_X,  O_X,  O_X,  O_X,  0,    0,    O_X,  O_X,
+	/* 0xf8 */ 0,    0,    0,    0,    0,    0,    O_M,  O_X,
+};
+
+/* Properties of opcodes in the 0x0f map. */
+static uint8_t two_byte_map_(uint8_t opcode)
+{
+	switch (opcode) {
+	case 0x05: case 0x06: case 0x07: case 0x08:
+	case 0x09: case 0x0e: case 0x77:
+	case 0xa0: case 0xa1: case 0xa2: case 0xa8:
+	case 0xa9: case 0xaa:
+		return O_NONE;
+	case 0x0b:
+		/* ud2 */
+		return O_X;
+	case 0x0f:
+		/* 3DNow! suffix byte. */
+	case 0x70: case 0x71: case 0x72: case 0x73:
+	case 0xa4: case 0xac: case 0xba:
+	case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+		return M_I8;
+	}
+
+	if (opcode >= 0x30 && opcode <= 0x37)
+		return O_NONE;
+
+	if (opcode >= 0xc8 && opcode <= 0xcf)
+		return O_NONE;
+
+	if (opcode >= 0x80 && opcode <= 0x8f)
+		return R_IZ;
+
+	return O_M;
+}
+
+static int is_legacy_prefix_(uint8_t byte)
+{
+	switch (byte) {
+	case 0xf0: case 0xf2: case 0xf3:
+	case 0x2e: case 0x36: case 0x3e: case 0x26: case 0x64: case 0x65:
+	case 0x66: case 0x67:
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Decode a ModRM operand starting at 'p'.  Returns the number of bytes
+ * consumed, or -1 if the buffer is too short.
+ */
+static int
+decode_modrm_(struct x86_insn *insn, const uint8_t *buf, size_t off,
+              size_t size, int address_size, int mode)
+{
+	size_t start = off;
+	uint8_t modrm, mod, rm, sib;
+	int disp = 0;
+
+	if (off >= size)
+		return -1;
+
+	insn->modrm_offset = off;
+	insn->flags |= X86_INSN_FLAG_MODRM;
+
+	modrm = buf[off++];
+	mod   = modrm >> 6;
+	rm    = modrm & 7;
+
+	if (mod == 3)
+		return off - start;
+
+	if (address_size == 16) {
+		if ((mod == 0 && rm == 6) || mod == 2)
+			disp = 2;
+		else if (mod == 1)
+			disp = 1;
+	} else {
+		if (rm == 4) {
+			if (off >= size)
+				return -1;
+			sib = buf[off++];
+
+			if (mod == 0 && (sib & 7) == 5)
+				disp = 4;
+		} else if (mod == 0 && rm == 5) {
+			disp = 4;
+			if (mode == X86_INSN_MODE_64)
+				insn->flags |= X86_INSN_FLAG_RIP_RELATIVE;
+		}
+
+		if (mod == 1)
+			disp = 1;
+		else if (mod == 2)
+			disp = 4;
+	}
+
+	if (disp != 0) {
+		insn->disp_offset = off;
+		insn->disp_size   = disp;
+	}
+
+	return off + disp - start;
+}
+
+/* Decode the instruction in 'buf'.  Returns the instruction length, or -1
+ * if it could not be decoded, in which case PT_ERROR_UNSUPPORTED is set.
+ */
+int x86_insn_decode(struct x86_insn *insn, const uint8_t *buf, size_t size,
+                    int mode)
+{
+	int opsize16 = 0, addrsize_override = 0, rex_w = 0;
+	int address_size, imm = 0, ret;
+	uint8_t opcode, props;
+	size_t off = 0;
+
+	memset(insn, 0, sizeof *insn);
+
+	if (size > X86_INSN_LENGTH_MAX)
+		size = X86_INSN_LENGTH_MAX;
+
+	/* Legacy prefixes. */
+	while (off < size && is_legacy_prefix_(buf[off])) {
+		if (buf[off] == 0x66)
+			opsize16 = 1;
+		else if (buf[off] == 0x67)
+			addrsize_override = 1;
+		off++;
+	}
+
+	/* A REX prefix must directly precede the opcode. */
+	if (mode == X86_INSN_MODE_64 && off < size && (buf[off] & 0xf0) == 0x40)
+		rex_w = (buf[off++] & 0x08) != 0;
+
+	if (mode == X86_INSN_MODE_64)
+		address_size = addrsize_override ? 32 : 64;
+	else
+		address_size = addrsize_override ? 16 : 32;
+
+	if (off >= size)
+		goto err_short;
+
+	insn->opcode_offset = off;
+	opcode = buf[off++];
+	props  = one_byte_map_[opcode];
+
+	if (props & O_BAD)
+		goto err_unsupported;
+
+	if (props & O_X) {
+		switch (opcode) {
+		case 0x0f:
+			if (off >= size)
+				goto err_short;
+			opcode = buf[off++];
+
+			if (opcode == 0x38) {
+				props = O_M;
+				off++;
+			} else if (opcode == 0x3a) {
+				props = M_I8;
+				off++;
+			} else {
+				props = two_byte_map_(opcode);
+			}
+
+			if (props & O_X) {
+				/* ud2 */
+				insn->flags |= X86_INSN_FLAG_TRAP;
+				props = O_NONE;
+			}
+			break;
+
+		case 0x62:
+		case 0xc4:
+		case 0xc5:
+			/* Outside of 64-bit mode these are BOUND, LES and LDS
+			 * unless the next byte has ModRM.mod == 3.
+			 */
+			if (off >= size)
+				goto err_short;
+
+			if (mode != X86_INSN_MODE_64 && (buf[off] & 0xc0) != 0xc0) {
+				props = O_M;
+				break;
+			}
+
+			if (opcode == 0xc5) {
+				/* 2-byte VEX, implied 0x0f map. */
+				off += 1;
+				if (off >= size)
+					goto err_short;
+				opcode = buf[off++];
+				props  = two_byte_map_(opcode);
+			} else {
+				uint8_t map = buf[off] & (opcode == 0x62 ? 0x07 : 0x1f);
+
+				off += opcode == 0x62 ? 3 : 2;
+				if (off >= size)
+					goto err_short;
+				opcode = buf[off++];
+
+				if (map == 1)
+					props = two_byte_map_(opcode);
+				else if (map == 2 || map == 5 || map == 6)
+					props = O_M;
+				else if (map == 3)
+					props = M_I8;
+				else
+					goto err_unsupported;
+			}
+
+			/* EVEX always has a ModRM byte. */
+			if (buf[insn->opcode_offset] == 0x62)
+				props |= O_M;
+
+			/* Relative branches and oddities do not exist in
+			 * these maps; be conservative about anything else.
+			 */
+			if (props & (O_REL | O_X))
+				goto err_unsupported;
+			break;
+
+		case 0x8f:
+			/* XOP is not supported. */
+			if (off >= size)
+				goto err_short;
+			if ((buf[off] & 0x38) != 0)
+				goto err_unsupported;
+			props = O_M;
+			break;
+
+		case 0xa0: case 0xa1: case 0xa2: case 0xa3:
+			/* moffs operands are address sized. */
+			props = O_NONE;
+			imm   = address_size / 8;
+			break;
+
+		case 0xb8: case 0xb9: case 0xba: case 0xbb:
+		case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+			props = O_NONE;
+			imm   = rex_w ? 8 : (opsize16 ? 2 : 4);
+			break;
+
+		case 0xcc: case 0xce: case 0xf1:
+			insn->flags |= X86_INSN_FLAG_TRAP;
+			props = O_NONE;
+			break;
+
+		case 0xcd:
+			insn->flags |= X86_INSN_FLAG_TRAP;
+			props = O_I8;
+			break;
+
+		case 0xc7:
+			/* xbegin is encoded as c7 f8 rel32. */
+			if (off >= size)
+				goto err_short;
+			if (buf[off] == 0xf8)
+				insn->flags |= X86_INSN_FLAG_BRANCH_RELATIVE;
+			props = M_IZ;
+			break;
+
+		case 0xe8:
+			insn->flags |= X86_INSN_FLAG_CALL;
+			props = R_IZ;
+			break;
+
+		case 0xf6:
+		case 0xf7:
+			/* test r/m, imm has an immediate; the rest does not. */
+			if (off >= size)
+				goto err_short;
+			props = O_M;
+			if (((buf[off] >> 3) & 7) < 2)
+				props |= opcode == 0xf6 ? O_I8 : O_IZ;
+			break;
+
+		case 0xff:
+			if (off >= size)
+				goto err_short;
+			/* call near and far indirect. */
+			if (((buf[off] >> 3) & 7) == 2 || ((buf[off] >> 3) & 7) == 3)
+				insn->flags |= X86_INSN_FLAG_CALL;
+			props = O_M;
+			break;
+
+		default:
+			/* A stray legacy prefix after REX, or a segment
+			 * prefix we did not consume above.
+			 */
+			goto err_unsupported;
+		}
+	}
+
+	if (props & O_REL)
+		insn->flags |= X86_INSN_FLAG_BRANCH_RELATIVE;
+
+	if (props & O_M) {
+		ret = decode_modrm_(insn, buf, off, size, address_size, mode);
+		if (ret == -1)
+			goto err_short;
+		off += ret;
+	}
+
+	if (props & O_IW)
+		imm += 2;
+
+	if (props & O_I8)
+		imm += 1;
+
+	if (props & O_IZ) {
+		/* Relative branches in 64-bit mode always take rel32. */
+		if (opsize16 && !rex_w &&
+		    !(mode == X86_INSN_MODE_64 && (props & O_REL)))
+			imm += 2;
+		else
+			imm += 4;
+	}
+
+	if (imm != 0) {
+		insn->imm_offset = off;
+		insn->imm_size   = imm;
+		off += imm;
+	}
+
+	if (off > size)
+		goto err_short;
+
+	insn->length = off;
+	return off;
+
+err_short:
+	/* An instruction longer than 15 bytes is invalid; otherwise the
+	 * caller did not pass enough bytes.
+	 */
+	pt_error_internal_set(size == X86_INSN_LENGTH_MAX ?
+	                      PT_ERROR_UNSUPPORTED : PT_ERROR_INVALID_ARG);
+	return -1;
+
+err_unsupported:
+	pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+	return -1;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * insn_x86.h
+ *
+ * Minimal x86 instruction length decoder.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_INSN_X86_INTERNAL_H
+#define PT_INSN_X86_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define X86_INSN_LENGTH_MAX		15
+
+#define X86_INSN_FLAG_NONE		0
+#define X86_INSN_FLAG_MODRM		1	/* Has a ModRM byte.            */
+#define X86_INSN_FLAG_RIP_RELATIVE	2	/* RIP relative memory operand. */
+#define X86_INSN_FLAG_BRANCH_RELATIVE	4	/* Relative jmp/jcc/loop/call.  */
+#define X86_INSN_FLAG_CALL		8	/* Pushes a return address.     */
+#define X86_INSN_FLAG_TRAP		16	/* int3, int1, int n, into.     */
+
+#define X86_INSN_MODE_32		0
+#define X86_INSN_MODE_64		1
+
+struct x86_insn
+{
+	uint8_t		length;
+	uint8_t		flags;
+	uint8_t		opcode_offset;
+	uint8_t		modrm_offset;
+	/* Offset and size of the displacement, if any. */
+	uint8_t		disp_offset;
+	uint8_t		disp_size;
+	/* Offset and size of the immediate, if any. */
+	uint8_t		imm_offset;
+	uint8_t		imm_size;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int x86_insn_decode(struct x86_insn *, const uint8_t *, size_t, int mode);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_INSN_X86_INTERNAL_H */
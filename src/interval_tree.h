@@ -509,9 +509,9 @@ type *interval_tree_##name##_max(struct interval_tree *tree)		\
 	return tn;							\
 }									\
 									\
-static type *        internal_iter_node_  = NULL;			\
-static unsigned long internal_iter_begin_ = 0;				\
-static unsigned long internal_iter_end_   = 0;				\
+static __thread type *        internal_iter_node_  = NULL;		\
+static __thread unsigned long internal_iter_begin_ = 0;			\
+static __thread unsigned long internal_iter_end_   = 0;			\
 									\
 static inline								\
 struct avl_node *interval_tree_##name##_next_(struct avl_node *an)	\
@@ -35,20 +35,84 @@
  *
  * libptrace logging framework.
  *
+ * Every message carries a category and a level, and is tested against a
+ * single global mask before any of its arguments are evaluated.  The mask
+ * is cleared when there are no consumers, so disabled logging costs one
+ * load and test per call site.
+ *
+ * Next to the formatting hooks there is a binary log, which stores the
+ * format string and raw arguments in a ring buffer per thread and leaves
+ * the formatting to whoever drains the rings.
+ *
  * Dedicated to Yuzuyu Arielle Huizer.
  *
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define _GNU_SOURCE
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
+#include <libptrace/error.h>
 #include <libptrace/list.h>
 #include <libptrace/log.h>
+#include <libptrace/util.h>
+#include "log.h"
+#include "mutex.h"
+
+#define LOG_ARG_NONE		0	/* '%%' or a malformed spec.	*/
+#define LOG_ARG_IGNORE		1	/* '%n', consumes a pointer.	*/
+#define LOG_ARG_INT		2
+#define LOG_ARG_LONG		3
+#define LOG_ARG_LLONG		4
+#define LOG_ARG_SIZE		5
+#define LOG_ARG_INTMAX		6
+#define LOG_ARG_PTRDIFF		7
+#define LOG_ARG_POINTER		8
+#define LOG_ARG_DOUBLE		9
+#define LOG_ARG_STRING		10
+#define LOG_ARG_WSTRING		11
+
+struct log_spec
+{
+	int		type;
+	int		stars;
+	const char	*length;	/* Start of the length modifier. */
+	char		conversion;
+};
 
 /* XXX: mark for review with multithreaded cores. This breaks. */
 struct list_head log_hooks_ = LIST_HEAD_INIT(log_hooks_);
 
+uint64_t pt_log_mask_ = 0;
+static uint64_t log_mask_config_ = PT_LOG_MASK_ALL;
+
+/* Binary log state.  Rings are never freed, as a thread may be writing
+ * to its ring at any time; they are reused when logging is re-enabled.
+ */
+static int log_binary_;
+static size_t log_binary_capacity_;
+static pt_mutex_t log_rings_lock_ = PT_MUTEX_INITIALIZER;
+static struct list_head log_rings_ = LIST_HEAD_INIT(log_rings_);
+static __thread struct pt_log_ring *log_ring_;
+static __thread int log_draining_;
+
+/* Messages for the hooks queued by this thread, see pt_log_hooks_hold(). */
+static __thread unsigned int log_hooks_held_;
+static __thread char **log_deferred_;
+static __thread size_t log_deferred_count_;
+static __thread size_t log_deferred_size_;
+
+static void log_mask_update_(void)
+{
+	if (!list_empty(&log_hooks_) || log_binary_)
+		pt_log_mask_ = log_mask_config_;
+	else
+		pt_log_mask_ = 0;
+}
+
 static int pt_log_hook_used_(struct pt_log_hook *log_hook)
 {
 	struct list_head *lh;
@@ -62,27 +126,396 @@ static int pt_log_hook_used_(struct pt_log_hook *log_hook)
 	return 0;
 }
 
-void pt_log(const char *format, ...)
+/* Parse the conversion spec following a '%'.  Returns a pointer past it. */
+static const char *log_spec_parse_(const char *p, struct log_spec *spec)
+{
+	int length = 0;
+
+	spec->type       = LOG_ARG_NONE;
+	spec->stars      = 0;
+	spec->conversion = '\0';
+
+	while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+		p++;
+
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	if (*p == '.') {
+		if (*++p == '*') {
+			spec->stars++;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+	}
+
+	spec->length = p;
+	switch (*p) {
+	case 'h':
+		p += p[1] == 'h' ? 2 : 1;
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			length = LOG_ARG_LLONG;
+			p += 2;
+		} else {
+			length = LOG_ARG_LONG;
+			p++;
+		}
+		break;
+	case 'L':
+	case 'q':
+		length = LOG_ARG_LLONG;
+		p++;
+		break;
+	case 'z':
+		length = LOG_ARG_SIZE;
+		p++;
+		break;
+	case 'j':
+		length = LOG_ARG_INTMAX;
+		p++;
+		break;
+	case 't':
+		length = LOG_ARG_PTRDIFF;
+		p++;
+		break;
+	case 'I':
+		if (p[1] == '6' && p[2] == '4') {
+			length = LOG_ARG_LLONG;
+			p += 3;
+		} else if (p[1] == '3' && p[2] == '2') {
+			p += 3;
+		} else {
+			length = LOG_ARG_SIZE;
+			p++;
+		}
+		break;
+	}
+
+	spec->conversion = *p;
+	switch (*p) {
+	case '\0':
+		spec->stars = 0;
+		return p;
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+		spec->type = length == 0 ? LOG_ARG_INT : length;
+		break;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		spec->type = LOG_ARG_DOUBLE;
+		break;
+	case 'p':
+		spec->type = LOG_ARG_POINTER;
+		break;
+	case 's':
+		spec->type = length == LOG_ARG_LONG ? LOG_ARG_WSTRING : LOG_ARG_STRING;
+		break;
+	case 'S':
+		spec->type = LOG_ARG_WSTRING;
+		break;
+	case 'n':
+		spec->type = LOG_ARG_IGNORE;
+		break;
+	default:
+		spec->stars = 0;
+		break;
+	}
+
+	return p + 1;
+}
+
+static struct pt_log_ring *log_ring_get_(void)
+{
+	struct pt_log_ring *ring;
+	size_t capacity;
+
+	if (log_ring_ != NULL)
+		return log_ring_;
+
+	if ( (capacity = log_binary_capacity_) == 0)
+		return NULL;
+
+	if ( (ring = malloc(sizeof *ring)) == NULL)
+		return NULL;
+
+	if ( (ring->records = calloc(capacity, sizeof *ring->records)) == NULL) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->head    = 0;
+	ring->tail    = 0;
+	ring->dropped = 0;
+	ring->mask    = capacity - 1;
+
+	pt_mutex_lock(&log_rings_lock_);
+	list_add_tail(&ring->list, &log_rings_);
+	pt_mutex_unlock(&log_rings_lock_);
+
+	return log_ring_ = ring;
+}
+
+static int log_record_arg_(struct pt_log_record *record, uint64_t value)
+{
+	if (record->nargs == PT_LOG_RECORD_ARGS) {
+		record->flags |= PT_LOG_RECORD_FLAG_TRUNCATED;
+		return -1;
+	}
+
+	record->args[record->nargs++] = value;
+	return 0;
+}
+
+/* Copy a string argument into the record, and store its offset. */
+static int
+log_record_string_(struct pt_log_record *record, size_t *used,
+                   const char *s, const wchar_t *ws)
+{
+	size_t offset = *used;
+
+	if (s == NULL && ws == NULL)
+		s = "(null)";
+
+	while (*used < PT_LOG_RECORD_STRINGS - 1) {
+		wchar_t c = s != NULL ? (unsigned char)*s++ : *ws++;
+
+		if (c == L'\0')
+			break;
+
+		record->strings[(*used)++] = c < 0x80 ? (char)c : '?';
+	}
+
+	if (*used == PT_LOG_RECORD_STRINGS - 1)
+		record->flags |= PT_LOG_RECORD_FLAG_TRUNCATED;
+	else
+		record->strings[(*used)++] = '\0';
+
+	return log_record_arg_(record, offset);
+}
+
+static void
+log_record_(int category, int level, const char *format, va_list ap)
+{
+	struct pt_log_record *record;
+	struct pt_log_ring *ring;
+	struct log_spec spec;
+	uint64_t head, value;
+	size_t used = 0;
+	const char *p;
+	int i;
+
+	if (log_draining_ || (ring = log_ring_get_()) == NULL)
+		return;
+
+	head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	record = &ring->records[head & ring->mask];
+	record->timestamp = pt_util_time_ns();
+	record->format    = format;
+	record->tid       = (uint32_t)pt_util_tid_get();
+	record->category  = category;
+	record->level     = level;
+	record->nargs     = 0;
+	record->flags     = 0;
+	record->strings[PT_LOG_RECORD_STRINGS - 1] = '\0';
+
+	for (p = format; (p = strchr(p, '%')) != NULL; ) {
+		p = log_spec_parse_(p + 1, &spec);
+
+		for (i = 0; i < spec.stars; i++)
+			if (log_record_arg_(record, (int64_t)va_arg(ap, int)) == -1)
+				goto out;
+
+		switch (spec.type) {
+		case LOG_ARG_NONE:
+			continue;
+		case LOG_ARG_IGNORE:
+			(void)va_arg(ap, void *);
+			continue;
+		case LOG_ARG_INT:
+			value = (int64_t)va_arg(ap, int);
+			break;
+		case LOG_ARG_LONG:
+			value = (int64_t)va_arg(ap, long);
+			break;
+		case LOG_ARG_LLONG:
+			value = (int64_t)va_arg(ap, long long);
+			break;
+		case LOG_ARG_SIZE:
+			value = (uint64_t)va_arg(ap, size_t);
+			break;
+		case LOG_ARG_INTMAX:
+			value = (int64_t)va_arg(ap, intmax_t);
+			break;
+		case LOG_ARG_PTRDIFF:
+			value = (int64_t)va_arg(ap, ptrdiff_t);
+			break;
+		case LOG_ARG_POINTER:
+			value = (uintptr_t)va_arg(ap, void *);
+			break;
+		case LOG_ARG_DOUBLE: {
+			double d = spec.length[0] == 'L' ?
+			           (double)va_arg(ap, long double) :
+			           va_arg(ap, double);
+			memcpy(&value, &d, sizeof value);
+			break;
+		}
+		case LOG_ARG_STRING:
+			if (log_record_string_(record, &used, va_arg(ap, const char *), NULL) == -1)
+				goto out;
+			continue;
+		case LOG_ARG_WSTRING:
+			if (log_record_string_(record, &used, NULL, va_arg(ap, const wchar_t *)) == -1)
+				goto out;
+			continue;
+		}
+
+		if (log_record_arg_(record, value) == -1)
+			break;
+	}
+
+out:
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void log_hook_call_(struct pt_log_hook *log_hook, const char *format, ...)
 {
-	struct list_head *lh;
 	va_list ap;
 
 	va_start(ap, format);
+	log_hook->handler(log_hook->cookie, format, ap);
+	va_end(ap);
+}
+
+static void log_hooks_defer_(const char *format, va_list ap)
+{
+	char *str, **p;
+	size_t size;
+
+	if (log_deferred_count_ == log_deferred_size_) {
+		size = log_deferred_size_ ? log_deferred_size_ * 2 : 16;
+		if ( (p = realloc(log_deferred_, size * sizeof *p)) == NULL)
+			return;
+		log_deferred_      = p;
+		log_deferred_size_ = size;
+	}
+
+	if (vasprintf(&str, format, ap) == -1)
+		return;
+
+	log_deferred_[log_deferred_count_++] = str;
+}
+
+static void
+log_vwrite_(int category, int level, const char *format, va_list ap)
+{
+	struct list_head *lh;
+	va_list aq;
 
+	if (log_binary_) {
+		va_copy(aq, ap);
+		log_record_(category, level, format, aq);
+		va_end(aq);
+	}
+
+	if (log_hooks_held_ != 0) {
+		if (!list_empty(&log_hooks_)) {
+			va_copy(aq, ap);
+			log_hooks_defer_(format, aq);
+			va_end(aq);
+		}
+		return;
+	}
+
+	/* Every hook consumes its own copy of the argument list. */
 	list_for_each(lh, &log_hooks_) {
 		struct pt_log_hook *log_hook;
 
 		log_hook = list_entry(lh, struct pt_log_hook, list);
-		log_hook->handler(log_hook->cookie, format, ap);
+		va_copy(aq, ap);
+		log_hook->handler(log_hook->cookie, format, aq);
+		va_end(aq);
 	}
+}
 
+/* Hooks can call out to code that waits on other threads, such as the
+ * Python bindings taking the GIL.  While a thread holds a lock other
+ * threads may wait on with such a lock of their own, messages for the
+ * hooks are formatted and queued, and passed on once it has released
+ * the last of these locks.
+ */
+void pt_log_hooks_hold(void)
+{
+	log_hooks_held_++;
+}
+
+void pt_log_hooks_release(void)
+{
+	struct list_head *lh;
+	size_t i, count;
+	char **deferred;
+
+	if (--log_hooks_held_ != 0 || log_deferred_count_ == 0)
+		return;
+
+	/* A hook may log and queue messages again. */
+	deferred            = log_deferred_;
+	count               = log_deferred_count_;
+	log_deferred_       = NULL;
+	log_deferred_count_ = 0;
+	log_deferred_size_  = 0;
+
+	for (i = 0; i < count; i++) {
+		list_for_each(lh, &log_hooks_) {
+			struct pt_log_hook *log_hook;
+
+			log_hook = list_entry(lh, struct pt_log_hook, list);
+			log_hook_call_(log_hook, "%s", deferred[i]);
+		}
+		free(deferred[i]);
+	}
+
+	free(deferred);
+}
+
+void pt_log_write(int category, int level, const char *format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	log_vwrite_(category, level, format, ap);
 	va_end(ap);
 }
 
+/* Function version of pt_log(), for callers outside of the library. */
+void (pt_log)(const char *format, ...)
+{
+	va_list ap;
+
+	if (!pt_log_enabled(PT_LOG_CATEGORY_GENERIC, PT_LOG_LEVEL_DEBUG))
+		return;
+
+	va_start(ap, format);
+	log_vwrite_(PT_LOG_CATEGORY_GENERIC, PT_LOG_LEVEL_DEBUG, format, ap);
+	va_end(ap);
+}
 
 void pt_log_hook_register(struct pt_log_hook *log_hook)
 {
 	list_add(&log_hook->list, &log_hooks_);
+	log_mask_update_();
 }
 
 int pt_log_hook_unregister(struct pt_log_hook *log_hook)
@@ -91,5 +524,236 @@ int pt_log_hook_unregister(struct pt_log_hook *log_hook)
 		return -1;
 
 	list_del(&log_hook->list);
+	log_mask_update_();
 	return 0;
 }
+
+uint64_t pt_log_mask_get(void)
+{
+	return log_mask_config_;
+}
+
+void pt_log_mask_set(uint64_t mask)
+{
+	log_mask_config_ = mask;
+	log_mask_update_();
+}
+
+/* Log messages up to and including 'level' for all categories in the
+ * 'categories' mask.  A level of -1 disables these categories.
+ */
+void pt_log_level_set(uint32_t categories, int level)
+{
+	int category, i;
+
+	for (category = 0; category < PT_LOG_CATEGORIES; category++) {
+		if (!(categories & PT_LOG_CATEGORY_MASK(category)))
+			continue;
+
+		for (i = 0; i < PT_LOG_LEVELS; i++) {
+			if (i <= level)
+				log_mask_config_ |= PT_LOG_BIT(category, i);
+			else
+				log_mask_config_ &= ~PT_LOG_BIT(category, i);
+		}
+	}
+
+	log_mask_update_();
+}
+
+/* Enable the binary log with rings of 'capacity' records per thread.
+ * The capacity is rounded up to a power of two.
+ */
+int pt_log_binary_enable(size_t capacity)
+{
+	size_t size = 1;
+
+	if (capacity == 0 || capacity > SIZE_MAX / 2 / sizeof(struct pt_log_record)) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	while (size < capacity)
+		size <<= 1;
+
+	log_binary_capacity_ = size;
+	log_binary_          = 1;
+	log_mask_update_();
+
+	return 0;
+}
+
+void pt_log_binary_disable(void)
+{
+	log_binary_ = 0;
+	log_mask_update_();
+}
+
+/* Pass all pending binary log records to 'handler'.  The calling thread
+ * does not record messages while draining, so the handler may log.
+ */
+size_t pt_log_binary_drain(pt_log_record_handler_t handler, void *cookie)
+{
+	struct pt_log_ring *ring;
+	struct list_head *lh;
+	uint64_t head, tail;
+	size_t count = 0;
+
+	log_draining_ = 1;
+	pt_mutex_lock(&log_rings_lock_);
+
+	list_for_each (lh, &log_rings_) {
+		ring = list_entry(lh, struct pt_log_ring, list);
+		tail = ring->tail;
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		for (; tail != head; tail++, count++)
+			handler(cookie, &ring->records[tail & ring->mask]);
+
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	pt_mutex_unlock(&log_rings_lock_);
+	log_draining_ = 0;
+
+	return count;
+}
+
+uint64_t pt_log_binary_dropped(void)
+{
+	struct pt_log_ring *ring;
+	struct list_head *lh;
+	uint64_t dropped = 0;
+
+	pt_mutex_lock(&log_rings_lock_);
+	list_for_each (lh, &log_rings_) {
+		ring = list_entry(lh, struct pt_log_ring, list);
+		dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	}
+	pt_mutex_unlock(&log_rings_lock_);
+
+	return dropped;
+}
+
+static void log_append_(char *buf, size_t size, size_t *len, const char *s, size_t n)
+{
+	if (n > size - 1 - *len)
+		n = size - 1 - *len;
+
+	memcpy(buf + *len, s, n);
+	*len += n;
+	buf[*len] = '\0';
+}
+
+/* Format a binary log record into 'buf'.  Returns the length of the
+ * result, which is truncated to fit 'size' bytes.
+ */
+int pt_log_record_format(const struct pt_log_record *record, char *buf, size_t size)
+{
+	char spec_buf[32], value_buf[256];
+	struct log_spec spec;
+	const uint64_t *args;
+	const char *p, *q;
+	int arg = 0, n = 0;
+	int truncated;
+	size_t len = 0;
+	double d;
+
+	if (record == NULL || record->format == NULL || buf == NULL || size == 0) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	args      = record->args;
+	truncated = record->flags & PT_LOG_RECORD_FLAG_TRUNCATED;
+	buf[0]    = '\0';
+
+	for (p = record->format; *p != '\0'; p = q) {
+		if (*p != '%') {
+			if ( (q = strchr(p, '%')) == NULL)
+				q = p + strlen(p);
+			log_append_(buf, size, &len, p, q - p);
+			continue;
+		}
+
+		q = log_spec_parse_(p + 1, &spec);
+
+		if (spec.type == LOG_ARG_IGNORE)
+			continue;
+
+		if (spec.type == LOG_ARG_NONE) {
+			log_append_(buf, size, &len, p + 1, q - p - 1);
+			continue;
+		}
+
+		if (arg + spec.stars + 1 > record->nargs) {
+			truncated = 1;
+			break;
+		}
+
+		/* Rebuild the spec with '*' replaced by the recorded values,
+		 * and with strings and doubles using their recorded types.
+		 */
+		spec_buf[0] = '%';
+		n = 1;
+		for (p++; p < spec.length && n < (int)sizeof spec_buf - 16; p++) {
+			if (*p == '*')
+				n += snprintf(spec_buf + n, sizeof spec_buf - n,
+				              "%d", (int)args[arg++]);
+			else
+				spec_buf[n++] = *p;
+		}
+
+		if (spec.type == LOG_ARG_STRING || spec.type == LOG_ARG_WSTRING)
+			spec_buf[n++] = 's';
+		else if (spec.type == LOG_ARG_DOUBLE)
+			spec_buf[n++] = spec.conversion;
+		else
+			for (; p < q && n < (int)sizeof spec_buf - 1; p++)
+				spec_buf[n++] = *p;
+		spec_buf[n] = '\0';
+
+		switch (spec.type) {
+		case LOG_ARG_INT:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (int)args[arg]);
+			break;
+		case LOG_ARG_LONG:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (long)args[arg]);
+			break;
+		case LOG_ARG_LLONG:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (long long)args[arg]);
+			break;
+		case LOG_ARG_SIZE:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (size_t)args[arg]);
+			break;
+		case LOG_ARG_INTMAX:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (intmax_t)args[arg]);
+			break;
+		case LOG_ARG_PTRDIFF:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (ptrdiff_t)args[arg]);
+			break;
+		case LOG_ARG_POINTER:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, (void *)(uintptr_t)args[arg]);
+			break;
+		case LOG_ARG_DOUBLE:
+			memcpy(&d, &args[arg], sizeof d);
+			n = snprintf(value_buf, sizeof value_buf, spec_buf, d);
+			break;
+		case LOG_ARG_STRING:
+		case LOG_ARG_WSTRING:
+			n = snprintf(value_buf, sizeof value_buf, spec_buf,
+			             &record->strings[args[arg] % PT_LOG_RECORD_STRINGS]);
+			break;
+		}
+		arg++;
+
+		if (n > 0)
+			log_append_(buf, size, &len, value_buf,
+			            n < (int)sizeof value_buf ? n : sizeof value_buf - 1);
+	}
+
+	if (truncated)
+		log_append_(buf, size, &len, "...", 3);
+
+	return (int)len;
+}
@@ -43,26 +43,20 @@
 #ifndef PT_LOG_INTERNAL_H
 #define PT_LOG_INTERNAL_H
 
-#include <stdio.h>
-#include <stdarg.h>
+#include <stdint.h>
 #include <libptrace/list.h>
-#include <libptrace/charset.h>
+#include <libptrace/log.h>
 
-#define PT_LOG_HOOK_INIT	{ .handler = NULL, .cookie = NULL }
-
-extern struct list_head log_hooks_;
-
-static inline int pt_log_active(void)
-{
-	return !list_empty(&log_hooks_);
-};
-
-typedef void (*pt_log_hook_t)(void *, const char *, va_list);
-
-struct pt_log_hook
+/* Single producer, single consumer ring of binary log records.  Every
+ * thread that logs gets its own ring, so writers never contend.
+ */
+struct pt_log_ring
 {
-	pt_log_hook_t		handler;
-	void			*cookie;
+	uint64_t		head;		/* Written by the owner.   */
+	uint64_t		tail;		/* Written by the reader.  */
+	uint64_t		dropped;
+	size_t			mask;
+	struct pt_log_record	*records;
 
 	struct list_head	list;
 };
@@ -71,9 +65,8 @@ struct pt_log_hook
 extern "C" {
 #endif
 
-void pt_log(const char *format, ...);
-void pt_log_hook_register(struct pt_log_hook *);
-int pt_log_hook_unregister(struct pt_log_hook *);
+void pt_log_hooks_hold(void);
+void pt_log_hooks_release(void);
 
 #ifdef __cplusplus
 };
@@ -45,12 +45,17 @@
 #define PT_MMAP_INTERNAL_H
 
 #include <stdint.h>
+#include <libptrace/types.h>
 #include "interval_tree.h"
 
 #define PT_VMA_PROT_READ	1
 #define PT_VMA_PROT_WRITE	2
 #define PT_VMA_PROT_EXEC	4
 
+/* Granularity used for batching remote memory accesses. */
+#define PT_MMAP_PAGE_SIZE	4096
+#define PT_MMAP_PAGE_MASK	(~((pt_address_t)PT_MMAP_PAGE_SIZE - 1))
+
 struct pt_process;
 
 struct pt_mmap_area
@@ -47,11 +47,30 @@
 
 typedef pthread_mutex_t pt_mutex_t;
 
+#define PT_MUTEX_INITIALIZER	PTHREAD_MUTEX_INITIALIZER
+
 static inline int pt_mutex_init(pt_mutex_t *mutex)
 {
 	return pthread_mutex_init(mutex, NULL);
 }
 
+/* A mutex the owning thread can lock again without deadlocking. */
+static inline int pt_mutex_init_recursive(pt_mutex_t *mutex)
+{
+	pthread_mutexattr_t attr;
+	int ret;
+
+	if ( (ret = pthread_mutexattr_init(&attr)) != 0)
+		return ret;
+
+	ret = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (ret == 0)
+		ret = pthread_mutex_init(mutex, &attr);
+
+	pthread_mutexattr_destroy(&attr);
+	return ret;
+}
+
 static inline int pt_mutex_destroy(pt_mutex_t *mutex)
 {
 	return pthread_mutex_destroy(mutex);
@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * page_hash.c
+ *
+ * libptrace page hashing and change detection.
+ *
+ * Pages are hashed by eight 64-bit lanes that each accumulate the
+ * product of the low and high halves of a data word mixed with a key,
+ * plus the word itself.  The key changes with every 64 byte stripe, so
+ * moving data around within a page changes its hash.  The lanes map
+ * onto SSE2 or AVX2 vectors, where the 32x32 to 64-bit multiply is a
+ * single instruction, and all implementations produce the same hash.
+ *
+ * This is not a cryptographic hash, and a tracee can craft collisions
+ * if it wants to.  It serves to find which pages changed between two
+ * stops without keeping a copy of them.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_MEMORY
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include <libptrace/page_hash.h>
+#include <libptrace/scan.h>
+#include <libptrace/util.h>
+#include "mmap.h"
+#include "process.h"
+#include "workers.h"
+
+#if defined(__GNUC__) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define PT_PAGE_HASH_SIMD
+#include <immintrin.h>
+#endif
+
+/* Pages read and hashed per job. */
+#define PT_PAGE_HASH_JOB_PAGES	256
+
+#define HASH_LANES		8
+#define HASH_STRIPE		(HASH_LANES * sizeof(uint64_t))
+#define HASH_STRIPES		(PT_MMAP_PAGE_SIZE / HASH_STRIPE)
+#define HASH_KEY_STEP		0x9e3779b97f4a7c15ULL
+#define HASH_PRIME1		0x9e3779b185ebca87ULL
+#define HASH_PRIME2		0xc2b2ae3d27d4eb4fULL
+
+static const uint64_t hash_key_[HASH_LANES] = {
+	0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL,
+	0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+	0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+	0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL
+};
+
+struct hash_job_
+{
+	pt_address_t	start;
+	size_t		pages;
+	size_t		index;
+	int		error;
+};
+
+struct hash_ctx_
+{
+	struct pt_process	*process;
+	struct hash_job_	*jobs;
+	uint64_t		*hashes;
+};
+
+static inline uint64_t hash_load64_(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static void hash_accumulate_scalar_(const uint8_t *page, uint64_t *acc)
+{
+	uint64_t d, k;
+	size_t i, l;
+
+	for (i = 0; i < HASH_STRIPES; i++) {
+		for (l = 0; l < HASH_LANES; l++) {
+			d = hash_load64_(page + i * HASH_STRIPE + l * sizeof d);
+			k = d ^ (hash_key_[l] + i * HASH_KEY_STEP);
+			acc[l] += (k & 0xffffffff) * (k >> 32) + d;
+		}
+	}
+}
+
+#ifdef PT_PAGE_HASH_SIMD
+static void hash_accumulate_sse2_(const uint8_t *page, uint64_t *acc)
+{
+	__m128i a[4], key[4], step, d, k;
+	size_t i, j;
+
+	step = _mm_set1_epi64x((long long)HASH_KEY_STEP);
+
+	for (j = 0; j < 4; j++) {
+		a[j]   = _mm_loadu_si128((const __m128i *)&acc[j * 2]);
+		key[j] = _mm_loadu_si128((const __m128i *)&hash_key_[j * 2]);
+	}
+
+	for (i = 0; i < HASH_STRIPES; i++) {
+		for (j = 0; j < 4; j++) {
+			d      = _mm_loadu_si128((const __m128i *)(page + i * HASH_STRIPE + j * 16));
+			k      = _mm_xor_si128(d, key[j]);
+			k      = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+			a[j]   = _mm_add_epi64(a[j], _mm_add_epi64(k, d));
+			key[j] = _mm_add_epi64(key[j], step);
+		}
+	}
+
+	for (j = 0; j < 4; j++)
+		_mm_storeu_si128((__m128i *)&acc[j * 2], a[j]);
+}
+
+__attribute__((target("avx2")))
+static void hash_accumulate_avx2_(const uint8_t *page, uint64_t *acc)
+{
+	__m256i a[2], key[2], step, d, k;
+	size_t i, j;
+
+	step = _mm256_set1_epi64x((long long)HASH_KEY_STEP);
+
+	for (j = 0; j < 2; j++) {
+		a[j]   = _mm256_loadu_si256((const __m256i *)&acc[j * 4]);
+		key[j] = _mm256_loadu_si256((const __m256i *)&hash_key_[j * 4]);
+	}
+
+	for (i = 0; i < HASH_STRIPES; i++) {
+		for (j = 0; j < 2; j++) {
+			d      = _mm256_loadu_si256((const __m256i *)(page + i * HASH_STRIPE + j * 32));
+			k      = _mm256_xor_si256(d, key[j]);
+			k      = _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+			a[j]   = _mm256_add_epi64(a[j], _mm256_add_epi64(k, d));
+			key[j] = _mm256_add_epi64(key[j], step);
+		}
+	}
+
+	for (j = 0; j < 2; j++)
+		_mm256_storeu_si256((__m256i *)&acc[j * 4], a[j]);
+}
+#endif
+
+static void (*hash_accumulate_)(const uint8_t *, uint64_t *) =
+	hash_accumulate_scalar_;
+
+/* Racing initializations store the same value, so this needs no locking. */
+static void hash_init_(void)
+{
+#ifdef PT_PAGE_HASH_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		hash_accumulate_ = hash_accumulate_avx2_;
+	else
+		hash_accumulate_ = hash_accumulate_sse2_;
+#endif
+}
+
+static inline uint64_t hash_avalanche_(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= HASH_PRIME2;
+	h ^= h >> 29;
+	h *= HASH_PRIME1;
+	h ^= h >> 32;
+	return h;
+}
+
+static uint64_t hash_page_(const uint8_t *page)
+{
+	uint64_t acc[HASH_LANES], h = PT_MMAP_PAGE_SIZE * HASH_PRIME1;
+	size_t l;
+
+	for (l = 0; l < HASH_LANES; l++)
+		acc[l] = HASH_PRIME2 ^ l;
+
+	hash_accumulate_(page, acc);
+
+	for (l = 0; l < HASH_LANES; l++) {
+		h ^= hash_avalanche_(acc[l] + l * HASH_KEY_STEP);
+		h  = ((h << 27) | (h >> 37)) * HASH_PRIME1;
+	}
+
+	h = hash_avalanche_(h);
+	return h == PT_PAGE_HASH_NONE ? 1 : h;
+}
+
+/** Hash a single page of local memory. */
+uint64_t pt_page_hash(const void *page)
+{
+	hash_init_();
+	return hash_page_(page);
+}
+
+static void hash_job_(size_t n, void *cookie)
+{
+	struct hash_ctx_ *ctx = cookie;
+	struct hash_job_ *job = &ctx->jobs[n];
+	size_t i, len = job->pages * PT_MMAP_PAGE_SIZE;
+	uint64_t *hashes = &ctx->hashes[job->index];
+	uint8_t *buf;
+	int whole;
+
+	if ( (buf = malloc(len)) == NULL) {
+		job->error = errno;
+		return;
+	}
+
+	whole = pt_process_read_locked(ctx->process, buf, job->start, len) ==
+	        (ssize_t)len;
+
+	for (i = 0; i < job->pages; i++) {
+		uint8_t *page = buf + i * PT_MMAP_PAGE_SIZE;
+
+		if (!whole &&
+		    pt_process_read_locked(ctx->process, page,
+		                           job->start + i * PT_MMAP_PAGE_SIZE,
+		                           PT_MMAP_PAGE_SIZE) != PT_MMAP_PAGE_SIZE)
+			hashes[i] = PT_PAGE_HASH_NONE;
+		else
+			hashes[i] = hash_page_(page);
+	}
+
+	free(buf);
+}
+
+static int hash_area_wanted_(struct pt_mmap_area *area, int prot)
+{
+	int flags = PT_VMA_PROT_READ;
+
+	if (prot & PT_SCAN_PROT_WRITE)
+		flags |= PT_VMA_PROT_WRITE;
+	if (prot & PT_SCAN_PROT_EXEC)
+		flags |= PT_VMA_PROT_EXEC;
+
+	return (area->flags & flags) == flags;
+}
+
+void pt_page_hashes_delete(struct pt_page_hashes *hashes)
+{
+	if (hashes == NULL)
+		return;
+
+	free(hashes->ranges);
+	free(hashes->hashes);
+	free(hashes);
+}
+
+/* Lay out one range per area, and one job per run of at most
+ * PT_PAGE_HASH_JOB_PAGES pages of a range.
+ */
+static int
+hash_layout_(struct pt_page_hashes *hashes, struct pt_process *process,
+             int prot, struct hash_job_ **jobs, size_t *job_count)
+{
+	struct pt_page_range *range;
+	struct pt_mmap_area *area;
+	struct hash_job_ *job;
+	size_t i, count = 0, n = 0;
+
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (hash_area_wanted_(area, prot))
+			count++;
+	}
+
+	if ( (hashes->ranges = calloc(count + 1, sizeof *range)) == NULL)
+		goto err;
+
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (!hash_area_wanted_(area, prot))
+			continue;
+
+		range = &hashes->ranges[hashes->range_count++];
+		range->start = area->start_ & PT_MMAP_PAGE_MASK;
+		range->pages = (area->end_ - range->start + PT_MMAP_PAGE_SIZE - 1) /
+		               PT_MMAP_PAGE_SIZE;
+		range->index = hashes->pages;
+
+		hashes->pages += range->pages;
+		n += (range->pages + PT_PAGE_HASH_JOB_PAGES - 1) /
+		     PT_PAGE_HASH_JOB_PAGES;
+	}
+
+	hashes->hashes = malloc((hashes->pages + 1) * sizeof *hashes->hashes);
+	*jobs = calloc(n + 1, sizeof **jobs);
+	if (hashes->hashes == NULL || *jobs == NULL)
+		goto err;
+
+	*job_count = 0;
+	for (i = 0; i < hashes->range_count; i++) {
+		range = &hashes->ranges[i];
+
+		for (count = 0; count < range->pages;
+		     count += PT_PAGE_HASH_JOB_PAGES) {
+			job        = &(*jobs)[(*job_count)++];
+			job->start = range->start + count * PT_MMAP_PAGE_SIZE;
+			job->index = range->index + count;
+			job->pages = range->pages - count;
+			if (job->pages > PT_PAGE_HASH_JOB_PAGES)
+				job->pages = PT_PAGE_HASH_JOB_PAGES;
+		}
+	}
+
+	return 0;
+
+err:
+	pt_error_errno_set(errno);
+	return -1;
+}
+
+/** Hash every page of the areas of a process.
+ *
+ * Only readable areas with at least the PT_SCAN_PROT_* protection in
+ * 'prot' are hashed, and pages are read in parallel.  Pages that cannot
+ * be read hash to PT_PAGE_HASH_NONE.  Breakpoints set by us are not
+ * visible to the hash, so setting them does not change a page.
+ */
+struct pt_page_hashes *pt_mmap_page_hashes(struct pt_process *process, int prot)
+{
+	struct pt_page_hashes *hashes;
+	struct hash_job_ *jobs = NULL;
+	struct hash_ctx_ ctx;
+	size_t i, job_count;
+	uint64_t start;
+	int error = 0;
+
+	if ( (hashes = calloc(1, sizeof *hashes)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	/* Lay out the ranges under the process lock, as other threads can
+	 * rebuild the memory map.
+	 */
+	pt_process_lock(process);
+	if (pt_mmap_load(process) == -1 ||
+	    hash_layout_(hashes, process, prot, &jobs, &job_count) == -1) {
+		pt_process_unlock(process);
+		free(jobs);
+		pt_page_hashes_delete(hashes);
+		return NULL;
+	}
+	pt_process_unlock(process);
+
+	hash_init_();
+	ctx.process = process;
+	ctx.jobs    = jobs;
+	ctx.hashes  = hashes->hashes;
+	start       = pt_util_time_ns();
+
+	/* The workers read on our behalf, under our process lock. */
+	pt_process_lock(process);
+	pt_workers_run(job_count, hash_job_, &ctx);
+	pt_process_unlock(process);
+
+	for (i = 0; i < job_count; i++)
+		if (jobs[i].error != 0 && error == 0)
+			error = jobs[i].error;
+
+	free(jobs);
+
+	if (error != 0) {
+		pt_error_errno_set(error);
+		pt_page_hashes_delete(hashes);
+		return NULL;
+	}
+
+	pt_log("%s(): %zu ranges, %zu pages in %llu ns\n", __FUNCTION__,
+	       hashes->range_count, hashes->pages,
+	       (unsigned long long)(pt_util_time_ns() - start));
+
+	return hashes;
+}
+
+struct hash_cursor_
+{
+	const struct pt_page_hashes	*hashes;
+	size_t				range;
+	size_t				page;
+};
+
+static int
+hash_cursor_get_(struct hash_cursor_ *c, pt_address_t *address, uint64_t *hash)
+{
+	const struct pt_page_range *range;
+
+	if (c->range == c->hashes->range_count)
+		return 0;
+
+	range    = &c->hashes->ranges[c->range];
+	*address = range->start + c->page * PT_MMAP_PAGE_SIZE;
+	*hash    = c->hashes->hashes[range->index + c->page];
+	return 1;
+}
+
+/* Move to the next range once we are past the end of the current one,
+ * skipping empty ranges, which a caller may have built.
+ */
+static void hash_cursor_skip_(struct hash_cursor_ *c)
+{
+	while (c->range < c->hashes->range_count &&
+	       c->page == c->hashes->ranges[c->range].pages) {
+		c->range++;
+		c->page = 0;
+	}
+}
+
+static void hash_cursor_next_(struct hash_cursor_ *c)
+{
+	c->page++;
+	hash_cursor_skip_(c);
+}
+
+static void hash_cursor_init_(struct hash_cursor_ *c,
+                              const struct pt_page_hashes *hashes)
+{
+	c->hashes = hashes;
+	c->range  = 0;
+	c->page   = 0;
+	hash_cursor_skip_(c);
+}
+
+/** Report the runs of pages that differ between two sets of hashes.
+ *
+ * A page differs if its hash changed, or if it is present in only one
+ * of the sets, such as when it was mapped or unmapped in between.  Pages
+ * that could not be read either time are considered unchanged.  Returns
+ * the number of changed pages reported, or -1.
+ */
+ssize_t pt_page_hashes_diff(const struct pt_page_hashes *old,
+                            const struct pt_page_hashes *new,
+                            pt_page_diff_handler_t handler, void *cookie)
+{
+	struct hash_cursor_ a, b;
+	pt_address_t addr_a, addr_b, address, run_start = 0;
+	uint64_t hash_a, hash_b;
+	size_t run = 0;
+	ssize_t changed = 0;
+	int has_a, has_b, differs;
+
+	if (old == NULL || new == NULL || handler == NULL) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	hash_cursor_init_(&a, old);
+	hash_cursor_init_(&b, new);
+
+	for (;;) {
+		has_a = hash_cursor_get_(&a, &addr_a, &hash_a);
+		has_b = hash_cursor_get_(&b, &addr_b, &hash_b);
+		if (!has_a && !has_b)
+			break;
+
+		if (has_a && has_b && addr_a == addr_b) {
+			address = addr_a;
+			differs = hash_a != hash_b;
+			hash_cursor_next_(&a);
+			hash_cursor_next_(&b);
+		} else if (has_a && (!has_b || addr_a < addr_b)) {
+			address = addr_a;
+			differs = 1;
+			hash_cursor_next_(&a);
+		} else {
+			address = addr_b;
+			differs = 1;
+			hash_cursor_next_(&b);
+		}
+
+		if (differs && run != 0 &&
+		    address == run_start + run * PT_MMAP_PAGE_SIZE) {
+			run++;
+			continue;
+		}
+
+		if (run != 0) {
+			changed += run;
+			if (handler(run_start, run, cookie) != 0)
+				return changed;
+		}
+
+		run_start = address;
+		run       = differs;
+	}
+
+	if (run != 0) {
+		changed += run;
+		handler(run_start, run, cookie);
+	}
+
+	return changed;
+}
@@ -42,15 +42,22 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_PROCESS
+
 #include <assert.h>
 #include <stdarg.h>
 #include <libptrace/log.h>
 #include <libptrace/error.h>
 #include "breakpoint.h"
 #include "core.h"
+#include "displaced.h"
+#include "function_trace.h"
+#include "fuzz.h"
 #include "event.h"
+#include "log.h"
 #include "process.h"
 #include "module.h"
+#include "stats.h"
 #include "thread.h"
 
 int thread_avl_compare_(struct avl_node *a, struct avl_node *b_);
@@ -61,6 +68,7 @@ int pt_process_init(struct pt_process *process)
 	process->pid                = -1;
 	process->private_data       = NULL;
 	process->state              = PT_PROCESS_STATE_INIT;
+	process->flags              = 0;
 	process->remote_break_count = 0;
 	process->options            = PT_PROCESS_OPTION_NONE;
 	process->creation_time      = 0;
@@ -71,13 +79,28 @@ int pt_process_init(struct pt_process *process)
 	process->smgr               = NULL;
 	process->remote_break_addr  = PT_ADDRESS_NULL;
 	process->super_             = NULL;
+	process->displaced          = NULL;
+	process->fuzz               = NULL;
+	process->fuzz_hooks.installed = 0;
+	process->events_subscribed  = 0;
+	process->regs_cached        = NULL;
+	list_init(&process->threads_restore);
+	process->stats              = NULL;
+	process->stats_continued    = 0;
 
 	INIT_AVL_TREE(&process->threads, thread_avl_compare_);
 	list_init(&process->modules);
 	INIT_AVL_TREE(&process->breakpoints, breakpoint_avl_compare_);
+	list_init(&process->breakpoints_retired);
+	list_init(&process->function_traces);
 	pt_mmap_init(&process->mmap);
 	pt_event_handlers_internal_init(&process->handlers);
 
+	if (pt_mutex_init_recursive(&process->lock) != 0) {
+		pt_error_internal_set(PT_ERROR_RESOURCE_LIMIT);
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -97,6 +120,12 @@ int pt_process_destroy(struct pt_process *process)
 	/* Free the handler functions we had allocated. */
 	pt_event_handlers_internal_destroy(&process->handlers);
 
+	/* End a fuzzing loop, and remove its breakpoints. */
+	pt_fuzz_process_destroy(process);
+
+	/* Remove all function traces and their return breakpoints. */
+	pt_function_trace_process_destroy(process);
+
 	/* Remove all breakpoints. */
 	pt_process_for_each_breakpoint_internal (process, bp)
 		bp->breakpoint->b_op->process_remove(process, bp);
@@ -109,8 +138,15 @@ int pt_process_destroy(struct pt_process *process)
 	pt_process_for_each_module (process, module)
 		pt_module_delete(module);
 
+	/* Free the displaced stepping state. */
+	pt_displaced_destroy(process);
+
+	/* Free the latency histograms. */
+	pt_stats_process_destroy(process);
+
 	/* Free the memory map. */
 	pt_mmap_destroy(&process->mmap);
+	pt_mutex_destroy(&process->lock);
 
 	if (process->core != NULL)
 		avl_tree_delete(&process->core->process_tree, &process->avl_node);
@@ -126,6 +162,24 @@ int pt_process_delete(struct pt_process *process)
 	return 0;
 }
 
+/* The process lock is only ever held around short sections that do not
+ * call out to handlers, so it can be taken from any thread, including
+ * those holding a lock of their own such as the Python GIL.  Log hooks
+ * are deferred until it is released for the same reason.  The lock is
+ * recursive, so library functions taking it can call each other.
+ */
+void pt_process_lock(struct pt_process *process)
+{
+	pt_mutex_lock(&process->lock);
+	pt_log_hooks_hold();
+}
+
+void pt_process_unlock(struct pt_process *process)
+{
+	pt_mutex_unlock(&process->lock);
+	pt_log_hooks_release();
+}
+
 /* Can be called from other threads to interrupt the pt_main loop. */
 int pt_process_brk(struct pt_process *process)
 {
@@ -141,6 +195,7 @@ int pt_process_option_set(struct pt_process *process, int option)
 {
 	switch (option) {
 	case PT_PROCESS_OPTION_EVENT_SECOND_CHANCE:
+	case PT_PROCESS_OPTION_DISPLACED_STEPPING:
 		process->options |= option;
 		break;
 	default:
@@ -150,10 +205,73 @@ int pt_process_option_set(struct pt_process *process, int option)
 	return 0;
 }
 
+/* Returns the PT_EVENT_CLASS_* mask of events that need to be handled
+ * for this process.  This covers the registered event handlers, explicit
+ * subscriptions, and the internal needs of libptrace itself.  Events
+ * outside of this mask are passed on by the backend without dispatch.
+ */
+uint32_t pt_process_event_mask_get(struct pt_process *process)
+{
+	uint32_t mask;
+
+	mask  = pt_event_handlers_internal_mask(&process->handlers);
+	mask |= process->events_subscribed;
+
+	if (!avl_tree_empty(&process->breakpoints) ||
+	    !list_empty(&process->function_traces))
+		mask |= PT_EVENT_CLASS_BREAKPOINT | PT_EVENT_CLASS_SINGLE_STEP;
+
+	if (process->remote_break_count != 0)
+		mask |= PT_EVENT_CLASS_REMOTE_BREAK;
+
+	/* Debug strings are only read from the process to be logged. */
+	if (pt_log_enabled(PT_LOG_CATEGORY_EVENT, PT_LOG_LEVEL_DEBUG))
+		mask |= PT_EVENT_CLASS_DEBUG_STRING;
+
+	return mask;
+}
+
+void pt_process_event_subscribe(struct pt_process *process, uint32_t mask)
+{
+	process->events_subscribed |= mask & PT_EVENT_CLASS_ALL;
+}
+
+void pt_process_event_unsubscribe(struct pt_process *process, uint32_t mask)
+{
+	process->events_subscribed &= ~mask;
+}
+
+/* Find the first breakpoint at or above 'address'.  The caller holds the
+ * process lock.
+ */
+struct avl_node *
+pt_process_breakpoint_lower_bound(struct pt_process *process,
+                                  pt_address_t address)
+{
+	struct avl_node *an = process->breakpoints.root;
+	struct avl_node *best = NULL;
+
+	while (an != NULL) {
+		struct pt_breakpoint_internal *bp;
+
+		bp = container_of(an, struct pt_breakpoint_internal, avl_node);
+		if (bp->address >= address) {
+			best = an;
+			an = an->left;
+		} else {
+			an = an->right;
+		}
+	}
+
+	return best;
+}
 
+/* Read process memory as is, including the breakpoint opcodes we have
+ * patched into it.
+ */
 ssize_t
-pt_process_read(struct pt_process *process, void *dst,
-                const pt_address_t src, size_t size)
+pt_process_read_raw(struct pt_process *process, void *dst,
+                    const pt_address_t src, size_t size)
 {
 	if (process->p_op->read == NULL) {
 		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
@@ -163,6 +281,55 @@ pt_process_read(struct pt_process *process, void *dst,
 	return process->p_op->read(process, dst, src, size);
 }
 
+/* Read process memory, hiding the breakpoints we have set.  The process
+ * breakpoint tree is ordered by address, so we descend to the first
+ * breakpoint in the range once and walk forward from there.  The cost of
+ * the overlay is proportional to the number of breakpoints in the range.
+ *
+ * The caller holds the process lock, or runs as a worker for a thread
+ * that holds it.
+ */
+ssize_t
+pt_process_read_locked(struct pt_process *process, void *dst,
+                       const pt_address_t src, size_t size)
+{
+	struct pt_breakpoint_internal *bpi;
+	struct avl_node *an;
+	ssize_t ret;
+
+	if ( (ret = pt_process_read_raw(process, dst, src, size)) == -1)
+		return -1;
+
+	an = pt_process_breakpoint_lower_bound(process, src);
+	for (; an != NULL; an = avl_tree_next(an)) {
+		bpi = container_of(an, struct pt_breakpoint_internal, avl_node);
+
+		if (bpi->address - src >= size)
+			break;
+
+		if (bpi->patched)
+			((uint8_t *)dst)[bpi->address - src] = bpi->original;
+	}
+
+	return ret;
+}
+
+/* Breakpoints can be set and removed from other threads, so the read and
+ * the overlay are done under the process lock.
+ */
+ssize_t
+pt_process_read(struct pt_process *process, void *dst,
+                const pt_address_t src, size_t size)
+{
+	ssize_t ret;
+
+	pt_process_lock(process);
+	ret = pt_process_read_locked(process, dst, src, size);
+	pt_process_unlock(process);
+
+	return ret;
+}
+
 int pt_process_suspend(struct pt_process *process)
 {
 	if (process->p_op->suspend == NULL) {
@@ -180,9 +347,33 @@ int pt_process_resume(struct pt_process *process)
 		return -1;
 	}
 
+	if (pt_process_registers_flush(process) == -1)
+		return -1;
+
 	return process->p_op->resume(process);
 }
 
+/* Write back all dirty cached register contexts of the process and drop
+ * the cache.  Called before the process continues from a stop.
+ */
+int pt_process_registers_flush(struct pt_process *process)
+{
+	struct pt_thread *thread;
+	int ret = 0;
+
+	while ( (thread = process->regs_cached) != NULL) {
+		if (pt_thread_registers_flush(thread) == -1) {
+			pt_log("%s(): failed to flush registers of thread %d\n",
+			       __FUNCTION__, thread->tid);
+			ret = -1;
+		}
+
+		pt_thread_registers_invalidate(thread);
+	}
+
+	return ret;
+}
+
 int
 pt_process_write(struct pt_process *process, pt_address_t dst,
                  const void *src, size_t size)
@@ -216,6 +407,22 @@ pt_address_t pt_process_malloc(struct pt_process *process, size_t size)
 	return process->p_op->malloc(process, size);
 }
 
+/* Allocate memory within rel32 reach of 'near' when the platform lets us,
+ * and anywhere otherwise.
+ */
+pt_address_t
+pt_process_malloc_near(struct pt_process *process, size_t size,
+                       pt_address_t near)
+{
+	pt_address_t p;
+
+	if (process->p_op->malloc_near != NULL &&
+	    (p = process->p_op->malloc_near(process, size, near)) != PT_ADDRESS_NULL)
+		return p;
+
+	return pt_process_malloc(process, size);
+}
+
 int pt_process_free(struct pt_process *process, pt_address_t p)
 {
 	if (process->p_op->free == NULL) {
@@ -347,6 +554,7 @@ int pt_process_breakpoint_remove(struct pt_process *process,
 	struct pt_breakpoint_internal *bpi;
 	pt_address_t address = bp->address;
 	char *symbol = bp->symbol;
+	int ret;
 
 	assert(process != NULL);
 	assert(bp != NULL);
@@ -363,14 +571,20 @@ int pt_process_breakpoint_remove(struct pt_process *process,
 		}
 	}
 
-	/* Do not allow multiple breakpoints on the same address. */
+	pt_process_lock(process);
+
 	bpi = pt_process_breakpoint_find_internal(process, address);
 	if (bpi == NULL) {
+		pt_process_unlock(process);
 		pt_log("%s(): breakpoint does not exist -- returning -1\n", __FUNCTION__);
 		return -1;
 	}
 
-	return bp->b_op->process_remove(process, bpi);
+	list_del_init(&bpi->retired);
+	ret = bp->b_op->process_remove(process, bpi);
+	pt_process_unlock(process);
+
+	return ret;
 }
 
 int pt_process_breakpoint_set(struct pt_process *process,
@@ -399,8 +613,11 @@ int pt_process_breakpoint_set(struct pt_process *process,
 		pt_log("%s(): resolved symbol %s to 0x%.8x\n", __FUNCTION__, symbol, address);
 	}
 
+	pt_process_lock(process);
+
 	/* Do not allow multiple breakpoints on the same address. */
 	if (pt_process_breakpoint_find(process, address) != NULL) {
+		pt_process_unlock(process);
 		pt_error_internal_set(PT_ERROR_EXISTS);
 		pt_log("%s(): breakpoint exists -- returning -1\n", __FUNCTION__);
 		return -1;
@@ -408,6 +625,7 @@ int pt_process_breakpoint_set(struct pt_process *process,
 
 	/* Allocate our new per process breakpoint structure. */
 	if ( (bpi = malloc(sizeof *bpi)) == NULL) {
+		pt_process_unlock(process);
 		pt_error_errno_set(errno);
 		return -1;
 	}
@@ -415,11 +633,15 @@ int pt_process_breakpoint_set(struct pt_process *process,
 	/* And fill in the resolved address. */
 	bpi->address = address;
 	bpi->breakpoint = bp;
+	bpi->patched = 0;
+	list_init(&bpi->retired);
 
 	if ( (ret = bp->b_op->process_set(process, bpi)) == 0)
 		avl_tree_insert(&process->breakpoints, &bpi->avl_node);
 	else
-		free(bp);
+		free(bpi);
+
+	pt_process_unlock(process);
 
 	pt_log("%s(): returning %d\n", __FUNCTION__, ret);
 	return ret;
@@ -441,11 +663,23 @@ process_read_uint32(struct pt_process *process,
 struct pt_thread *
 pt_process_thread_find(struct pt_process *process, pt_pid_t tid)
 {
-	struct pt_thread *thread;
+	struct avl_node *an;
+
+	/* Events look up their thread on every stop, so walk the tree
+	 * rather than scanning all threads of the process.
+	 */
+	an = process->threads.root;
+	while (an != NULL) {
+		struct pt_thread *thread;
 
-	pt_process_for_each_thread (process, thread) {
-		if (thread->tid == tid)
+		thread = container_of(an, struct pt_thread, avl_node);
+		if (thread->tid == (pt_tid_t)tid)
 			return thread;
+
+		if (thread->tid > (pt_tid_t)tid)
+			an = an->left;
+		else
+			an = an->right;
 	}
 
 	return NULL;
@@ -455,15 +689,18 @@ pt_process_thread_find(struct pt_process *process, pt_pid_t tid)
 struct pt_breakpoint_internal *
 pt_process_breakpoint_find_internal(struct pt_process *process, pt_address_t address)
 {
+	struct pt_breakpoint_internal *bp;
 	struct avl_node *an;
 
+	pt_process_lock(process);
+
 	an = process->breakpoints.root;
 	while (an != NULL) {
-		struct pt_breakpoint_internal *bp;
-
 		bp = container_of(an, struct pt_breakpoint_internal, avl_node);
-		if (bp->address == address)
-                        return bp;
+		if (bp->address == address) {
+			pt_process_unlock(process);
+			return bp;
+		}
 
 		if (bp->address > address)
 			an = an->left;
@@ -471,8 +708,9 @@ pt_process_breakpoint_find_internal(struct pt_process *process, pt_address_t add
 			an = an->right;
 	}
 
+	pt_process_unlock(process);
 	pt_error_internal_set(PT_ERROR_NOT_FOUND);
-        return NULL;
+	return NULL;
 }
 
 struct pt_breakpoint *
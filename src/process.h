@@ -65,7 +65,28 @@
 	     an != NULL;						\
 	     an = an2, an2 = avl_tree_next_safe(an))
 
+/* Set while the process is stopped reporting an event. */
+#define PT_PROCESS_FLAG_STOPPED		1
+
+struct pt_displaced;
+struct pt_fuzz;
+
+/* Exception handlers a fuzzing loop hooks and chains to.  These are kept
+ * with the process rather than the loop, as the hooks stay installed
+ * after the loop has ended if other handlers were installed on top.
+ */
+struct pt_fuzz_hooks
+{
+	int	installed;
+	int	(*segfault)(struct pt_event_segfault *);
+	int	(*illegal_instruction)(struct pt_event_illegal_instruction *);
+	int	(*divide_by_zero)(struct pt_event_divide_by_zero *);
+	int	(*priv_instruction)(struct pt_event_priv_instruction *);
+	int	(*unknown_exception)(struct pt_event_unknown_exception *);
+};
+
 struct pt_process_operations;
+struct pt_stats;
 struct pt_symbol_manager;
 
 struct pt_process
@@ -87,6 +108,8 @@ struct pt_process
 
 	/* the memory map of the process. */
 	struct pt_mmap			mmap;
+	/* serializes rebuilding the memory map with threads walking it. */
+	pt_mutex_t			lock;
 
 	/* list of modules in the process. */
 	struct list_head		modules;
@@ -98,6 +121,26 @@ struct pt_process
 
 	/* breakpoint handlers for this process */
 	struct avl_tree			breakpoints;
+	/* breakpoints retired during the current event. */
+	struct list_head		breakpoints_retired;
+	/* function traces set on this process. */
+	struct list_head		function_traces;
+	/* fuzzing loop running on this process. */
+	struct pt_fuzz			*fuzz;
+	struct pt_fuzz_hooks		fuzz_hooks;
+	/* scratch page for displaced stepping, allocated on first use. */
+	struct pt_displaced		*displaced;
+	/* PT_EVENT_CLASS_* events subscribed to without a handler. */
+	uint32_t			events_subscribed;
+
+	/* latency histograms, allocated on the first sample. */
+	struct pt_stats			*stats;
+	/* time the process was last continued, for wait latencies. */
+	uint64_t			stats_continued;
+	/* threads holding a register context cached for this stop. */
+	struct pt_thread		*regs_cached;
+	/* threads with a persistent breakpoint to restore. */
+	struct list_head		threads_restore;
 
 	/* avl tree that tracks all processes being debugged. */
 	struct avl_node			avl_node;
@@ -129,6 +172,7 @@ struct pt_process_operations
 	int          (*thread_create)(struct pt_process *, pt_address_t, pt_address_t);
 	pt_address_t (*malloc)(struct pt_process *, size_t);
 	int          (*free)(struct pt_process *, pt_address_t);
+	pt_address_t (*malloc_near)(struct pt_process *, size_t, pt_address_t);
 };
 
 #ifdef __cplusplus
@@ -138,12 +182,19 @@ extern "C" {
 int pt_process_init(struct pt_process *);
 int pt_process_destroy(struct pt_process *);
 int pt_process_delete(struct pt_process *);
+int pt_process_registers_flush(struct pt_process *);
+void pt_process_lock(struct pt_process *);
+void pt_process_unlock(struct pt_process *);
+ssize_t pt_process_read_locked(struct pt_process *, void *,
+                               const pt_address_t, size_t);
 
 int process_read_uint32(struct pt_process *process,
                         uint32_t *dest, const pt_address_t src);
 
 struct pt_breakpoint_internal *
 pt_process_breakpoint_find_internal(struct pt_process *process, pt_address_t address);
+struct avl_node *
+pt_process_breakpoint_lower_bound(struct pt_process *process, pt_address_t address);
 
 #ifdef __cplusplus
 };
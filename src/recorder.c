@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * recorder.c
+ *
+ * libptrace binary event recorder.
+ *
+ * Events are appended as fixed size records to a memory mapped file, so
+ * that recording costs a single copy per event and no system calls.  In
+ * ring mode the log holds the most recent 'capacity' events; otherwise
+ * events that do not fit are counted as dropped.  The file can be read
+ * while it is being written, which allows for always-on flight recording.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_CORE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include <libptrace/recorder.h>
+#include "file.h"
+#include "recorder.h"
+
+struct pt_recorder *
+pt_recorder_open(const utf8_t *filename, uint64_t capacity, int flags)
+{
+	struct pt_recorder *recorder;
+	size_t size;
+
+	if (capacity == 0 ||
+	    capacity > (SIZE_MAX - sizeof(struct pt_record_header)) /
+	               sizeof(struct pt_record)) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return NULL;
+	}
+
+	if ( (recorder = malloc(sizeof *recorder)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	size = sizeof(struct pt_record_header) +
+	       capacity * sizeof(struct pt_record);
+
+	if (pt_file_mapping_open(&recorder->map, filename, size, PT_FILE_RDWR) == -1) {
+		free(recorder);
+		return NULL;
+	}
+
+	recorder->header  = (struct pt_record_header *)recorder->map.base;
+	recorder->records = (struct pt_record *)(recorder->header + 1);
+
+	memset(recorder->header, 0, sizeof *recorder->header);
+	recorder->header->magic       = PT_RECORDER_MAGIC;
+	recorder->header->version     = PT_RECORDER_VERSION;
+	recorder->header->record_size = sizeof(struct pt_record);
+	recorder->header->flags       = flags;
+	recorder->header->capacity    = capacity;
+
+	return recorder;
+}
+
+int pt_recorder_close(struct pt_recorder *recorder)
+{
+	int ret;
+
+	ret = pt_file_mapping_close(&recorder->map);
+	free(recorder);
+
+	return ret;
+}
+
+int pt_recorder_sync(struct pt_recorder *recorder)
+{
+	return pt_file_mapping_sync(&recorder->map);
+}
+
+void pt_recorder_append(struct pt_recorder *recorder,
+                        const struct pt_record *record)
+{
+	struct pt_record_header *header = recorder->header;
+
+	if (header->count >= header->capacity &&
+	    !(header->flags & PT_RECORDER_FLAG_RING)) {
+		header->dropped++;
+		return;
+	}
+
+	/* The record is complete before the count makes it visible. */
+	recorder->records[header->count % header->capacity] = *record;
+	header->count++;
+}
+
+struct pt_record_reader *pt_record_reader_open(const utf8_t *filename)
+{
+	struct pt_record_reader *reader;
+	struct pt_record_header *header;
+	uint64_t capacity;
+
+	if ( (reader = malloc(sizeof *reader)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	if (pt_file_mapping_open(&reader->map, filename, 0, PT_FILE_RDONLY) == -1) {
+		free(reader);
+		return NULL;
+	}
+
+	if (reader->map.size < sizeof *header)
+		goto err_format;
+
+	header   = (struct pt_record_header *)reader->map.base;
+	capacity = header->capacity;
+
+	if (header->magic != PT_RECORDER_MAGIC ||
+	    header->version != PT_RECORDER_VERSION ||
+	    header->record_size != sizeof(struct pt_record) ||
+	    capacity == 0 ||
+	    capacity > (reader->map.size - sizeof *header) / sizeof(struct pt_record))
+		goto err_format;
+
+	reader->header  = header;
+	reader->records = (struct pt_record *)(header + 1);
+
+	/* Take a snapshot of the records present now.  In ring mode the
+	 * oldest ones may have been overwritten.
+	 */
+	reader->end = header->count;
+	reader->pos = reader->end > capacity ? reader->end - capacity : 0;
+
+	return reader;
+
+err_format:
+	pt_log("%s(): %s is not a libptrace record file\n", __FUNCTION__, filename);
+	pt_error_internal_set(PT_ERROR_BAD_ENCODING);
+	pt_file_mapping_close(&reader->map);
+	free(reader);
+	return NULL;
+}
+
+/* Returns 1 and fills in 'record' while there are records left, and 0
+ * at the end of the log.
+ */
+int pt_record_reader_next(struct pt_record_reader *reader,
+                          struct pt_record *record)
+{
+	if (reader->pos >= reader->end)
+		return 0;
+
+	*record = reader->records[reader->pos++ % reader->header->capacity];
+	return 1;
+}
+
+uint64_t pt_record_reader_dropped_get(struct pt_record_reader *reader)
+{
+	return reader->header->dropped;
+}
+
+int pt_record_reader_close(struct pt_record_reader *reader)
+{
+	int ret;
+
+	ret = pt_file_mapping_close(&reader->map);
+	free(reader);
+
+	return ret;
+}
+
+const char *pt_record_type_to_string(int type)
+{
+	switch (type) {
+	case PT_RECORD_PROCESS_CREATE:
+		return "process_create";
+	case PT_RECORD_PROCESS_EXIT:
+		return "process_exit";
+	case PT_RECORD_THREAD_CREATE:
+		return "thread_create";
+	case PT_RECORD_THREAD_EXIT:
+		return "thread_exit";
+	case PT_RECORD_MODULE_LOAD:
+		return "module_load";
+	case PT_RECORD_MODULE_UNLOAD:
+		return "module_unload";
+	case PT_RECORD_BREAKPOINT:
+		return "breakpoint";
+	case PT_RECORD_SINGLE_STEP:
+		return "single_step";
+	case PT_RECORD_EXCEPTION:
+		return "exception";
+	}
+
+	return "unknown";
+}
@@ -40,11 +40,99 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <libptrace/error.h>
 #include "registers.h"
 
+struct pt_register_field_
+{
+	const char	*name;
+	size_t		offset;
+	size_t		size;
+};
+
+#define PT_REGISTER_FIELD_(t, r) \
+	{ #r, offsetof(struct t, r), sizeof(((struct t *)0)->r) }
+
+static const struct pt_register_field_ pt_registers_i386_fields_[] = {
+	PT_REGISTER_FIELD_(pt_registers_i386, eax),
+	PT_REGISTER_FIELD_(pt_registers_i386, ebx),
+	PT_REGISTER_FIELD_(pt_registers_i386, ecx),
+	PT_REGISTER_FIELD_(pt_registers_i386, edx),
+	PT_REGISTER_FIELD_(pt_registers_i386, esi),
+	PT_REGISTER_FIELD_(pt_registers_i386, edi),
+	PT_REGISTER_FIELD_(pt_registers_i386, esp),
+	PT_REGISTER_FIELD_(pt_registers_i386, ebp),
+	PT_REGISTER_FIELD_(pt_registers_i386, eip),
+	PT_REGISTER_FIELD_(pt_registers_i386, eflags),
+	{ NULL }
+};
+
+static const struct pt_register_field_ pt_registers_x86_64_fields_[] = {
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rax),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rbx),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rcx),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rdx),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r8),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r9),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r10),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r11),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r12),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r13),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r14),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, r15),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rsi),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rdi),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rsp),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rbp),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rip),
+	PT_REGISTER_FIELD_(pt_registers_x86_64, rflags),
+	{ NULL }
+};
+
+/* Set the general purpose register called 'name' in 'regs' to 'value'.
+ * Returns -1 if there is no such register in this layout.
+ */
+int pt_registers_set_by_name(struct pt_registers *regs, const char *name,
+                             uint64_t value)
+{
+	const struct pt_register_field_ *f;
+	uint32_t value32;
+
+	switch (regs->type) {
+	case PT_REGISTERS_I386:
+		f = pt_registers_i386_fields_;
+		break;
+	case PT_REGISTERS_X86_64:
+		f = pt_registers_x86_64_fields_;
+		break;
+	default:
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	for (; f->name != NULL; f++) {
+		if (strcmp(f->name, name) != 0)
+			continue;
+
+		if (f->size == sizeof(value)) {
+			memcpy((char *)regs + f->offset, &value, sizeof(value));
+		} else {
+			value32 = (uint32_t)value;
+			memcpy((char *)regs + f->offset, &value32, sizeof(value32));
+		}
+
+		return 0;
+	}
+
+	pt_error_internal_set(PT_ERROR_INVALID_ARG);
+	return -1;
+}
+
 int pt_registers_i386_print(struct pt_registers_i386 *regs)
 {
 	int total = 0;
@@ -122,12 +210,72 @@ int pt_registers_i386_print(struct pt_registers_i386 *regs)
 
 int pt_registers_get_size(struct pt_registers *regs)
 {
-	assert(regs->type == PT_REGISTERS_I386);
 	switch (regs->type) {
 	case PT_REGISTERS_I386:
 		return sizeof(struct pt_registers_i386);
+	case PT_REGISTERS_I386_LINUX:
+		return sizeof(struct pt_registers_i386_linux);
+	case PT_REGISTERS_X86_64:
+		return sizeof(struct pt_registers_x86_64);
+	case PT_REGISTERS_X86_64_LINUX:
+		return sizeof(struct pt_registers_x86_64_linux);
+	}
+
+	assert(0);
+	return 0;
+}
+
+pt_address_t pt_registers_pc_get(struct pt_registers *regs)
+{
+	switch (regs->type) {
+	case PT_REGISTERS_I386:
+		return ((struct pt_registers_i386 *)regs)->eip;
+	case PT_REGISTERS_I386_LINUX:
+		return ((struct pt_registers_i386_linux *)regs)->eip;
+	case PT_REGISTERS_X86_64:
+		return ((struct pt_registers_x86_64 *)regs)->rip;
+	case PT_REGISTERS_X86_64_LINUX:
+		return ((struct pt_registers_x86_64_linux *)regs)->rip;
+	}
+
+	assert(0);
+	return 0;
+}
+
+void pt_registers_pc_set(struct pt_registers *regs, pt_address_t pc)
+{
+	switch (regs->type) {
+	case PT_REGISTERS_I386:
+		((struct pt_registers_i386 *)regs)->eip = (uint32_t)pc;
+		break;
+	case PT_REGISTERS_I386_LINUX:
+		((struct pt_registers_i386_linux *)regs)->eip = (uint32_t)pc;
+		break;
+	case PT_REGISTERS_X86_64:
+		((struct pt_registers_x86_64 *)regs)->rip = pc;
+		break;
+	case PT_REGISTERS_X86_64_LINUX:
+		((struct pt_registers_x86_64_linux *)regs)->rip = pc;
+		break;
+	default:
+		assert(0);
+	}
+}
+
+pt_address_t pt_registers_sp_get(struct pt_registers *regs)
+{
+	switch (regs->type) {
+	case PT_REGISTERS_I386:
+		return ((struct pt_registers_i386 *)regs)->esp;
+	case PT_REGISTERS_I386_LINUX:
+		return ((struct pt_registers_i386_linux *)regs)->esp;
+	case PT_REGISTERS_X86_64:
+		return ((struct pt_registers_x86_64 *)regs)->rsp;
+	case PT_REGISTERS_X86_64_LINUX:
+		return ((struct pt_registers_x86_64_linux *)regs)->rsp;
 	}
 
+	assert(0);
 	return 0;
 }
 
@@ -44,6 +44,7 @@
 #define PT_REGISTERS_INTERNAL_H
 
 #include <stdint.h>
+#include <libptrace/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -191,6 +192,11 @@ struct pt_registers_x86_64_linux
 
 int pt_registers_print(struct pt_registers *regs);
 int pt_registers_get_size(struct pt_registers *regs);
+pt_address_t pt_registers_pc_get(struct pt_registers *regs);
+void pt_registers_pc_set(struct pt_registers *regs, pt_address_t pc);
+pt_address_t pt_registers_sp_get(struct pt_registers *regs);
+int pt_registers_set_by_name(struct pt_registers *regs, const char *name,
+                             uint64_t value);
 
 #ifdef __cplusplus
 };
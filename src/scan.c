@@ -0,0 +1,574 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * scan.c
+ *
+ * libptrace memory pattern scanning.
+ *
+ * Patterns are byte strings with an optional mask, where only the bits
+ * set in the mask have to match.  We search for a single fully masked
+ * byte of the pattern, the anchor, 16 or 32 bytes at a time, and verify
+ * the full pattern only where the anchor matches.
+ *
+ * Processes are scanned by splitting their readable areas in chunks,
+ * which are read and searched in parallel.  Chunks overlap by the pattern
+ * size so that matches crossing a chunk boundary are found, and a match
+ * is only reported by the chunk it starts in.  Chunks are handled in
+ * waves, and the matches of a wave are delivered in address order before
+ * the next wave starts, which bounds the memory held by pending matches.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_MEMORY
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include <libptrace/scan.h>
+#include <libptrace/util.h>
+#include "mmap.h"
+#include "process.h"
+#include "workers.h"
+
+#if defined(__GNUC__) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define PT_SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+/* Bytes of remote memory read and searched per job. */
+#define PT_SCAN_CHUNK_SIZE	(1024 * 1024)
+/* Jobs run before their matches are delivered. */
+#define PT_SCAN_WAVE		64
+
+#define SCAN_NONE		SIZE_MAX
+
+struct scan_pattern_
+{
+	const uint8_t	*pattern;
+	const uint8_t	*mask;
+	size_t		size;
+	/* index of the byte we search for, or 'size' if there is none. */
+	size_t		anchor;
+};
+
+struct scan_chunk_
+{
+	pt_address_t	start;
+	/* bytes a match can start in, and bytes read including overlap. */
+	size_t		size;
+	size_t		read;
+	pt_address_t	*matches;
+	size_t		count;
+	size_t		capacity;
+	int		error;
+};
+
+struct scan_ctx_
+{
+	struct pt_process	*process;
+	struct scan_pattern_	pattern;
+	struct scan_chunk_	*chunks;
+	size_t			base;
+};
+
+static inline int
+scan_verify_(const struct scan_pattern_ *p, const uint8_t *s)
+{
+	size_t i;
+
+	if (p->mask == NULL)
+		return memcmp(s, p->pattern, p->size) == 0;
+
+	for (i = 0; i < p->size; i++)
+		if ((s[i] ^ p->pattern[i]) & p->mask[i])
+			return 0;
+
+	return 1;
+}
+
+/* Find the first match starting in [i, last] of 'buf'. */
+static size_t
+scan_find_scalar_(const struct scan_pattern_ *p, const uint8_t *buf,
+                  size_t i, size_t last)
+{
+	const uint8_t *h = buf + p->anchor;
+	const uint8_t *q;
+
+	while (i <= last) {
+		q = memchr(h + i, p->pattern[p->anchor], last - i + 1);
+		if (q == NULL)
+			return SCAN_NONE;
+
+		i = q - h;
+		if (scan_verify_(p, buf + i))
+			return i;
+		i++;
+	}
+
+	return SCAN_NONE;
+}
+
+#ifdef PT_SCAN_SIMD
+static size_t
+scan_find_sse2_(const struct scan_pattern_ *p, const uint8_t *buf,
+                size_t i, size_t last)
+{
+	const uint8_t *h = buf + p->anchor;
+	__m128i needle, v;
+	unsigned int bits;
+	size_t j;
+
+	needle = _mm_set1_epi8((char)p->pattern[p->anchor]);
+
+	for (; i <= last && last - i >= 15; i += 16) {
+		v    = _mm_loadu_si128((const __m128i *)(h + i));
+		bits = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+
+		while (bits != 0) {
+			j = i + __builtin_ctz(bits);
+			if (scan_verify_(p, buf + j))
+				return j;
+			bits &= bits - 1;
+		}
+	}
+
+	return scan_find_scalar_(p, buf, i, last);
+}
+
+__attribute__((target("avx2")))
+static size_t
+scan_find_avx2_(const struct scan_pattern_ *p, const uint8_t *buf,
+                size_t i, size_t last)
+{
+	const uint8_t *h = buf + p->anchor;
+	__m256i needle, v;
+	unsigned int bits;
+	size_t j;
+
+	needle = _mm256_set1_epi8((char)p->pattern[p->anchor]);
+
+	for (; i <= last && last - i >= 31; i += 32) {
+		v    = _mm256_loadu_si256((const __m256i *)(h + i));
+		bits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+
+		while (bits != 0) {
+			j = i + __builtin_ctz(bits);
+			if (scan_verify_(p, buf + j))
+				return j;
+			bits &= bits - 1;
+		}
+	}
+
+	return scan_find_sse2_(p, buf, i, last);
+}
+#endif
+
+static size_t (*scan_find_)(const struct scan_pattern_ *, const uint8_t *,
+                            size_t, size_t) = scan_find_scalar_;
+
+/* Select the search routine once.  Racing initializations store the same
+ * value, so this needs no locking.
+ */
+static void scan_init_(void)
+{
+#ifdef PT_SCAN_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		scan_find_ = scan_find_avx2_;
+	else
+		scan_find_ = scan_find_sse2_;
+#endif
+}
+
+/* Anchor on a fully masked byte, avoiding the bytes that are most common
+ * in memory if we can.
+ */
+static void
+scan_pattern_init_(struct scan_pattern_ *p, const void *pattern,
+                   const void *mask, size_t size)
+{
+	size_t i;
+
+	p->pattern = pattern;
+	p->mask    = mask;
+	p->size    = size;
+	p->anchor  = size;
+
+	for (i = 0; i < size; i++) {
+		if (p->mask != NULL && p->mask[i] != 0xff)
+			continue;
+
+		if (p->anchor == size)
+			p->anchor = i;
+
+		if (p->pattern[i] != 0x00 && p->pattern[i] != 0xff &&
+		    p->pattern[i] != 0xcc) {
+			p->anchor = i;
+			break;
+		}
+	}
+}
+
+/* Find the first match starting at or after 'start' in 'len' bytes. */
+static size_t
+scan_next_(const struct scan_pattern_ *p, const uint8_t *buf,
+           size_t len, size_t start)
+{
+	size_t last, i;
+
+	if (len < p->size || start > len - p->size)
+		return SCAN_NONE;
+
+	last = len - p->size;
+
+	if (p->anchor != p->size)
+		return scan_find_(p, buf, start, last);
+
+	for (i = start; i <= last; i++)
+		if (scan_verify_(p, buf + i))
+			return i;
+
+	return SCAN_NONE;
+}
+
+/** Find 'pattern' in a local buffer.
+ *
+ * Only the bits set in 'mask' have to match, and a NULL mask matches all
+ * bits.  Returns the offset of the first match at or after 'start', or -1
+ * if there is none.
+ */
+ssize_t pt_memscan(const void *buf, size_t len, const void *pattern,
+                   const void *mask, size_t size, size_t start)
+{
+	struct scan_pattern_ p;
+	size_t ret;
+
+	if (size == 0)
+		return -1;
+
+	scan_init_();
+	scan_pattern_init_(&p, pattern, mask, size);
+
+	ret = scan_next_(&p, buf, len, start);
+	return ret == SCAN_NONE ? -1 : (ssize_t)ret;
+}
+
+static int hex_digit_(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	return -1;
+}
+
+/** Parse a signature such as "48 8b ?? 05 4?" into a pattern and mask.
+ *
+ * Every byte is two hex digits, where either digit can be '?' to match
+ * anything.  A single '?' matches a whole byte.  Returns the pattern size,
+ * or -1 if the signature is invalid or longer than 'size' bytes.
+ */
+ssize_t pt_scan_pattern_parse(const char *s, uint8_t *pattern, uint8_t *mask,
+                              size_t size)
+{
+	size_t i, n = 0;
+	int digit;
+
+	while (*s != '\0') {
+		if (isspace((unsigned char)*s)) {
+			s++;
+			continue;
+		}
+
+		if (n == size)
+			goto err;
+
+		pattern[n] = 0;
+		mask[n]    = 0;
+
+		for (i = 0; i < 2; i++) {
+			pattern[n] <<= 4;
+			mask[n]    <<= 4;
+
+			if (*s == '?') {
+				s++;
+			} else if ( (digit = hex_digit_(*s)) != -1) {
+				pattern[n] |= digit;
+				mask[n]    |= 0xf;
+				s++;
+			} else {
+				goto err;
+			}
+
+			/* A lone '?' is a full wildcard byte. */
+			if (i == 0 && s[-1] == '?' &&
+			    (*s == '\0' || isspace((unsigned char)*s)))
+				break;
+		}
+
+		n++;
+	}
+
+	if (n == 0)
+		goto err;
+
+	return n;
+
+err:
+	pt_error_internal_set(PT_ERROR_INVALID_ARG);
+	return -1;
+}
+
+static int scan_chunk_add_(struct scan_chunk_ *chunk, pt_address_t address)
+{
+	pt_address_t *matches;
+	size_t capacity;
+
+	if (chunk->count == chunk->capacity) {
+		capacity = chunk->capacity == 0 ? 16 : chunk->capacity * 2;
+		matches  = realloc(chunk->matches, capacity * sizeof *matches);
+		if (matches == NULL) {
+			chunk->error = errno;
+			return -1;
+		}
+
+		chunk->matches  = matches;
+		chunk->capacity = capacity;
+	}
+
+	chunk->matches[chunk->count++] = address;
+	return 0;
+}
+
+/* Search the readable run [from, to) of a chunk. */
+static void
+scan_chunk_run_(struct scan_ctx_ *ctx, struct scan_chunk_ *chunk,
+                const uint8_t *buf, size_t from, size_t to)
+{
+	size_t pos = from;
+
+	while ( (pos = scan_next_(&ctx->pattern, buf, to, pos)) != SCAN_NONE &&
+	        pos < chunk->size) {
+		if (scan_chunk_add_(chunk, chunk->start + pos) == -1)
+			return;
+		pos++;
+	}
+}
+
+static void scan_job_(size_t job, void *cookie)
+{
+	struct scan_ctx_ *ctx = cookie;
+	struct scan_chunk_ *chunk = &ctx->chunks[ctx->base + job];
+	size_t offset, len, run;
+	uint8_t *buf;
+
+	if ( (buf = malloc(chunk->read)) == NULL) {
+		chunk->error = errno;
+		return;
+	}
+
+	if (pt_process_read_locked(ctx->process, buf, chunk->start,
+	                           chunk->read) == (ssize_t)chunk->read) {
+		scan_chunk_run_(ctx, chunk, buf, 0, chunk->read);
+		goto out;
+	}
+
+	/* Part of the chunk cannot be read, so we search every run of
+	 * readable pages on its own.
+	 */
+	for (offset = run = 0; offset < chunk->read; offset += len) {
+		len = PT_MMAP_PAGE_SIZE - ((chunk->start + offset) & ~PT_MMAP_PAGE_MASK);
+		if (len > chunk->read - offset)
+			len = chunk->read - offset;
+
+		if (pt_process_read_locked(ctx->process, buf + offset,
+		                           chunk->start + offset, len) ==
+		    (ssize_t)len)
+			continue;
+
+		scan_chunk_run_(ctx, chunk, buf, run, offset);
+		run = offset + len;
+	}
+
+	scan_chunk_run_(ctx, chunk, buf, run, chunk->read);
+
+out:
+	free(buf);
+}
+
+static int scan_area_wanted_(struct pt_mmap_area *area, int prot)
+{
+	int flags = PT_VMA_PROT_READ;
+
+	if (prot & PT_SCAN_PROT_WRITE)
+		flags |= PT_VMA_PROT_WRITE;
+	if (prot & PT_SCAN_PROT_EXEC)
+		flags |= PT_VMA_PROT_EXEC;
+
+	return (area->flags & flags) == flags;
+}
+
+static struct scan_chunk_ *
+scan_chunks_(struct pt_process *process, int prot, size_t size, size_t *count)
+{
+	struct scan_chunk_ *chunks, *chunk;
+	struct pt_mmap_area *area;
+	pt_address_t start;
+	size_t n = 0;
+
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (scan_area_wanted_(area, prot))
+			n += (area->end_ - area->start_ + PT_SCAN_CHUNK_SIZE - 1) /
+			     PT_SCAN_CHUNK_SIZE;
+	}
+
+	if ( (chunks = calloc(n + 1, sizeof *chunks)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	*count = 0;
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (!scan_area_wanted_(area, prot))
+			continue;
+
+		for (start = area->start_; start < area->end_;
+		     start += PT_SCAN_CHUNK_SIZE) {
+			chunk        = &chunks[(*count)++];
+			chunk->start = start;
+			chunk->size  = area->end_ - start;
+			if (chunk->size > PT_SCAN_CHUNK_SIZE)
+				chunk->size = PT_SCAN_CHUNK_SIZE;
+
+			chunk->read = chunk->size + size - 1;
+			if (chunk->read > area->end_ - start)
+				chunk->read = area->end_ - start;
+		}
+	}
+
+	return chunks;
+}
+
+/** Scan the memory of a process for 'pattern'.
+ *
+ * Only readable areas with at least the PT_SCAN_PROT_* protection in
+ * 'prot' are scanned.  'handler' is called for every match, in address
+ * order, on the calling thread.  Breakpoints set by us are not visible
+ * to the scan.  Returns the number of matches reported, or -1.
+ */
+ssize_t pt_process_scan(struct pt_process *process, const void *pattern,
+                        const void *mask, size_t size, int prot,
+                        pt_scan_handler_t handler, void *cookie)
+{
+	struct scan_chunk_ *chunk;
+	struct scan_ctx_ ctx;
+	size_t i, j, count, wave;
+	ssize_t matches = 0;
+	uint64_t start;
+	int stop = 0;
+
+	if (size == 0 || handler == NULL) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	/* Other threads can rebuild the memory map, so we lay out the
+	 * chunks under the process lock.  The scan itself only uses the
+	 * chunk array.
+	 */
+	pt_process_lock(process);
+	ctx.chunks = NULL;
+	if (pt_mmap_load(process) == 0)
+		ctx.chunks = scan_chunks_(process, prot, size, &count);
+	pt_process_unlock(process);
+
+	if (ctx.chunks == NULL)
+		return -1;
+
+	scan_init_();
+	scan_pattern_init_(&ctx.pattern, pattern, mask, size);
+	ctx.process = process;
+	start       = pt_util_time_ns();
+
+	for (ctx.base = 0; ctx.base < count; ctx.base += wave) {
+		wave = count - ctx.base;
+		if (wave > PT_SCAN_WAVE)
+			wave = PT_SCAN_WAVE;
+
+		/* The workers read on our behalf, so breakpoints do not
+		 * change while they overlay them.
+		 */
+		pt_process_lock(process);
+		pt_workers_run(wave, scan_job_, &ctx);
+		pt_process_unlock(process);
+
+		for (i = ctx.base; i < ctx.base + wave; i++) {
+			chunk = &ctx.chunks[i];
+
+			if (chunk->error != 0 && !stop) {
+				pt_error_errno_set(chunk->error);
+				matches = -1;
+				stop    = 1;
+			}
+
+			for (j = 0; j < chunk->count && !stop; j++) {
+				matches++;
+				if (handler(process, chunk->matches[j], cookie) != 0)
+					stop = 1;
+			}
+
+			free(chunk->matches);
+		}
+
+		if (stop)
+			break;
+	}
+
+	pt_log("%s(): %zu chunks, %zd matches in %llu ns\n", __FUNCTION__,
+	       count, matches, (unsigned long long)(pt_util_time_ns() - start));
+
+	free(ctx.chunks);
+	return matches;
+}
@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * snapshot.c
+ *
+ * libptrace process state snapshots.
+ *
+ * A snapshot holds the register context of every thread and a copy of
+ * all writable memory of a stopped process.  Restoring it compares the
+ * current contents of that memory against the copy, and only writes back
+ * the pages that differ.  This allows resetting a target to a known
+ * state at the cost of the pages it dirtied, rather than restarting it.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_MEMORY
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include <libptrace/snapshot.h>
+#include "breakpoint.h"
+#include "mmap.h"
+#include "process.h"
+#include "registers.h"
+#include "thread.h"
+
+struct pt_snapshot_thread
+{
+	pt_tid_t		tid;
+	struct pt_registers	*regs;
+};
+
+struct pt_snapshot_range
+{
+	pt_address_t		start;
+	size_t			pages;
+	/* page contents, and whether each page could be read. */
+	uint8_t			*data;
+	uint8_t			*present;
+};
+
+struct pt_snapshot
+{
+	size_t				thread_count;
+	struct pt_snapshot_thread	*threads;
+	size_t				range_count;
+	struct pt_snapshot_range	*ranges;
+	size_t				pages;
+};
+
+void pt_snapshot_delete(struct pt_snapshot *snapshot)
+{
+	size_t i;
+
+	if (snapshot == NULL)
+		return;
+
+	for (i = 0; i < snapshot->thread_count; i++)
+		free(snapshot->threads[i].regs);
+
+	for (i = 0; i < snapshot->range_count; i++) {
+		free(snapshot->ranges[i].data);
+		free(snapshot->ranges[i].present);
+	}
+
+	free(snapshot->threads);
+	free(snapshot->ranges);
+	free(snapshot);
+}
+
+size_t pt_snapshot_pages_get(struct pt_snapshot *snapshot)
+{
+	return snapshot->pages;
+}
+
+/* Read 'pages' pages at 'start' into 'buf'.  A single read is tried
+ * first, and if part of the range cannot be read we go page by page and
+ * mark the unreadable pages in 'present'.
+ *
+ * The breakpoints we have set are hidden, so that the copy holds what
+ * the process itself would see.  The caller holds the process lock.
+ */
+static void
+snapshot_range_read_(struct pt_process *process, pt_address_t start,
+                     size_t pages, uint8_t *buf, uint8_t *present)
+{
+	size_t size = pages * PT_MMAP_PAGE_SIZE;
+	size_t i;
+
+	if (pt_process_read_locked(process, buf, start, size) == (ssize_t)size) {
+		memset(present, 1, pages);
+		return;
+	}
+
+	for (i = 0; i < pages; i++) {
+		present[i] = pt_process_read_locked(process,
+		                                    buf + i * PT_MMAP_PAGE_SIZE,
+		                                    start + i * PT_MMAP_PAGE_SIZE,
+		                                    PT_MMAP_PAGE_SIZE) == PT_MMAP_PAGE_SIZE;
+	}
+}
+
+/* Copy the pages covering [start, end) into 'range'. */
+static int
+snapshot_range_init_(struct pt_snapshot_range *range,
+                     struct pt_process *process,
+                     pt_address_t start, pt_address_t end)
+{
+	range->start = start & PT_MMAP_PAGE_MASK;
+	range->pages = (end - range->start + PT_MMAP_PAGE_SIZE - 1) /
+	               PT_MMAP_PAGE_SIZE;
+
+	range->data    = malloc(range->pages * PT_MMAP_PAGE_SIZE);
+	range->present = malloc(range->pages);
+	if (range->data == NULL || range->present == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	snapshot_range_read_(process, range->start, range->pages,
+	                     range->data, range->present);
+
+	return 0;
+}
+
+static int
+snapshot_threads_(struct pt_snapshot *snapshot, struct pt_process *process)
+{
+	struct pt_snapshot_thread *st;
+	struct pt_thread *thread;
+	size_t count = 0;
+
+	pt_process_for_each_thread (process, thread)
+		count++;
+
+	if ( (snapshot->threads = calloc(count, sizeof *st)) == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	pt_process_for_each_thread (process, thread) {
+		st = &snapshot->threads[snapshot->thread_count];
+
+		if ( (st->regs = pt_thread_registers_get(thread)) == NULL)
+			return -1;
+
+		st->tid = thread->tid;
+		snapshot->thread_count++;
+	}
+
+	return 0;
+}
+
+static int
+snapshot_memory_locked_(struct pt_snapshot *snapshot, struct pt_process *process)
+{
+	struct pt_snapshot_range *range;
+	struct pt_mmap_area *area;
+	size_t count = 0;
+
+	if (pt_mmap_load(process) == -1)
+		return -1;
+
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (area->flags & PT_VMA_PROT_WRITE)
+			count++;
+	}
+
+	if ( (snapshot->ranges = calloc(count, sizeof *range)) == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (!(area->flags & PT_VMA_PROT_WRITE))
+			continue;
+
+		range = &snapshot->ranges[snapshot->range_count++];
+		if (snapshot_range_init_(range, process, area->start_,
+		                         area->end_) == -1)
+			return -1;
+
+		snapshot->pages += range->pages;
+	}
+
+	return 0;
+}
+
+/* The memory map is walked under the process lock, as other threads can
+ * rebuild it.
+ */
+static int
+snapshot_memory_(struct pt_snapshot *snapshot, struct pt_process *process)
+{
+	int ret;
+
+	pt_process_lock(process);
+	ret = snapshot_memory_locked_(snapshot, process);
+	pt_process_unlock(process);
+
+	return ret;
+}
+
+/** Take a snapshot of the registers and writable memory of a process.
+ *
+ * The process needs to be stopped for the snapshot to be consistent.
+ */
+struct pt_snapshot *pt_process_snapshot(struct pt_process *process)
+{
+	struct pt_snapshot *snapshot;
+
+	if ( (snapshot = calloc(1, sizeof *snapshot)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	if (snapshot_threads_(snapshot, process) == -1)
+		goto err;
+
+	if (snapshot_memory_(snapshot, process) == -1)
+		goto err;
+
+	pt_log("%s(): %zu threads, %zu ranges, %zu pages\n", __FUNCTION__,
+	       snapshot->thread_count, snapshot->range_count, snapshot->pages);
+
+	return snapshot;
+
+err:
+	pt_snapshot_delete(snapshot);
+	return NULL;
+}
+
+/** Take a snapshot of the 'size' bytes of memory at 'start'.
+ *
+ * The snapshot covers the pages holding the range, and no registers.
+ * Restoring it only touches those pages.
+ */
+struct pt_snapshot *
+pt_process_snapshot_range(struct pt_process *process,
+                          pt_address_t start, size_t size)
+{
+	struct pt_snapshot *snapshot;
+	int ret;
+
+	if ( (snapshot = calloc(1, sizeof *snapshot)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	if ( (snapshot->ranges = calloc(1, sizeof *snapshot->ranges)) == NULL) {
+		pt_error_errno_set(errno);
+		goto err;
+	}
+
+	snapshot->range_count = 1;
+
+	pt_process_lock(process);
+	ret = snapshot_range_init_(snapshot->ranges, process, start, start + size);
+	pt_process_unlock(process);
+
+	if (ret == -1)
+		goto err;
+
+	snapshot->pages = snapshot->ranges->pages;
+	return snapshot;
+
+err:
+	pt_snapshot_delete(snapshot);
+	return NULL;
+}
+
+/** Report the runs of pages that differ between a saved copy of 'pages'
+ * pages at 'start' and their current contents.
+ *
+ * Pages that could not be read either time are never reported, and end
+ * the run they are in.  Returns the number of pages reported.
+ */
+size_t pt_snapshot_pages_diff(pt_address_t start, const uint8_t *saved,
+                              const uint8_t *saved_present,
+                              const uint8_t *current,
+                              const uint8_t *current_present, size_t pages,
+                              pt_page_diff_handler_t handler, void *cookie)
+{
+	size_t i, run, offset;
+	size_t changed = 0;
+
+	for (i = 0; i < pages; i += run) {
+		for (run = 0; i + run < pages; run++) {
+			offset = (i + run) * PT_MMAP_PAGE_SIZE;
+
+			if (!saved_present[i + run] || !current_present[i + run])
+				break;
+
+			if (memcmp(saved + offset, current + offset,
+			           PT_MMAP_PAGE_SIZE) == 0)
+				break;
+		}
+
+		if (run == 0) {
+			run = 1;
+			continue;
+		}
+
+		changed += run;
+		if (handler(start + i * PT_MMAP_PAGE_SIZE, run, cookie) != 0)
+			break;
+	}
+
+	return changed;
+}
+
+struct restore_ctx_
+{
+	struct pt_process			*process;
+	const struct pt_snapshot_range		*range;
+	int					error;
+};
+
+/* Write back a run of changed pages without disturbing the breakpoints
+ * we have set.  The snapshot holds memory with breakpoints hidden, so its
+ * byte at a breakpoint becomes the new original byte.  Armed breakpoints
+ * keep their opcode in memory, and suppressed ones, such as one a thread
+ * is stepping over, get the restored byte.
+ *
+ * The caller holds the process lock.
+ */
+static int restore_run_(pt_address_t start, size_t pages, void *cookie)
+{
+	struct restore_ctx_ *ctx = cookie;
+	const struct pt_snapshot_range *range = ctx->range;
+	pt_address_t end = start + pages * PT_MMAP_PAGE_SIZE;
+	struct pt_breakpoint_internal *bpi;
+	pt_address_t from = start;
+	struct avl_node *an;
+	uint8_t byte;
+
+	an = pt_process_breakpoint_lower_bound(ctx->process, start);
+	for (; an != NULL; an = avl_tree_next(an)) {
+		bpi = container_of(an, struct pt_breakpoint_internal, avl_node);
+
+		if (bpi->address >= end)
+			break;
+
+		if (!bpi->patched)
+			continue;
+
+		if (pt_process_read_raw(ctx->process, &byte, bpi->address, 1) != 1)
+			goto err;
+
+		bpi->original = range->data[bpi->address - range->start];
+		if (byte != 0xCC)
+			continue;
+
+		/* Write up to the breakpoint, and leave its opcode alone. */
+		if (bpi->address > from &&
+		    pt_process_write(ctx->process, from,
+		                     range->data + (from - range->start),
+		                     bpi->address - from) == -1)
+			goto err;
+
+		from = bpi->address + 1;
+	}
+
+	if (end > from &&
+	    pt_process_write(ctx->process, from,
+	                     range->data + (from - range->start),
+	                     end - from) == -1)
+		goto err;
+
+	return 0;
+
+err:
+	ctx->error = 1;
+	return 1;
+}
+
+/* Write back the runs of pages in 'range' that differ from 'current'. */
+static ssize_t
+restore_range_(struct pt_process *process, struct pt_snapshot_range *range,
+               uint8_t *current, uint8_t *present)
+{
+	struct restore_ctx_ ctx;
+	size_t written;
+
+	snapshot_range_read_(process, range->start, range->pages,
+	                     current, present);
+
+	ctx.process = process;
+	ctx.range   = range;
+	ctx.error   = 0;
+
+	written = pt_snapshot_pages_diff(range->start, range->data,
+	                                 range->present, current, present,
+	                                 range->pages, restore_run_, &ctx);
+
+	return ctx.error ? -1 : (ssize_t)written;
+}
+
+/** Restore the memory of a process to the state in 'snapshot'.
+ *
+ * Only pages that changed since the snapshot are written.  Returns the
+ * number of pages written, or -1.
+ */
+ssize_t pt_process_restore_memory(struct pt_process *process,
+                                  struct pt_snapshot *snapshot)
+{
+	uint8_t *current = NULL, *present = NULL;
+	size_t i, max_pages = 0;
+	ssize_t ret, written = 0;
+
+	for (i = 0; i < snapshot->range_count; i++)
+		if (snapshot->ranges[i].pages > max_pages)
+			max_pages = snapshot->ranges[i].pages;
+
+	current = malloc(max_pages * PT_MMAP_PAGE_SIZE);
+	present = malloc(max_pages);
+	if (max_pages != 0 && (current == NULL || present == NULL)) {
+		pt_error_errno_set(errno);
+		written = -1;
+		goto out;
+	}
+
+	/* Breakpoints can be set and removed from other threads while we
+	 * compare and write back memory around them.
+	 */
+	pt_process_lock(process);
+	for (i = 0; i < snapshot->range_count; i++) {
+		ret = restore_range_(process, &snapshot->ranges[i], current, present);
+		if (ret == -1) {
+			written = -1;
+			break;
+		}
+
+		written += ret;
+	}
+	pt_process_unlock(process);
+
+	if (written == -1)
+		goto out;
+
+	pt_log("%s(): restored %zd pages\n", __FUNCTION__, written);
+
+out:
+	free(current);
+	free(present);
+	return written;
+}
+
+/** Restore a process to the state recorded in 'snapshot'.
+ *
+ * Threads that no longer exist are skipped, and threads created since
+ * the snapshot are left untouched.  Returns the number of pages written,
+ * or -1.
+ */
+ssize_t pt_process_restore(struct pt_process *process, struct pt_snapshot *snapshot)
+{
+	struct pt_thread *thread;
+	ssize_t written;
+	size_t i;
+
+	if ( (written = pt_process_restore_memory(process, snapshot)) == -1)
+		return -1;
+
+	for (i = 0; i < snapshot->thread_count; i++) {
+		thread = pt_process_thread_find(process, snapshot->threads[i].tid);
+		if (thread == NULL)
+			continue;
+
+		if (pt_thread_registers_set(thread, snapshot->threads[i].regs) == -1)
+			return -1;
+	}
+
+	return written;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * stats.c
+ *
+ * libptrace event loop latency statistics.
+ *
+ * Every debug event is timed in a number of phases, and each phase is
+ * accumulated in a log-linear histogram for the event type, both for the
+ * core as a whole and for the process that raised the event.  Histograms
+ * are allocated when the first sample comes in, so the cost without
+ * PT_CORE_OPTION_STATS is a single option test per event.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/iterator.h>
+#include <libptrace/log.h>
+#include <libptrace/stats.h>
+#include "core.h"
+#include "process.h"
+#include "stats.h"
+
+static const char *phase_names_[PT_STATS_PHASES] = {
+	[PT_STATS_WAIT]     = "wait",
+	[PT_STATS_DISPATCH] = "dispatch",
+	[PT_STATS_HANDLER]  = "handler",
+	[PT_STATS_CONTINUE] = "continue"
+};
+
+int pt_histogram_bucket(uint64_t value)
+{
+	int exp;
+
+	if (value < PT_HISTOGRAM_SUB)
+		return (int)value;
+
+	exp = 63 - __builtin_clzll(value);
+	if (exp > PT_HISTOGRAM_EXP_MAX)
+		return PT_HISTOGRAM_BUCKETS - 1;
+
+	/* The top PT_HISTOGRAM_SUB_BITS below the leading bit select the
+	 * linear bucket within this power of two.
+	 */
+	return (exp - PT_HISTOGRAM_SUB_BITS + 1) * PT_HISTOGRAM_SUB +
+	       (int)((value >> (exp - PT_HISTOGRAM_SUB_BITS)) &
+	             (PT_HISTOGRAM_SUB - 1));
+}
+
+uint64_t pt_histogram_bucket_lower(int bucket)
+{
+	int exp;
+
+	if (bucket < PT_HISTOGRAM_SUB)
+		return (uint64_t)bucket;
+
+	if (bucket >= PT_HISTOGRAM_BUCKETS - 1)
+		return (uint64_t)1 << (PT_HISTOGRAM_EXP_MAX + 1);
+
+	exp = bucket / PT_HISTOGRAM_SUB + PT_HISTOGRAM_SUB_BITS - 1;
+
+	return ((uint64_t)1 << exp) +
+	       ((uint64_t)(bucket % PT_HISTOGRAM_SUB) <<
+	        (exp - PT_HISTOGRAM_SUB_BITS));
+}
+
+void pt_histogram_record(struct pt_histogram *h, uint64_t value)
+{
+	if (h->count == 0 || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+
+	h->count++;
+	h->sum += value;
+	h->buckets[pt_histogram_bucket(value)]++;
+}
+
+/* Returns the lower bound of the bucket holding the 'p' percentile,
+ * clamped to the observed range, or 0 for an empty histogram.
+ */
+uint64_t pt_histogram_percentile(const struct pt_histogram *h, double p)
+{
+	uint64_t rank, seen = 0;
+	uint64_t value;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+
+	if (p <= 0.0)
+		return h->min;
+	if (p >= 100.0)
+		return h->max;
+
+	rank = (uint64_t)(p / 100.0 * (double)h->count);
+	if (rank >= h->count)
+		rank = h->count - 1;
+
+	for (i = 0; i < PT_HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			break;
+	}
+
+	value = pt_histogram_bucket_lower(i);
+	if (value < h->min)
+		return h->min;
+	if (value > h->max)
+		return h->max;
+
+	return value;
+}
+
+const char *pt_stats_phase_to_string(int phase)
+{
+	if (phase < 0 || phase >= PT_STATS_PHASES)
+		return "unknown";
+
+	return phase_names_[phase];
+}
+
+void pt_stats_record(struct pt_core *core, struct pt_process *process,
+                     int phase, int type, uint64_t ns)
+{
+	if (phase < 0 || phase >= PT_STATS_PHASES)
+		return;
+
+	if (type < 0 || type >= PT_STATS_EVENT_TYPES)
+		type = 0;
+
+	/* An allocation failure just loses the sample. */
+	if (core->stats == NULL)
+		core->stats = calloc(1, sizeof *core->stats);
+	if (core->stats != NULL)
+		pt_histogram_record(&core->stats->histograms[phase][type], ns);
+
+	if (process == NULL)
+		return;
+
+	if (process->stats == NULL)
+		process->stats = calloc(1, sizeof *process->stats);
+	if (process->stats != NULL)
+		pt_histogram_record(&process->stats->histograms[phase][type], ns);
+}
+
+void pt_stats_process_destroy(struct pt_process *process)
+{
+	free(process->stats);
+	process->stats = NULL;
+}
+
+int pt_core_stats_get(struct pt_core *core, struct pt_stats *stats)
+{
+	if (core == NULL || stats == NULL) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	if (core->stats == NULL)
+		memset(stats, 0, sizeof *stats);
+	else
+		memcpy(stats, core->stats, sizeof *stats);
+
+	return 0;
+}
+
+void pt_core_stats_reset(struct pt_core *core)
+{
+	struct pt_process *process;
+
+	free(core->stats);
+	core->stats = NULL;
+
+	pt_core_for_each_process (core, process)
+		pt_stats_process_destroy(process);
+}
+
+int pt_process_stats_get(struct pt_process *process, struct pt_stats *stats)
+{
+	if (process == NULL || stats == NULL) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	if (process->stats == NULL)
+		memset(stats, 0, sizeof *stats);
+	else
+		memcpy(stats, process->stats, sizeof *stats);
+
+	return 0;
+}
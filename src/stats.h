@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * stats.h
+ *
+ * libptrace event loop latency statistics.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_STATS_INTERNAL_H
+#define PT_STATS_INTERNAL_H
+
+#include <stdint.h>
+#include <libptrace/core.h>
+#include <libptrace/stats.h>
+#include <libptrace/util.h>
+#include "core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pt_process;
+
+/* Returns a timestamp when statistics are collected, and 0 otherwise. */
+static inline uint64_t pt_stats_clock(struct pt_core *core)
+{
+	if (core == NULL || !(core->options & PT_CORE_OPTION_STATS))
+		return 0;
+
+	return pt_util_time_ns();
+}
+
+/* Runs 'call' and accounts its time to the handlers of the current event. */
+#define PT_STATS_HANDLER_CALL(core, call) do {				\
+	struct pt_core *stats_core_ = (core);				\
+	uint64_t stats_start_ = pt_stats_clock(stats_core_);		\
+	call;								\
+	if (stats_start_ != 0)						\
+		stats_core_->stats_handler_ns +=			\
+			pt_util_time_ns() - stats_start_;		\
+} while (0)
+
+void pt_stats_record(struct pt_core *, struct pt_process *, int, int, uint64_t);
+void pt_stats_process_destroy(struct pt_process *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_STATS_INTERNAL_H */
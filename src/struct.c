@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * struct.c
+ *
+ * libptrace remote structure layouts.
+ *
+ * A layout is described by a format of scanf-style conversions, one per
+ * field, in the order of the structure members:
+ *
+ *   %i, %d, %u	32-bit signed or unsigned integer
+ *   %hhi, %hhu	8-bit integer, with 'h' for 16-bit and 'll' for 64-bit;
+ *		'l' is 32-bit, as in the Windows ABI
+ *   %p		pointer, 4 or 8 bytes depending on the thread
+ *   %Nc		N raw bytes
+ *
+ * A count before any other conversion makes it an array, so that %4u
+ * reads 4 unsigned integers.  A '*' after the '%' makes the field
+ * padding, which is skipped without storing anything.  Fields are
+ * aligned naturally as a C compiler would, unless the format starts
+ * with '=', in which case the layout is packed.
+ *
+ * The layout is computed for both 4 and 8 byte pointers at once, so
+ * parsing a format once serves both 32-bit and 64-bit threads.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/struct.h>
+
+static inline size_t struct_align_(size_t offset, size_t align)
+{
+	return (offset + align - 1) & ~(align - 1);
+}
+
+/* Parse one conversion after the '%', and return the position after
+ * it, or NULL if it is invalid.
+ */
+static const char *
+struct_field_parse_(const char *p, struct pt_struct_field *field)
+{
+	unsigned long count = 1;
+	char *end;
+	int size = 4;
+
+	memset(field, 0, sizeof *field);
+
+	if (*p == '*') {
+		field->skip = 1;
+		p++;
+	}
+
+	if (isdigit((unsigned char)*p)) {
+		count = strtoul(p, &end, 10);
+		if (count == 0 || count > UINT32_MAX / 8)
+			return NULL;
+		p = end;
+	}
+
+	if (p[0] == 'h' && p[1] == 'h') {
+		size = 1;
+		p += 2;
+	} else if (p[0] == 'h') {
+		size = 2;
+		p++;
+	} else if (p[0] == 'l' && p[1] == 'l') {
+		size = 8;
+		p += 2;
+	} else if (p[0] == 'l') {
+		p++;
+	} else if (*p == 'p' || *p == 'c') {
+		size = 0;
+	}
+
+	/* Length modifiers only apply to integers. */
+	if ((*p == 'p' || *p == 'c') && size != 0)
+		return NULL;
+
+	switch (*p) {
+	case 'd':
+	case 'i':
+		field->type = PT_STRUCT_FIELD_INT;
+		break;
+	case 'u':
+		field->type = PT_STRUCT_FIELD_UINT;
+		break;
+	case 'p':
+		field->type = PT_STRUCT_FIELD_POINTER;
+		size        = 0;
+		break;
+	case 'c':
+		field->type = PT_STRUCT_FIELD_BYTES;
+		size        = 1;
+		break;
+	default:
+		return NULL;
+	}
+
+	field->size  = size;
+	field->count = count;
+	return p + 1;
+}
+
+/** Parse a structure format into a layout.
+ *
+ * Layouts are plain data and can be parsed once and kept around, so
+ * that reads on hot paths need not parse the format every time.
+ */
+int pt_struct_layout_init(struct pt_struct_layout *layout, const char *fmt)
+{
+	struct pt_struct_field *field;
+	size_t w, size, align, max_align[2] = { 1, 1 };
+	int packed = 0;
+
+	memset(layout, 0, sizeof *layout);
+
+	if (*fmt == '=') {
+		packed = 1;
+		fmt++;
+	}
+
+	while (*fmt != '\0') {
+		if (isspace((unsigned char)*fmt)) {
+			fmt++;
+			continue;
+		}
+
+		if (*fmt != '%' || layout->field_count == PT_STRUCT_FIELDS_MAX)
+			goto err;
+
+		field = &layout->fields[layout->field_count];
+		if ( (fmt = struct_field_parse_(fmt + 1, field)) == NULL)
+			goto err;
+
+		for (w = 0; w < 2; w++) {
+			size  = pt_struct_field_size(field, w ? 8 : 4);
+			align = packed ? 1 : size;
+
+			field->offset[w] = struct_align_(layout->extent[w], align);
+			layout->extent[w] = field->offset[w] + size * field->count;
+			if (align > max_align[w])
+				max_align[w] = align;
+		}
+
+		layout->field_count++;
+	}
+
+	for (w = 0; w < 2; w++)
+		layout->size[w] = struct_align_(layout->extent[w], max_align[w]);
+
+	return 0;
+
+err:
+	pt_error_internal_set(PT_ERROR_INVALID_ARG);
+	return -1;
+}
+
+/** Get element 'index' of a field from a buffer holding the structure.
+ *
+ * Signed fields are sign extended.  This is not meaningful for raw byte
+ * fields other than to fetch a single byte.
+ */
+uint64_t pt_struct_element_get(const struct pt_struct_layout *layout,
+                               int pointer_size, const void *buf,
+                               size_t field, size_t index)
+{
+	const struct pt_struct_field *f = &layout->fields[field];
+	size_t size = pt_struct_field_size(f, pointer_size);
+	const uint8_t *p;
+	uint8_t u8; uint16_t u16; uint32_t u32; uint64_t u64 = 0;
+
+	p = (const uint8_t *)buf + f->offset[PT_STRUCT_WIDTH(pointer_size)] +
+	    index * size;
+
+	switch (size) {
+	case 1:
+		memcpy(&u8, p, sizeof u8);
+		u64 = f->type == PT_STRUCT_FIELD_INT ? (uint64_t)(int8_t)u8 : u8;
+		break;
+	case 2:
+		memcpy(&u16, p, sizeof u16);
+		u64 = f->type == PT_STRUCT_FIELD_INT ? (uint64_t)(int16_t)u16 : u16;
+		break;
+	case 4:
+		memcpy(&u32, p, sizeof u32);
+		u64 = f->type == PT_STRUCT_FIELD_INT ? (uint64_t)(int32_t)u32 : u32;
+		break;
+	case 8:
+		memcpy(&u64, p, sizeof u64);
+		break;
+	}
+
+	return u64;
+}
+
+static void
+struct_store_(const struct pt_struct_field *field, void *arg, size_t index,
+              uint64_t value)
+{
+	if (field->type == PT_STRUCT_FIELD_POINTER) {
+		((void **)arg)[index] = (void *)(uintptr_t)value;
+		return;
+	}
+
+	switch (field->size) {
+	case 1:
+		((uint8_t *)arg)[index] = value;
+		break;
+	case 2:
+		((uint16_t *)arg)[index] = value;
+		break;
+	case 4:
+		((uint32_t *)arg)[index] = value;
+		break;
+	case 8:
+		((uint64_t *)arg)[index] = value;
+		break;
+	}
+}
+
+/** Decode a structure read from a thread of 'pointer_size' into the
+ * arguments.
+ *
+ * Every field that is not padding takes a pointer argument of the type
+ * of its conversion, pointing to 'count' elements for arrays.  Pointers
+ * are stored in a 'void *'.  Returns the number of fields stored.
+ */
+int pt_struct_vdecode(const struct pt_struct_layout *layout, int pointer_size,
+                      const void *buf, va_list ap)
+{
+	const struct pt_struct_field *field;
+	size_t i, j;
+	int items = 0;
+	void *arg;
+
+	for (i = 0; i < layout->field_count; i++) {
+		field = &layout->fields[i];
+		if (field->skip)
+			continue;
+
+		arg = va_arg(ap, void *);
+
+		if (field->type == PT_STRUCT_FIELD_BYTES) {
+			memcpy(arg, (const uint8_t *)buf +
+			       field->offset[PT_STRUCT_WIDTH(pointer_size)],
+			       field->count);
+		} else {
+			for (j = 0; j < field->count; j++)
+				struct_store_(field, arg, j,
+				              pt_struct_element_get(layout, pointer_size,
+				                                    buf, i, j));
+		}
+
+		items++;
+	}
+
+	return items;
+}
+
+int pt_struct_decode(const struct pt_struct_layout *layout, int pointer_size,
+                     const void *buf, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, buf);
+	ret = pt_struct_vdecode(layout, pointer_size, buf, ap);
+	va_end(ap);
+
+	return ret;
+}
@@ -42,13 +42,20 @@
  * Author: Ronald Huizer <rhuizer@hexpedition.com>, <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_THREAD
+
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <libptrace/log.h>
 #include <libptrace/breakpoint_x86.h>
 #include <libptrace/error.h>
+#include <libptrace/struct.h>
 #include "breakpoint.h"
+#include "displaced.h"
+#include "fuzz.h"
 #include "registers.h"
 #include "thread.h"
 #include "process.h"
@@ -76,14 +83,19 @@ void pt_thread_init(struct pt_thread *thread)
 	thread->state              = 0;
 	thread->tls_data           = NULL;
 	thread->exit_code          = 0;
-	thread->registers          = NULL;
+	thread->regs_cache         = NULL;
+	thread->regs_cache_next    = NULL;
+	thread->regs_dirty         = 0;
 	thread->breakpoint_restore = NULL;
+	list_init(&thread->restore_list);
 	thread->db_restore         = NULL;
+	thread->displaced_slot     = -1;
 	thread->super_	           = NULL;
 	thread->t_op               = NULL;
 
 	INIT_AVL_NODE(&thread->avl_node);
 	INIT_AVL_TREE(&thread->breakpoints, breakpoint_avl_compare_);
+	pt_function_stack_init(&thread->function_stack);
 	x86_debug_registers_init(&thread->debug_registers);
 }
 
@@ -92,6 +104,11 @@ int pt_thread_destroy(struct pt_thread *thread)
 	if (thread->t_op->destroy && thread->t_op->destroy(thread) == -1)
 		return -1;
 
+	pt_thread_registers_invalidate(thread);
+	list_del_init(&thread->restore_list);
+	pt_displaced_slot_release(thread);
+	pt_function_trace_thread_destroy(thread);
+	pt_fuzz_thread_destroy(thread);
 	avl_tree_delete(&thread->process->threads, &thread->avl_node);
 	return 0;
 }
@@ -110,60 +127,74 @@ int pt_thread_delete(struct pt_thread *thread)
  * processes: it is perfectly possible to have threads in 32-bit and 64-bit
  * mode coexisting within a single process.  All of these threads will have
  * different default pointer sizes and architecture data.
+ *
+ * The whole structure is fetched with a single read and decoded locally.
  */
-int
-pt_thread_sscanf(struct pt_thread *thread, const pt_address_t src, const char *fmt, ...)
+static int
+thread_struct_vread_(struct pt_thread *thread, const pt_address_t src,
+                     const struct pt_struct_layout *layout, va_list ap)
 {
-	struct pt_process *process = thread->process;
-	int items = 0;
-	const char *p;
-	va_list ap;
+	int pointer_size = thread->arch_data->pointer_size;
+	size_t size = layout->extent[PT_STRUCT_WIDTH(pointer_size)];
+	uint8_t stack_buf[256], *buf = stack_buf;
+	int items = -1;
 
-	va_start(ap, fmt);
+	if (size > sizeof stack_buf && (buf = malloc(size)) == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
 
-	for (p = fmt; *p != '\0'; p++) {
-		/* XXX: support literals that have to match later. */
-		if (*p != '%')
-			continue;
+	if (pt_process_read(thread->process, buf, src, size) == -1)
+		goto out;
 
-		/* Ensure we do not overindex. */
-		if (*++p == '\0')
-			break;
+	items = pt_struct_vdecode(layout, pointer_size, buf, ap);
 
-		switch (*p) {
-		case 'i': {
-			int *arg = va_arg(ap, int *);
-			if (pt_process_read(process, arg, src, sizeof *arg) == -1)
-				return EOF;
-			items++;
-			break;
-		}
-		case 'u': {
-			unsigned int *arg = va_arg(ap, unsigned int *);
-			if (pt_process_read(process, arg, src, sizeof *arg) == -1)
-				return EOF;
-			items++;
-			break;
-		}
-		case 'p': {
-			void **arg = va_arg(ap, void **);
+out:
+	if (buf != stack_buf)
+		free(buf);
+	return items;
+}
 
-			*arg = NULL;
-			if (pt_process_read(process, arg, src, thread->arch_data->pointer_size) == -1)
-				return EOF;
-			items++;
-			break;
-		}
-		default:
-			break;
-		}
-	}
+/** Read a structure described by a layout from thread memory.
+ *
+ * This avoids parsing a format on every read.  Returns the number of
+ * fields stored, or -1.
+ */
+int
+pt_thread_read_struct(struct pt_thread *thread, const pt_address_t src,
+                      const struct pt_struct_layout *layout, ...)
+{
+	va_list ap;
+	int ret;
 
+	va_start(ap, layout);
+	ret = thread_struct_vread_(thread, src, layout, ap);
 	va_end(ap);
 
-	return items;
+	return ret;
 }
 
+/** Read a structure described by a format from thread memory.
+ *
+ * See struct.c for the format.  Returns the number of fields stored, or
+ * -1 (EOF).
+ */
+int
+pt_thread_sscanf(struct pt_thread *thread, const pt_address_t src, const char *fmt, ...)
+{
+	struct pt_struct_layout layout;
+	va_list ap;
+	int ret;
+
+	if (pt_struct_layout_init(&layout, fmt) == -1)
+		return EOF;
+
+	va_start(ap, fmt);
+	ret = thread_struct_vread_(thread, src, &layout, ap);
+	va_end(ap);
+
+	return ret;
+}
 
 int pt_thread_suspend(struct pt_thread *thread)
 {
@@ -182,6 +213,9 @@ int pt_thread_resume(struct pt_thread *thread)
 		return -1;
 	}
 
+	if (pt_thread_registers_flush(thread) == -1)
+		return -1;
+
 	return thread->t_op->resume(thread);
 }
 
@@ -258,24 +292,154 @@ int pt_thread_single_step_internal_remove(struct pt_thread *thread)
 	return 0;
 }
 
-struct pt_registers *pt_thread_registers_get(struct pt_thread *thread)
+/* Set the persistent breakpoint 'thread' needs to restore after single
+ * stepping, or clear it if 'bpi' is NULL.  Threads with a breakpoint to
+ * restore are kept on a process list, so that a stop does not need to
+ * visit every thread of the process to find them.
+ */
+void pt_thread_breakpoint_restore_set(struct pt_thread *thread,
+                                      struct pt_breakpoint_internal *bpi)
 {
-	if (thread->t_op->registers_get == NULL) {
+	thread->breakpoint_restore = bpi;
+
+	if (bpi == NULL)
+		list_del_init(&thread->restore_list);
+	else if (list_empty(&thread->restore_list))
+		list_add_tail(&thread->restore_list,
+		              &thread->process->threads_restore);
+}
+
+/************************************************************************
+ * Register context cache.
+ *
+ * While the process is stopped for an event, the full register context
+ * of a thread is fetched at most once and kept in thread->regs_cache.
+ * Setters update the cached copy and mark it dirty, and dirty contexts
+ * are written back in one call right before the thread is resumed.
+ ***********************************************************************/
+
+/* Get the cached context of 'thread', fetching it if needed.  Returns 1
+ * and stores the context in 'regs' on success, 0 if the context cannot
+ * be cached, and -1 on error.
+ */
+int pt_thread_registers_cached(struct pt_thread *thread,
+                               struct pt_registers **regs)
+{
+	struct pt_process *process = thread->process;
+
+	if (thread->regs_cache != NULL) {
+		*regs = thread->regs_cache;
+		return 1;
+	}
+
+	/* Without full context access the backend is used directly. */
+	if (!(process->flags & PT_PROCESS_FLAG_STOPPED) ||
+	    thread->t_op->registers_get == NULL ||
+	    thread->t_op->registers_set == NULL)
+		return 0;
+
+	if ( (*regs = thread->t_op->registers_get(thread)) == NULL)
+		return -1;
+
+	thread->regs_cache      = *regs;
+	thread->regs_dirty      = 0;
+	thread->regs_cache_next = process->regs_cached;
+	process->regs_cached    = thread;
+
+	return 1;
+}
+
+/* Write back a dirty cached context.  The cache stays valid. */
+int pt_thread_registers_flush(struct pt_thread *thread)
+{
+	if (thread->regs_cache == NULL || thread->regs_dirty == 0)
+		return 0;
+
+	if (thread->t_op->registers_set == NULL) {
 		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return -1;
+	}
+
+	if (thread->t_op->registers_set(thread, thread->regs_cache) == -1)
+		return -1;
+
+	thread->regs_dirty = 0;
+	return 0;
+}
+
+/* Drop the cached context without writing it back. */
+void pt_thread_registers_invalidate(struct pt_thread *thread)
+{
+	struct pt_thread **p;
+
+	if (thread->regs_cache == NULL)
+		return;
+
+	for (p = &thread->process->regs_cached; *p != NULL; p = &(*p)->regs_cache_next) {
+		if (*p == thread) {
+			*p = thread->regs_cache_next;
+			break;
+		}
+	}
+
+	free(thread->regs_cache);
+	thread->regs_cache      = NULL;
+	thread->regs_cache_next = NULL;
+	thread->regs_dirty      = 0;
+}
+
+struct pt_registers *pt_thread_registers_get(struct pt_thread *thread)
+{
+	struct pt_registers *regs, *copy;
+	size_t size;
+
+	switch (pt_thread_registers_cached(thread, &regs)) {
+	case -1:
+		return NULL;
+	case 0:
+		if (thread->t_op->registers_get == NULL) {
+			pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+			return NULL;
+		}
+
+		return thread->t_op->registers_get(thread);
+	}
+
+	/* Callers own the result, so hand out a copy of the cache. */
+	size = pt_registers_get_size(regs);
+	if ( (copy = malloc(size)) == NULL) {
+		pt_error_errno_set(errno);
 		return NULL;
 	}
 
-	return thread->t_op->registers_get(thread);
+	return memcpy(copy, regs, size);
 }
 
 int pt_thread_registers_set(struct pt_thread *thread, struct pt_registers *regs)
 {
-	if (thread->t_op->registers_set == NULL) {
-		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+	struct pt_registers *cache;
+
+	switch (pt_thread_registers_cached(thread, &cache)) {
+	case -1:
+		return -1;
+	case 0:
+		if (thread->t_op->registers_set == NULL) {
+			pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+			return -1;
+		}
+
+		return thread->t_op->registers_set(thread, regs);
+	}
+
+	if (regs->type != cache->type) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
 		return -1;
 	}
 
-	return thread->t_op->registers_set(thread, regs);
+	memcpy(cache, regs, pt_registers_get_size(regs));
+	thread->regs_dirty = 1;
+
+	return 0;
 }
 
 int pt_thread_debug_registers_apply(struct pt_thread *thread)
@@ -285,6 +449,14 @@ int pt_thread_debug_registers_apply(struct pt_thread *thread)
 		return -1;
 	}
 
+	/* The backend writes the debug registers directly, so write back
+	 * and drop the cached context around it.
+	 */
+	if (pt_thread_registers_flush(thread) == -1)
+		return -1;
+
+	pt_thread_registers_invalidate(thread);
+
 	return thread->t_op->debug_registers_apply(thread);
 }
 
@@ -351,6 +523,8 @@ int thread_breakpoint_set(struct pt_thread *thread,
 
 	bpi->address = bp->address;
 	bpi->breakpoint = bp;
+	bpi->patched = 0;
+	list_init(&bpi->retired);
 
 	if ( (ret = bp->b_op->thread_set(thread, bpi)) == 0)
 		avl_tree_insert(&thread->breakpoints, &bpi->avl_node);
@@ -360,11 +534,55 @@ int thread_breakpoint_set(struct pt_thread *thread,
 	return ret;
 }
 
+/* Remove the thread scope breakpoint instance 'bpi' from 'thread' and
+ * release it.  The breakpoint it refers to is left alone.
+ */
+int thread_breakpoint_remove_internal(struct pt_thread *thread,
+                                      struct pt_breakpoint_internal *bpi)
+{
+	struct pt_breakpoint *bp = bpi->breakpoint;
+	int ret = 0;
+
+	assert(thread != NULL);
+	assert(bp != NULL);
+	assert(bp->b_op != NULL);
+
+	if (bp->b_op->thread_remove != NULL)
+		ret = bp->b_op->thread_remove(thread, bpi);
+
+	if (thread->breakpoint_restore == bpi)
+		pt_thread_breakpoint_restore_set(thread, NULL);
+
+	avl_tree_delete(&thread->breakpoints, &bpi->avl_node);
+	free(bpi);
+
+	return ret;
+}
+
 /************************************************************************
  * Thread abstract register access functions.
  ***********************************************************************/
+pt_address_t pt_thread_register_pc_get(struct pt_thread *thread)
+{
+	if (thread->regs_cache != NULL)
+		return pt_registers_pc_get(thread->regs_cache);
+
+	if (thread->t_op->register_pc_get == NULL) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return PT_ADDRESS_NULL;
+	}
+
+	return thread->t_op->register_pc_get(thread);
+}
+
 int pt_thread_register_pc_set(struct pt_thread *thread, pt_address_t pc)
 {
+	if (thread->regs_cache != NULL) {
+		pt_registers_pc_set(thread->regs_cache, pc);
+		thread->regs_dirty = 1;
+		return 0;
+	}
+
 	if (thread->t_op->register_pc_set == NULL) {
 		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
 		return -1;
@@ -372,3 +590,16 @@ int pt_thread_register_pc_set(struct pt_thread *thread, pt_address_t pc)
 
 	return thread->t_op->register_pc_set(thread, pc);
 }
+
+pt_address_t pt_thread_register_sp_get(struct pt_thread *thread)
+{
+	if (thread->regs_cache != NULL)
+		return pt_registers_sp_get(thread->regs_cache);
+
+	if (thread->t_op->register_sp_get == NULL) {
+		pt_error_internal_set(PT_ERROR_UNSUPPORTED);
+		return PT_ADDRESS_NULL;
+	}
+
+	return thread->t_op->register_sp_get(thread);
+}
@@ -47,9 +47,11 @@
 
 #include <libptrace/breakpoint.h>
 #include <libptrace/breakpoint_x86.h>
+#include <libptrace/struct.h>
 //#include <libptrace/error.h>
 #include <libptrace/types.h>
 #include "avl.h"
+#include "function_trace.h"
 
 /* Thread states */
 #define THREAD_EXITED				2
@@ -83,6 +85,7 @@ struct pt_thread_operations
 
 	pt_address_t (*register_pc_get)(struct pt_thread *);
 	int	     (*register_pc_set)(struct pt_thread *, pt_address_t);
+	pt_address_t (*register_sp_get)(struct pt_thread *);
 
 	struct pt_registers *	(*registers_get)(struct pt_thread *);
 	int			(*registers_set)(struct pt_thread *, struct pt_registers *);
@@ -100,7 +103,12 @@ struct pt_thread
 	uint16_t			state;
 	uint16_t			flags;
 
-	struct registers		*registers;
+	/* register context cached for the current stop, or NULL. */
+	struct pt_registers		*regs_cache;
+	/* next thread in the list of cached contexts of the process. */
+	struct pt_thread		*regs_cache_next;
+	/* set if regs_cache needs to be written back before resuming. */
+	uint8_t				regs_dirty;
 
 	/* XXX: architecture specific kludge. */
 	struct x86_debug_registers	debug_registers;
@@ -113,8 +121,14 @@ struct pt_thread
 	struct avl_node			avl_node;
 	/* persistent breakpoint that may need to be restored. */
 	struct pt_breakpoint_internal	*breakpoint_restore;
+	/* entry on the process list of threads with breakpoint_restore. */
+	struct list_head		restore_list;
 	/* persistent code hw breakpoint that may need to be restored. */
 	struct x86_debug_register	*db_restore;
+	/* slot on the displaced stepping scratch page, or -1. */
+	int				displaced_slot;
+	/* shadow stack of traced calls that have not returned yet. */
+	struct pt_function_stack	function_stack;
 
         /* breakpoint handlers for this thread */
         struct avl_tree			breakpoints;
@@ -140,15 +154,26 @@ int  pt_thread_single_step_remove(struct pt_thread *thread);
 int  pt_thread_single_step_internal_set(struct pt_thread *thread);
 int  pt_thread_single_step_internal_remove(struct pt_thread *thread);
 int  pt_thread_sscanf(struct pt_thread *thread, const pt_address_t src, const char *fmt, ...);
+int  pt_thread_read_struct(struct pt_thread *, const pt_address_t,
+                           const struct pt_struct_layout *, ...);
 
 
 struct pt_registers *pt_thread_registers_get(struct pt_thread *);
 int pt_thread_registers_set(struct pt_thread *, struct pt_registers *);
 
+int  pt_thread_registers_cached(struct pt_thread *, struct pt_registers **);
+int  pt_thread_registers_flush(struct pt_thread *);
+void pt_thread_registers_invalidate(struct pt_thread *);
+
+void pt_thread_breakpoint_restore_set(struct pt_thread *,
+                                      struct pt_breakpoint_internal *);
+
 int pt_thread_debug_registers_apply(struct pt_thread *thread);
 int pt_thread_registers_print(struct pt_thread *);
 
 int thread_breakpoint_set(struct pt_thread *, struct pt_breakpoint *);
+int thread_breakpoint_remove_internal(struct pt_thread *,
+                                      struct pt_breakpoint_internal *);
 
 struct pt_breakpoint_internal *
 pt_thread_breakpoint_internal_find(struct pt_thread *thread, pt_address_t address);
@@ -159,6 +184,7 @@ pt_thread_breakpoint_find(struct pt_thread *thread, pt_address_t address);
 /* Abstract register access. */
 int          pt_thread_register_pc_set(struct pt_thread *, pt_address_t);
 pt_address_t pt_thread_register_pc_get(struct pt_thread *);
+pt_address_t pt_thread_register_sp_get(struct pt_thread *);
 
 #ifdef __cplusplus
 };
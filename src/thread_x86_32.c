@@ -46,6 +46,7 @@
 #include <libptrace/error.h>
 #include <libptrace/types.h>
 #include "arch.h"
+#include "registers.h"
 #include "thread.h"
 #include "thread_x86.h"
 #include "thread_x86_32.h"
@@ -54,6 +55,7 @@
 uint##s##_t pt_thread_x86_32_get_##r(struct pt_thread *thread)		\
 {									\
 	struct pt_arch_data_x86_32 *arch_data;				\
+	struct pt_registers *regs;					\
 									\
 	assert(thread->arch_data != NULL);				\
 									\
@@ -62,6 +64,11 @@ uint##s##_t pt_thread_x86_32_get_##r(struct pt_thread *thread)		\
 		return -1;						\
 	}								\
 									\
+	if (pt_thread_registers_cached(thread, &regs) == 1 &&		\
+	    regs->type == PT_REGISTERS_I386) {				\
+		return ((struct pt_registers_i386 *)regs)->r;		\
+	}								\
+									\
 	arch_data = (struct pt_arch_data_x86_32 *)thread->arch_data;	\
 									\
 	if (arch_data->t_op->get_##r == NULL) {				\
@@ -76,6 +83,7 @@ uint##s##_t pt_thread_x86_32_get_##r(struct pt_thread *thread)		\
 int pt_thread_x86_32_set_##r(struct pt_thread *thread, uint##s##_t reg)	\
 {									\
 	struct pt_arch_data_x86_32 *arch_data;				\
+	struct pt_registers *regs;					\
 									\
 	assert(thread->arch_data != NULL);				\
 									\
@@ -84,6 +92,13 @@ int pt_thread_x86_32_set_##r(struct pt_thread *thread, uint##s##_t reg)	\
 		return -1;						\
 	}								\
 									\
+	if (pt_thread_registers_cached(thread, &regs) == 1 &&		\
+	    regs->type == PT_REGISTERS_I386) {				\
+		((struct pt_registers_i386 *)regs)->r = reg;		\
+		thread->regs_dirty = 1;					\
+		return 0;						\
+	}								\
+									\
 	arch_data = (struct pt_arch_data_x86_32 *)thread->arch_data;	\
 									\
 	if (arch_data->t_op->set_##r == NULL) {				\
@@ -0,0 +1,943 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * value_scan.c
+ *
+ * libptrace iterative value scanning.
+ *
+ * A value scan starts with every aligned value in the selected areas of
+ * a process and narrows them down one pass at a time.  Candidates are
+ * kept per page, either as a bitmap of value slots, or as an array of
+ * 16-bit slot numbers relative to the page when few remain, whichever is
+ * smaller.  Pages without candidates are dropped entirely, and we keep a
+ * copy of the contents of the remaining pages for comparisons against
+ * the previous pass.
+ *
+ * Passes after the first read only the pages that still hold candidates,
+ * coalescing runs of adjacent pages in a single read.  Values that would
+ * cross a page boundary are never candidates.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_MEMORY
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libptrace/error.h>
+#include <libptrace/log.h>
+#include <libptrace/scan.h>
+#include <libptrace/util.h>
+#include <libptrace/value_scan.h>
+#include "mmap.h"
+#include "process.h"
+#include "value_scan.h"
+#include "workers.h"
+
+#if defined(__GNUC__) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define PT_VALUE_SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+/* Pages read and compared per job. */
+#define PT_VALUE_SCAN_JOB_PAGES		256
+
+struct value_job_
+{
+	pt_address_t		start;
+	size_t			pages;
+	/* pages with candidates found by the first pass. */
+	struct pt_value_page	*found;
+	size_t			count;
+	int			error;
+};
+
+struct pt_value_scan
+{
+	struct pt_process	*process;
+	int			type;
+	size_t			size;
+	size_t			align;
+	size_t			slots;
+	int			prot;
+	double			tolerance;
+	/* use the vectorized comparisons where they apply. */
+	int			simd;
+	int			scanned;
+	struct pt_value_page	*pages;
+	size_t			page_count;
+	uint64_t		count;
+};
+
+struct value_ctx_
+{
+	struct pt_value_scan	*scan;
+	int			cmp;
+	const union pt_value	*value;
+	struct value_job_	*jobs;
+};
+
+static const size_t value_size_[PT_VALUE_MAX] = {
+	1, 2, 4, 8, 1, 2, 4, 8, 4, 8
+};
+
+static inline size_t value_bitmap_size_(struct pt_value_scan *scan)
+{
+	return (scan->slots + 7) / 8;
+}
+
+static inline int value_is_float_(int type)
+{
+	return type == PT_VALUE_FLOAT || type == PT_VALUE_DOUBLE;
+}
+
+static inline int value_is_signed_(int type)
+{
+	return type >= PT_VALUE_INT8 && type <= PT_VALUE_INT64;
+}
+
+static inline void value_load_(int type, const uint8_t *p, union pt_value *v)
+{
+	int8_t i8; int16_t i16; int32_t i32; int64_t i64;
+	uint8_t u8; uint16_t u16; uint32_t u32; uint64_t u64;
+	float f; double d;
+
+	switch (type) {
+	case PT_VALUE_INT8:
+		memcpy(&i8, p, sizeof i8);
+		v->i = i8;
+		break;
+	case PT_VALUE_INT16:
+		memcpy(&i16, p, sizeof i16);
+		v->i = i16;
+		break;
+	case PT_VALUE_INT32:
+		memcpy(&i32, p, sizeof i32);
+		v->i = i32;
+		break;
+	case PT_VALUE_INT64:
+		memcpy(&i64, p, sizeof i64);
+		v->i = i64;
+		break;
+	case PT_VALUE_UINT8:
+		memcpy(&u8, p, sizeof u8);
+		v->u = u8;
+		break;
+	case PT_VALUE_UINT16:
+		memcpy(&u16, p, sizeof u16);
+		v->u = u16;
+		break;
+	case PT_VALUE_UINT32:
+		memcpy(&u32, p, sizeof u32);
+		v->u = u32;
+		break;
+	case PT_VALUE_UINT64:
+		memcpy(&u64, p, sizeof u64);
+		v->u = u64;
+		break;
+	case PT_VALUE_FLOAT:
+		memcpy(&f, p, sizeof f);
+		v->f = f;
+		break;
+	case PT_VALUE_DOUBLE:
+		memcpy(&d, p, sizeof d);
+		v->f = d;
+		break;
+	}
+}
+
+/* Reduce a comparison against the previous pass to the same comparison
+ * against a given value.
+ */
+static inline int value_cmp_base_(int cmp)
+{
+	switch (cmp) {
+	case PT_VALUE_CMP_UNCHANGED:
+		return PT_VALUE_CMP_EQUAL;
+	case PT_VALUE_CMP_CHANGED:
+		return PT_VALUE_CMP_NOT_EQUAL;
+	case PT_VALUE_CMP_INCREASED:
+		return PT_VALUE_CMP_GREATER;
+	case PT_VALUE_CMP_DECREASED:
+		return PT_VALUE_CMP_LESS;
+	}
+
+	return cmp;
+}
+
+static inline int value_is_relative_(int cmp)
+{
+	return value_cmp_base_(cmp) != cmp;
+}
+
+/* Whether the integer 'value' can be represented by 'type'.  Values that
+ * cannot never match, and the vectorized comparisons only look at the
+ * low bytes of the value, so we reject them up front.
+ */
+static int value_in_range_(int type, const union pt_value *value)
+{
+	unsigned int bits = value_size_[type] * 8;
+
+	if (value_is_float_(type) || bits == 64)
+		return 1;
+
+	if (value_is_signed_(type))
+		return value->i >= -(INT64_C(1) << (bits - 1)) &&
+		       value->i < (INT64_C(1) << (bits - 1));
+
+	return value->u < (UINT64_C(1) << bits);
+}
+
+/* Floating point values within the tolerance of each other are equal,
+ * and NaN is equal to nothing.
+ */
+static inline int
+value_match_(struct pt_value_scan *scan, int cmp, const uint8_t *p,
+             const uint8_t *old, const union pt_value *value)
+{
+	union pt_value cur, ref;
+	int eq;
+
+	if (cmp == PT_VALUE_CMP_ANY)
+		return 1;
+
+	value_load_(scan->type, p, &cur);
+	if (value_is_relative_(cmp))
+		value_load_(scan->type, old, &ref);
+	else
+		ref = *value;
+
+	cmp = value_cmp_base_(cmp);
+
+	if (value_is_float_(scan->type)) {
+		eq = fabs(cur.f - ref.f) <= scan->tolerance;
+
+		switch (cmp) {
+		case PT_VALUE_CMP_EQUAL:
+			return eq;
+		case PT_VALUE_CMP_NOT_EQUAL:
+			return !eq;
+		case PT_VALUE_CMP_GREATER:
+			return !eq && cur.f > ref.f;
+		case PT_VALUE_CMP_LESS:
+			return !eq && cur.f < ref.f;
+		}
+	} else if (value_is_signed_(scan->type)) {
+		switch (cmp) {
+		case PT_VALUE_CMP_EQUAL:
+			return cur.i == ref.i;
+		case PT_VALUE_CMP_NOT_EQUAL:
+			return cur.i != ref.i;
+		case PT_VALUE_CMP_GREATER:
+			return cur.i > ref.i;
+		case PT_VALUE_CMP_LESS:
+			return cur.i < ref.i;
+		}
+	} else {
+		switch (cmp) {
+		case PT_VALUE_CMP_EQUAL:
+			return cur.u == ref.u;
+		case PT_VALUE_CMP_NOT_EQUAL:
+			return cur.u != ref.u;
+		case PT_VALUE_CMP_GREATER:
+			return cur.u > ref.u;
+		case PT_VALUE_CMP_LESS:
+			return cur.u < ref.u;
+		}
+	}
+
+	return 0;
+}
+
+#ifdef PT_VALUE_SCAN_SIMD
+/* Compare every naturally aligned integer in a page against 'v', 16
+ * bytes at a time, and store one bit per value in 'bitmap'.
+ */
+static void
+value_page_equal_sse2_(const uint8_t *page, size_t size, uint64_t v,
+                       uint8_t *bitmap)
+{
+	__m128i needle, c;
+	unsigned int bits, nbits;
+	size_t offset, slot;
+
+	switch (size) {
+	case 1:
+		needle = _mm_set1_epi8((char)v);
+		break;
+	case 2:
+		needle = _mm_set1_epi16((short)v);
+		break;
+	case 4:
+		needle = _mm_set1_epi32((int)v);
+		break;
+	default:
+		needle = _mm_set1_epi64x((long long)v);
+		break;
+	}
+
+	nbits = 16 / size;
+
+	for (offset = 0; offset < PT_MMAP_PAGE_SIZE; offset += 16) {
+		c = _mm_loadu_si128((const __m128i *)(page + offset));
+
+		switch (size) {
+		case 1:
+			c    = _mm_cmpeq_epi8(c, needle);
+			bits = _mm_movemask_epi8(c);
+			break;
+		case 2:
+			c    = _mm_cmpeq_epi16(c, needle);
+			c    = _mm_packs_epi16(c, _mm_setzero_si128());
+			bits = _mm_movemask_epi8(c) & 0xff;
+			break;
+		case 4:
+			c    = _mm_cmpeq_epi32(c, needle);
+			bits = _mm_movemask_ps(_mm_castsi128_ps(c));
+			break;
+		default:
+			/* Both halves of a 64-bit value have to match. */
+			c    = _mm_cmpeq_epi32(c, needle);
+			c    = _mm_and_si128(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+			bits = _mm_movemask_pd(_mm_castsi128_pd(c));
+			break;
+		}
+
+		slot = offset / size;
+		bitmap[slot / 8] |= (uint8_t)(bits << (slot % 8));
+		if (nbits > 8)
+			bitmap[slot / 8 + 1] |= (uint8_t)(bits >> 8);
+	}
+}
+#endif
+
+/* Match every slot of a page, optionally restricted to the slots set in
+ * 'mask', and return the number of matches stored in 'bitmap'.
+ */
+size_t
+pt_value_page_match(struct pt_value_scan *scan, int cmp,
+                    const union pt_value *value, const uint8_t *cur,
+                    const uint8_t *old, const uint8_t *mask, uint8_t *bitmap)
+{
+	size_t i, slot, offset, count = 0, bytes = value_bitmap_size_(scan);
+
+	memset(bitmap, 0, bytes);
+
+#ifdef PT_VALUE_SCAN_SIMD
+	if (scan->simd && cmp == PT_VALUE_CMP_EQUAL &&
+	    !value_is_float_(scan->type) && scan->align == scan->size) {
+		value_page_equal_sse2_(cur, scan->size, value->u, bitmap);
+		goto out;
+	}
+#endif
+
+	for (slot = 0; slot < scan->slots; slot++) {
+		if (mask != NULL && !(mask[slot / 8] & (1U << (slot % 8))))
+			continue;
+
+		offset = slot * scan->align;
+		if (value_match_(scan, cmp, cur + offset,
+		                 old == NULL ? NULL : old + offset, value))
+			bitmap[slot / 8] |= 1U << (slot % 8);
+	}
+
+#ifdef PT_VALUE_SCAN_SIMD
+out:
+#endif
+	for (i = 0; i < bytes; i++) {
+		if (mask != NULL)
+			bitmap[i] &= mask[i];
+		count += __builtin_popcount(bitmap[i]);
+	}
+
+	return count;
+}
+
+void pt_value_page_free(struct pt_value_page *page)
+{
+	free(page->set);
+	free(page->data);
+	page->set  = NULL;
+	page->data = NULL;
+}
+
+/* Store the slots set in 'bitmap' in the smaller of the two forms. */
+int
+pt_value_page_encode(struct pt_value_scan *scan, struct pt_value_page *page,
+                     const uint8_t *bitmap, size_t count)
+{
+	size_t bytes = value_bitmap_size_(scan);
+	uint16_t *slots;
+	size_t i, n = 0;
+	unsigned int b;
+	void *set;
+
+	if (count * sizeof(uint16_t) >= bytes) {
+		if ( (set = malloc(bytes)) == NULL)
+			return -1;
+		memcpy(set, bitmap, bytes);
+		page->dense = 1;
+	} else {
+		if ( (set = slots = malloc(count * sizeof *slots)) == NULL)
+			return -1;
+
+		for (i = 0; i < bytes; i++) {
+			for (b = bitmap[i]; b != 0; b &= b - 1)
+				slots[n++] = i * 8 + __builtin_ctz(b);
+		}
+		page->dense = 0;
+	}
+
+	free(page->set);
+	page->set   = set;
+	page->count = count;
+	return 0;
+}
+
+void
+pt_value_page_decode(struct pt_value_scan *scan,
+                     const struct pt_value_page *page, uint8_t *bitmap)
+{
+	const uint16_t *slots = page->set;
+	size_t i;
+
+	if (page->dense) {
+		memcpy(bitmap, page->set, value_bitmap_size_(scan));
+		return;
+	}
+
+	memset(bitmap, 0, value_bitmap_size_(scan));
+	for (i = 0; i < page->count; i++)
+		bitmap[slots[i] / 8] |= 1U << (slots[i] % 8);
+}
+
+/* Refine a page against its new contents in 'cur'. */
+static int
+value_page_refine_(struct value_ctx_ *ctx, struct pt_value_page *page,
+                   const uint8_t *cur)
+{
+	struct pt_value_scan *scan = ctx->scan;
+	const uint16_t *slots = page->set;
+	uint8_t bitmap[PT_VALUE_BITMAP_MAX];
+	uint8_t mask[PT_VALUE_BITMAP_MAX];
+	size_t i, offset, count = 0;
+
+	if (page->dense) {
+		pt_value_page_decode(scan, page, mask);
+		count = pt_value_page_match(scan, ctx->cmp, ctx->value, cur,
+		                            page->data, mask, bitmap);
+	} else {
+		memset(bitmap, 0, value_bitmap_size_(scan));
+
+		for (i = 0; i < page->count; i++) {
+			offset = slots[i] * scan->align;
+			if (value_match_(scan, ctx->cmp, cur + offset,
+			                 page->data + offset, ctx->value)) {
+				bitmap[slots[i] / 8] |= 1U << (slots[i] % 8);
+				count++;
+			}
+		}
+	}
+
+	if (count == 0) {
+		pt_value_page_free(page);
+		page->count = 0;
+		return 0;
+	}
+
+	if (pt_value_page_encode(scan, page, bitmap, count) == -1)
+		return -1;
+
+	memcpy(page->data, cur, PT_MMAP_PAGE_SIZE);
+	return 0;
+}
+
+static int
+value_job_add_(struct value_ctx_ *ctx, struct value_job_ *job,
+               pt_address_t address, const uint8_t *cur)
+{
+	struct pt_value_scan *scan = ctx->scan;
+	uint8_t bitmap[PT_VALUE_BITMAP_MAX];
+	struct pt_value_page *page;
+	size_t count;
+
+	count = pt_value_page_match(scan, ctx->cmp, ctx->value, cur,
+	                            NULL, NULL, bitmap);
+	if (count == 0)
+		return 0;
+
+	if (job->found == NULL) {
+		job->found = calloc(job->pages, sizeof *job->found);
+		if (job->found == NULL)
+			return -1;
+	}
+
+	page = &job->found[job->count];
+	page->address = address;
+
+	if ( (page->data = malloc(PT_MMAP_PAGE_SIZE)) == NULL)
+		return -1;
+
+	if (pt_value_page_encode(scan, page, bitmap, count) == -1) {
+		pt_value_page_free(page);
+		return -1;
+	}
+
+	memcpy(page->data, cur, PT_MMAP_PAGE_SIZE);
+	job->count++;
+	return 0;
+}
+
+/* First pass over a range of pages of a single area. */
+static void value_first_job_(size_t n, void *cookie)
+{
+	struct value_ctx_ *ctx = cookie;
+	struct value_job_ *job = &ctx->jobs[n];
+	size_t i, len = job->pages * PT_MMAP_PAGE_SIZE;
+	pt_address_t address;
+	uint8_t *buf;
+	int whole;
+
+	if ( (buf = malloc(len)) == NULL) {
+		job->error = errno;
+		return;
+	}
+
+	whole = pt_process_read_locked(ctx->scan->process, buf, job->start,
+	                               len) == (ssize_t)len;
+
+	for (i = 0; i < job->pages; i++) {
+		address = job->start + i * PT_MMAP_PAGE_SIZE;
+
+		if (!whole &&
+		    pt_process_read_locked(ctx->scan->process,
+		                           buf + i * PT_MMAP_PAGE_SIZE, address,
+		                           PT_MMAP_PAGE_SIZE) != PT_MMAP_PAGE_SIZE)
+			continue;
+
+		if (value_job_add_(ctx, job, address,
+		                   buf + i * PT_MMAP_PAGE_SIZE) == -1) {
+			job->error = errno;
+			break;
+		}
+	}
+
+	free(buf);
+}
+
+/* Later passes over a range of candidate pages. */
+static void value_next_job_(size_t n, void *cookie)
+{
+	struct value_ctx_ *ctx = cookie;
+	struct pt_value_scan *scan = ctx->scan;
+	struct value_job_ *job = &ctx->jobs[n];
+	struct pt_value_page *pages;
+	size_t i, j, run, len;
+	uint8_t *buf;
+	int whole;
+
+	pages = &scan->pages[n * PT_VALUE_SCAN_JOB_PAGES];
+
+	if ( (buf = malloc(job->pages * PT_MMAP_PAGE_SIZE)) == NULL) {
+		job->error = errno;
+		return;
+	}
+
+	for (i = 0; i < job->pages; i += run) {
+		for (run = 1; i + run < job->pages; run++)
+			if (pages[i + run].address !=
+			    pages[i].address + run * PT_MMAP_PAGE_SIZE)
+				break;
+
+		len   = run * PT_MMAP_PAGE_SIZE;
+		whole = pt_process_read_locked(scan->process, buf,
+		                               pages[i].address, len) ==
+		        (ssize_t)len;
+
+		for (j = i; j < i + run; j++) {
+			uint8_t *cur = buf + (j - i) * PT_MMAP_PAGE_SIZE;
+
+			/* Pages we can no longer read lose their candidates. */
+			if (!whole &&
+			    pt_process_read_locked(scan->process, cur,
+			                           pages[j].address,
+			                           PT_MMAP_PAGE_SIZE) !=
+			    PT_MMAP_PAGE_SIZE) {
+				pt_value_page_free(&pages[j]);
+				pages[j].count = 0;
+				continue;
+			}
+
+			if (value_page_refine_(ctx, &pages[j], cur) == -1) {
+				job->error = errno;
+				goto out;
+			}
+		}
+	}
+
+out:
+	free(buf);
+}
+
+static int value_area_wanted_(struct pt_mmap_area *area, int prot)
+{
+	int flags = PT_VMA_PROT_READ;
+
+	if (prot & PT_SCAN_PROT_WRITE)
+		flags |= PT_VMA_PROT_WRITE;
+	if (prot & PT_SCAN_PROT_EXEC)
+		flags |= PT_VMA_PROT_EXEC;
+
+	return (area->flags & flags) == flags;
+}
+
+static struct value_job_ *
+value_first_jobs_(struct pt_value_scan *scan, size_t *count)
+{
+	struct pt_process *process = scan->process;
+	struct pt_mmap_area *area;
+	struct value_job_ *jobs, *job;
+	pt_address_t start;
+	size_t n = 0, span = PT_VALUE_SCAN_JOB_PAGES * PT_MMAP_PAGE_SIZE;
+
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (value_area_wanted_(area, scan->prot))
+			n += (area->end_ - area->start_ + span - 1) / span;
+	}
+
+	if ( (jobs = calloc(n + 1, sizeof *jobs)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	*count = 0;
+	pt_mmap_for_each_area (&process->mmap, area) {
+		if (!value_area_wanted_(area, scan->prot))
+			continue;
+
+		for (start = area->start_; start < area->end_; start += span) {
+			job        = &jobs[(*count)++];
+			job->start = start;
+			job->pages = area->end_ - start < span ?
+			             (area->end_ - start) / PT_MMAP_PAGE_SIZE :
+			             PT_VALUE_SCAN_JOB_PAGES;
+		}
+	}
+
+	return jobs;
+}
+
+static int value_scan_first_(struct value_ctx_ *ctx)
+{
+	struct pt_value_scan *scan = ctx->scan;
+	size_t i, j, jobs, total = 0;
+	int error = 0;
+
+	/* Other threads can rebuild the memory map, so we lay out the jobs
+	 * under the process lock.  The jobs do not refer to the map.
+	 */
+	pt_process_lock(scan->process);
+	ctx->jobs = NULL;
+	if (pt_mmap_load(scan->process) == 0)
+		ctx->jobs = value_first_jobs_(scan, &jobs);
+	pt_process_unlock(scan->process);
+
+	if (ctx->jobs == NULL)
+		return -1;
+
+	/* The workers read on our behalf, under our process lock. */
+	pt_process_lock(scan->process);
+	pt_workers_run(jobs, value_first_job_, ctx);
+	pt_process_unlock(scan->process);
+
+	for (i = 0; i < jobs; i++) {
+		if (ctx->jobs[i].error != 0 && error == 0)
+			error = ctx->jobs[i].error;
+		total += ctx->jobs[i].count;
+	}
+
+	if (error == 0 &&
+	    (scan->pages = malloc((total + 1) * sizeof *scan->pages)) == NULL)
+		error = errno;
+
+	for (i = 0; i < jobs; i++) {
+		for (j = 0; j < ctx->jobs[i].count; j++) {
+			if (error == 0)
+				scan->pages[scan->page_count++] = ctx->jobs[i].found[j];
+			else
+				pt_value_page_free(&ctx->jobs[i].found[j]);
+		}
+		free(ctx->jobs[i].found);
+	}
+
+	free(ctx->jobs);
+
+	if (error != 0) {
+		pt_error_errno_set(error);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int value_scan_next_(struct value_ctx_ *ctx)
+{
+	struct pt_value_scan *scan = ctx->scan;
+	size_t i, j, jobs;
+	int error = 0;
+
+	jobs = (scan->page_count + PT_VALUE_SCAN_JOB_PAGES - 1) /
+	       PT_VALUE_SCAN_JOB_PAGES;
+
+	if ( (ctx->jobs = calloc(jobs + 1, sizeof *ctx->jobs)) == NULL) {
+		pt_error_errno_set(errno);
+		return -1;
+	}
+
+	for (i = 0; i < jobs; i++) {
+		ctx->jobs[i].pages = scan->page_count - i * PT_VALUE_SCAN_JOB_PAGES;
+		if (ctx->jobs[i].pages > PT_VALUE_SCAN_JOB_PAGES)
+			ctx->jobs[i].pages = PT_VALUE_SCAN_JOB_PAGES;
+	}
+
+	pt_process_lock(scan->process);
+	pt_workers_run(jobs, value_next_job_, ctx);
+	pt_process_unlock(scan->process);
+
+	for (i = 0; i < jobs; i++)
+		if (ctx->jobs[i].error != 0 && error == 0)
+			error = ctx->jobs[i].error;
+
+	free(ctx->jobs);
+
+	/* Drop the pages that lost all candidates.  On failure some pages
+	 * may have been refined and others not, so the candidates are only
+	 * guaranteed to be a superset of the matches.
+	 */
+	for (i = j = 0; i < scan->page_count; i++)
+		if (scan->pages[i].count != 0)
+			scan->pages[j++] = scan->pages[i];
+	scan->page_count = j;
+
+	if (error != 0) {
+		pt_error_errno_set(error);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Create a value scan over the memory of a process.
+ *
+ * 'type' is one of the PT_VALUE_* types, and values are expected at
+ * multiples of 'align', which defaults to the size of the type if it is
+ * 0.  Only readable areas with at least the PT_SCAN_PROT_* protection in
+ * 'prot' are scanned.  Nothing is read until the first update.
+ */
+struct pt_value_scan *
+pt_value_scan_new(struct pt_process *process, int type, size_t align, int prot)
+{
+	struct pt_value_scan *scan;
+
+	if (type < 0 || type >= PT_VALUE_MAX)
+		goto err_inval;
+
+	if (align == 0)
+		align = value_size_[type];
+
+	if (align > PT_MMAP_PAGE_SIZE || (align & (align - 1)) != 0)
+		goto err_inval;
+
+	if ( (scan = calloc(1, sizeof *scan)) == NULL) {
+		pt_error_errno_set(errno);
+		return NULL;
+	}
+
+	scan->process = process;
+	scan->type    = type;
+	scan->size    = value_size_[type];
+	scan->align   = align;
+	scan->slots   = (PT_MMAP_PAGE_SIZE - scan->size) / align + 1;
+	scan->prot    = prot;
+#ifdef PT_VALUE_SCAN_SIMD
+	scan->simd    = 1;
+#endif
+
+	return scan;
+
+err_inval:
+	pt_error_internal_set(PT_ERROR_INVALID_ARG);
+	return NULL;
+}
+
+void pt_value_scan_delete(struct pt_value_scan *scan)
+{
+	size_t i;
+
+	for (i = 0; i < scan->page_count; i++)
+		pt_value_page_free(&scan->pages[i]);
+
+	free(scan->pages);
+	free(scan);
+}
+
+/* Turn the vectorized comparisons on or off.  They are on by default
+ * where they are available, and are only turned off to check them
+ * against the scalar comparisons.
+ */
+void pt_value_scan_simd_set(struct pt_value_scan *scan, int enable)
+{
+#ifdef PT_VALUE_SCAN_SIMD
+	scan->simd = enable != 0;
+#endif
+}
+
+/** Set the tolerance for floating point comparisons.
+ *
+ * Values that differ by at most 'tolerance' are considered equal, and
+ * unchanged from the previous pass.  The default is 0.
+ */
+void pt_value_scan_tolerance_set(struct pt_value_scan *scan, double tolerance)
+{
+	scan->tolerance = fabs(tolerance);
+}
+
+/** Run a scan pass.
+ *
+ * The first pass reads all memory and keeps the values for which 'cmp'
+ * holds against 'value', where PT_VALUE_CMP_ANY keeps every value.  Later
+ * passes re-read the remaining candidates and keep those for which 'cmp'
+ * still holds, where the PT_VALUE_CMP_CHANGED family compares against
+ * the value seen by the previous pass and ignore 'value'.  Integer values
+ * must be representable by the scan type.  Returns the number of
+ * candidates left, or -1.
+ */
+ssize_t pt_value_scan_update(struct pt_value_scan *scan, int cmp,
+                             const union pt_value *value)
+{
+	struct value_ctx_ ctx;
+	uint64_t start;
+	size_t i;
+	int ret;
+
+	if (cmp < 0 || cmp >= PT_VALUE_CMP_MAX ||
+	    (value == NULL && cmp != PT_VALUE_CMP_ANY && !value_is_relative_(cmp)) ||
+	    (!scan->scanned && value_is_relative_(cmp))) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	if (cmp != PT_VALUE_CMP_ANY && !value_is_relative_(cmp) &&
+	    !value_in_range_(scan->type, value)) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		return -1;
+	}
+
+	ctx.scan  = scan;
+	ctx.cmp   = cmp;
+	ctx.value = value;
+	start     = pt_util_time_ns();
+
+	if (!scan->scanned) {
+		ret = value_scan_first_(&ctx);
+		scan->scanned = ret == 0;
+	} else {
+		ret = value_scan_next_(&ctx);
+	}
+
+	scan->count = 0;
+	for (i = 0; i < scan->page_count; i++)
+		scan->count += scan->pages[i].count;
+
+	pt_log("%s(): %zu pages, %llu candidates in %llu ns\n", __FUNCTION__,
+	       scan->page_count, (unsigned long long)scan->count,
+	       (unsigned long long)(pt_util_time_ns() - start));
+
+	return ret == -1 ? -1 : (ssize_t)scan->count;
+}
+
+uint64_t pt_value_scan_count_get(struct pt_value_scan *scan)
+{
+	return scan->count;
+}
+
+/* The number of pages holding candidates, each of which costs a copy of
+ * the page and its candidate set.
+ */
+size_t pt_value_scan_pages_get(struct pt_value_scan *scan)
+{
+	return scan->page_count;
+}
+
+/** Iterate over the remaining candidates.
+ *
+ * Returns the value returned by 'handler' if it ended the iteration, and
+ * 0 otherwise.
+ */
+int pt_value_scan_for_each(struct pt_value_scan *scan,
+                           pt_value_scan_handler_t handler, void *cookie)
+{
+	uint8_t bitmap[PT_VALUE_BITMAP_MAX];
+	struct pt_value_page *page;
+	union pt_value value;
+	size_t i, j, slot;
+	unsigned int b;
+	int ret;
+
+	for (i = 0; i < scan->page_count; i++) {
+		page = &scan->pages[i];
+		pt_value_page_decode(scan, page, bitmap);
+
+		for (j = 0; j < value_bitmap_size_(scan); j++) {
+			for (b = bitmap[j]; b != 0; b &= b - 1) {
+				slot = j * 8 + __builtin_ctz(b);
+				value_load_(scan->type, page->data + slot * scan->align,
+				            &value);
+
+				ret = handler(scan->process,
+				              page->address + slot * scan->align,
+				              &value, cookie);
+				if (ret != 0)
+					return ret;
+			}
+		}
+	}
+
+	return 0;
+}
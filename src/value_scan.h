@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * value_scan.h
+ *
+ * libptrace iterative value scanning internals.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#ifndef PT_VALUE_SCAN_INTERNAL_H
+#define PT_VALUE_SCAN_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libptrace/types.h>
+#include <libptrace/value_scan.h>
+#include "mmap.h"
+
+/* Bytes in the largest candidate bitmap of a page, for 1-byte slots. */
+#define PT_VALUE_BITMAP_MAX		(PT_MMAP_PAGE_SIZE / 8)
+
+/* The candidates on a single page, and a copy of its contents. */
+struct pt_value_page
+{
+	pt_address_t	address;
+	uint32_t	count;
+	/* 'set' is a bitmap rather than an array of slot numbers. */
+	int		dense;
+	void		*set;
+	uint8_t		*data;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void   pt_value_scan_simd_set(struct pt_value_scan *, int);
+size_t pt_value_page_match(struct pt_value_scan *, int, const union pt_value *,
+                           const uint8_t *cur, const uint8_t *old,
+                           const uint8_t *mask, uint8_t *bitmap);
+int    pt_value_page_encode(struct pt_value_scan *, struct pt_value_page *,
+                            const uint8_t *bitmap, size_t count);
+void   pt_value_page_decode(struct pt_value_scan *,
+                            const struct pt_value_page *, uint8_t *bitmap);
+void   pt_value_page_free(struct pt_value_page *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif	/* !PT_VALUE_SCAN_INTERNAL_H */
@@ -71,6 +71,16 @@ pt_address_t pt_windows_process_malloc_adapter(
 	return (pt_address_t)pt_windows_process_malloc(process, len);
 }
 
+pt_address_t pt_windows_process_malloc_near_adapter(
+	struct pt_process *process, size_t len, pt_address_t near)
+{
+	return (pt_address_t)pt_windows_process_malloc_near(
+		process,
+		len,
+		(const void *)near
+	);
+}
+
 int pt_windows_process_free_adapter(struct pt_process *process, pt_address_t p)
 {
 	return pt_windows_process_free(process, (const void *)p);
@@ -85,7 +95,8 @@ struct pt_process_operations pt_windows_process_operations = {
 	.write         = pt_windows_process_write_adapter,
 	.thread_create = pt_windows_process_thread_create_adapter,
 	.malloc        = pt_windows_process_malloc_adapter,
-	.free          = pt_windows_process_free_adapter
+	.free          = pt_windows_process_free_adapter,
+	.malloc_near   = pt_windows_process_malloc_near_adapter
 };
 
 pt_address_t pt_windows_thread_register_pc_get_adapter(struct pt_thread *thread)
@@ -98,15 +109,25 @@ int pt_windows_thread_register_pc_set_adapter(struct pt_thread *thread, pt_addre
 	return pt_windows_thread_register_pc_set(thread, (void *)pc);
 }
 
+pt_address_t pt_windows_thread_register_sp_get_adapter(struct pt_thread *thread)
+{
+	return (pt_address_t)pt_windows_thread_register_sp_get(thread);
+}
+
 #ifdef __x86_64__
 pt_address_t pt_windows_wow64_thread_register_pc_get_adapter(struct pt_thread *thread)
 {
-	return (pt_address_t)pt_windows_thread_register_pc_get(thread);
+	return (pt_address_t)pt_windows_wow64_thread_register_pc_get(thread);
 }
 
 int pt_windows_wow64_thread_register_pc_set_adapter(struct pt_thread *thread, pt_address_t pc)
 {
-	return pt_windows_thread_register_pc_set(thread, (void *)pc);
+	return pt_windows_wow64_thread_register_pc_set(thread, (void *)pc);
+}
+
+pt_address_t pt_windows_wow64_thread_register_sp_get_adapter(struct pt_thread *thread)
+{
+	return (pt_address_t)pt_windows_wow64_thread_register_sp_get(thread);
 }
 #endif
 
@@ -122,6 +143,7 @@ struct pt_thread_operations pt_windows_thread_operations = {
 
 	.register_pc_get = pt_windows_thread_register_pc_get_adapter,
 	.register_pc_set = pt_windows_thread_register_pc_set_adapter,
+	.register_sp_get = pt_windows_thread_register_sp_get_adapter,
 };
 
 #ifdef __x86_64__
@@ -137,5 +159,6 @@ struct pt_thread_operations pt_windows_wow64_thread_operations = {
 
 	.register_pc_get = pt_windows_wow64_thread_register_pc_get_adapter,
 	.register_pc_set = pt_windows_wow64_thread_register_pc_set_adapter,
+	.register_sp_get = pt_windows_wow64_thread_register_sp_get_adapter,
 };
 #endif
@@ -50,14 +50,14 @@
 int
 pt_x86_32_cconv_function_argv_get(struct pt_thread *thread, int argc, pt_register_t *argv)
 {
-	uint32_t esp;
+	pt_address_t esp;
 	int i;
 
 	pt_error_save(), pt_error_clear();
 
-	esp = pt_windows_thread_x86_32_get_esp(thread);
+	esp = pt_thread_register_sp_get(thread);
 
-	if (esp == -1 && pt_error_is_set())
+	if (esp == PT_ADDRESS_NULL && pt_error_is_set())
 		return -1;
 
 	pt_error_restore();
@@ -82,13 +82,14 @@ uint32_t pt_x86_32_cconv_function_retval_get(struct pt_thread *thread)
 
 uint32_t pt_x86_32_cconv_function_retaddr_get(struct pt_thread *thread)
 {
-	uint32_t esp, retaddr;
+	pt_address_t esp;
+	uint32_t retaddr;
 
 	pt_error_save(), pt_error_clear();
 
-	esp = pt_windows_thread_x86_32_get_esp(thread);
+	esp = pt_thread_register_sp_get(thread);
 
-	if (esp == -1 && pt_error_is_set())
+	if (esp == PT_ADDRESS_NULL && pt_error_is_set())
 		return -1;
 
 	pt_error_restore();
@@ -99,6 +100,11 @@ uint32_t pt_x86_32_cconv_function_retaddr_get(struct pt_thread *thread)
 	return retaddr;
 }
 
+uint32_t pt_x86_32_cconv_function_stack_get(struct pt_thread *thread)
+{
+	return pt_thread_register_sp_get(thread);
+}
+
 #ifdef __i386__
 int pt_cconv_function_argv_get(struct pt_thread *thread, int argc, pt_register_t *argv)
 {
@@ -120,20 +126,31 @@ pt_register_t pt_cconv_function_retval_get(struct pt_thread *thread)
 
 	return pt_x86_32_cconv_function_retval_get(thread);
 }
+
+pt_register_t pt_cconv_function_stack_get(struct pt_thread *thread)
+{
+	assert(thread != NULL);
+	assert(thread->process != NULL);
+
+	return pt_x86_32_cconv_function_stack_get(thread);
+}
 #endif
 
 #ifdef __x86_64__
 int
 pt_x86_64_cconv_function_argv_get(struct pt_thread *thread, int argc, pt_register_t *argv)
 {
-	uint64_t rsp;
+	pt_address_t rsp;
 	int i;
 
 	pt_error_save(), pt_error_clear();
 
 	switch (argc) {
 	default:
-		rsp = pt_windows_thread_x86_64_get_rsp(thread);
+		rsp = pt_thread_register_sp_get(thread);
+
+		if (rsp == PT_ADDRESS_NULL && pt_error_is_set())
+			return -1;
 
 		/* Skip saved rip and 32-bytes of shadow space. */
 		rsp += 40;
@@ -170,13 +187,14 @@ uint64_t pt_x86_64_cconv_function_retval_get(struct pt_thread *thread)
 
 uint64_t pt_x86_64_cconv_function_retaddr_get(struct pt_thread *thread)
 {
-	uint64_t rsp, retaddr;
+	pt_address_t rsp;
+	uint64_t retaddr;
 
 	pt_error_save(), pt_error_clear();
 
-	rsp = pt_windows_thread_x86_64_get_rsp(thread);
+	rsp = pt_thread_register_sp_get(thread);
 
-	if (rsp == -1 && pt_error_is_set())
+	if (rsp == PT_ADDRESS_NULL && pt_error_is_set())
 		return -1;
 
 	pt_error_restore();
@@ -187,6 +205,11 @@ uint64_t pt_x86_64_cconv_function_retaddr_get(struct pt_thread *thread)
 	return retaddr;
 }
 
+uint64_t pt_x86_64_cconv_function_stack_get(struct pt_thread *thread)
+{
+	return pt_thread_register_sp_get(thread);
+}
+
 pt_register_t pt_cconv_function_retaddr_get(struct pt_thread *thread)
 {
 	assert(thread != NULL);
@@ -209,6 +232,17 @@ pt_register_t pt_cconv_function_retval_get(struct pt_thread *thread)
 		return pt_x86_32_cconv_function_retval_get(thread);
 }
 
+pt_register_t pt_cconv_function_stack_get(struct pt_thread *thread)
+{
+	assert(thread != NULL);
+	assert(thread->process != NULL);
+
+	if (pt_windows_process_wow64_get(thread->process) == 0)
+		return pt_x86_64_cconv_function_stack_get(thread);
+	else
+		return pt_x86_32_cconv_function_stack_get(thread);
+}
+
 int pt_cconv_function_argv_get(struct pt_thread *thread, int argc, pt_register_t *argv)
 {
 	assert(thread != NULL);
@@ -52,10 +52,13 @@ extern "C" {
 
 uint32_t      pt_x86_32_cconv_function_retaddr_get(struct pt_thread *thread);
 uint64_t      pt_x86_64_cconv_function_retaddr_get(struct pt_thread *thread);
+uint32_t      pt_x86_32_cconv_function_stack_get(struct pt_thread *thread);
+uint64_t      pt_x86_64_cconv_function_stack_get(struct pt_thread *thread);
 
 int           pt_cconv_function_argv_get(struct pt_thread *, int, pt_register_t *);
 pt_register_t pt_cconv_function_retaddr_get(struct pt_thread *thread);
 pt_register_t pt_cconv_function_retval_get(struct pt_thread *thread);
+pt_register_t pt_cconv_function_stack_get(struct pt_thread *thread);
 
 #ifdef __cplusplus
 };
@@ -40,11 +40,16 @@
  * Author: Ronald Huizer <rhuizer@hexpedition.com>, <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_EVENT
+
 #include <assert.h>
+#include <string.h>
 #include <windows.h>
 #include <ntstatus.h>
 #include <libptrace/pe.h>
 #include <libptrace/log.h>
+#include <libptrace/recorder.h>
+#include <libptrace/util.h>
 #include <libptrace/windows/error.h>
 #include "core.h"
 #include "module.h"
@@ -62,6 +67,8 @@
 #include "../compat.h"
 #include "../factory.h"
 #include "../message.h"
+#include "../recorder.h"
+#include "../stats.h"
 #include "../handle.h"
 
 /* XXX: FACTOR OUT */
@@ -90,7 +97,11 @@ struct pt_core_operations pt_windows_core_operations = {
 	.detach		= pt_windows_core_process_detach,
 	.exec		= pt_windows_core_exec,
 	.execv		= pt_windows_core_execv,
-	.event_wait	= pt_windows_core_event_wait
+	.event_wait	= pt_windows_core_event_wait,
+	.event_pending	= pt_windows_core_event_pending,
+	.event_dispatch_pending	= pt_windows_core_event_dispatch_pending,
+	.event_notify_start	= pt_windows_core_event_notify_start,
+	.event_notify_stop	= pt_windows_core_event_notify_stop
 };
 
 static int
@@ -113,6 +124,11 @@ int pt_windows_core_init(struct pt_core *core)
 	}
 	core_data->debug_object_handle         = INVALID_HANDLE_VALUE;
 	core_data->msg_queue_post_event_handle = INVALID_HANDLE_VALUE;
+	core_data->notify_thread               = NULL;
+	core_data->notify_stop_event           = NULL;
+	core_data->notify_arm_event            = NULL;
+	core_data->notify_handler              = NULL;
+	core_data->notify_cookie               = NULL;
 
 	/* Allocate an event handle. */
 	event_handle = CreateEvent(NULL, FALSE, FALSE, NULL);
@@ -150,11 +166,17 @@ err:
 
 int pt_windows_core_destroy(struct pt_core *core)
 {
+	struct pt_windows_core_data *core_data;
 	HANDLE h;
 
 	assert(core != NULL);
 	assert(core->private_data != NULL);
 
+	/* Stop the event notification thread before closing its handles. */
+	core_data = core->private_data;
+	if (core_data->notify_thread != NULL)
+		pt_windows_core_event_notify_stop(core);
+
 	/* Close the debug object handle. */
 	h = pt_windows_core_debug_object_handle_get(core);
 	if (HANDLE_VALID(h) && CloseHandle(h) == 0) {
@@ -191,13 +213,169 @@ struct pt_core *pt_windows_core_new(void)
 	return core;
 }
 
+/* Classify a debug event as one of the PT_RECORD_* types, or 0. */
+static int event_type_(PDBGUI_WAIT_STATE_CHANGE event)
+{
+	switch (event->NewState) {
+	case DbgCreateThreadStateChange:
+		return PT_RECORD_THREAD_CREATE;
+	case DbgCreateProcessStateChange:
+		return PT_RECORD_PROCESS_CREATE;
+	case DbgExitThreadStateChange:
+		return PT_RECORD_THREAD_EXIT;
+	case DbgExitProcessStateChange:
+		return PT_RECORD_PROCESS_EXIT;
+	case DbgExceptionStateChange:
+	case DbgBreakpointStateChange:
+	case DbgSingleStepStateChange:
+		switch (event->StateInfo.Exception.ExceptionRecord.ExceptionCode) {
+		case STATUS_WX86_BREAKPOINT:
+		case EXCEPTION_BREAKPOINT:
+			return PT_RECORD_BREAKPOINT;
+		case STATUS_WX86_SINGLE_STEP:
+		case EXCEPTION_SINGLE_STEP:
+			return PT_RECORD_SINGLE_STEP;
+		default:
+			return PT_RECORD_EXCEPTION;
+		}
+	case DbgLoadDllStateChange:
+		return PT_RECORD_MODULE_LOAD;
+	case DbgUnloadDllStateChange:
+		return PT_RECORD_MODULE_UNLOAD;
+	default:
+		return 0;
+	}
+}
+
+/* Append a debug event to the event log of the core. */
+static void
+record_event_(struct pt_core *core, PDBGUI_WAIT_STATE_CHANGE event, int type)
+{
+	LPEXCEPTION_RECORD exception;
+	struct pt_record record;
+
+	if (type == 0)
+		return;
+
+	memset(&record, 0, sizeof record);
+	record.timestamp = pt_util_time_ns();
+	record.pid       = DBGUI_PID(event);
+	record.tid       = DBGUI_TID(event);
+	record.type      = type;
+
+	switch (event->NewState) {
+	case DbgCreateThreadStateChange:
+		record.pc   = (uintptr_t)event->StateInfo.CreateThread.NewThread.StartAddress;
+		break;
+	case DbgCreateProcessStateChange:
+		record.pc   = (uintptr_t)event->StateInfo.CreateProcessInfo.NewProcess.InitialThread.StartAddress;
+		record.info = (uintptr_t)event->StateInfo.CreateProcessInfo.NewProcess.BaseOfImage;
+		break;
+	case DbgExitThreadStateChange:
+		record.info = (uint32_t)event->StateInfo.ExitThread.ExitStatus;
+		break;
+	case DbgExitProcessStateChange:
+		record.info = (uint32_t)event->StateInfo.ExitProcess.ExitStatus;
+		break;
+	case DbgExceptionStateChange:
+	case DbgBreakpointStateChange:
+	case DbgSingleStepStateChange:
+		exception = &event->StateInfo.Exception.ExceptionRecord;
+
+		record.code   = exception->ExceptionCode;
+		record.pc     = (uintptr_t)exception->ExceptionAddress;
+		record.chance = !event->StateInfo.Exception.FirstChance;
+
+		if (exception->ExceptionCode == EXCEPTION_ACCESS_VIOLATION)
+			record.info = exception->ExceptionInformation[1];
+		break;
+	case DbgLoadDllStateChange:
+		record.pc   = (uintptr_t)event->StateInfo.LoadDll.BaseOfDll;
+		break;
+	case DbgUnloadDllStateChange:
+		record.pc   = (uintptr_t)event->StateInfo.UnloadDll.BaseAddress;
+		break;
+	default:
+		break;
+	}
+
+	pt_recorder_append(core->recorder, &record);
+}
+
+/* Exception classes that can be passed on to the debuggee without any
+ * bookkeeping when nobody subscribed to them.
+ */
+#define EVENT_CLASS_PASSTHROUGH_					\
+	(PT_EVENT_CLASS_SEGFAULT | PT_EVENT_CLASS_ILLEGAL_INSTRUCTION |	\
+	 PT_EVENT_CLASS_DIVIDE_BY_ZERO | PT_EVENT_CLASS_PRIV_INSTRUCTION |	\
+	 PT_EVENT_CLASS_UNKNOWN_EXCEPTION | PT_EVENT_CLASS_DEBUG_STRING)
+
+/* Classify an exception as a PT_EVENT_CLASS_*, or 0 for exceptions
+ * that are never passed to a handler.
+ */
+static uint32_t exception_class_(DWORD code)
+{
+	switch (code) {
+	case STATUS_WX86_BREAKPOINT:
+	case EXCEPTION_BREAKPOINT:
+		return PT_EVENT_CLASS_BREAKPOINT;
+	case STATUS_WX86_SINGLE_STEP:
+	case EXCEPTION_SINGLE_STEP:
+		return PT_EVENT_CLASS_SINGLE_STEP;
+	case EXCEPTION_ACCESS_VIOLATION:
+		return PT_EVENT_CLASS_SEGFAULT;
+	case EXCEPTION_ILLEGAL_INSTRUCTION:
+	case 0xC000001E:	/* STATUS_INVALID_LOCK_SEQUENCE */
+		return PT_EVENT_CLASS_ILLEGAL_INSTRUCTION;
+	case EXCEPTION_FLT_DIVIDE_BY_ZERO:
+	case EXCEPTION_INT_DIVIDE_BY_ZERO:
+		return PT_EVENT_CLASS_DIVIDE_BY_ZERO;
+	case EXCEPTION_PRIV_INSTRUCTION:
+		return PT_EVENT_CLASS_PRIV_INSTRUCTION;
+	case DBG_PRINTEXCEPTION_C:
+		return PT_EVENT_CLASS_DEBUG_STRING;
+	case EXCEPTION_INVALID_HANDLE:
+	case 0x406d1388:	/* SetThreadName() */
+		return 0;
+	default:
+		return PT_EVENT_CLASS_UNKNOWN_EXCEPTION;
+	}
+}
+
+/* Windows stops the debuggee for every debug event, so the best we can
+ * do for unsubscribed events is to continue them straight away.  This
+ * only applies to first chance exceptions: the other events update the
+ * thread and module state, and second chance exceptions are subject to
+ * exception_filter_().
+ */
+static int
+event_subscribed_(struct pt_core *core, struct pt_process *process,
+                  PDBGUI_WAIT_STATE_CHANGE event)
+{
+	uint32_t class;
+
+	if (event->NewState != DbgExceptionStateChange ||
+	    event->StateInfo.Exception.FirstChance == 0)
+		return 1;
+
+	if (core->quit != 0 || process->state != PT_PROCESS_STATE_ATTACHED)
+		return 1;
+
+	class = exception_class_(event->StateInfo.Exception.ExceptionRecord.ExceptionCode);
+	if (class & ~EVENT_CLASS_PASSTHROUGH_)
+		return 1;
+
+	return (pt_process_event_mask_get(process) & class) != 0;
+}
+
 static int
 pt_windows_core_event_handle_debug_(struct pt_core *core, HANDLE h)
 {
 	LARGE_INTEGER delay = { .QuadPart = 0 };
 	DBGUI_WAIT_STATE_CHANGE event;
 	struct pt_process *process;
-	int status;
+	uint64_t received, now;
+	int status, type;
 
 	/* Get a debug event without blocking. */
 	pt_log("%s(): waiting for debug event\n", __FUNCTION__);
@@ -205,6 +383,8 @@ pt_windows_core_event_handle_debug_(struct pt_core *core, HANDLE h)
 	if (pt_windows_api_nt_wait_for_debug_event(h, TRUE, &delay, &event) == -1)
 		return -1;
 
+	received = pt_stats_clock(core);
+
 	pt_log("%s(): received an event: %d\n", __FUNCTION__, event.NewState);
 
 	/* We've drained all events. */
@@ -214,6 +394,11 @@ pt_windows_core_event_handle_debug_(struct pt_core *core, HANDLE h)
 	/* This should not be exposed to us.  Make sure on debug builds. */
 	assert(event.NewState != DbgReplyPending);
 
+	type = event_type_(&event);
+
+	if ((core->options & PT_CORE_OPTION_EVENT_RECORD) && core->recorder != NULL)
+		record_event_(core, &event, type);
+
 	/* Find the pt_process by PID. */
 	process = pt_core_process_find(core, DBGUI_PID(&event));
 	if (process == NULL) {
@@ -221,8 +406,37 @@ pt_windows_core_event_handle_debug_(struct pt_core *core, HANDLE h)
 		return -1;
 	}
 
-	/* Handle the event for this process. */
-	pt_core_event_handle(process, &event, &status);
+	/* Register contexts may be cached until we continue the event. */
+	process->flags |= PT_PROCESS_FLAG_STOPPED;
+
+	/* Time spent running the debuggee since we last continued it. */
+	if (received != 0 && process->stats_continued != 0 &&
+	    received > process->stats_continued)
+		pt_stats_record(core, process, PT_STATS_WAIT, type,
+		                received - process->stats_continued);
+
+	if (event_subscribed_(core, process, &event)) {
+		/* Handle the event for this process. */
+		core->stats_handler_ns = 0;
+		pt_core_event_handle(process, &event, &status);
+
+		if (received != 0) {
+			now = pt_util_time_ns();
+			pt_stats_record(core, process, PT_STATS_DISPATCH, type,
+			                now - received);
+			pt_stats_record(core, process, PT_STATS_HANDLER, type,
+			                core->stats_handler_ns);
+		}
+	} else {
+		pt_log("%s(): passing on unsubscribed exception %#08x\n",
+		       __FUNCTION__,
+		       event.StateInfo.Exception.ExceptionRecord.ExceptionCode);
+		status = DBG_EXCEPTION_NOT_HANDLED;
+	}
+
+	/* Write back register contexts modified while handling the event. */
+	pt_process_registers_flush(process);
+	process->flags &= ~PT_PROCESS_FLAG_STOPPED;
 
 	/* If we're quitting, mark the process to be detached. */
 	if (core->quit == 1)
@@ -234,8 +448,17 @@ pt_windows_core_event_handle_debug_(struct pt_core *core, HANDLE h)
 	pt_log("%s(): process state: %d\n", __FUNCTION__, process->state);
 
 	/* XXX: error handling. */
+	now = pt_stats_clock(core);
 	pt_windows_api_nt_debug_continue(h, &event.AppClientId, status);
 
+	if (now != 0) {
+		process->stats_continued = pt_util_time_ns();
+		pt_stats_record(core, process, PT_STATS_CONTINUE, type,
+		                process->stats_continued - now);
+	} else {
+		process->stats_continued = 0;
+	}
+
 	/* See if we can detach.  On success, the process is gone,
 	 * so we break the loop.
 	 */
@@ -340,6 +563,157 @@ int pt_windows_core_event_wait(struct pt_core *core)
 	return 0;
 }
 
+int pt_windows_core_event_pending(struct pt_core *core)
+{
+	HANDLE debug_object;
+
+	/* The debug object is signaled while state changes are queued. */
+	debug_object = pt_windows_core_debug_object_handle_get(core);
+	switch (WaitForSingleObject(debug_object, 0)) {
+	case WAIT_OBJECT_0:
+		return 1;
+	case WAIT_TIMEOUT:
+		return 0;
+	}
+
+	pt_windows_error_winapi_set();
+	return -1;
+}
+
+int pt_windows_core_event_dispatch_pending(struct pt_core *core, int max)
+{
+	struct pt_windows_core_data *core_data = core->private_data;
+	HANDLE debug_object = core_data->debug_object_handle;
+	int count = 0;
+	DWORD ret;
+
+	/* The notification thread may have consumed the auto-reset message
+	 * queue event, so we always drain the queue.
+	 */
+	pt_windows_core_event_handle_queue_(core);
+
+	while (max == 0 || count < max) {
+		ret = WaitForSingleObject(debug_object, 0);
+		if (ret == WAIT_TIMEOUT)
+			break;
+
+		if (ret != WAIT_OBJECT_0) {
+			pt_windows_error_winapi_set();
+			count = -1;
+			break;
+		}
+
+		pt_windows_core_event_handle_debug_(core, debug_object);
+		count++;
+	}
+
+	/* Let the notification thread wait for new events. */
+	if (core_data->notify_thread != NULL)
+		SetEvent(core_data->notify_arm_event);
+
+	return count;
+}
+
+static DWORD WINAPI pt_windows_core_notify_thread_(LPVOID arg)
+{
+	struct pt_windows_core_data *core_data = arg;
+	HANDLE events[3], arm[2];
+
+	events[0] = core_data->notify_stop_event;
+	events[1] = core_data->debug_object_handle;
+	events[2] = core_data->msg_queue_post_event_handle;
+
+	arm[0] = core_data->notify_stop_event;
+	arm[1] = core_data->notify_arm_event;
+
+	for (;;) {
+		switch (WaitForMultipleObjects(3, events, FALSE, INFINITE)) {
+		case WAIT_OBJECT_0 + 1:
+		case WAIT_OBJECT_0 + 2:
+			break;
+		default:
+			return 0;
+		}
+
+		core_data->notify_handler(core_data->notify_cookie);
+
+		/* The debug object stays signaled until its events have been
+		 * handled, so wait for a dispatch before looking again.
+		 */
+		if (WaitForMultipleObjects(2, arm, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+			return 0;
+	}
+}
+
+int pt_windows_core_event_notify_start(struct pt_core *core,
+                                       void (*handler)(void *), void *cookie)
+{
+	struct pt_windows_core_data *core_data = core->private_data;
+
+	if (core_data->notify_thread != NULL) {
+		pt_error_internal_set(PT_ERROR_EXISTS);
+		return -1;
+	}
+
+	core_data->notify_handler = handler;
+	core_data->notify_cookie  = cookie;
+
+	core_data->notify_stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (core_data->notify_stop_event == NULL) {
+		pt_windows_error_winapi_set();
+		goto err;
+	}
+
+	core_data->notify_arm_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (core_data->notify_arm_event == NULL) {
+		pt_windows_error_winapi_set();
+		goto err_stop;
+	}
+
+	core_data->notify_thread = CreateThread(
+		NULL, 0, pt_windows_core_notify_thread_, core_data, 0, NULL);
+	if (core_data->notify_thread == NULL) {
+		pt_windows_error_winapi_set();
+		goto err_arm;
+	}
+
+	return 0;
+
+err_arm:
+	CloseHandle(core_data->notify_arm_event);
+	core_data->notify_arm_event = NULL;
+err_stop:
+	CloseHandle(core_data->notify_stop_event);
+	core_data->notify_stop_event = NULL;
+err:
+	return -1;
+}
+
+int pt_windows_core_event_notify_stop(struct pt_core *core)
+{
+	struct pt_windows_core_data *core_data = core->private_data;
+
+	if (core_data->notify_thread == NULL) {
+		pt_error_internal_set(PT_ERROR_NOT_FOUND);
+		return -1;
+	}
+
+	SetEvent(core_data->notify_stop_event);
+	WaitForSingleObject(core_data->notify_thread, INFINITE);
+
+	CloseHandle(core_data->notify_thread);
+	CloseHandle(core_data->notify_arm_event);
+	CloseHandle(core_data->notify_stop_event);
+
+	core_data->notify_thread     = NULL;
+	core_data->notify_arm_event  = NULL;
+	core_data->notify_stop_event = NULL;
+	core_data->notify_handler    = NULL;
+	core_data->notify_cookie     = NULL;
+
+	return 0;
+}
+
 struct pt_process *pt_windows_core_execv(
 	struct pt_core *core,
 	const utf8_t *pathname,
@@ -559,12 +933,12 @@ int pt_windows_core_process_kill_on_exit_set(struct pt_core *core, int value)
 static int
 process_handlers_init_(struct pt_process *process, struct pt_event_handlers *handlers)
 {
-	struct pt_event_handler *module_unload = NULL;
-	struct pt_event_handler *thread_create = NULL;
-	struct pt_event_handler *process_exit = NULL;
-	struct pt_event_handler *thread_exit = NULL;
-	struct pt_event_handler *module_load = NULL;
-	struct pt_event_handler *attached = NULL;
+	uint32_t module_unload = 0;
+	uint32_t thread_create = 0;
+	uint32_t process_exit = 0;
+	uint32_t thread_exit = 0;
+	uint32_t module_load = 0;
+	uint32_t attached = 0;
 
 	if (handlers->attached.handler != NULL) {
 		attached = pt_event_handler_stack_push(
@@ -572,7 +946,7 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 			(pt_event_handler_t)handlers->attached.handler,
 			handlers->attached.cookie
 		);
-	        if (attached == NULL)
+	        if (attached == 0)
 			goto err;
 	}
 
@@ -582,7 +956,7 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 			(pt_event_handler_t)handlers->process_exit.handler,
 			handlers->process_exit.cookie
 		);
-		if (process_exit == NULL)
+		if (process_exit == 0)
 			goto err_attached;
 	}
 
@@ -592,7 +966,7 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 			(pt_event_handler_t)handlers->thread_create.handler,
 			handlers->thread_create.cookie
 		);
-		if (thread_create == NULL)
+		if (thread_create == 0)
 			goto err_process_exit;
 	}
 
@@ -602,7 +976,7 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 			(pt_event_handler_t)handlers->thread_exit.handler,
 			handlers->thread_exit.cookie
 		);
-		if (thread_exit == NULL)
+		if (thread_exit == 0)
 			goto err_thread_create;
 	}
 
@@ -612,7 +986,7 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 			(pt_event_handler_t)handlers->module_load.handler,
 			handlers->module_load.cookie
 		);
-		if (module_load == NULL)
+		if (module_load == 0)
 			goto err_thread_exit;
 	}
 
@@ -622,7 +996,7 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 			(pt_event_handler_t)handlers->module_unload.handler,
 			handlers->module_unload.cookie
 		);
-		if (module_unload == NULL)
+		if (module_unload == 0)
 			goto err_module_load;
 	}
 
@@ -639,20 +1013,20 @@ process_handlers_init_(struct pt_process *process, struct pt_event_handlers *han
 	return 0;
 
 err_module_load:
-	if (module_load != NULL)
-		pt_event_handler_destroy(module_load);
+	if (module_load != 0)
+		pt_event_handler_stack_remove(&process->handlers.module_load, module_load);
 err_thread_exit:
-	if (thread_exit != NULL)
-		pt_event_handler_destroy(thread_exit);
+	if (thread_exit != 0)
+		pt_event_handler_stack_remove(&process->handlers.thread_exit, thread_exit);
 err_thread_create:
-	if (thread_create != NULL)
-		pt_event_handler_destroy(thread_create);
+	if (thread_create != 0)
+		pt_event_handler_stack_remove(&process->handlers.thread_create, thread_create);
 err_process_exit:
-	if (process_exit != NULL)
-		pt_event_handler_destroy(process_exit);
+	if (process_exit != 0)
+		pt_event_handler_stack_remove(&process->handlers.process_exit, process_exit);
 err_attached:
-	if (attached != NULL)
-		pt_event_handler_destroy(attached);
+	if (attached != 0)
+		pt_event_handler_stack_remove(&process->handlers.attached, attached);
 err:
 	return -1;
 }
@@ -982,8 +1356,9 @@ static void handle_create_thread_(
 	ev.error  = 0;
 	ev.thread = thread;
 out:
-	pt_event_handler_stack_call(&process->handlers.thread_create,
-	                            (struct pt_event *)&ev);
+	PT_STATS_HANDLER_CALL(process->core,
+		pt_event_handler_stack_call(&process->handlers.thread_create,
+		                            (struct pt_event *)&ev));
 }
 
 static void handle_exit_process_(
@@ -997,8 +1372,9 @@ static void handle_exit_process_(
 	/* Invoke callback handlers. */
 	ev.process  = process;
 	ev.exitcode = event->StateInfo.ExitProcess.ExitStatus;
-	pt_event_handler_stack_call(&process->handlers.process_exit,
-	                            (struct pt_event *)&ev);
+	PT_STATS_HANDLER_CALL(process->core,
+		pt_event_handler_stack_call(&process->handlers.process_exit,
+		                            (struct pt_event *)&ev));
 }
 
 static void handle_exit_thread_(
@@ -1021,8 +1397,9 @@ static void handle_exit_thread_(
 		ev.exitcode = event->StateInfo.ExitThread.ExitStatus;
 	}
 
-	pt_event_handler_stack_call(&process->handlers.thread_exit,
-	                            (struct pt_event *)&ev);
+	PT_STATS_HANDLER_CALL(process->core,
+		pt_event_handler_stack_call(&process->handlers.thread_exit,
+		                            (struct pt_event *)&ev));
 
 	if (thread != NULL)
 		pt_thread_delete(thread);
@@ -1080,10 +1457,11 @@ static void handle_load_dll_(
 	/* Invoke the callback handlers. */
 	ev.module = module;
 out:
-	pt_event_handler_stack_call(
-		&process->handlers.module_load,
-		(struct pt_event *)&ev
-	);
+	PT_STATS_HANDLER_CALL(process->core,
+		pt_event_handler_stack_call(
+			&process->handlers.module_load,
+			(struct pt_event *)&ev
+		));
 }
 
 static struct pt_module *
@@ -1118,10 +1496,11 @@ static void handle_unload_dll_(
 		       module->pathname);
 	}
 
-	pt_event_handler_stack_call(
-		&process->handlers.module_unload,
-		(struct pt_event *)&ev
-	);
+	PT_STATS_HANDLER_CALL(process->core,
+		pt_event_handler_stack_call(
+			&process->handlers.module_unload,
+			(struct pt_event *)&ev
+		));
 
 	if (module != NULL)
 		pt_module_delete(module);
@@ -1328,10 +1707,11 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 			ev.process = process;
 
 			/* Call the event handlers for the attached event. */
-			pt_event_handler_stack_call(
-				&process->handlers.attached,
-				(struct pt_event *)&ev
-			);
+			PT_STATS_HANDLER_CALL(process->core,
+				pt_event_handler_stack_call(
+					&process->handlers.attached,
+					(struct pt_event *)&ev
+				));
 		} else {
 			/* Invoke the bottom handler. */
 			ev.address = (pt_address_t)exception->ExceptionAddress;
@@ -1347,7 +1727,8 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 					process->remote_break_count--;
 
 					if (process->handlers.remote_break != NULL)
-						status = process->handlers.remote_break(&ev);
+						PT_STATS_HANDLER_CALL(process->core,
+							status = process->handlers.remote_break(&ev));
 					else
 						status = PT_EVENT_FORWARD;
 					break;
@@ -1379,7 +1760,8 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 			ev.thread        = thread;
 			ev.chance        = !first_chance;
 
-			status = process->handlers.segfault(&ev);
+			PT_STATS_HANDLER_CALL(process->core,
+				status = process->handlers.segfault(&ev));
 		}
 		break;
 
@@ -1397,7 +1779,8 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 			ev.thread  = thread;
 			ev.chance  = !first_chance;
 
-			status = process->handlers.illegal_instruction(&ev);
+			PT_STATS_HANDLER_CALL(process->core,
+				status = process->handlers.illegal_instruction(&ev));
 		}
 		break;
 
@@ -1410,7 +1793,8 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 			ev.thread  = thread;
 			ev.chance  = !first_chance;
 
-			status = process->handlers.divide_by_zero(&ev);
+			PT_STATS_HANDLER_CALL(process->core,
+				status = process->handlers.divide_by_zero(&ev));
 		}
 		break;
 
@@ -1422,7 +1806,8 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 			ev.thread  = thread;
 			ev.chance  = !first_chance;
 
-			status = process->handlers.priv_instruction(&ev);
+			PT_STATS_HANDLER_CALL(process->core,
+				status = process->handlers.priv_instruction(&ev));
 		}
 		break;
 
@@ -1457,7 +1842,8 @@ handle_exception_(struct pt_process *process, PDBGUI_WAIT_STATE_CHANGE event)
 			ev.thread  = thread;
 			ev.chance  = !first_chance;
 
-			status = process->handlers.unknown_exception(&ev);
+			PT_STATS_HANDLER_CALL(process->core,
+				status = process->handlers.unknown_exception(&ev));
 		}
 		break;
 	}
@@ -1478,6 +1864,7 @@ static int pt_core_event_handle(
 	int *status)
 {
 	struct pt_thread *thread;
+	struct list_head *lh;
 	int ret = 0;
 
         *status = DBG_EXCEPTION_NOT_HANDLED;
@@ -1535,19 +1922,24 @@ static int pt_core_event_handle(
                 break;
 	}
 
+	/* Breakpoints that ran out of their hit budget are released in one
+	 * batch before the debuggee runs again.
+	 */
+	pt_breakpoint_retired_flush(process);
+
 	/* We are close to resuming the debuggee through ContinueDebugEvent()
 	 * At this point, we want to reestablish the list of persistent
 	 * breakpoints.  The way we do this is by single stepping over the
 	 * replaced breakpoint and then patching back the soft break.
 	 */
-	pt_process_for_each_thread (process, thread) {
-		if (thread->breakpoint_restore != NULL) {
-			pt_log("%s(): breakpoint_restore set.  Single stepping\n", __FUNCTION__);
+	list_for_each (lh, &process->threads_restore) {
+		thread = list_entry(lh, struct pt_thread, restore_list);
 
-			if (pt_thread_single_step_internal_set(thread) == -1)
-				pt_log("Failed to set single-step flag: %s\n",
-				       pt_error_strerror());
-		}
+		pt_log("%s(): breakpoint_restore set.  Single stepping\n", __FUNCTION__);
+
+		if (pt_thread_single_step_internal_set(thread) == -1)
+			pt_log("Failed to set single-step flag: %s\n",
+			       pt_error_strerror());
 	}
 
 	return ret;
@@ -1573,9 +1965,15 @@ handle_debug_single_step_(struct pt_process *process,
 		/* Mask out the flag again. */
 		thread->flags &= ~THREAD_FLAG_SINGLE_STEP_INTERNAL;
 
+		/* Other threads removing the breakpoint clear our restore
+		 * pointer under the process lock.
+		 */
+		pt_process_lock(process);
+		bp = thread->breakpoint_restore;
 		if (bp && bp->breakpoint->b_op->restore != NULL)
 			bp->breakpoint->b_op->restore(thread, bp);
-		thread->breakpoint_restore = NULL;
+		pt_thread_breakpoint_restore_set(thread, NULL);
+		pt_process_unlock(process);
 
 		/* Only pass the event to our handler if it was not
 		 * internal, or was both internal and external.
@@ -1590,7 +1988,8 @@ handle_debug_single_step_(struct pt_process *process,
 		ev.address = exception->ExceptionAddress;
 		ev.thread = thread;
 
-		status = process->handlers.single_step(&ev);
+		PT_STATS_HANDLER_CALL(process->core,
+			status = process->handlers.single_step(&ev));
 	}
 
 	/* If we requested the single-step ourselves, we can now remove the
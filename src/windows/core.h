@@ -50,6 +50,13 @@ struct pt_windows_core_data
 {
 	HANDLE		debug_object_handle;
 	HANDLE		msg_queue_post_event_handle;
+
+	/* Event notification thread, see pt_core_event_notify_start(). */
+	HANDLE		notify_thread;
+	HANDLE		notify_stop_event;
+	HANDLE		notify_arm_event;
+	void		(*notify_handler)(void *);
+	void		*notify_cookie;
 };
 
 static inline HANDLE
@@ -92,6 +99,10 @@ int pt_windows_core_init(struct pt_core *core);
 struct pt_core *pt_windows_core_new(void);
 int pt_windows_core_destroy(struct pt_core *core);
 int pt_windows_core_event_wait(struct pt_core *core);
+int pt_windows_core_event_pending(struct pt_core *core);
+int pt_windows_core_event_dispatch_pending(struct pt_core *core, int max);
+int pt_windows_core_event_notify_start(struct pt_core *core, void (*)(void *), void *);
+int pt_windows_core_event_notify_stop(struct pt_core *core);
 struct pt_process *pt_windows_core_process_attach(struct pt_core *, pt_pid_t, struct pt_event_handlers *, int);
 int pt_windows_core_process_detach(struct pt_core *, struct pt_process *);
 struct pt_process *pt_windows_core_exec(struct pt_core *, const utf8_t *, const utf8_t *, struct pt_event_handlers *, int);
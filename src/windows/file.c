@@ -249,6 +249,110 @@ off_t   pt_file_native_tell(struct pt_file *file_)
 	return ret;
 }
 
+/* Map 'filename' into memory.  Read-only mappings cover the whole file
+ * and ignore 'size'.  Writable mappings create the file if needed and
+ * extend it to 'size' bytes.  The file can be shared with other readers
+ * and writers while it is mapped.
+ */
+int pt_file_mapping_open(struct pt_file_mapping *map, const utf8_t *filename,
+                         size_t size, int flags)
+{
+	DWORD desired_access, disposition, protect, map_access;
+	utf16_t *filename_w;
+	LARGE_INTEGER li;
+
+	if (flags & PT_FILE_WRONLY) {
+		desired_access = GENERIC_READ | GENERIC_WRITE;
+		disposition    = OPEN_ALWAYS;
+		protect        = PAGE_READWRITE;
+		map_access     = FILE_MAP_WRITE;
+	} else {
+		desired_access = GENERIC_READ;
+		disposition    = OPEN_EXISTING;
+		protect        = PAGE_READONLY;
+		map_access     = FILE_MAP_READ;
+	}
+
+	if ( (filename_w = pt_utf8_to_utf16(filename)) == NULL)
+		return -1;
+
+	map->file = CreateFileW(
+		filename_w,
+		desired_access,
+		FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL,
+		disposition,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL
+	);
+	free(filename_w);
+
+	if (map->file == INVALID_HANDLE_VALUE) {
+		pt_windows_error_winapi_set();
+		return -1;
+	}
+
+	if ( !(flags & PT_FILE_WRONLY)) {
+		if (GetFileSizeEx(map->file, &li) == 0) {
+			pt_windows_error_winapi_set();
+			goto err_file;
+		}
+		size = li.QuadPart;
+	}
+
+	/* Empty files cannot be mapped. */
+	if (size == 0) {
+		pt_error_internal_set(PT_ERROR_INVALID_ARG);
+		goto err_file;
+	}
+
+	li.QuadPart  = size;
+	map->mapping = CreateFileMappingW(map->file, NULL, protect,
+	                                  li.HighPart, li.LowPart, NULL);
+	if (map->mapping == NULL) {
+		pt_windows_error_winapi_set();
+		goto err_file;
+	}
 
+	if ( (map->base = MapViewOfFile(map->mapping, map_access, 0, 0, size)) == NULL) {
+		pt_windows_error_winapi_set();
+		goto err_mapping;
+	}
 
+	map->size = size;
+	return 0;
+
+err_mapping:
+	CloseHandle(map->mapping);
+err_file:
+	CloseHandle(map->file);
+	return -1;
+}
+
+int pt_file_mapping_sync(struct pt_file_mapping *map)
+{
+	if (FlushViewOfFile(map->base, map->size) == 0) {
+		pt_windows_error_winapi_set();
+		return -1;
+	}
 
+	return 0;
+}
+
+int pt_file_mapping_close(struct pt_file_mapping *map)
+{
+	int ret = 0;
+
+	if (UnmapViewOfFile(map->base) == 0) {
+		pt_windows_error_winapi_set();
+		ret = -1;
+	}
+
+	CloseHandle(map->mapping);
+	CloseHandle(map->file);
+
+	map->base = NULL;
+	map->size = 0;
+
+	return ret;
+}
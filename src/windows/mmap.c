@@ -198,7 +198,7 @@ static int translate_protection_(DWORD protect)
 	return 0;
 }
 
-int pt_mmap_load(struct pt_process *process)
+static int mmap_load_(struct pt_process *process)
 {
 	MEMORY_BASIC_INFORMATION mbi;
 	struct pt_mmap_area *area;
@@ -257,3 +257,20 @@ out_err:
 	pt_mmap_destroy(&process->mmap);
 	return -1;
 }
+
+/** Rebuild the memory map of a process.
+ *
+ * This frees all areas of the previous map.  Callers walking the map
+ * afterwards hold the process lock across both, so that other threads
+ * do not rebuild it underneath them.
+ */
+int pt_mmap_load(struct pt_process *process)
+{
+	int ret;
+
+	pt_process_lock(process);
+	ret = mmap_load_(process);
+	pt_process_unlock(process);
+
+	return ret;
+}
@@ -40,6 +40,8 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_MODULE
+
 #include <assert.h>
 #include <limits.h>
 #include <windows.h>
@@ -40,6 +40,8 @@
  * Author: Ronald Huizer <rhuizer@hexpedition.com>, <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_PROCESS
+
 #include <assert.h>
 #include <windows.h>
 #include <libptrace/log.h>
@@ -160,8 +162,10 @@ void pt_process_detach_bottom_(struct pt_process *process)
 		return;
 
 	/* Remove all breakpoints. */
+	pt_process_lock(process);
 	pt_process_for_each_breakpoint_internal (process, bp)
 		bp->breakpoint->b_op->process_remove(process, bp);
+	pt_process_unlock(process);
 
 	/* Remove all internal single step flags. */
 	pt_process_for_each_thread (process, thread)
@@ -536,6 +540,69 @@ void *pt_windows_process_malloc(struct pt_process *process, size_t len)
 	return ret;
 }
 
+/* Allocate memory within rel32 reach of 'near'.  We walk the regions of
+ * the address space first upwards and then downwards from 'near', and try
+ * to allocate in every free region at the allocation granularity.
+ */
+void *pt_windows_process_malloc_near(struct pt_process *process, size_t len,
+                                     const void *near)
+{
+	HANDLE handle = pt_windows_process_handle_get(process);
+	uintptr_t addr, lo, hi, gran, reach = 0x7FFF0000;
+	MEMORY_BASIC_INFORMATION mbi;
+	SYSTEM_INFO si;
+	void *ret;
+
+	GetSystemInfo(&si);
+	gran = si.dwAllocationGranularity;
+
+	lo = (uintptr_t)si.lpMinimumApplicationAddress;
+	if ((uintptr_t)near > lo + reach)
+		lo = (uintptr_t)near - reach;
+
+	hi = (uintptr_t)si.lpMaximumApplicationAddress;
+	if ((uintptr_t)near < hi - reach)
+		hi = (uintptr_t)near + reach;
+
+	addr = ((uintptr_t)near + gran - 1) & ~(gran - 1);
+	while (addr + len <= hi &&
+	       VirtualQueryEx(handle, (void *)addr, &mbi, sizeof mbi) != 0) {
+		if (mbi.State == MEM_FREE) {
+			ret = VirtualAllocEx(handle, (void *)addr, len,
+			                     MEM_COMMIT | MEM_RESERVE,
+			                     PAGE_EXECUTE_READWRITE);
+			if (ret != NULL)
+				return ret;
+		}
+
+		addr = (uintptr_t)mbi.BaseAddress + mbi.RegionSize;
+		addr = (addr + gran - 1) & ~(gran - 1);
+	}
+
+	addr = ((uintptr_t)near & ~(gran - 1));
+	while (addr >= lo + gran) {
+		addr -= gran;
+
+		if (VirtualQueryEx(handle, (void *)addr, &mbi, sizeof mbi) == 0)
+			break;
+
+		if (mbi.State == MEM_FREE) {
+			ret = VirtualAllocEx(handle, (void *)addr, len,
+			                     MEM_COMMIT | MEM_RESERVE,
+			                     PAGE_EXECUTE_READWRITE);
+			if (ret != NULL)
+				return ret;
+		} else {
+			/* Skip to just below the whole allocation. */
+			addr = (uintptr_t)mbi.AllocationBase;
+		}
+	}
+
+	pt_log("%s(): no free memory near 0x%p\n", __FUNCTION__, near);
+	pt_error_internal_set(PT_ERROR_NOMEMORY);
+	return NULL;
+}
+
 int pt_windows_process_free(struct pt_process *process, const void *p)
 {
 	HANDLE handle = pt_windows_process_handle_get(process);
@@ -99,6 +99,7 @@ ssize_t	pt_windows_process_read(struct pt_process *, void *, const void *, size_
 int	pt_windows_process_write(struct pt_process *, void *, const void *, size_t);
 int	pt_windows_process_thread_create(struct pt_process *, const void *, const void *);
 void *	pt_windows_process_malloc(struct pt_process *, size_t);
+void *	pt_windows_process_malloc_near(struct pt_process *, size_t, const void *);
 int	pt_windows_process_free(struct pt_process *, const void *);
 
 int	pt_windows_process_brk(struct pt_process *process);
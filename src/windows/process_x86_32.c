@@ -42,6 +42,8 @@
  * Author: Ronald Huizer <rhuizer@hexpedition.com>, <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_PROCESS
+
 #include <assert.h>
 #include <stdint.h>
 #include <windows.h>
@@ -41,6 +41,8 @@
  * Author: Ronald Huizer <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_SYMBOL
+
 #include <assert.h>
 #include <windows.h>
 #include <libptrace/log.h>
@@ -87,6 +87,7 @@ void *pt_thread_get_start(struct pt_thread *);
 
 void *pt_windows_thread_register_pc_get(struct pt_thread *);
 int   pt_windows_thread_register_pc_set(struct pt_thread *, void *);
+void *pt_windows_thread_register_sp_get(struct pt_thread *);
 
 #ifdef __cplusplus
 };
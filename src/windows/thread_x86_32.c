@@ -42,6 +42,8 @@
  * Author: Ronald Huizer <rhuizer@hexpedition.com>, <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_THREAD
+
 #include <assert.h>
 #include <windows.h>
 #include <libptrace/log.h>
@@ -119,6 +121,23 @@ int pt_windows_thread_register_pc_set(struct pt_thread *thread, void *pc)
 	return pt_windows_thread_x86_32_set_eip(thread, (uint32_t)pc);
 }
 
+/* Failure is reported as NULL, as pt_thread_register_sp_get() does. */
+void *pt_windows_thread_register_sp_get(struct pt_thread *thread)
+{
+	uint32_t esp;
+
+	pt_error_save(), pt_error_clear();
+
+	esp = pt_windows_thread_x86_32_get_esp(thread);
+
+	if (esp == (uint32_t)-1 && pt_error_is_set())
+		return NULL;
+
+	pt_error_restore();
+
+	return (void *)esp;
+}
+
 int pt_windows_thread_debug_registers_apply(struct pt_thread *thread)
 {
 	struct x86_debug_registers *db = &thread->debug_registers;
@@ -42,7 +42,11 @@
  * Author: Ronald Huizer <rhuizer@hexpedition.com>, <ronald@immunityinc.com>
  *
  */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_THREAD
+
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <windows.h>
 #include <libptrace/log.h>
 //#include <libptrace/thread_x86.h>
@@ -55,6 +59,17 @@
 #include "thread_x86_64.h"
 #include "wrappers/kernel32.h"
 
+/* The context parts held by our register structures.  The floating point
+ * state is left out, so that writing back a context we read does not
+ * clobber it.
+ */
+#define PT_WINDOWS_X86_64_CONTEXT_REGS					\
+	(CONTEXT_CONTROL | CONTEXT_INTEGER | CONTEXT_SEGMENTS |		\
+	 CONTEXT_DEBUG_REGISTERS)
+#define PT_WINDOWS_WOW64_CONTEXT_REGS					\
+	(WOW64_CONTEXT_CONTROL | WOW64_CONTEXT_INTEGER |		\
+	 WOW64_CONTEXT_SEGMENTS | WOW64_CONTEXT_DEBUG_REGISTERS)
+
 struct pt_thread_x86_32_operations pt_windows_thread_x86_32_operations = {
 	.get_eax	= pt_windows_thread_x86_32_get_eax,
 	.get_ebx	= pt_windows_thread_x86_32_get_ebx,
@@ -186,6 +201,23 @@ int pt_windows_thread_register_pc_set(struct pt_thread *thread, void *pc)
 	return pt_windows_thread_x86_64_set_rip(thread, (uint64_t)pc);
 }
 
+/* Failure is reported as NULL, as pt_thread_register_sp_get() does. */
+void *pt_windows_thread_register_sp_get(struct pt_thread *thread)
+{
+	uint64_t rsp;
+
+	pt_error_save(), pt_error_clear();
+
+	rsp = pt_windows_thread_x86_64_get_rsp(thread);
+
+	if (rsp == (uint64_t)-1 && pt_error_is_set())
+		return NULL;
+
+	pt_error_restore();
+
+	return (void *)rsp;
+}
+
 int pt_windows_thread_single_step_set(struct pt_thread *thread)
 {
 	uint64_t rflags;
@@ -280,15 +312,19 @@ pt_windows_thread_registers_get(struct pt_thread *thread)
 	struct pt_registers_x86_64 *regs;
 	CONTEXT ctx;
 
-	/* Get the registers from the given thread. */
-	ctx.ContextFlags = CONTEXT_FULL | CONTEXT_DEBUG_REGISTERS;
+	/* Get the registers from the given thread.  On AMD64 CONTEXT_FULL
+	 * includes the floating point state, which we do not represent, so
+	 * we leave it out to make this round trip with registers_set().
+	 */
+	memset(&ctx, 0, sizeof ctx);
+	ctx.ContextFlags = PT_WINDOWS_X86_64_CONTEXT_REGS;
 	if (GetThreadContext(h, &ctx) == 0) {
 		pt_windows_error_winapi_set();
 		return NULL;
 	}
 
 	/* Allocate a pt_registers structure for this. */
-	if ( (regs = malloc(sizeof(*regs))) == NULL) {
+	if ( (regs = calloc(1, sizeof(*regs))) == NULL) {
 		pt_error_errno_set(errno);
 		return NULL;
 	}
@@ -299,6 +335,14 @@ pt_windows_thread_registers_get(struct pt_thread *thread)
 	regs->rbx = ctx.Rbx;
 	regs->rcx = ctx.Rcx;
 	regs->rdx = ctx.Rdx;
+	regs->r8  = ctx.R8;
+	regs->r9  = ctx.R9;
+	regs->r10 = ctx.R10;
+	regs->r11 = ctx.R11;
+	regs->r12 = ctx.R12;
+	regs->r13 = ctx.R13;
+	regs->r14 = ctx.R14;
+	regs->r15 = ctx.R15;
 	regs->rsi = ctx.Rsi;
 	regs->rdi = ctx.Rdi;
 	regs->rsp = ctx.Rsp;
@@ -337,11 +381,20 @@ pt_windows_thread_registers_set(struct pt_thread *thread, struct pt_registers *r
 	 * but we keep the API and structure views consistent over all
 	 * platforms, including remote debugging ones.
 	 */
-	ctx.ContextFlags = CONTEXT_FULL | CONTEXT_DEBUG_REGISTERS;
+	memset(&ctx, 0, sizeof ctx);
+	ctx.ContextFlags = PT_WINDOWS_X86_64_CONTEXT_REGS;
 	ctx.Rax = regs->rax;
 	ctx.Rbx = regs->rbx;
 	ctx.Rcx = regs->rcx;
 	ctx.Rdx = regs->rdx;
+	ctx.R8  = regs->r8;
+	ctx.R9  = regs->r9;
+	ctx.R10 = regs->r10;
+	ctx.R11 = regs->r11;
+	ctx.R12 = regs->r12;
+	ctx.R13 = regs->r13;
+	ctx.R14 = regs->r14;
+	ctx.R15 = regs->r15;
 	ctx.Rsi = regs->rsi;
 	ctx.Rdi = regs->rdi;
 	ctx.Rsp = regs->rsp;
@@ -645,6 +698,22 @@ int pt_windows_wow64_thread_register_pc_set(struct pt_thread *thread, void *pc)
 	                                        (uint32_t)(uintptr_t)pc);
 }
 
+void *pt_windows_wow64_thread_register_sp_get(struct pt_thread *thread)
+{
+	uint32_t esp;
+
+	pt_error_save(), pt_error_clear();
+
+	esp = pt_windows_thread_x86_32_get_esp(thread);
+
+	if (esp == (uint32_t)-1 && pt_error_is_set())
+		return NULL;
+
+	pt_error_restore();
+
+	return (void *)(uintptr_t)esp;
+}
+
 int pt_windows_wow64_thread_init(struct pt_thread *thread)
 {
 	struct pt_windows_thread_data *thread_data;
@@ -699,12 +768,13 @@ pt_windows_wow64_thread_registers_get(struct pt_thread *thread)
 	WOW64_CONTEXT ctx;
 
 	/* Get the registers from the given thread. */
-	ctx.ContextFlags = CONTEXT_FULL | CONTEXT_DEBUG_REGISTERS;
+	memset(&ctx, 0, sizeof ctx);
+	ctx.ContextFlags = PT_WINDOWS_WOW64_CONTEXT_REGS;
 	if (pt_windows_api_wow64_get_thread_context(h, &ctx) == -1)
 		return NULL;
 
 	/* Allocate a pt_registers structure for this. */
-	if ( (regs = malloc(sizeof(*regs))) == NULL) {
+	if ( (regs = calloc(1, sizeof(*regs))) == NULL) {
 		pt_error_errno_set(errno);
 		return NULL;
 	}
@@ -753,7 +823,8 @@ pt_windows_wow64_thread_registers_set(struct pt_thread *thread, struct pt_regist
 	 * but we keep the API and structure views consistent over all
 	 * platforms, including remote debugging ones.
 	 */
-	ctx.ContextFlags = CONTEXT_FULL | CONTEXT_DEBUG_REGISTERS;
+	memset(&ctx, 0, sizeof ctx);
+	ctx.ContextFlags = PT_WINDOWS_WOW64_CONTEXT_REGS;
 	ctx.Eax = regs->eax;
 	ctx.Ebx = regs->ebx;
 	ctx.Ecx = regs->ecx;
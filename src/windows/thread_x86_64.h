@@ -128,6 +128,10 @@ int pt_windows_wow64_thread_suspend(struct pt_thread *thread);
 int pt_windows_wow64_thread_single_step_set(struct pt_thread *);
 int pt_windows_wow64_thread_single_step_remove(struct pt_thread *);
 
+void *pt_windows_wow64_thread_register_pc_get(struct pt_thread *);
+int   pt_windows_wow64_thread_register_pc_set(struct pt_thread *, void *);
+void *pt_windows_wow64_thread_register_sp_get(struct pt_thread *);
+
 #ifdef __cplusplus
 };
 #endif
@@ -48,3 +48,30 @@ pt_tid_t pt_util_tid_get(void)
 {
 	return (pt_tid_t)GetCurrentThreadId();
 }
+
+/* Monotonic time in nanoseconds, for measuring intervals. */
+uint64_t pt_util_time_ns(void)
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	/* The frequency is fixed at boot, so a racy init is harmless. */
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&counter);
+
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+	       (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL /
+	       frequency.QuadPart;
+}
+
+/* Number of processors available, for sizing worker pools. */
+unsigned int pt_util_cpu_count(void)
+{
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+
+	return si.dwNumberOfProcessors != 0 ? si.dwNumberOfProcessors : 1;
+}
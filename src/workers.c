@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * workers.c
+ *
+ * Parallel execution of independent jobs.
+ *
+ * Jobs are numbered, and handed out to the workers through a shared
+ * counter, so that workers that finish early pick up more work.  The
+ * calling thread is one of the workers, and the run returns once every
+ * job is done.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define PT_LOG_CATEGORY	PT_LOG_CATEGORY_CORE
+
+#include <pthread.h>
+#include <libptrace/log.h>
+#include <libptrace/util.h>
+#include "workers.h"
+
+struct pt_workers_run_
+{
+	pt_workers_job_t	job;
+	void			*cookie;
+	size_t			jobs;
+	size_t			next;
+};
+
+static void workers_loop_(struct pt_workers_run_ *run)
+{
+	size_t job;
+
+	while ( (job = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED)) < run->jobs)
+		run->job(job, run->cookie);
+}
+
+static void *workers_thread_(void *arg)
+{
+	workers_loop_(arg);
+	return NULL;
+}
+
+/** Run jobs 0 to 'jobs' - 1 in parallel.
+ *
+ * If no threads can be created, all jobs run on the calling thread.
+ */
+void pt_workers_run(size_t jobs, pt_workers_job_t job, void *cookie)
+{
+	pthread_t threads[PT_WORKERS_MAX - 1];
+	struct pt_workers_run_ run;
+	size_t i, count, created;
+
+	run.job    = job;
+	run.cookie = cookie;
+	run.jobs   = jobs;
+	run.next   = 0;
+
+	count = pt_util_cpu_count();
+	if (count > jobs)
+		count = jobs;
+	if (count > PT_WORKERS_MAX)
+		count = PT_WORKERS_MAX;
+
+	for (created = 0; created + 1 < count; created++) {
+		if (pthread_create(&threads[created], NULL, workers_thread_, &run) != 0) {
+			pt_log("%s(): cannot create worker thread\n", __FUNCTION__);
+			break;
+		}
+	}
+
+	workers_loop_(&run);
+
+	for (i = 0; i < created; i++)
+		pthread_join(threads[i], NULL);
+}
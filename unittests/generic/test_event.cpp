@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_event.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstdlib>
+#include <string>
+#include <boost/test/included/unit_test.hpp>
+#include "../../src/event.h"
+
+using namespace std;
+
+static struct pt_event_handler_stack stack;
+static string calls;
+static uint32_t ids[16];
+
+static int handler_a(struct pt_event *ev)
+{
+	calls += 'a';
+	return PT_EVENT_FORWARD;
+}
+
+static int handler_b(struct pt_event *ev)
+{
+	calls += 'b';
+	return PT_EVENT_FORWARD;
+}
+
+static int handler_drop(struct pt_event *ev)
+{
+	calls += 'd';
+	return PT_EVENT_DROP;
+}
+
+/* Removes itself, and pushes a new handler. */
+static int handler_self(struct pt_event *ev)
+{
+	calls += 's';
+	BOOST_REQUIRE(pt_event_handler_stack_remove(&stack, ids[0]) == 0);
+	BOOST_REQUIRE(pt_event_handler_stack_push(&stack, handler_a, NULL) != 0);
+	return PT_EVENT_FORWARD;
+}
+
+BOOST_AUTO_TEST_CASE(event_stack_order)
+{
+	struct pt_event ev;
+
+	pt_event_handler_stack_init(&stack);
+	BOOST_REQUIRE(pt_event_handler_stack_empty(&stack));
+
+	ids[0] = pt_event_handler_stack_push(&stack, handler_a, NULL);
+	ids[1] = pt_event_handler_stack_push(&stack, handler_b, NULL);
+	BOOST_REQUIRE(ids[0] != 0 && ids[1] != 0 && ids[0] != ids[1]);
+
+	/* The most recently pushed handler is called first. */
+	calls.clear();
+	pt_event_handler_stack_call(&stack, &ev);
+	BOOST_REQUIRE(calls == "ba");
+
+	ids[2] = pt_event_handler_stack_push(&stack, handler_drop, NULL);
+	calls.clear();
+	BOOST_REQUIRE(pt_event_handler_stack_call(&stack, &ev) == PT_EVENT_DROP);
+	BOOST_REQUIRE(calls == "d");
+
+	BOOST_REQUIRE(pt_event_handler_stack_remove(&stack, ids[2]) == 0);
+	BOOST_REQUIRE(pt_event_handler_stack_remove(&stack, ids[2]) == -1);
+	calls.clear();
+	pt_event_handler_stack_call(&stack, &ev);
+	BOOST_REQUIRE(calls == "ba");
+
+	pt_event_handler_stack_destroy(&stack);
+	BOOST_REQUIRE(pt_event_handler_stack_empty(&stack));
+}
+
+BOOST_AUTO_TEST_CASE(event_stack_dispatch)
+{
+	struct pt_event ev;
+
+	pt_event_handler_stack_init(&stack);
+
+	ids[1] = pt_event_handler_stack_push(&stack, handler_b, NULL);
+	ids[0] = pt_event_handler_stack_push(&stack, handler_self, NULL);
+
+	/* The handler pushed during dispatch is not called. */
+	calls.clear();
+	pt_event_handler_stack_call(&stack, &ev);
+	BOOST_REQUIRE(calls == "sb");
+	BOOST_REQUIRE(stack.count == 2);
+	BOOST_REQUIRE(stack.tombstones == 0);
+
+	calls.clear();
+	pt_event_handler_stack_call(&stack, &ev);
+	BOOST_REQUIRE(calls == "ab");
+
+	pt_event_handler_stack_destroy(&stack);
+}
+
+BOOST_AUTO_TEST_CASE(event_stack_grow)
+{
+	struct pt_event ev;
+	string expected;
+
+	pt_event_handler_stack_init(&stack);
+
+	for (int i = 0; i < 16; i++) {
+		ids[i] = pt_event_handler_stack_push(&stack,
+			i % 2 ? handler_b : handler_a, NULL);
+		BOOST_REQUIRE(ids[i] != 0);
+		expected.insert(expected.begin(), i % 2 ? 'b' : 'a');
+	}
+
+	BOOST_REQUIRE(stack.heap != NULL);
+	calls.clear();
+	pt_event_handler_stack_call(&stack, &ev);
+	BOOST_REQUIRE(calls == expected);
+
+	for (int i = 0; i < 16; i++)
+		BOOST_REQUIRE(pt_event_handler_stack_remove(&stack, ids[i]) == 0);
+	BOOST_REQUIRE(pt_event_handler_stack_empty(&stack));
+
+	pt_event_handler_stack_destroy(&stack);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_insn_x86.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstdlib>
+#include <cstddef>
+#include <boost/test/included/unit_test.hpp>
+#include "../../src/insn_x86.h"
+
+using namespace std;
+
+#define DECODE(insn, bytes, mode) \
+	x86_insn_decode(&(insn), (const uint8_t *)(bytes), sizeof(bytes) - 1, mode)
+
+BOOST_AUTO_TEST_CASE(insn_x86_simple)
+{
+	struct x86_insn insn;
+
+	BOOST_REQUIRE(DECODE(insn, "\x55", X86_INSN_MODE_64) == 1);
+	BOOST_REQUIRE(insn.flags == X86_INSN_FLAG_NONE);
+
+	/* mov rbp, rsp */
+	BOOST_REQUIRE(DECODE(insn, "\x48\x89\xe5", X86_INSN_MODE_64) == 3);
+	BOOST_REQUIRE(insn.flags == X86_INSN_FLAG_MODRM);
+	BOOST_REQUIRE(insn.opcode_offset == 1);
+
+	/* movabs rax, imm64 */
+	BOOST_REQUIRE(DECODE(insn, "\x48\xb8\x88\x77\x66\x55\x44\x33\x22\x11",
+	                     X86_INSN_MODE_64) == 10);
+	BOOST_REQUIRE(insn.imm_offset == 2);
+	BOOST_REQUIRE(insn.imm_size == 8);
+}
+
+BOOST_AUTO_TEST_CASE(insn_x86_rip_relative)
+{
+	struct x86_insn insn;
+
+	/* mov eax, [rip + 0x11223344] */
+	BOOST_REQUIRE(DECODE(insn, "\x8b\x05\x44\x33\x22\x11", X86_INSN_MODE_64) == 6);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_RIP_RELATIVE);
+	BOOST_REQUIRE(insn.disp_offset == 2);
+	BOOST_REQUIRE(insn.disp_size == 4);
+
+	/* mov dword [rip + 0x10], 1: the displacement is followed by imm32. */
+	BOOST_REQUIRE(DECODE(insn, "\xc7\x05\x10\x00\x00\x00\x01\x00\x00\x00",
+	                     X86_INSN_MODE_64) == 10);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_RIP_RELATIVE);
+	BOOST_REQUIRE(insn.imm_offset == 6);
+
+	/* The same encoding is an absolute address in 32-bit mode. */
+	BOOST_REQUIRE(DECODE(insn, "\x8b\x05\x44\x33\x22\x11", X86_INSN_MODE_32) == 6);
+	BOOST_REQUIRE(!(insn.flags & X86_INSN_FLAG_RIP_RELATIVE));
+}
+
+BOOST_AUTO_TEST_CASE(insn_x86_branches)
+{
+	struct x86_insn insn;
+
+	BOOST_REQUIRE(DECODE(insn, "\xe8\x00\x00\x00\x00", X86_INSN_MODE_64) == 5);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_CALL);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_BRANCH_RELATIVE);
+
+	BOOST_REQUIRE(DECODE(insn, "\x0f\x84\x00\x01\x00\x00", X86_INSN_MODE_64) == 6);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_BRANCH_RELATIVE);
+
+	/* call qword [rax] */
+	BOOST_REQUIRE(DECODE(insn, "\xff\x10", X86_INSN_MODE_64) == 2);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_CALL);
+	BOOST_REQUIRE(!(insn.flags & X86_INSN_FLAG_BRANCH_RELATIVE));
+
+	BOOST_REQUIRE(DECODE(insn, "\xcc", X86_INSN_MODE_64) == 1);
+	BOOST_REQUIRE(insn.flags & X86_INSN_FLAG_TRAP);
+}
+
+BOOST_AUTO_TEST_CASE(insn_x86_truncated)
+{
+	struct x86_insn insn;
+
+	BOOST_REQUIRE(DECODE(insn, "\x8b\x05\x44\x33", X86_INSN_MODE_64) == -1);
+	BOOST_REQUIRE(DECODE(insn, "\x66\x66", X86_INSN_MODE_64) == -1);
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_log.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/log.h>
+#include "../../src/log.h"
+
+using namespace std;
+
+static int evaluated;
+
+static int evaluate(void)
+{
+	return ++evaluated;
+}
+
+static void hook(void *cookie, const char *format, va_list ap)
+{
+	vector<string> *lines = (vector<string> *)cookie;
+	char buf[256];
+
+	vsnprintf(buf, sizeof buf, format, ap);
+	lines->push_back(buf);
+}
+
+static void drain(void *cookie, const struct pt_log_record *record)
+{
+	vector<string> *lines = (vector<string> *)cookie;
+	char buf[256];
+
+	BOOST_REQUIRE(pt_log_record_format(record, buf, sizeof buf) >= 0);
+	lines->push_back(buf);
+}
+
+BOOST_AUTO_TEST_CASE(log_disabled)
+{
+	evaluated = 0;
+	pt_log("%d\n", evaluate());
+	BOOST_REQUIRE(evaluated == 0);
+	BOOST_REQUIRE(!pt_log_active());
+}
+
+BOOST_AUTO_TEST_CASE(log_binary)
+{
+	vector<string> lines;
+
+	BOOST_REQUIRE(pt_log_binary_enable(16) == 0);
+
+	pt_log("%s(): %d %lx %llu %p %%\n", "test", -3, 0xabcL,
+	       1234567890123ULL, (void *)0x10);
+	pt_log("%ls %.2f %zu %*d", L"wide", 3.14159, (size_t)9, 4, 42);
+
+	BOOST_REQUIRE(pt_log_binary_drain(drain, &lines) == 2);
+	BOOST_REQUIRE(lines[0] == "test(): -3 abc 1234567890123 0x10 %\n");
+	BOOST_REQUIRE(lines[1] == "wide 3.14 9   42");
+
+	pt_log_binary_disable();
+}
+
+BOOST_AUTO_TEST_CASE(log_levels)
+{
+	vector<string> lines;
+
+	BOOST_REQUIRE(pt_log_binary_enable(16) == 0);
+	pt_log_level_set(PT_LOG_CATEGORY_MASK_ALL, PT_LOG_LEVEL_INFO);
+
+	evaluated = 0;
+	pt_log("%d", evaluate());
+	pt_log_info("%d", evaluate());
+	pt_log_at(PT_LOG_CATEGORY_MODULE, PT_LOG_LEVEL_ERROR, "%s", "error");
+
+	BOOST_REQUIRE(evaluated == 1);
+	BOOST_REQUIRE(pt_log_binary_drain(drain, &lines) == 2);
+	BOOST_REQUIRE(lines[0] == "1");
+	BOOST_REQUIRE(lines[1] == "error");
+
+	pt_log_mask_set(PT_LOG_MASK_ALL);
+	pt_log_binary_disable();
+	BOOST_REQUIRE(!pt_log_active());
+}
+
+BOOST_AUTO_TEST_CASE(log_binary_full)
+{
+	vector<string> lines;
+	uint64_t dropped = pt_log_binary_dropped();
+
+	BOOST_REQUIRE(pt_log_binary_enable(16) == 0);
+
+	for (int i = 0; i < 20; i++)
+		pt_log("%d", i);
+
+	BOOST_REQUIRE(pt_log_binary_drain(drain, &lines) == 16);
+	BOOST_REQUIRE(pt_log_binary_dropped() - dropped == 4);
+	BOOST_REQUIRE(lines[15] == "15");
+
+	pt_log_binary_disable();
+}
+
+BOOST_AUTO_TEST_CASE(log_hooks_held)
+{
+	vector<string> lines;
+	struct pt_log_hook log_hook;
+
+	log_hook.handler = hook;
+	log_hook.cookie  = &lines;
+	pt_log_hook_register(&log_hook);
+
+	/* Messages are queued while a lock is held, and passed on in order
+	 * once the outermost lock is released.
+	 */
+	pt_log_hooks_hold();
+	pt_log("%d %s", 1, "one");
+	pt_log_hooks_hold();
+	pt_log("%d", 2);
+	pt_log_hooks_release();
+	BOOST_REQUIRE(lines.empty());
+	pt_log_hooks_release();
+
+	BOOST_REQUIRE(lines.size() == 2);
+	BOOST_REQUIRE(lines[0] == "1 one");
+	BOOST_REQUIRE(lines[1] == "2");
+
+	pt_log("%d", 3);
+	BOOST_REQUIRE(lines.size() == 3);
+	BOOST_REQUIRE(lines[2] == "3");
+
+	BOOST_REQUIRE(pt_log_hook_unregister(&log_hook) == 0);
+}
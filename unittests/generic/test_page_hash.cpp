@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_page_hash.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/page_hash.h>
+
+using namespace std;
+
+#define PAGE	4096
+
+typedef vector<pair<pt_address_t, size_t> > runs_t;
+
+static int diff_handler(pt_address_t start, size_t pages, void *cookie)
+{
+	static_cast<runs_t *>(cookie)->push_back(make_pair(start, pages));
+	return 0;
+}
+
+BOOST_AUTO_TEST_CASE(page_hash_content)
+{
+	static uint8_t buf[PAGE + 1];
+	uint64_t hash;
+
+	srand(1);
+	for (size_t i = 0; i < PAGE; i++)
+		buf[i] = rand();
+
+	hash = pt_page_hash(buf);
+	BOOST_REQUIRE(hash != PT_PAGE_HASH_NONE);
+	BOOST_REQUIRE(pt_page_hash(buf) == hash);
+
+	/* The hash does not depend on the alignment of the page. */
+	memmove(buf + 1, buf, PAGE);
+	BOOST_REQUIRE(pt_page_hash(buf + 1) == hash);
+	memmove(buf, buf + 1, PAGE);
+
+	/* Every single bit flip changes the hash. */
+	for (size_t i = 0; i < PAGE * 8; i += 7) {
+		buf[i / 8] ^= 1 << (i % 8);
+		BOOST_REQUIRE(pt_page_hash(buf) != hash);
+		buf[i / 8] ^= 1 << (i % 8);
+	}
+
+	/* So does swapping two stripes of the page. */
+	uint8_t tmp[64];
+	memcpy(tmp, buf, 64);
+	memcpy(buf, buf + 64, 64);
+	memcpy(buf + 64, tmp, 64);
+	BOOST_REQUIRE(pt_page_hash(buf) != hash);
+}
+
+BOOST_AUTO_TEST_CASE(page_hashes_diff)
+{
+	uint64_t old_hashes[] = { 1, 2, 3, 4, 5, 6, PT_PAGE_HASH_NONE };
+	uint64_t new_hashes[] = { 1, 9, 9, 4, 5, 7, PT_PAGE_HASH_NONE, 8 };
+	struct pt_page_range old_ranges[] = {
+		{ 0x10000, 4, 0 }, { 0x20000, 3, 4 }
+	};
+	struct pt_page_range new_ranges[] = {
+		{ 0x10000, 4, 0 }, { 0x20000, 0, 4 },
+		{ 0x20000, 3, 4 }, { 0x30000, 1, 7 }
+	};
+	struct pt_page_hashes old_set = { old_ranges, 2, old_hashes, 7 };
+	struct pt_page_hashes new_set = { new_ranges, 4, new_hashes, 8 };
+	runs_t runs;
+
+	BOOST_REQUIRE(pt_page_hashes_diff(&old_set, &new_set, diff_handler, &runs) == 4);
+	BOOST_REQUIRE(runs.size() == 3);
+	BOOST_REQUIRE(runs[0] == make_pair((pt_address_t)0x11000, (size_t)2));
+	BOOST_REQUIRE(runs[1] == make_pair((pt_address_t)0x21000, (size_t)1));
+	BOOST_REQUIRE(runs[2] == make_pair((pt_address_t)0x30000, (size_t)1));
+
+	/* Adjacent changed pages in different ranges form a single run. */
+	struct pt_page_range split_ranges[] = {
+		{ 0x10000, 2, 0 }, { 0x12000, 2, 2 }, { 0x20000, 3, 4 }
+	};
+	struct pt_page_hashes split_set = { split_ranges, 3, old_hashes, 7 };
+	uint64_t changed[] = { 1, 9, 9, 4, 5, 6, PT_PAGE_HASH_NONE };
+	struct pt_page_hashes changed_set = { split_ranges, 3, changed, 7 };
+
+	runs.clear();
+	BOOST_REQUIRE(pt_page_hashes_diff(&split_set, &changed_set, diff_handler, &runs) == 2);
+	BOOST_REQUIRE(runs.size() == 1);
+	BOOST_REQUIRE(runs[0] == make_pair((pt_address_t)0x11000, (size_t)2));
+
+	runs.clear();
+	BOOST_REQUIRE(pt_page_hashes_diff(&old_set, &old_set, diff_handler, &runs) == 0);
+	BOOST_REQUIRE(runs.empty());
+	BOOST_REQUIRE(pt_page_hashes_diff(&old_set, NULL, diff_handler, &runs) == -1);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_scan.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstdlib>
+#include <cstring>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/scan.h>
+
+using namespace std;
+
+/* Reference implementation to check pt_memscan() against. */
+static ssize_t memscan_naive(const uint8_t *buf, size_t len,
+                             const uint8_t *pattern, const uint8_t *mask,
+                             size_t size, size_t start)
+{
+	for (size_t i = start; i + size <= len; i++) {
+		size_t j;
+
+		for (j = 0; j < size; j++) {
+			uint8_t m = mask != NULL ? mask[j] : 0xff;
+			if ((buf[i + j] ^ pattern[j]) & m)
+				break;
+		}
+
+		if (j == size)
+			return i;
+	}
+
+	return -1;
+}
+
+BOOST_AUTO_TEST_CASE(memscan_exact)
+{
+	uint8_t buf[256];
+	const uint8_t pattern[] = { 0xde, 0xad, 0xbe, 0xef };
+
+	memset(buf, 0xde, sizeof buf);
+	BOOST_REQUIRE(pt_memscan(buf, sizeof buf, pattern, NULL, 4, 0) == -1);
+
+	/* Place matches around the 16 and 32 byte vector boundaries. */
+	memcpy(buf + 30, pattern, 4);
+	memcpy(buf + 252, pattern, 4);
+
+	BOOST_REQUIRE(pt_memscan(buf, sizeof buf, pattern, NULL, 4, 0) == 30);
+	BOOST_REQUIRE(pt_memscan(buf, sizeof buf, pattern, NULL, 4, 30) == 30);
+	BOOST_REQUIRE(pt_memscan(buf, sizeof buf, pattern, NULL, 4, 31) == 252);
+	BOOST_REQUIRE(pt_memscan(buf, 255, pattern, NULL, 4, 31) == -1);
+	BOOST_REQUIRE(pt_memscan(buf, sizeof buf, pattern, NULL, 0, 0) == -1);
+}
+
+BOOST_AUTO_TEST_CASE(memscan_random)
+{
+	uint8_t buf[300], pattern[6], mask[6];
+
+	srand(1);
+
+	for (int i = 0; i < 20000; i++) {
+		size_t len   = rand() % sizeof buf;
+		size_t size  = 1 + rand() % sizeof pattern;
+		size_t start = rand() % (len + 2);
+		bool masked  = rand() % 2;
+
+		for (size_t j = 0; j < len; j++)
+			buf[j] = rand() % 4;
+
+		for (size_t j = 0; j < size; j++) {
+			pattern[j] = rand() % 4;
+			mask[j]    = rand() % 3 == 0 ? 0x00 : 0xff;
+		}
+
+		BOOST_REQUIRE(pt_memscan(buf, len, pattern, masked ? mask : NULL,
+		                         size, start) ==
+		              memscan_naive(buf, len, pattern, masked ? mask : NULL,
+		                            size, start));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(scan_pattern_parse)
+{
+	const uint8_t pattern_ok[] = { 0x48, 0x8b, 0x00, 0x05, 0x40, 0x0a, 0x00 };
+	const uint8_t mask_ok[]    = { 0xff, 0xff, 0x00, 0xff, 0xf0, 0x0f, 0x00 };
+	uint8_t pattern[16], mask[16];
+
+	BOOST_REQUIRE(pt_scan_pattern_parse("48 8B ?? 05 4? ?a ?",
+	                                    pattern, mask, sizeof pattern) == 7);
+	BOOST_REQUIRE(memcmp(pattern, pattern_ok, sizeof pattern_ok) == 0);
+	BOOST_REQUIRE(memcmp(mask, mask_ok, sizeof mask_ok) == 0);
+
+	BOOST_REQUIRE(pt_scan_pattern_parse("", pattern, mask, 16) == -1);
+	BOOST_REQUIRE(pt_scan_pattern_parse("4", pattern, mask, 16) == -1);
+	BOOST_REQUIRE(pt_scan_pattern_parse("zz", pattern, mask, 16) == -1);
+	BOOST_REQUIRE(pt_scan_pattern_parse("01 02 03", pattern, mask, 2) == -1);
+}
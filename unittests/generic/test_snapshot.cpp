@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_snapshot.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/snapshot.h>
+#include "../../src/breakpoint.h"
+#include "../../src/breakpoint_sw.h"
+#include "../../src/process.h"
+
+using namespace std;
+
+#define PAGE	4096
+#define PAGES	8
+#define BASE	0x10000
+
+typedef vector<pair<pt_address_t, size_t> > runs_t;
+
+static int diff_handler(pt_address_t start, size_t pages, void *cookie)
+{
+	static_cast<runs_t *>(cookie)->push_back(make_pair(start, pages));
+	return 0;
+}
+
+static int stop_handler(pt_address_t start, size_t pages, void *cookie)
+{
+	static_cast<runs_t *>(cookie)->push_back(make_pair(start, pages));
+	return 1;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_pages_diff)
+{
+	static uint8_t saved[PAGES * PAGE], current[PAGES * PAGE];
+	uint8_t saved_present[PAGES], current_present[PAGES];
+	size_t total;
+	runs_t runs;
+
+	memset(saved, 0x41, sizeof saved);
+	memset(current, 0x41, sizeof current);
+	memset(saved_present, 1, sizeof saved_present);
+	memset(current_present, 1, sizeof current_present);
+
+	/* Nothing changed, nothing to restore. */
+	BOOST_REQUIRE(pt_snapshot_pages_diff(0x10000, saved, saved_present,
+	              current, current_present, PAGES, diff_handler, &runs) == 0);
+	BOOST_REQUIRE(runs.empty());
+
+	/* Pages 1-2 and 4-6 changed; 3 is identical and splits the runs.
+	 * A single changed byte at the end of a page is enough.
+	 */
+	current[1 * PAGE] = 0;
+	current[2 * PAGE] = 0;
+	current[4 * PAGE + PAGE - 1] = 0;
+	current[5 * PAGE + 17] = 0;
+	current[6 * PAGE] = 0;
+
+	BOOST_REQUIRE(pt_snapshot_pages_diff(0x10000, saved, saved_present,
+	              current, current_present, PAGES, diff_handler, &runs) == 5);
+	BOOST_REQUIRE(runs.size() == 2);
+	BOOST_REQUIRE(runs[0] == make_pair((pt_address_t)0x11000, (size_t)2));
+	BOOST_REQUIRE(runs[1] == make_pair((pt_address_t)0x14000, (size_t)3));
+
+	/* Pages unreadable in either copy are skipped and end the run. */
+	saved_present[1] = 0;
+	current_present[5] = 0;
+
+	runs.clear();
+	total = pt_snapshot_pages_diff(0x10000, saved, saved_present,
+	                               current, current_present, PAGES,
+	                               diff_handler, &runs);
+	BOOST_REQUIRE(total == 3);
+	BOOST_REQUIRE(runs.size() == 3);
+	BOOST_REQUIRE(runs[0] == make_pair((pt_address_t)0x12000, (size_t)1));
+	BOOST_REQUIRE(runs[1] == make_pair((pt_address_t)0x14000, (size_t)1));
+	BOOST_REQUIRE(runs[2] == make_pair((pt_address_t)0x16000, (size_t)1));
+
+	/* The count covers every page handed to the handler. */
+	size_t sum = 0;
+	for (size_t i = 0; i < runs.size(); i++)
+		sum += runs[i].second;
+	BOOST_REQUIRE(sum == total);
+
+	/* A changed last page is reported as well. */
+	current[(PAGES - 1) * PAGE + PAGE - 1] = 0;
+	runs.clear();
+	BOOST_REQUIRE(pt_snapshot_pages_diff(0x10000, saved, saved_present,
+	              current, current_present, PAGES, diff_handler, &runs) == 4);
+	BOOST_REQUIRE(runs.size() == 3);
+	BOOST_REQUIRE(runs[2] == make_pair((pt_address_t)0x16000, (size_t)2));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_pages_diff_stop)
+{
+	static uint8_t saved[PAGES * PAGE], current[PAGES * PAGE];
+	uint8_t present[PAGES];
+	runs_t runs;
+
+	memset(saved, 0, sizeof saved);
+	memset(current, 0, sizeof current);
+	memset(present, 1, sizeof present);
+
+	current[0] = current[PAGE] = 1;
+	current[3 * PAGE] = 1;
+
+	/* A handler stopping the diff gets no further runs, and the count
+	 * only covers the pages reported so far.
+	 */
+	BOOST_REQUIRE(pt_snapshot_pages_diff(0x10000, saved, present,
+	              current, present, PAGES, stop_handler, &runs) == 2);
+	BOOST_REQUIRE(runs.size() == 1);
+	BOOST_REQUIRE(runs[0] == make_pair((pt_address_t)0x10000, (size_t)2));
+}
+
+/* A process whose memory is a local buffer at BASE. */
+static uint8_t memory[PAGES * PAGE];
+
+static ssize_t
+memory_read(struct pt_process *process, void *dst,
+            const pt_address_t src, size_t size)
+{
+	if (src < BASE || src - BASE + size > sizeof memory)
+		return -1;
+
+	memcpy(dst, memory + (src - BASE), size);
+	return size;
+}
+
+static int
+memory_write(struct pt_process *process, pt_address_t dst,
+             const void *src, size_t size)
+{
+	if (dst < BASE || dst - BASE + size > sizeof memory)
+		return -1;
+
+	memcpy(memory + (dst - BASE), src, size);
+	return 0;
+}
+
+static struct pt_process_operations memory_operations;
+
+static void memory_process_init(struct pt_process *process)
+{
+	memory_operations.read  = memory_read;
+	memory_operations.write = memory_write;
+
+	memset(memory, 0x90, sizeof memory);
+	BOOST_REQUIRE(pt_process_init(process) == 0);
+	process->p_op = &memory_operations;
+}
+
+static uint8_t memory_get(struct pt_process *process, pt_address_t address)
+{
+	uint8_t byte;
+
+	BOOST_REQUIRE(pt_process_read(process, &byte, address, 1) == 1);
+	return byte;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_restore_breakpoint_set)
+{
+	struct pt_breakpoint_internal *bpi;
+	struct pt_breakpoint bp, bp_clean;
+	struct pt_snapshot *snapshot;
+	struct pt_process process;
+
+	memory_process_init(&process);
+
+	snapshot = pt_process_snapshot_range(&process, BASE, sizeof memory);
+	BOOST_REQUIRE(snapshot != NULL);
+	BOOST_REQUIRE(pt_snapshot_pages_get(snapshot) == PAGES);
+
+	/* Page 1 is dirtied, and gets a breakpoint on a changed byte. */
+	memory[PAGE + 0x10] = 0x41;
+	memory[PAGE + 0x20] = 0x55;
+	pt_breakpoint_sw_init(&bp);
+	bp.address = BASE + PAGE + 0x20;
+	BOOST_REQUIRE(pt_process_breakpoint_set(&process, &bp) == 0);
+	BOOST_REQUIRE(memory[PAGE + 0x20] == 0xCC);
+
+	/* A breakpoint alone does not make a page differ. */
+	pt_breakpoint_sw_init(&bp_clean);
+	bp_clean.address = BASE + 3 * PAGE;
+	BOOST_REQUIRE(pt_process_breakpoint_set(&process, &bp_clean) == 0);
+
+	BOOST_REQUIRE(pt_process_restore_memory(&process, snapshot) == 1);
+
+	/* The page is restored, but both breakpoints are still armed, and
+	 * the one on page 1 now hides the restored byte.
+	 */
+	BOOST_REQUIRE(memory[PAGE + 0x10] == 0x90);
+	BOOST_REQUIRE(memory[PAGE + 0x20] == 0xCC);
+	BOOST_REQUIRE(memory[3 * PAGE] == 0xCC);
+	BOOST_REQUIRE(memory_get(&process, BASE + PAGE + 0x20) == 0x90);
+
+	bpi = pt_process_breakpoint_find_internal(&process, bp.address);
+	BOOST_REQUIRE(bpi != NULL && bpi->patched);
+	BOOST_REQUIRE(bpi->original == 0x90);
+
+	/* Removing it patches back the restored byte. */
+	BOOST_REQUIRE(pt_process_breakpoint_remove(&process, &bp) == 0);
+	BOOST_REQUIRE(memory[PAGE + 0x20] == 0x90);
+	BOOST_REQUIRE(pt_process_breakpoint_remove(&process, &bp_clean) == 0);
+	BOOST_REQUIRE(memory[3 * PAGE] == 0x90);
+
+	pt_snapshot_delete(snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_restore_breakpoint_suppressed)
+{
+	struct pt_breakpoint_internal *bpi;
+	struct pt_snapshot *snapshot;
+	struct pt_process process;
+	struct pt_breakpoint bp;
+
+	memory_process_init(&process);
+
+	snapshot = pt_process_snapshot_range(&process, BASE, sizeof memory);
+	BOOST_REQUIRE(snapshot != NULL);
+
+	memory[2 * PAGE + 8] = 0x55;
+	pt_breakpoint_sw_init(&bp);
+	bp.address = BASE + 2 * PAGE + 8;
+	BOOST_REQUIRE(pt_process_breakpoint_set(&process, &bp) == 0);
+
+	/* A thread stepping over the breakpoint has its original byte in
+	 * place.  That byte is what the restore has to write.
+	 */
+	bpi = pt_process_breakpoint_find_internal(&process, bp.address);
+	BOOST_REQUIRE(bpi != NULL);
+	memory[2 * PAGE + 8] = bpi->original;
+
+	BOOST_REQUIRE(pt_process_restore_memory(&process, snapshot) == 1);
+	BOOST_REQUIRE(memory[2 * PAGE + 8] == 0x90);
+	BOOST_REQUIRE(bpi->patched && bpi->original == 0x90);
+
+	BOOST_REQUIRE(pt_process_breakpoint_remove(&process, &bp) == 0);
+	pt_snapshot_delete(snapshot);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_restore_breakpoint_removed)
+{
+	struct pt_snapshot *snapshot;
+	struct pt_process process;
+	struct pt_breakpoint bp;
+
+	memory_process_init(&process);
+
+	pt_breakpoint_sw_init(&bp);
+	bp.address = BASE + 2 * PAGE + 8;
+	BOOST_REQUIRE(pt_process_breakpoint_set(&process, &bp) == 0);
+
+	/* The snapshot holds the byte under the breakpoint. */
+	snapshot = pt_process_snapshot_range(&process, BASE, sizeof memory);
+	BOOST_REQUIRE(snapshot != NULL);
+
+	BOOST_REQUIRE(pt_process_breakpoint_remove(&process, &bp) == 0);
+	memory[2 * PAGE] = 0x41;
+
+	/* Restoring the page does not bring the breakpoint opcode back. */
+	BOOST_REQUIRE(pt_process_restore_memory(&process, snapshot) == 1);
+	BOOST_REQUIRE(memory[2 * PAGE] == 0x90);
+	BOOST_REQUIRE(memory[2 * PAGE + 8] == 0x90);
+
+	pt_snapshot_delete(snapshot);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_stats.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstdlib>
+#include <cstring>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/stats.h>
+
+using namespace std;
+
+BOOST_AUTO_TEST_CASE(histogram_bucket_linear)
+{
+	for (int i = 0; i < PT_HISTOGRAM_SUB; i++) {
+		BOOST_REQUIRE(pt_histogram_bucket(i) == i);
+		BOOST_REQUIRE(pt_histogram_bucket_lower(i) == (uint64_t)i);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(histogram_bucket_bounds)
+{
+	/* Every bucket holds its lower bound, and the value just below it
+	 * falls in the previous bucket.
+	 */
+	for (int i = 1; i < PT_HISTOGRAM_BUCKETS; i++) {
+		uint64_t lower = pt_histogram_bucket_lower(i);
+
+		BOOST_REQUIRE(pt_histogram_bucket(lower) == i);
+		BOOST_REQUIRE(pt_histogram_bucket(lower - 1) == i - 1);
+	}
+
+	BOOST_REQUIRE(pt_histogram_bucket(~0ULL) == PT_HISTOGRAM_BUCKETS - 1);
+}
+
+BOOST_AUTO_TEST_CASE(histogram_record)
+{
+	struct pt_histogram h;
+
+	memset(&h, 0, sizeof h);
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 50.0) == 0);
+
+	for (int i = 1; i <= 1000; i++)
+		pt_histogram_record(&h, i * 1000);
+
+	BOOST_REQUIRE(h.count == 1000);
+	BOOST_REQUIRE(h.sum == 500500000);
+	BOOST_REQUIRE(h.min == 1000);
+	BOOST_REQUIRE(h.max == 1000000);
+
+	/* Percentiles are exact to within one bucket, or 25%. */
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 50.0) >= 375000);
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 50.0) <= 501000);
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 99.0) >= 742500);
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 99.0) <= 990000);
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 100.0) == 1000000);
+	BOOST_REQUIRE(pt_histogram_percentile(&h, 0.0) == 1000);
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_struct.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cstring>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/struct.h>
+
+using namespace std;
+
+BOOST_AUTO_TEST_CASE(struct_layout_aligned)
+{
+	struct pt_struct_layout layout;
+
+	/* MSG: HWND, UINT, WPARAM, LPARAM. */
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%p%u%p%p") == 0);
+	BOOST_REQUIRE(layout.field_count == 4);
+	BOOST_REQUIRE(layout.fields[1].offset[0] == 4);
+	BOOST_REQUIRE(layout.fields[2].offset[0] == 8);
+	BOOST_REQUIRE(layout.fields[3].offset[0] == 12);
+	BOOST_REQUIRE(layout.size[0] == 16);
+	BOOST_REQUIRE(layout.fields[1].offset[1] == 8);
+	BOOST_REQUIRE(layout.fields[2].offset[1] == 16);
+	BOOST_REQUIRE(layout.fields[3].offset[1] == 24);
+	BOOST_REQUIRE(layout.size[1] == 32);
+
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%lli %hhu") == 0);
+	BOOST_REQUIRE(layout.fields[1].offset[0] == 8);
+	BOOST_REQUIRE(layout.extent[0] == 9);
+	BOOST_REQUIRE(layout.size[0] == 16);
+
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%hhu%*3c%3hu%p") == 0);
+	BOOST_REQUIRE(layout.fields[1].skip);
+	BOOST_REQUIRE(layout.fields[2].offset[0] == 4);
+	BOOST_REQUIRE(layout.fields[3].offset[0] == 12);
+	BOOST_REQUIRE(layout.fields[3].offset[1] == 16);
+	BOOST_REQUIRE(layout.size[1] == 24);
+}
+
+BOOST_AUTO_TEST_CASE(struct_layout_packed)
+{
+	struct pt_struct_layout layout;
+
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "=%hhu%lli%p") == 0);
+	BOOST_REQUIRE(layout.fields[1].offset[0] == 1);
+	BOOST_REQUIRE(layout.fields[2].offset[0] == 9);
+	BOOST_REQUIRE(layout.extent[0] == 13);
+	BOOST_REQUIRE(layout.extent[1] == 17);
+	BOOST_REQUIRE(layout.size[1] == 17);
+}
+
+BOOST_AUTO_TEST_CASE(struct_layout_invalid)
+{
+	struct pt_struct_layout layout;
+
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%") == -1);
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%x") == -1);
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%0u") == -1);
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "u") == -1);
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%hp") == -1);
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "") == 0);
+	BOOST_REQUIRE(layout.field_count == 0);
+}
+
+BOOST_AUTO_TEST_CASE(struct_decode)
+{
+	const uint8_t buf[] = {
+		0xfe, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+		0x01, 0x00, 0x02, 0x00, 0x03, 0x00, 'a',  'b',
+		0x78, 0x56, 0x34, 0x12, 0x00, 0x00, 0x00, 0x00
+	};
+	struct pt_struct_layout layout;
+	int8_t small;
+	int32_t negative;
+	uint16_t array[3];
+	char bytes[2];
+	void *pointer;
+
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%hhi%i%3hu%2c%p") == 0);
+	BOOST_REQUIRE(pt_struct_decode(&layout, 4, buf, &small, &negative,
+	                               array, bytes, &pointer) == 5);
+	BOOST_REQUIRE(small == -2);
+	BOOST_REQUIRE(negative == -1);
+	BOOST_REQUIRE(array[0] == 1 && array[1] == 2 && array[2] == 3);
+	BOOST_REQUIRE(bytes[0] == 'a' && bytes[1] == 'b');
+	BOOST_REQUIRE(pointer == (void *)0x12345678);
+
+	BOOST_REQUIRE(pt_struct_element_get(&layout, 4, buf, 1, 0) == (uint64_t)-1);
+	BOOST_REQUIRE(pt_struct_element_get(&layout, 4, buf, 2, 2) == 3);
+
+	/* Padding stores nothing. */
+	BOOST_REQUIRE(pt_struct_layout_init(&layout, "%*i%i") == 0);
+	BOOST_REQUIRE(pt_struct_decode(&layout, 8, buf, &negative) == 1);
+	BOOST_REQUIRE(negative == -1);
+}
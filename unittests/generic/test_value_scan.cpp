@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2019, Cyxtera Cybersecurity, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * version 2.1 for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * version 2.1 along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ *
+ * THE CODE AND SCRIPTS POSTED ON THIS WEBSITE ARE PROVIDED ON AN "AS IS" BASIS
+ * AND YOUR USE OF SUCH CODE AND/OR SCRIPTS IS AT YOUR OWN RISK.  CYXTERA
+ * DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, EITHER IN FACT OR BY OPERATION
+ * OF LAW, STATUTORY OR OTHERWISE, INCLUDING, BUT NOT LIMITED TO, ALL
+ * WARRANTIES OF MERCHANTABILITY, TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+ * NON-INFRINGEMENT, ACCURACY, COMPLETENESS, COMPATABILITY OF SOFTWARE OR
+ * EQUIPMENT OR ANY RESULTS TO BE ACHIEVED THEREFROM.  CYXTERA DOES NOT WARRANT
+ * THAT SUCH CODE AND/OR SCRIPTS ARE OR WILL BE ERROR-FREE.  IN NO EVENT SHALL
+ * CYXTERA BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, RELIANCE,
+ * EXEMPLARY, PUNITIVE OR CONSEQUENTIAL DAMAGES, OR ANY LOSS OF GOODWILL, LOSS
+ * OF ANTICIPATED SAVINGS, COST OF PURCHASING REPLACEMENT SERVICES, LOSS OF
+ * PROFITS, REVENUE, DATA OR DATA USE, ARISING IN ANY WAY OUT OF THE USE AND/OR
+ * REDISTRIBUTION OF SUCH CODE AND/OR SCRIPTS, REGARDLESS OF THE LEGAL THEORY
+ * UNDER WHICH SUCH LIABILITY IS ASSERTED AND REGARDLESS OF WHETHER CYXTERA HAS
+ * BEEN ADVISED OF THE POSSIBILITY OF SUCH LIABILITY.
+ *
+ * test_value_scan.cpp
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Author: Ronald Huizer <ronald@immunityinc.com>
+ *
+ */
+#define BOOST_TEST_MODULE windows_native
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <boost/test/included/unit_test.hpp>
+#include <libptrace/value_scan.h>
+#include "../../src/value_scan.h"
+
+using namespace std;
+
+#define PAGE	PT_MMAP_PAGE_SIZE
+
+static const size_t sizes[PT_VALUE_MAX] = { 1, 2, 4, 8, 1, 2, 4, 8, 4, 8 };
+
+static void value_load(int type, const uint8_t *p, union pt_value *v)
+{
+	int8_t i8; int16_t i16; int32_t i32; int64_t i64;
+	float f; double d;
+
+	v->u = 0;
+
+	switch (type) {
+	case PT_VALUE_INT8:  memcpy(&i8, p, 1);  v->i = i8;  break;
+	case PT_VALUE_INT16: memcpy(&i16, p, 2); v->i = i16; break;
+	case PT_VALUE_INT32: memcpy(&i32, p, 4); v->i = i32; break;
+	case PT_VALUE_INT64: memcpy(&i64, p, 8); v->i = i64; break;
+	case PT_VALUE_FLOAT: memcpy(&f, p, 4);   v->f = f;   break;
+	case PT_VALUE_DOUBLE: memcpy(&d, p, 8);  v->f = d;   break;
+	default:
+		memcpy(&v->u, p, sizes[type]);
+		break;
+	}
+}
+
+/* Three way comparison of 'a' against 'b', where 2 means unordered. */
+static int value_compare(int type, double tolerance,
+                         const union pt_value *a, const union pt_value *b)
+{
+	switch (type) {
+	case PT_VALUE_FLOAT:
+	case PT_VALUE_DOUBLE:
+		if (fabs(a->f - b->f) <= tolerance)
+			return 0;
+		if (a->f > b->f)
+			return 1;
+		if (a->f < b->f)
+			return -1;
+		return 2;
+	case PT_VALUE_INT8:
+	case PT_VALUE_INT16:
+	case PT_VALUE_INT32:
+	case PT_VALUE_INT64:
+		return a->i == b->i ? 0 : a->i > b->i ? 1 : -1;
+	default:
+		return a->u == b->u ? 0 : a->u > b->u ? 1 : -1;
+	}
+}
+
+/* Reference implementation to check pt_value_page_match() against. */
+static size_t value_match_naive(int type, size_t align, double tolerance,
+                                int cmp, const union pt_value *value,
+                                const uint8_t *cur, const uint8_t *old,
+                                const uint8_t *mask, uint8_t *bitmap)
+{
+	size_t slots = (PAGE - sizes[type]) / align + 1;
+	size_t slot, count = 0;
+	union pt_value v, ref;
+	int c, match;
+
+	memset(bitmap, 0, (slots + 7) / 8);
+
+	for (slot = 0; slot < slots; slot++) {
+		if (mask != NULL && !(mask[slot / 8] & (1U << (slot % 8))))
+			continue;
+
+		value_load(type, cur + slot * align, &v);
+		if (cmp >= PT_VALUE_CMP_UNCHANGED)
+			value_load(type, old + slot * align, &ref);
+		else
+			ref = *value;
+
+		c = value_compare(type, tolerance, &v, &ref);
+
+		switch (cmp) {
+		case PT_VALUE_CMP_ANY:
+			match = 1;
+			break;
+		case PT_VALUE_CMP_EQUAL:
+		case PT_VALUE_CMP_UNCHANGED:
+			match = c == 0;
+			break;
+		case PT_VALUE_CMP_NOT_EQUAL:
+		case PT_VALUE_CMP_CHANGED:
+			match = c != 0;
+			break;
+		case PT_VALUE_CMP_GREATER:
+		case PT_VALUE_CMP_INCREASED:
+			match = c == 1;
+			break;
+		default:
+			match = c == -1;
+			break;
+		}
+
+		if (match) {
+			bitmap[slot / 8] |= 1U << (slot % 8);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Fill a page with few distinct bytes, so that values repeat often. */
+static void page_fill(uint8_t *page)
+{
+	for (size_t i = 0; i < PAGE; i++)
+		page[i] = rand() % 8 == 0 ? rand() : rand() % 3;
+}
+
+static void value_match_check(struct pt_value_scan *scan, int type,
+                              size_t align, double tolerance)
+{
+	static uint8_t cur[PAGE], old[PAGE];
+	uint8_t bitmap[PT_VALUE_BITMAP_MAX], expect[PT_VALUE_BITMAP_MAX];
+	uint8_t mask[PT_VALUE_BITMAP_MAX];
+	size_t slots = (PAGE - sizes[type]) / align + 1;
+	size_t bytes = (slots + 7) / 8;
+	union pt_value value;
+	size_t count;
+
+	page_fill(cur);
+	memcpy(old, cur, sizeof old);
+	for (size_t i = 0; i < 256; i++)
+		old[rand() % PAGE] = rand();
+
+	for (size_t i = 0; i < bytes; i++)
+		mask[i] = rand();
+
+	for (int cmp = 0; cmp < PT_VALUE_CMP_MAX; cmp++) {
+		for (int masked = 0; masked < 2; masked++) {
+			/* Look for a value that is on the page. */
+			value_load(type, cur + (rand() % slots) * align, &value);
+
+			count = pt_value_page_match(scan, cmp, &value, cur, old,
+			                            masked ? mask : NULL, bitmap);
+			BOOST_REQUIRE(count ==
+			              value_match_naive(type, align, tolerance, cmp,
+			                                &value, cur, old,
+			                                masked ? mask : NULL,
+			                                expect));
+			BOOST_REQUIRE(memcmp(bitmap, expect, bytes) == 0);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(value_page_match)
+{
+	struct pt_value_scan *scan;
+
+	srand(1);
+
+	for (int type = 0; type < PT_VALUE_MAX; type++) {
+		/* Naturally aligned values take the vectorized comparisons,
+		 * others only the scalar ones.
+		 */
+		size_t aligns[] = { sizes[type], 1 };
+
+		for (size_t a = 0; a < 2; a++) {
+			for (int simd = 0; simd < 2; simd++) {
+				scan = pt_value_scan_new(NULL, type, aligns[a], 0);
+				BOOST_REQUIRE(scan != NULL);
+				pt_value_scan_simd_set(scan, simd);
+
+				for (int i = 0; i < 20; i++)
+					value_match_check(scan, type, aligns[a], 0);
+
+				pt_value_scan_tolerance_set(scan, 0.5);
+				for (int i = 0; i < 20; i++)
+					value_match_check(scan, type, aligns[a], 0.5);
+
+				pt_value_scan_delete(scan);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(value_page_match_extremes)
+{
+	static uint8_t cur[PAGE];
+	uint8_t bitmap[PT_VALUE_BITMAP_MAX], expect[PT_VALUE_BITMAP_MAX];
+	struct pt_value_scan *scan;
+	union pt_value value;
+
+	/* Every slot holds the largest value, and equals it. */
+	memset(cur, 0xff, sizeof cur);
+
+	for (int type = PT_VALUE_INT8; type <= PT_VALUE_UINT64; type++) {
+		size_t slots = PAGE / sizes[type];
+
+		value_load(type, cur, &value);
+
+		for (int simd = 0; simd < 2; simd++) {
+			scan = pt_value_scan_new(NULL, type, 0, 0);
+			BOOST_REQUIRE(scan != NULL);
+			pt_value_scan_simd_set(scan, simd);
+
+			BOOST_REQUIRE(pt_value_page_match(scan, PT_VALUE_CMP_EQUAL,
+			              &value, cur, NULL, NULL, bitmap) == slots);
+			BOOST_REQUIRE(value_match_naive(type, sizes[type], 0,
+			              PT_VALUE_CMP_EQUAL, &value, cur, NULL, NULL,
+			              expect) == slots);
+			BOOST_REQUIRE(memcmp(bitmap, expect, (slots + 7) / 8) == 0);
+
+			pt_value_scan_delete(scan);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(value_page_encode)
+{
+	uint8_t bitmap[PT_VALUE_BITMAP_MAX], decoded[PT_VALUE_BITMAP_MAX];
+	struct pt_value_page page;
+	struct pt_value_scan *scan;
+
+	srand(2);
+
+	for (int type = 0; type < PT_VALUE_MAX; type++) {
+		size_t slots = (PAGE - sizes[type]) / sizes[type] + 1;
+		size_t bytes = (slots + 7) / 8;
+
+		scan = pt_value_scan_new(NULL, type, 0, 0);
+		BOOST_REQUIRE(scan != NULL);
+		memset(&page, 0, sizeof page);
+
+		/* From a single candidate to all of them, covering both the
+		 * slot array and the bitmap.
+		 */
+		for (size_t want = 1; want <= slots; want += 1 + want / 4) {
+			size_t count = 0;
+
+			memset(bitmap, 0, sizeof bitmap);
+			while (count < want) {
+				size_t slot = rand() % slots;
+
+				if (!(bitmap[slot / 8] & (1U << (slot % 8)))) {
+					bitmap[slot / 8] |= 1U << (slot % 8);
+					count++;
+				}
+			}
+
+			BOOST_REQUIRE(pt_value_page_encode(scan, &page, bitmap, count) == 0);
+			BOOST_REQUIRE(page.count == count);
+			BOOST_REQUIRE(page.dense == (count * sizeof(uint16_t) >= bytes));
+
+			memset(decoded, 0xaa, sizeof decoded);
+			pt_value_page_decode(scan, &page, decoded);
+			BOOST_REQUIRE(memcmp(decoded, bitmap, bytes) == 0);
+		}
+
+		pt_value_page_free(&page);
+		pt_value_scan_delete(scan);
+	}
+}